@@ -60,6 +60,7 @@
 #include <wiretap/wtap.h>
 
 #include <ui/cmdarg_err.h>
+#include <ui/clopts_common.h>
 #include <wsutil/filesystem.h>
 #include <wsutil/privileges.h>
 #include <cli_main.h>
@@ -97,6 +98,12 @@
 
 static gboolean stop_after_failure = FALSE;
 
+/*
+ * Files are read by this many threads at once; their infos are still
+ * reported in the order in which the files were given.
+ */
+static guint num_threads = 1;
+
 /*
  * table report variables
  */
@@ -153,15 +160,6 @@ static gboolean cap_file_hashes    = TRUE;  /* Calculate file hashes */
 #define HASH_STR_SIZE (65) /* Max hash size * 2 + '\0' */
 #define HASH_BUF_SIZE (1024 * 1024)
 
-
-static gchar file_sha256[HASH_STR_SIZE];
-static gchar file_rmd160[HASH_STR_SIZE];
-static gchar file_sha1[HASH_STR_SIZE];
-
-static guint num_ipv4_addresses;
-static guint num_ipv6_addresses;
-static guint num_decryption_secrets;
-
 /*
  * If we have at least two packets with time stamps, and they're not in
  * order - i.e., the later packet has a time stamp older than the earlier
@@ -214,8 +212,39 @@ typedef struct _capture_info {
   GArray               *interface_packet_counts;  /* array of per_packet interface_id counts; one entry per file IDB */
   guint32               pkt_interface_id_unknown; /* counts if packet interface_id didn't match a known one */
   GArray               *idb_info_strings;         /* array of IDB info strings */
+
+  guint                 num_ipv4_addresses;
+  guint                 num_ipv6_addresses;
+  guint                 num_decryption_secrets;
+
+  gchar                 file_sha256[HASH_STR_SIZE];
+  gchar                 file_rmd160[HASH_STR_SIZE];
+  gchar                 file_sha1[HASH_STR_SIZE];
 } capture_info;
 
+/*
+ * An input file, and what we found out about it.  The file is read,
+ * possibly by a worker thread, and then reported on in the main thread.
+ */
+typedef struct _capinfos_job {
+  capture_info          cf_info;
+  int                   status;    /* 0, 1 if the infos are for a file cut short, 2 if there are none */
+  GString              *messages;  /* errors and warnings for the file, to print with its infos */
+  gboolean              done;      /* TRUE once the file has been read */
+} capinfos_job;
+
+/*
+ * The messages of the file being read by this thread, or NULL to print
+ * them right away.
+ */
+static GPrivate job_messages = G_PRIVATE_INIT(NULL);
+
+/*
+ * The capture_info of the file being read by this thread, for the
+ * wiretap callbacks.
+ */
+static GPrivate job_cf_info = G_PRIVATE_INIT(NULL);
+
 static char *decimal_point;
 
 static void
@@ -738,9 +767,9 @@ print_stats(const gchar *filename, capture_info *cf_info)
     }
   }
   if (cap_file_hashes) {
-    printf     ("SHA256:              %s\n", file_sha256);
-    printf     ("RIPEMD160:           %s\n", file_rmd160);
-    printf     ("SHA1:                %s\n", file_sha1);
+    printf     ("SHA256:              %s\n", cf_info->file_sha256);
+    printf     ("RIPEMD160:           %s\n", cf_info->file_rmd160);
+    printf     ("SHA1:                %s\n", cf_info->file_sha1);
   }
   if (cap_order)          printf     ("Strict time order:   %s\n", order_string(cf_info->order));
 
@@ -793,14 +822,14 @@ print_stats(const gchar *filename, capture_info *cf_info)
     }
 
     if (cap_file_nrb) {
-      if (num_ipv4_addresses != 0)
-        printf   ("Number of resolved IPv4 addresses in file: %u\n", num_ipv4_addresses);
-      if (num_ipv6_addresses != 0)
-        printf   ("Number of resolved IPv6 addresses in file: %u\n", num_ipv6_addresses);
+      if (cf_info->num_ipv4_addresses != 0)
+        printf   ("Number of resolved IPv4 addresses in file: %u\n", cf_info->num_ipv4_addresses);
+      if (cf_info->num_ipv6_addresses != 0)
+        printf   ("Number of resolved IPv6 addresses in file: %u\n", cf_info->num_ipv6_addresses);
     }
     if (cap_file_dsb) {
-      if (num_decryption_secrets != 0)
-        printf   ("Number of decryption secrets in file: %u\n", num_decryption_secrets);
+      if (cf_info->num_decryption_secrets != 0)
+        printf   ("Number of decryption secrets in file: %u\n", cf_info->num_decryption_secrets);
     }
   }
 }
@@ -1018,17 +1047,17 @@ print_stats_table(const gchar *filename, capture_info *cf_info)
   if (cap_file_hashes) {
     putsep();
     putquote();
-    printf("%s", file_sha256);
+    printf("%s", cf_info->file_sha256);
     putquote();
 
     putsep();
     putquote();
-    printf("%s", file_rmd160);
+    printf("%s", cf_info->file_rmd160);
     putquote();
 
     putsep();
     putquote();
-    printf("%s", file_sha1);
+    printf("%s", cf_info->file_sha1);
     putquote();
   }
 
@@ -1139,25 +1168,100 @@ cleanup_capture_info(capture_info *cf_info)
 static void
 count_ipv4_address(const guint addr _U_, const gchar *name _U_)
 {
-  num_ipv4_addresses++;
+  capture_info *cf_info = (capture_info *)g_private_get(&job_cf_info);
+
+  cf_info->num_ipv4_addresses++;
 }
 
 static void
 count_ipv6_address(const void *addrp _U_, const gchar *name _U_)
 {
-  num_ipv6_addresses++;
+  capture_info *cf_info = (capture_info *)g_private_get(&job_cf_info);
+
+  cf_info->num_ipv6_addresses++;
 }
 
 static void
 count_decryption_secret(guint32 secrets_type _U_, const void *secrets _U_, guint size _U_)
 {
+  capture_info *cf_info = (capture_info *)g_private_get(&job_cf_info);
+
   /* XXX - count them based on the secrets type (which is an opaque code,
      not a small integer)? */
-  num_decryption_secrets++;
+  cf_info->num_decryption_secrets++;
+}
+
+/*
+ * Report a problem with the file being read; if it's being read for a
+ * job, the message is printed along with the file's infos.
+ */
+static void
+file_message(const char *msg_format, ...)
+{
+  GString *messages = (GString *)g_private_get(&job_messages);
+  va_list ap;
+
+  va_start(ap, msg_format);
+  if (messages != NULL)
+    g_string_append_vprintf(messages, msg_format, ap);
+  else
+    vfprintf(stderr, msg_format, ap);
+  va_end(ap);
+}
+
+static void
+hash_to_str(const unsigned char *hash, size_t length, char *str) {
+  int i;
+
+  for (i = 0; i < (int) length; i++) {
+    g_snprintf(str+(i*2), 3, "%02x", hash[i]);
+  }
+}
+
+static void
+calculate_hashes(const char *filename, capture_info *cf_info)
+{
+  FILE  *fh;
+  char  *hash_buf;
+  gcry_md_hd_t hd = NULL;
+  size_t hash_bytes;
+
+  g_strlcpy(cf_info->file_sha256, "<unknown>", HASH_STR_SIZE);
+  g_strlcpy(cf_info->file_rmd160, "<unknown>", HASH_STR_SIZE);
+  g_strlcpy(cf_info->file_sha1, "<unknown>", HASH_STR_SIZE);
+
+  if (!cap_file_hashes)
+    return;
+
+  gcry_md_open(&hd, GCRY_MD_SHA256, 0);
+  if (!hd)
+    return;
+  gcry_md_enable(hd, GCRY_MD_RMD160);
+  gcry_md_enable(hd, GCRY_MD_SHA1);
+
+  fh = ws_fopen(filename, "rb");
+  if (fh) {
+    hash_buf = (char *)g_malloc(HASH_BUF_SIZE);
+    while((hash_bytes = fread(hash_buf, 1, HASH_BUF_SIZE, fh)) > 0) {
+      gcry_md_write(hd, hash_buf, hash_bytes);
+    }
+    gcry_md_final(hd);
+    hash_to_str(gcry_md_read(hd, GCRY_MD_SHA256), HASH_SIZE_SHA256, cf_info->file_sha256);
+    hash_to_str(gcry_md_read(hd, GCRY_MD_RMD160), HASH_SIZE_RMD160, cf_info->file_rmd160);
+    hash_to_str(gcry_md_read(hd, GCRY_MD_SHA1), HASH_SIZE_SHA1, cf_info->file_sha1);
+    g_free(hash_buf);
+    fclose(fh);
+  }
+  gcry_md_close(hd);
 }
 
+/*
+ * Read a file and fill in its capture_info.  Unless this fails and
+ * returns 2, the file is left open, for print_cap_file() to look at
+ * its section and interface information.
+ */
 static int
-process_cap_file(const char *filename, gboolean need_separator)
+process_cap_file(const char *filename, capture_info *cf_info)
 {
   int                   status = 0;
   int                   err;
@@ -1171,7 +1275,6 @@ process_cap_file(const char *filename, gboolean need_separator)
   guint32               snaplen_max_inferred =          0;
   wtap_rec              rec;
   Buffer                buf;
-  capture_info          cf_info;
   gboolean              have_times = TRUE;
   nstime_t              start_time;
   int                   start_time_tsprec;
@@ -1184,15 +1287,21 @@ process_cap_file(const char *filename, gboolean need_separator)
   guint                 i;
   wtapng_iface_descriptions_t *idb_info;
 
-  cf_info.wth = wtap_open_offline(filename, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
-  if (!cf_info.wth) {
+  cf_info->filename = filename;
+
+  calculate_hashes(filename, cf_info);
+
+  cf_info->wth = wtap_open_offline(filename, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
+  if (!cf_info->wth) {
     cfile_open_failure_message("capinfos", filename, err, err_info);
     return 2;
   }
 
-  if (need_separator && long_report) {
-    printf("\n");
-  }
+  /* We only look at each packet once, so don't bother copying them */
+  (void)wtap_use_mmap(cf_info->wth);
+
+  /* None of our infos need the packet data, so don't read it at all */
+  wtap_set_skip_packet_data(cf_info->wth, TRUE);
 
   nstime_set_zero(&start_time);
   start_time_tsprec = WTAP_TSPREC_UNKNOWN;
@@ -1201,35 +1310,36 @@ process_cap_file(const char *filename, gboolean need_separator)
   nstime_set_zero(&cur_time);
   nstime_set_zero(&prev_time);
 
-  cf_info.encap_counts = g_new0(int,WTAP_NUM_ENCAP_TYPES);
+  cf_info->encap_counts = g_new0(int,WTAP_NUM_ENCAP_TYPES);
 
-  idb_info = wtap_file_get_idb_info(cf_info.wth);
+  idb_info = wtap_file_get_idb_info(cf_info->wth);
 
   g_assert(idb_info->interface_data != NULL);
 
-  cf_info.num_interfaces = idb_info->interface_data->len;
-  cf_info.interface_packet_counts  = g_array_sized_new(FALSE, TRUE, sizeof(guint32), cf_info.num_interfaces);
-  g_array_set_size(cf_info.interface_packet_counts, cf_info.num_interfaces);
-  cf_info.pkt_interface_id_unknown = 0;
+  cf_info->num_interfaces = idb_info->interface_data->len;
+  cf_info->interface_packet_counts  = g_array_sized_new(FALSE, TRUE, sizeof(guint32), cf_info->num_interfaces);
+  g_array_set_size(cf_info->interface_packet_counts, cf_info->num_interfaces);
+  cf_info->pkt_interface_id_unknown = 0;
 
   g_free(idb_info);
   idb_info = NULL;
 
   /* Register callbacks for new name<->address maps from the file and
      decryption secrets from the file. */
-  wtap_set_cb_new_ipv4(cf_info.wth, count_ipv4_address);
-  wtap_set_cb_new_ipv6(cf_info.wth, count_ipv6_address);
-  wtap_set_cb_new_secrets(cf_info.wth, count_decryption_secret);
+  g_private_set(&job_cf_info, cf_info);
+  wtap_set_cb_new_ipv4(cf_info->wth, count_ipv4_address);
+  wtap_set_cb_new_ipv6(cf_info->wth, count_ipv6_address);
+  wtap_set_cb_new_secrets(cf_info->wth, count_decryption_secret);
 
   /* Zero out the counters for the callbacks. */
-  num_ipv4_addresses = 0;
-  num_ipv6_addresses = 0;
-  num_decryption_secrets = 0;
+  cf_info->num_ipv4_addresses = 0;
+  cf_info->num_ipv6_addresses = 0;
+  cf_info->num_decryption_secrets = 0;
 
   /* Tally up data that we need to parse through the file to find */
   wtap_rec_init(&rec);
   ws_buffer_init(&buf, 1514);
-  while (wtap_read(cf_info.wth, &rec, &buf, &err, &err_info, &data_offset))  {
+  while (wtap_read(cf_info->wth, &rec, &buf, &err, &err_info, &data_offset))  {
     if (rec.presence_flags & WTAP_HAS_TS) {
       prev_time = cur_time;
       cur_time = rec.ts;
@@ -1274,45 +1384,45 @@ process_cap_file(const char *filename, gboolean need_separator)
 
       if ((rec.rec_header.packet_header.pkt_encap > 0) &&
           (rec.rec_header.packet_header.pkt_encap < WTAP_NUM_ENCAP_TYPES)) {
-        cf_info.encap_counts[rec.rec_header.packet_header.pkt_encap] += 1;
+        cf_info->encap_counts[rec.rec_header.packet_header.pkt_encap] += 1;
       } else {
-        fprintf(stderr, "capinfos: Unknown packet encapsulation %d in frame %u of file \"%s\"\n",
+        file_message("capinfos: Unknown packet encapsulation %d in frame %u of file \"%s\"\n",
                 rec.rec_header.packet_header.pkt_encap, packet, filename);
       }
 
       /* Packet interface_id info */
       if (rec.presence_flags & WTAP_HAS_INTERFACE_ID) {
-        /* cf_info.num_interfaces is size, not index, so it's one more than max index */
-        if (rec.rec_header.packet_header.interface_id >= cf_info.num_interfaces) {
+        /* cf_info->num_interfaces is size, not index, so it's one more than max index */
+        if (rec.rec_header.packet_header.interface_id >= cf_info->num_interfaces) {
           /*
            * OK, re-fetch the number of interfaces, as there might have
            * been an interface that was in the middle of packets, and
            * grow the array to be big enough for the new number of
            * interfaces.
            */
-          idb_info = wtap_file_get_idb_info(cf_info.wth);
+          idb_info = wtap_file_get_idb_info(cf_info->wth);
 
-          cf_info.num_interfaces = idb_info->interface_data->len;
-          g_array_set_size(cf_info.interface_packet_counts, cf_info.num_interfaces);
+          cf_info->num_interfaces = idb_info->interface_data->len;
+          g_array_set_size(cf_info->interface_packet_counts, cf_info->num_interfaces);
 
           g_free(idb_info);
           idb_info = NULL;
         }
-        if (rec.rec_header.packet_header.interface_id < cf_info.num_interfaces) {
-          g_array_index(cf_info.interface_packet_counts, guint32,
+        if (rec.rec_header.packet_header.interface_id < cf_info->num_interfaces) {
+          g_array_index(cf_info->interface_packet_counts, guint32,
                         rec.rec_header.packet_header.interface_id) += 1;
         }
         else {
-          cf_info.pkt_interface_id_unknown += 1;
+          cf_info->pkt_interface_id_unknown += 1;
         }
       }
       else {
         /* it's for interface_id 0 */
-        if (cf_info.num_interfaces != 0) {
-          g_array_index(cf_info.interface_packet_counts, guint32, 0) += 1;
+        if (cf_info->num_interfaces != 0) {
+          g_array_index(cf_info->interface_packet_counts, guint32, 0) += 1;
         }
         else {
-          cf_info.pkt_interface_id_unknown += 1;
+          cf_info->pkt_interface_id_unknown += 1;
         }
       }
     }
@@ -1320,120 +1430,251 @@ process_cap_file(const char *filename, gboolean need_separator)
   } /* while */
   wtap_rec_cleanup(&rec);
   ws_buffer_free(&buf);
+  g_private_set(&job_cf_info, NULL);
 
   /*
    * Get IDB info strings.
    * We do this at the end, so we can get information for all IDBs in
    * the file, even those that come after packet records.
    */
-  idb_info = wtap_file_get_idb_info(cf_info.wth);
+  idb_info = wtap_file_get_idb_info(cf_info->wth);
 
-  cf_info.idb_info_strings = g_array_sized_new(FALSE, FALSE, sizeof(gchar*), cf_info.num_interfaces);
-  cf_info.num_interfaces = idb_info->interface_data->len;
-  for (i = 0; i < cf_info.num_interfaces; i++) {
+  cf_info->idb_info_strings = g_array_sized_new(FALSE, FALSE, sizeof(gchar*), cf_info->num_interfaces);
+  cf_info->num_interfaces = idb_info->interface_data->len;
+  for (i = 0; i < cf_info->num_interfaces; i++) {
     const wtap_block_t if_descr = g_array_index(idb_info->interface_data, wtap_block_t, i);
     gchar *s = wtap_get_debug_if_descr(if_descr, 21, "\n");
-    g_array_append_val(cf_info.idb_info_strings, s);
+    g_array_append_val(cf_info->idb_info_strings, s);
   }
 
   g_free(idb_info);
   idb_info = NULL;
 
   if (err != 0) {
-    fprintf(stderr,
+    file_message(
         "capinfos: An error occurred after reading %u packets from \"%s\".\n",
         packet, filename);
     cfile_read_failure_message("capinfos", filename, err, err_info);
     if (err == WTAP_ERR_SHORT_READ) {
         /* Don't give up completely with this one. */
         status = 1;
-        fprintf(stderr,
+        file_message(
           "  (will continue anyway, checksums might be incorrect)\n");
     } else {
-        cleanup_capture_info(&cf_info);
-        wtap_close(cf_info.wth);
+        cleanup_capture_info(cf_info);
+        wtap_close(cf_info->wth);
         return 2;
     }
   }
 
   /* File size */
-  size = wtap_file_size(cf_info.wth, &err);
+  size = wtap_file_size(cf_info->wth, &err);
   if (size == -1) {
-    fprintf(stderr,
+    file_message(
         "capinfos: Can't get size of \"%s\": %s.\n",
         filename, g_strerror(err));
-    cleanup_capture_info(&cf_info);
-    wtap_close(cf_info.wth);
+    cleanup_capture_info(cf_info);
+    wtap_close(cf_info->wth);
     return 2;
   }
 
-  cf_info.filesize = size;
+  cf_info->filesize = size;
 
   /* File Type */
-  cf_info.file_type = wtap_file_type_subtype(cf_info.wth);
-  cf_info.compression_type = wtap_get_compression_type(cf_info.wth);
+  cf_info->file_type = wtap_file_type_subtype(cf_info->wth);
+  cf_info->compression_type = wtap_get_compression_type(cf_info->wth);
 
   /* File Encapsulation */
-  cf_info.file_encap = wtap_file_encap(cf_info.wth);
+  cf_info->file_encap = wtap_file_encap(cf_info->wth);
 
-  cf_info.file_tsprec = wtap_file_tsprec(cf_info.wth);
+  cf_info->file_tsprec = wtap_file_tsprec(cf_info->wth);
 
   /* Packet size limit (snaplen) */
-  cf_info.snaplen = wtap_snapshot_length(cf_info.wth);
-  if (cf_info.snaplen > 0)
-    cf_info.snap_set = TRUE;
+  cf_info->snaplen = wtap_snapshot_length(cf_info->wth);
+  if (cf_info->snaplen > 0)
+    cf_info->snap_set = TRUE;
   else
-    cf_info.snap_set = FALSE;
+    cf_info->snap_set = FALSE;
 
-  cf_info.snaplen_min_inferred = snaplen_min_inferred;
-  cf_info.snaplen_max_inferred = snaplen_max_inferred;
+  cf_info->snaplen_min_inferred = snaplen_min_inferred;
+  cf_info->snaplen_max_inferred = snaplen_max_inferred;
 
   /* # of packets */
-  cf_info.packet_count = packet;
+  cf_info->packet_count = packet;
 
   /* File Times */
-  cf_info.times_known = have_times;
-  cf_info.start_time = start_time;
-  cf_info.start_time_tsprec = start_time_tsprec;
-  cf_info.stop_time = stop_time;
-  cf_info.stop_time_tsprec = stop_time_tsprec;
-  nstime_delta(&cf_info.duration, &stop_time, &start_time);
+  cf_info->times_known = have_times;
+  cf_info->start_time = start_time;
+  cf_info->start_time_tsprec = start_time_tsprec;
+  cf_info->stop_time = stop_time;
+  cf_info->stop_time_tsprec = stop_time_tsprec;
+  nstime_delta(&cf_info->duration, &stop_time, &start_time);
   /* Duration precision is the higher of the start and stop time precisions. */
-  if (cf_info.stop_time_tsprec > cf_info.start_time_tsprec)
-    cf_info.duration_tsprec = cf_info.stop_time_tsprec;
+  if (cf_info->stop_time_tsprec > cf_info->start_time_tsprec)
+    cf_info->duration_tsprec = cf_info->stop_time_tsprec;
   else
-    cf_info.duration_tsprec = cf_info.start_time_tsprec;
-  cf_info.know_order = know_order;
-  cf_info.order = order;
+    cf_info->duration_tsprec = cf_info->start_time_tsprec;
+  cf_info->know_order = know_order;
+  cf_info->order = order;
 
   /* Number of packet bytes */
-  cf_info.packet_bytes = bytes;
+  cf_info->packet_bytes = bytes;
 
-  cf_info.data_rate   = 0.0;
-  cf_info.packet_rate = 0.0;
-  cf_info.packet_size = 0.0;
+  cf_info->data_rate   = 0.0;
+  cf_info->packet_rate = 0.0;
+  cf_info->packet_size = 0.0;
 
   if (packet > 0) {
     double delta_time = nstime_to_sec(&stop_time) - nstime_to_sec(&start_time);
     if (delta_time > 0.0) {
-      cf_info.data_rate   = (double)bytes  / delta_time; /* Data rate per second */
-      cf_info.packet_rate = (double)packet / delta_time; /* packet rate per second */
+      cf_info->data_rate   = (double)bytes  / delta_time; /* Data rate per second */
+      cf_info->packet_rate = (double)packet / delta_time; /* packet rate per second */
     }
-    cf_info.packet_size = (double)bytes / packet;                  /* Avg packet size      */
+    cf_info->packet_size = (double)bytes / packet;                  /* Avg packet size      */
+  }
+
+  return status;
+}
+
+/*
+ * Print the infos for a file that process_cap_file() has read, and
+ * close it.
+ */
+static void
+print_cap_file(const char *filename, capture_info *cf_info, gboolean need_separator)
+{
+  if (need_separator && long_report) {
+    printf("\n");
   }
 
   if (long_report) {
-    print_stats(filename, &cf_info);
+    print_stats(filename, cf_info);
   } else {
-    print_stats_table(filename, &cf_info);
+    print_stats_table(filename, cf_info);
   }
 
-  cleanup_capture_info(&cf_info);
-  wtap_close(cf_info.wth);
+  cleanup_capture_info(cf_info);
+  wtap_close(cf_info->wth);
+}
 
-  return status;
+/*
+ * Read a file for a job; its messages are saved rather than printed,
+ * so that the main thread can print them with its infos.
+ */
+static void
+run_job(capinfos_job *job, const char *filename)
+{
+  job->messages = g_string_new("");
+  g_private_set(&job_messages, job->messages);
+  job->status = process_cap_file(filename, &job->cf_info);
+  g_private_set(&job_messages, NULL);
+}
+
+typedef struct _capinfos_pool {
+  GThreadPool          *pool;
+  capinfos_job         *jobs;
+  char                **filenames;
+  GMutex                lock;
+  GCond                 cond;       /* signalled when a job is done */
+} capinfos_pool;
+
+static void
+job_thread(gpointer data, gpointer user_data)
+{
+  capinfos_pool *pool = (capinfos_pool *)user_data;
+  guint i = GPOINTER_TO_UINT(data) - 1;
+
+  run_job(&pool->jobs[i], pool->filenames[i]);
+
+  g_mutex_lock(&pool->lock);
+  pool->jobs[i].done = TRUE;
+  g_cond_broadcast(&pool->cond);
+  g_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Process the files, reading up to num_threads of them at once and
+ * printing their infos in order as each one is done.  At most a few
+ * files per thread are open at any time.
+ *
+ * Returns the status of the last file that failed, or 0.
+ */
+static int
+process_cap_files(char **filenames, guint num_files)
+{
+  capinfos_pool pool;
+  guint i, next = 0;
+  guint max_ahead = num_threads * 2;
+  gboolean need_separator = FALSE;
+  int overall_status = 0;
+
+  pool.jobs = g_new0(capinfos_job, num_files);
+  pool.filenames = filenames;
+  pool.pool = NULL;
+  g_mutex_init(&pool.lock);
+  g_cond_init(&pool.cond);
+  if (num_threads > 1 && num_files > 1)
+    pool.pool = g_thread_pool_new(job_thread, &pool, num_threads, FALSE, NULL);
+
+  for (i = 0; i < num_files; i++) {
+    capinfos_job *job = &pool.jobs[i];
+
+    if (pool.pool != NULL) {
+      while (next < num_files && next < i + max_ahead) {
+        g_thread_pool_push(pool.pool, GUINT_TO_POINTER(next + 1), NULL);
+        next++;
+      }
+      g_mutex_lock(&pool.lock);
+      while (!job->done)
+        g_cond_wait(&pool.cond, &pool.lock);
+      g_mutex_unlock(&pool.lock);
+    } else {
+      run_job(job, filenames[i]);
+    }
+
+    fputs(job->messages->str, stderr);
+    g_string_free(job->messages, TRUE);
+    job->messages = NULL;
+    if (job->status != 2) {
+      /* Either it succeeded or it got a "short read" but we print
+         information anyway.  Note that we need a blank line before
+         the next file's information, to separate it from the
+         previous file. */
+      print_cap_file(filenames[i], &job->cf_info, need_separator);
+      need_separator = TRUE;
+    }
+    if (job->status) {
+      /* Something failed.  It's been reported; remember that processing
+         one file failed and, if -C was specified, stop. */
+      overall_status = job->status;
+      if (stop_after_failure)
+        break;
+    }
+  }
+
+  if (pool.pool != NULL) {
+    /* Don't start any more files, and throw away those read ahead */
+    g_thread_pool_free(pool.pool, TRUE, TRUE);
+    for (i++; i < next; i++) {
+      capinfos_job *job = &pool.jobs[i];
+
+      if (!job->done)
+        continue;
+      g_string_free(job->messages, TRUE);
+      if (job->status != 2) {
+        cleanup_capture_info(&job->cf_info);
+        wtap_close(job->cf_info.wth);
+      }
+    }
+  }
+  g_cond_clear(&pool.cond);
+  g_mutex_clear(&pool.lock);
+  g_free(pool.jobs);
+
+  return overall_status;
 }
 
+
 static void
 print_usage(FILE *output)
 {
@@ -1491,6 +1732,7 @@ print_usage(FILE *output)
   fprintf(output, "Miscellaneous:\n");
   fprintf(output, "  -h display this help and exit\n");
   fprintf(output, "  -C cancel processing if file open fails (default is to continue)\n");
+  fprintf(output, "  -j <threads> read this many files at once (default is one per CPU)\n");
   fprintf(output, "  -A generate all infos (default)\n");
   fprintf(output, "  -K disable displaying the capture comment\n");
   fprintf(output, "\n");
@@ -1508,6 +1750,14 @@ print_usage(FILE *output)
 static void
 failure_warning_message(const char *msg_format, va_list ap)
 {
+  GString *messages = (GString *)g_private_get(&job_messages);
+
+  if (messages != NULL) {
+    g_string_append(messages, "capinfos: ");
+    g_string_append_vprintf(messages, msg_format, ap);
+    g_string_append_c(messages, '\n');
+    return;
+  }
   fprintf(stderr, "capinfos: ");
   vfprintf(stderr, msg_format, ap);
   fprintf(stderr, "\n");
@@ -1519,24 +1769,21 @@ failure_warning_message(const char *msg_format, va_list ap)
 static void
 failure_message_cont(const char *msg_format, va_list ap)
 {
-  vfprintf(stderr, msg_format, ap);
-  fprintf(stderr, "\n");
-}
-
-static void
-hash_to_str(const unsigned char *hash, size_t length, char *str) {
-  int i;
+  GString *messages = (GString *)g_private_get(&job_messages);
 
-  for (i = 0; i < (int) length; i++) {
-    g_snprintf(str+(i*2), 3, "%02x", hash[i]);
+  if (messages != NULL) {
+    g_string_append_vprintf(messages, msg_format, ap);
+    g_string_append_c(messages, '\n');
+    return;
   }
+  vfprintf(stderr, msg_format, ap);
+  fprintf(stderr, "\n");
 }
 
 int
 main(int argc, char *argv[])
 {
   char  *init_progfile_dir_error;
-  gboolean need_separator = FALSE;
   int    opt;
   int    overall_error_status = EXIT_SUCCESS;
   static const struct option long_options[] = {
@@ -1545,12 +1792,6 @@ main(int argc, char *argv[])
       {0, 0, 0, 0 }
   };
 
-  int status = 0;
-  FILE  *fh;
-  char  *hash_buf = NULL;
-  gcry_md_hd_t hd = NULL;
-  size_t hash_bytes;
-
   /*
    * Set the C-language locale to the native environment and set the
    * code page to UTF-8 on Windows.
@@ -1595,8 +1836,12 @@ main(int argc, char *argv[])
 
   wtap_init(TRUE);
 
+#if GLIB_CHECK_VERSION(2,36,0)
+  num_threads = g_get_num_processors();
+#endif
+
   /* Process the options */
-  while ((opt = getopt_long(argc, argv, "abcdehiklmnoqrstuvxyzABCDEFHIKLMNQRST", long_options, NULL)) !=-1) {
+  while ((opt = getopt_long(argc, argv, "abcdehij:klmnoqrstuvxyzABCDEFHIKLMNQRST", long_options, NULL)) !=-1) {
 
     switch (opt) {
 
@@ -1712,6 +1957,10 @@ main(int argc, char *argv[])
         stop_after_failure = TRUE;
         break;
 
+      case 'j':
+        num_threads = get_nonzero_guint32(optarg, "number of threads");
+        break;
+
       case 'A':
         enable_all_infos();
         break;
@@ -1791,57 +2040,11 @@ main(int argc, char *argv[])
 
   if (cap_file_hashes) {
     gcry_check_version(NULL);
-    gcry_md_open(&hd, GCRY_MD_SHA256, 0);
-    if (hd) {
-      gcry_md_enable(hd, GCRY_MD_RMD160);
-      gcry_md_enable(hd, GCRY_MD_SHA1);
-    }
-    hash_buf = (char *)g_malloc(HASH_BUF_SIZE);
   }
 
-  overall_error_status = 0;
-
-  for (opt = optind; opt < argc; opt++) {
-
-    g_strlcpy(file_sha256, "<unknown>", HASH_STR_SIZE);
-    g_strlcpy(file_rmd160, "<unknown>", HASH_STR_SIZE);
-    g_strlcpy(file_sha1, "<unknown>", HASH_STR_SIZE);
-
-    if (cap_file_hashes) {
-      fh = ws_fopen(argv[opt], "rb");
-      if (fh && hd) {
-        while((hash_bytes = fread(hash_buf, 1, HASH_BUF_SIZE, fh)) > 0) {
-          gcry_md_write(hd, hash_buf, hash_bytes);
-        }
-        gcry_md_final(hd);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_SHA256), HASH_SIZE_SHA256, file_sha256);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_RMD160), HASH_SIZE_RMD160, file_rmd160);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_SHA1), HASH_SIZE_SHA1, file_sha1);
-      }
-      if (fh) fclose(fh);
-      if (hd) gcry_md_reset(hd);
-    }
-
-    status = process_cap_file(argv[opt], need_separator);
-    if (status) {
-      /* Something failed.  It's been reported; remember that processing
-         one file failed and, if -C was specified, stop. */
-      overall_error_status = status;
-      if (stop_after_failure)
-        goto exit;
-    }
-    if (status != 2) {
-      /* Either it succeeded or it got a "short read" but printed
-         information anyway.  Note that we need a blank line before
-         the next file's information, to separate it from the
-         previous file. */
-      need_separator = TRUE;
-    }
-  }
+  overall_error_status = process_cap_files(argv + optind, argc - optind);
 
 exit:
-  g_free(hash_buf);
-  gcry_md_close(hd);
   wtap_cleanup();
   free_progdirs();
   return overall_error_status;
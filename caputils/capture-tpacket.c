@@ -0,0 +1,507 @@
+/* capture-tpacket.c
+ * Capture from Linux network interfaces through a memory-mapped
+ * TPACKET_V3 ring, without going through libpcap
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <ws_attributes.h>
+
+#ifdef HAVE_LIBPCAP
+
+#include "caputils/capture-tpacket.h"
+
+#ifdef __linux__
+#include <linux/if_packet.h>
+#endif
+
+#if defined(__linux__) && defined(TPACKET3_HDRLEN)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+/* Room left in front of each packet so that we can put a VLAN tag back */
+#define VLAN_TAG_LEN		4
+#define VLAN_TPID_8021Q		0x8100
+
+/* Smallest block we ask for; bigger ones are used if the snapshot length needs them */
+#define TPACKET_MIN_BLOCK_SIZE	(1024 * 1024)
+#define TPACKET_MIN_BLOCKS	2
+
+struct _tpacket_src {
+	int		fd;
+	int		ifindex;
+	gboolean	is_loopback;	/* don't see outgoing packets twice */
+	int		snaplen;
+	guint8		*ring;
+	size_t		ring_size;
+	guint		block_size;
+	guint		block_count;
+	guint		current;	/* block we'll look at next */
+	volatile sig_atomic_t break_loop;
+	tpacket_stats_t	stats;
+	char		errbuf[PCAP_ERRBUF_SIZE];
+};
+
+gboolean
+tpacket_supported(void)
+{
+	return TRUE;
+}
+
+tpacket_src *
+tpacket_open(const char *ifname, int snaplen, gboolean promisc,
+    guint buffer_size, int timeout_ms, int *err, char *errbuf,
+    size_t errbuf_len)
+{
+	tpacket_src *src;
+	struct ifreq ifr;
+	struct tpacket_req3 req;
+	struct packet_mreq mr;
+	int version = TPACKET_V3;
+	unsigned int reserve = VLAN_TAG_LEN;
+	guint frame_size;
+
+	src = g_new0(tpacket_src, 1);
+	src->fd = -1;
+	src->snaplen = snaplen;
+
+	src->ifindex = if_nametoindex(ifname);
+	if (src->ifindex == 0) {
+		*err = ENODEV;
+		g_snprintf(errbuf, (gulong)errbuf_len, "%s: No such device", ifname);
+		goto fail;
+	}
+
+	/* Don't receive anything until tpacket_start() binds to a protocol. */
+	src->fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (src->fd < 0) {
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "socket: %s", g_strerror(errno));
+		goto fail;
+	}
+
+	/*
+	 * We only hand back packets with their link-layer header, as
+	 * DLT_EN10MB; anything that isn't Ethernet-framed is left to libpcap.
+	 */
+	memset(&ifr, 0, sizeof ifr);
+	g_strlcpy(ifr.ifr_name, ifname, sizeof ifr.ifr_name);
+	if (ioctl(src->fd, SIOCGIFHWADDR, &ifr) < 0) {
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "SIOCGIFHWADDR: %s", g_strerror(errno));
+		goto fail;
+	}
+	switch (ifr.ifr_hwaddr.sa_family) {
+
+	case ARPHRD_ETHER:
+		break;
+
+	case ARPHRD_LOOPBACK:
+		src->is_loopback = TRUE;
+		break;
+
+	default:
+		*err = EAFNOSUPPORT;
+		g_snprintf(errbuf, (gulong)errbuf_len,
+		    "%s: link-layer type %d isn't supported by TPACKET_V3 capture",
+		    ifname, ifr.ifr_hwaddr.sa_family);
+		goto fail;
+	}
+
+	if (setsockopt(src->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof version) < 0) {
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "Can't use TPACKET_V3: %s", g_strerror(errno));
+		goto fail;
+	}
+	if (setsockopt(src->fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof reserve) < 0) {
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "PACKET_RESERVE: %s", g_strerror(errno));
+		goto fail;
+	}
+
+	/*
+	 * Blocks must be a power-of-2 number of pages and big enough for
+	 * the largest packet we want.
+	 */
+	frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + VLAN_TAG_LEN + (guint)snaplen);
+	src->block_size = TPACKET_MIN_BLOCK_SIZE;
+	while (src->block_size < frame_size)
+		src->block_size *= 2;
+	src->block_count = MAX(buffer_size / src->block_size, TPACKET_MIN_BLOCKS);
+
+	memset(&req, 0, sizeof req);
+	req.tp_block_size = src->block_size;
+	req.tp_block_nr = src->block_count;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (src->block_size / frame_size) * src->block_count;
+	req.tp_retire_blk_tov = timeout_ms;
+	if (setsockopt(src->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) < 0) {
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "Can't create a ring of %u blocks of %u bytes: %s",
+		    src->block_count, src->block_size, g_strerror(errno));
+		goto fail;
+	}
+
+	src->ring_size = (size_t)src->block_size * src->block_count;
+	src->ring = (guint8 *)mmap(NULL, src->ring_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, src->fd, 0);
+	if (src->ring == MAP_FAILED) {
+		src->ring = NULL;
+		*err = errno;
+		g_snprintf(errbuf, (gulong)errbuf_len, "Can't map the ring: %s", g_strerror(errno));
+		goto fail;
+	}
+
+	if (promisc) {
+		memset(&mr, 0, sizeof mr);
+		mr.mr_ifindex = src->ifindex;
+		mr.mr_type = PACKET_MR_PROMISC;
+		if (setsockopt(src->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof mr) < 0) {
+			*err = errno;
+			g_snprintf(errbuf, (gulong)errbuf_len,
+			    "Can't put %s into promiscuous mode: %s", ifname, g_strerror(errno));
+			goto fail;
+		}
+	}
+
+	return src;
+
+fail:
+	tpacket_close(src);
+	return NULL;
+}
+
+int
+tpacket_datalink(tpacket_src *src _U_)
+{
+	return DLT_EN10MB;
+}
+
+gboolean
+tpacket_set_filter(tpacket_src *src, struct bpf_program *fcode,
+    char *errbuf, size_t errbuf_len)
+{
+	struct sock_fprog prog;
+
+	/* A struct bpf_insn is laid out the same way as a struct sock_filter. */
+	prog.len = fcode->bf_len;
+	prog.filter = (struct sock_filter *)(void *)fcode->bf_insns;
+	if (setsockopt(src->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog) < 0) {
+		g_snprintf(errbuf, (gulong)errbuf_len, "SO_ATTACH_FILTER: %s", g_strerror(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+tpacket_start(tpacket_src *src, int fanout_group, char *errbuf,
+    size_t errbuf_len)
+{
+	struct sockaddr_ll sll;
+	int fanout_arg;
+
+	memset(&sll, 0, sizeof sll);
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = src->ifindex;
+	if (bind(src->fd, (struct sockaddr *)&sll, sizeof sll) < 0) {
+		g_snprintf(errbuf, (gulong)errbuf_len, "bind: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	if (fanout_group != -1) {
+		fanout_arg = PACKET_FANOUT_HASH;
+#ifdef PACKET_FANOUT_FLAG_DEFRAG
+		/* Keep the fragments of a datagram together. */
+		fanout_arg |= PACKET_FANOUT_FLAG_DEFRAG;
+#endif
+		/* Group IDs are system-wide; keep ours apart from other processes' */
+		fanout_arg = ((getpid() + fanout_group) & 0xffff) | (fanout_arg << 16);
+		if (setsockopt(src->fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof fanout_arg) < 0) {
+			g_snprintf(errbuf, (gulong)errbuf_len, "Can't join fanout group %d: %s",
+			    fanout_group, g_strerror(errno));
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static void
+tpacket_set_socket_error(tpacket_src *src)
+{
+	int sock_err = 0;
+	socklen_t len = sizeof sock_err;
+
+	if (getsockopt(src->fd, SOL_SOCKET, SO_ERROR, &sock_err, &len) < 0)
+		sock_err = errno;
+	/* Use the same messages as libpcap, so that our callers can recognize them. */
+	switch (sock_err) {
+
+	case ENETDOWN:
+		g_strlcpy(src->errbuf, "The interface went down", sizeof src->errbuf);
+		break;
+
+	case ENODEV:
+	case ENXIO:
+		g_strlcpy(src->errbuf, "The interface disappeared", sizeof src->errbuf);
+		break;
+
+	default:
+		g_snprintf(src->errbuf, sizeof src->errbuf, "poll: %s", g_strerror(sock_err));
+		break;
+	}
+}
+
+/* Hand the packets in one block to "callback" */
+static int
+tpacket_walk_block(tpacket_src *src, struct tpacket_block_desc *desc,
+    pcap_handler callback, u_char *user)
+{
+	struct tpacket3_hdr *hdr;
+	struct sockaddr_ll *sll;
+	struct pcap_pkthdr pkthdr;
+	u_char *data;
+	guint32 i;
+	int count = 0;
+
+	hdr = (struct tpacket3_hdr *)((guint8 *)desc + desc->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < desc->hdr.bh1.num_pkts; i++,
+	    hdr = (struct tpacket3_hdr *)((guint8 *)hdr + hdr->tp_next_offset)) {
+		sll = (struct sockaddr_ll *)((guint8 *)hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+		if (src->is_loopback && sll->sll_pkttype == PACKET_OUTGOING)
+			continue;
+
+		data = (u_char *)hdr + hdr->tp_mac;
+		pkthdr.ts.tv_sec = hdr->tp_sec;
+		pkthdr.ts.tv_usec = hdr->tp_nsec;
+		pkthdr.caplen = hdr->tp_snaplen;
+		pkthdr.len = hdr->tp_len;
+
+		/*
+		 * The kernel takes VLAN tags out of the packet; put them back,
+		 * in the room left by PACKET_RESERVE, as libpcap does.
+		 */
+		if ((hdr->tp_status & TP_STATUS_VLAN_VALID) && pkthdr.caplen >= 2 * 6) {
+			guint16 tpid = VLAN_TPID_8021Q;
+
+#ifdef TP_STATUS_VLAN_TPID_VALID
+			if (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID)
+				tpid = hdr->hv1.tp_vlan_tpid;
+#endif
+			memmove(data - VLAN_TAG_LEN, data, 2 * 6);
+			data -= VLAN_TAG_LEN;
+			data[12] = tpid >> 8;
+			data[13] = tpid & 0xff;
+			data[14] = hdr->hv1.tp_vlan_tci >> 8;
+			data[15] = hdr->hv1.tp_vlan_tci & 0xff;
+			pkthdr.caplen += VLAN_TAG_LEN;
+			pkthdr.len += VLAN_TAG_LEN;
+		}
+		if (pkthdr.caplen > (guint32)src->snaplen)
+			pkthdr.caplen = src->snaplen;
+
+		callback(user, &pkthdr, data);
+		count++;
+	}
+	return count;
+}
+
+int
+tpacket_dispatch(tpacket_src *src, int timeout_ms, pcap_handler callback,
+    u_char *user)
+{
+	struct tpacket_block_desc *desc;
+	struct pollfd pfd;
+	guint blocks;
+	int count = 0;
+
+	desc = (struct tpacket_block_desc *)(src->ring + (size_t)src->current * src->block_size);
+	if (!(g_atomic_int_get((gint *)&desc->hdr.bh1.block_status) & TP_STATUS_USER)) {
+		pfd.fd = src->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, timeout_ms) < 0) {
+			if (errno == EINTR)
+				return 0;
+			g_snprintf(src->errbuf, sizeof src->errbuf, "poll: %s", g_strerror(errno));
+			return -1;
+		}
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			tpacket_set_socket_error(src);
+			return -1;
+		}
+	}
+
+	/*
+	 * Go through every block the kernel has finished with, in order,
+	 * giving each one back as soon as its packets have been handled.
+	 */
+	for (blocks = 0; blocks < src->block_count; blocks++) {
+		if (src->break_loop) {
+			src->break_loop = 0;
+			return -2;
+		}
+		desc = (struct tpacket_block_desc *)(src->ring + (size_t)src->current * src->block_size);
+		if (!(g_atomic_int_get((gint *)&desc->hdr.bh1.block_status) & TP_STATUS_USER))
+			break;
+
+		count += tpacket_walk_block(src, desc, callback, user);
+
+		g_atomic_int_set((gint *)&desc->hdr.bh1.block_status, TP_STATUS_KERNEL);
+		src->stats.blocks++;
+		src->current = (src->current + 1) % src->block_count;
+	}
+	return count;
+}
+
+void
+tpacket_breakloop(tpacket_src *src)
+{
+	src->break_loop = 1;
+}
+
+const char *
+tpacket_geterr(tpacket_src *src)
+{
+	return src->errbuf;
+}
+
+gboolean
+tpacket_get_stats(tpacket_src *src, tpacket_stats_t *stats)
+{
+	struct tpacket_stats_v3 kstats;
+	socklen_t len = sizeof kstats;
+
+	/* The kernel resets its counters each time we read them. */
+	if (getsockopt(src->fd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) < 0) {
+		g_snprintf(src->errbuf, sizeof src->errbuf, "PACKET_STATISTICS: %s", g_strerror(errno));
+		return FALSE;
+	}
+	src->stats.received += kstats.tp_packets;
+	src->stats.dropped += kstats.tp_drops;
+	src->stats.freezes += kstats.tp_freeze_q_cnt;
+	*stats = src->stats;
+	return TRUE;
+}
+
+void
+tpacket_close(tpacket_src *src)
+{
+	if (src->ring != NULL)
+		munmap(src->ring, src->ring_size);
+	if (src->fd >= 0)
+		close(src->fd);
+	g_free(src);
+}
+
+#else /* __linux__ && TPACKET3_HDRLEN */
+
+#include <errno.h>
+
+struct _tpacket_src {
+	int dummy;
+};
+
+gboolean
+tpacket_supported(void)
+{
+	return FALSE;
+}
+
+tpacket_src *
+tpacket_open(const char *ifname _U_, int snaplen _U_, gboolean promisc _U_,
+    guint buffer_size _U_, int timeout_ms _U_, int *err, char *errbuf,
+    size_t errbuf_len)
+{
+	*err = ENOSYS;
+	g_strlcpy(errbuf, "TPACKET_V3 capture isn't supported on this platform", errbuf_len);
+	return NULL;
+}
+
+int
+tpacket_datalink(tpacket_src *src _U_)
+{
+	return -1;
+}
+
+gboolean
+tpacket_set_filter(tpacket_src *src _U_, struct bpf_program *fcode _U_,
+    char *errbuf _U_, size_t errbuf_len _U_)
+{
+	return FALSE;
+}
+
+gboolean
+tpacket_start(tpacket_src *src _U_, int fanout_group _U_, char *errbuf _U_,
+    size_t errbuf_len _U_)
+{
+	return FALSE;
+}
+
+int
+tpacket_dispatch(tpacket_src *src _U_, int timeout_ms _U_,
+    pcap_handler callback _U_, u_char *user _U_)
+{
+	return -1;
+}
+
+void
+tpacket_breakloop(tpacket_src *src _U_)
+{
+}
+
+const char *
+tpacket_geterr(tpacket_src *src _U_)
+{
+	return "TPACKET_V3 capture isn't supported on this platform";
+}
+
+gboolean
+tpacket_get_stats(tpacket_src *src _U_, tpacket_stats_t *stats _U_)
+{
+	return FALSE;
+}
+
+void
+tpacket_close(tpacket_src *src _U_)
+{
+}
+
+#endif /* __linux__ && TPACKET3_HDRLEN */
+
+#endif /* HAVE_LIBPCAP */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
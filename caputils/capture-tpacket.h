@@ -0,0 +1,112 @@
+/* capture-tpacket.h
+ * Definitions for capturing from Linux network interfaces through a
+ * memory-mapped TPACKET_V3 ring
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __CAPTURE_TPACKET_H__
+#define __CAPTURE_TPACKET_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#ifdef HAVE_LIBPCAP
+
+#include "wspcap.h"
+
+/*
+ * An AF_PACKET socket with a TPACKET_V3 receive ring mapped into our
+ * address space.  The kernel fills whole blocks of the ring with
+ * packets; tpacket_dispatch() hands each packet in a block to a
+ * pcap_handler with a pointer into the ring, then gives the block back.
+ * Time stamps are in nanoseconds, i.e. "ts.tv_usec" holds nanoseconds.
+ */
+typedef struct _tpacket_src tpacket_src;
+
+/* Counters for a ring, accumulated since it was opened. */
+typedef struct {
+	guint64 received;	/* packets the kernel put into the ring */
+	guint64 dropped;	/* packets dropped because the ring was full */
+	guint64 freezes;	/* times the ring filled up */
+	guint64 blocks;		/* blocks handed back to the kernel */
+} tpacket_stats_t;
+
+/* Returns TRUE if TPACKET_V3 capture is available on this platform. */
+gboolean tpacket_supported(void);
+
+/*
+ * Open a ring of about "buffer_size" bytes for the interface "ifname".
+ * A block is handed to us when it's full or when it's "timeout_ms"
+ * milliseconds old.  Nothing is captured until tpacket_start() is called.
+ *
+ * Returns NULL on failure, with "*err" set to an errno value and a
+ * message in "errbuf".  "*err" is ENODEV if there's no such interface
+ * and EAFNOSUPPORT if the interface isn't Ethernet or loopback; the
+ * caller may want to try libpcap then.
+ */
+tpacket_src *tpacket_open(const char *ifname, int snaplen, gboolean promisc,
+    guint buffer_size, int timeout_ms, int *err, char *errbuf,
+    size_t errbuf_len);
+
+/* Link-layer header type (DLT_) of the packets. */
+int tpacket_datalink(tpacket_src *src);
+
+/* Attach a compiled capture filter; returns FALSE and fills in "errbuf" on failure. */
+gboolean tpacket_set_filter(tpacket_src *src, struct bpf_program *fcode,
+    char *errbuf, size_t errbuf_len);
+
+/*
+ * Start capturing.  If "fanout_group" isn't -1, the socket joins a
+ * PACKET_FANOUT_HASH group shared by all of the rings this process
+ * starts with the same "fanout_group", so that the interface's packets
+ * are spread over them by flow.
+ */
+gboolean tpacket_start(tpacket_src *src, int fanout_group, char *errbuf,
+    size_t errbuf_len);
+
+/*
+ * Wait up to "timeout_ms" milliseconds for a block, then call "callback"
+ * for each packet in every block that's ready.
+ * Returns the number of packets handled, -1 on error (see
+ * tpacket_geterr()) or -2 if tpacket_breakloop() was called.
+ */
+int tpacket_dispatch(tpacket_src *src, int timeout_ms, pcap_handler callback,
+    u_char *user);
+
+/* Make tpacket_dispatch() return -2 after the current block; safe to call from a signal handler. */
+void tpacket_breakloop(tpacket_src *src);
+
+/* Message for the last error from tpacket_dispatch(). */
+const char *tpacket_geterr(tpacket_src *src);
+
+/* Update and get the counters for a ring. */
+gboolean tpacket_get_stats(tpacket_src *src, tpacket_stats_t *stats);
+
+void tpacket_close(tpacket_src *src);
+
+#endif /* HAVE_LIBPCAP */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __CAPTURE_TPACKET_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,41 @@
+#
+# - Find liburing
+# Find the io_uring userspace library and includes
+#
+#  LIBURING_INCLUDE_DIRS - where to find liburing.h, etc.
+#  LIBURING_LIBRARIES    - List of libraries when using liburing.
+#  LIBURING_FOUND        - True if liburing found.
+
+if( NOT WIN32)
+  find_package(PkgConfig)
+  pkg_search_module(LIBURING liburing)
+endif()
+
+find_path(LIBURING_INCLUDE_DIR
+  NAMES liburing.h
+  HINTS "${LIBURING_INCLUDEDIR}"
+  PATHS
+  /usr/local/include
+  /usr/include
+)
+
+find_library(LIBURING_LIBRARY
+  NAMES uring liburing
+  HINTS "${LIBURING_LIBDIR}"
+  PATHS
+  /usr/local/lib
+  /usr/lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args( LIBURING DEFAULT_MSG LIBURING_LIBRARY LIBURING_INCLUDE_DIR )
+
+if( LIBURING_FOUND )
+  set( LIBURING_INCLUDE_DIRS ${LIBURING_INCLUDE_DIR} )
+  set( LIBURING_LIBRARIES ${LIBURING_LIBRARY} )
+else()
+  set( LIBURING_INCLUDE_DIRS )
+  set( LIBURING_LIBRARIES )
+endif()
+
+mark_as_advanced( LIBURING_LIBRARIES LIBURING_INCLUDE_DIRS )
@@ -110,7 +110,7 @@ main(int argc, char **argv)
 	printf("Filter: \"%s\"\n", text);
 
 	/* Compile it */
-	if (!dfilter_compile(text, &df, &err_msg)) {
+	if (!dfilter_compile_flags(text, &df, &err_msg, DF_FILE_SETS)) {
 		fprintf(stderr, "dftest: %s\n", err_msg);
 		g_free(err_msg);
 		epan_cleanup();
@@ -53,11 +53,14 @@
 #include "caputils/capture_ifinfo.h"
 #include "caputils/capture-pcap-util.h"
 #include "caputils/capture-pcap-util-int.h"
+#include "caputils/capture-tpacket.h"
 #ifdef _WIN32
 #include "caputils/capture-wpcap.h"
 #endif /* _WIN32 */
 
 #include "writecap/pcapio.h"
+#include "writecap/aio_output.h"
+#include "writecap/compress_output.h"
 
 #ifndef _WIN32
 #include <sys/un.h>
@@ -111,12 +114,32 @@ FILE *debug_log;   /* for logging debug messages to  */
                    /*  is defined                    */
 #endif
 
-static GAsyncQueue *pcap_queue;
-static gint64 pcap_queue_bytes;
-static gint64 pcap_queue_packets;
+/* Per-interface packet queue limits when capturing with threads; see capture_queue */
+#define DEFAULT_QUEUE_BYTE_LIMIT (16 * 1024 * 1024)
 static gint64 pcap_queue_byte_limit = 0;
 static gint64 pcap_queue_packet_limit = 0;
 
+/* Write batching; see pcapio_batch_t */
+#define DEFAULT_WRITE_BATCH_DELAY 100 /* msecs */
+static size_t write_batch_size = 0;   /* bytes; 0 means write each packet as it arrives */
+static gint64 write_batch_delay = DEFAULT_WRITE_BATCH_DELAY;
+
+/* Asynchronous output; see aio_output_fdopen() */
+static guint aio_queue_depth = 0;     /* writes in flight; 0 means use stdio */
+
+/* Compressing the output as it's written; see compress_output_open() */
+static compress_output_type_t compress_type = COMPRESS_OUTPUT_NONE;
+
+/* Compressing ring buffer files once they're completed; see ringbuf_set_compress_files() */
+static compress_output_type_t compress_files_type = COMPRESS_OUTPUT_NONE;
+
+/* Ring buffer files created ahead of the switches; see ringbuf_set_spare_files() */
+static guint ring_spare_files = 0;
+
+/* Capturing from network interfaces with TPACKET_V3 rather than libpcap */
+static gboolean use_tpacket = FALSE;
+static guint tpacket_fanout = 0;      /* rings per interface in a fanout group; 0 means one ring */
+
 static gboolean capture_child = FALSE; /* FALSE: standalone call, TRUE: this is an Wireshark capture child */
 #ifdef _WIN32
 static gchar *sig_pipe_name = NULL;
@@ -180,6 +203,28 @@ typedef struct _pcapng_pipe_info {
 
 struct _loop_data; /* forward declaration so we can use it in the cap_pipe_dispatch function pointer */
 
+/*
+ * Queue of packets from one capture_src, used when capturing with threads.
+ *
+ * This is a single-producer/single-consumer ring in one preallocated
+ * slab: the capture thread for the source appends records at "tail" and
+ * the writer (main) thread removes them at "head", so neither needs a
+ * lock and no packet is allocated or freed on the way through.  Each
+ * side only ever writes its own offset and counter; the other side
+ * reads them atomically.
+ */
+typedef struct _capture_queue {
+    guint8                      *slab;        /**< Record storage, NULL if not capturing with threads */
+    guint32                      size;        /**< Size of slab */
+    gint                         head;        /**< Offset of the oldest record; written by the writer */
+    gint                         tail;        /**< Offset past the newest record; written by the reader */
+    gint                         enqueued;    /**< Records queued so far; written by the reader */
+    gint                         dequeued;    /**< Records written so far; written by the writer */
+    guint32                      hwm_bytes;   /**< Most bytes ever queued at once */
+    guint32                      hwm_packets; /**< Most records ever queued at once */
+    guint32                      full_drops;  /**< Records dropped because the queue was full */
+} capture_queue;
+
 /*
  * A source of packets from which we're capturing.
  */
@@ -188,12 +233,15 @@ typedef struct _capture_src {
     guint32                      dropped;
     guint32                      flushed;
     pcap_t                      *pcap_h;
+    tpacket_src                 *tpacket;                /**< TPACKET_V3 ring, if we're not using libpcap */
+    struct _capture_src         *fanout_parent;          /**< Source whose fanout group we're also reading, or NULL */
 #ifdef MUST_DO_SELECT
     int                          pcap_fd;                /**< pcap file descriptor */
 #endif
     gboolean                     pcap_err;
     guint                        interface_id;
     GThread                     *tid;
+    capture_queue                queue;                  /**< Packets read by tid but not yet written */
     int                          snaplen;
     int                          linktype;
     gboolean                     ts_nsec;                /**< TRUE if we're using nanosecond precision. */
@@ -259,6 +307,8 @@ typedef struct _loop_data {
     FILE     *pdh;
     int       save_file_fd;
     char     *io_buffer;           /**< Our IO buffer if we increase the size from the standard size */
+    guint8   *batch_buffer;        /**< Storage for batch, NULL if we're not batching writes */
+    pcapio_batch_t batch;          /**< Packets not yet handed to the output file */
     guint64   bytes_written;       /**< Bytes written for the current file. */
     /* autostop conditions */
     int       packets_written;     /**< Packets written for the current file. */
@@ -269,14 +319,27 @@ typedef struct _loop_data {
     int      interval_s;
 } loop_data;
 
-typedef struct _pcap_queue_element {
-    capture_src        *pcap_src;
+/*
+ * Header of a record in a capture_queue.  The packet data or pcapng block
+ * follows it, and the record is padded to a multiple of
+ * CAPTURE_QUEUE_ALIGN so that the next header is aligned.  A record with
+ * a length of 0 means the rest of the slab is unused and the next record
+ * is at the start.
+ */
+typedef struct _capture_queue_rec {
+    guint32                      rec_len;     /**< Length of the record, including this header and padding */
+    guint32                      pad;
+    guint64                      ts;          /**< Time used to merge the queues, in nanoseconds */
     union {
-        struct pcap_pkthdr  phdr;
-        pcapng_block_header_t  bh;
+        struct pcap_pkthdr       phdr;
+        pcapng_block_header_t    bh;
     } u;
-    u_char             *pd;
-} pcap_queue_element;
+} capture_queue_rec;
+
+#define CAPTURE_QUEUE_ALIGN       8
+#define CAPTURE_QUEUE_ROUND(len)  (((len) + (CAPTURE_QUEUE_ALIGN - 1)) & ~(CAPTURE_QUEUE_ALIGN - 1))
+#define CAPTURE_QUEUE_HDR_LEN     CAPTURE_QUEUE_ROUND((guint32)sizeof(capture_queue_rec))
+#define CAPTURE_QUEUE_REC_DATA(rec) ((u_char *)(rec) + CAPTURE_QUEUE_HDR_LEN)
 
 /*
  * This needs to be static, so that the SIGINT handler can clear the "go"
@@ -317,7 +380,17 @@ static gboolean need_timeout_workaround;
 #define PIPE_READ_TIMEOUT   250000
 #endif
 
-#define WRITER_THREAD_TIMEOUT 100000 /* usecs */
+/*
+ * Time, in microseconds, for which the writer thread sleeps when all of
+ * the packet queues are empty.
+ */
+#define WRITER_THREAD_IDLE_SLEEP 1000
+
+/*
+ * Maximum number of packets the writer thread writes before going back
+ * to check the stop conditions.
+ */
+#define WRITER_THREAD_BATCH 256
 
 static void
 console_log_handler(const char *log_domain, GLogLevelFlags log_level,
@@ -422,17 +495,39 @@ print_usage(FILE *output)
     fprintf(output, "                                          an exact multiple of NUM secs\n");
     fprintf(output, "                          printname:FILE - print filename to FILE when written\n");
     fprintf(output, "                                           (can use 'stdout' or 'stderr')\n");
+    if (ringbuf_spare_files_supported()) {
+        fprintf(output, "  --ring-spare-files <num> create the next <num> files ahead of the switches,\n");
+        fprintf(output, "                           and close completed ones, in the background\n");
+    }
     fprintf(output, "  -n                       use pcapng format instead of pcap (default)\n");
     fprintf(output, "  -P                       use libpcap format instead of pcapng\n");
     fprintf(output, "  --capture-comment <comment>\n");
     fprintf(output, "                           add a capture comment to the output file\n");
     fprintf(output, "                           (only for pcapng)\n");
+    if (aio_output_supported()) {
+        fprintf(output, "  --async-output <depth>   write file(s) asynchronously, bypassing the page\n");
+        fprintf(output, "                           cache, with up to <depth> writes in flight\n");
+    }
+    fprintf(output, "  --compress <type>        compress the output file(s) with <type>, one of:\n");
+    fprintf(output, "                           %s\n", compress_output_type_names());
+    fprintf(output, "  --compress-files <type>  compress ring buffer files with <type> in the\n");
+    fprintf(output, "                           background once they're completed\n");
     fprintf(output, "\n");
     fprintf(output, "Miscellaneous:\n");
-    fprintf(output, "  -N <packet_limit>        maximum number of packets buffered within dumpcap\n");
-    fprintf(output, "  -C <byte_limit>          maximum number of bytes used for buffering packets\n");
+    fprintf(output, "  -N <packet_limit>        maximum number of packets buffered per interface\n");
+    fprintf(output, "  -C <byte_limit>          bytes used for buffering packets per interface\n");
     fprintf(output, "                           within dumpcap\n");
     fprintf(output, "  -t                       use a separate thread per interface\n");
+    fprintf(output, "  --write-batch-size <KiB> collect packets in a buffer of this size and write\n");
+    fprintf(output, "                           them to the file with one call (def: 0, off)\n");
+    fprintf(output, "  --write-batch-delay <ms> maximum time a packet is held in the write batch\n");
+    fprintf(output, "                           (def: %d)\n", DEFAULT_WRITE_BATCH_DELAY);
+    if (tpacket_supported()) {
+        fprintf(output, "  --tpacket                capture from network interfaces with a TPACKET_V3\n");
+        fprintf(output, "                           ring rather than libpcap\n");
+        fprintf(output, "  --tpacket-fanout <num>   with --tpacket, spread each interface's packets\n");
+        fprintf(output, "                           over <num> rings, each read by its own thread\n");
+    }
     fprintf(output, "  -q                       don't report packet capture counts\n");
     fprintf(output, "  -v, --version            print version information and exit\n");
     fprintf(output, "  -h, --help               display this help and exit\n");
@@ -1029,6 +1124,16 @@ report_capture_count(gboolean reportit)
     /* Don't print this if we're a capture child. */
     if (!capture_child && reportit) {
         fprintf(stderr, "\rPackets captured: %d\n", global_ld.packets_captured);
+        if (aio_queue_depth != 0) {
+            aio_output_stats_t aio_stats;
+
+            aio_output_get_stats(&aio_stats);
+            fprintf(stderr, "Output (%s): %u of %u writes in flight, %u max, "
+                    "%" G_GUINT64_FORMAT " writes, stalled %" G_GUINT64_FORMAT " times for %.3f s\n",
+                    aio_stats.backend ? aio_stats.backend : "not open",
+                    aio_stats.in_flight, aio_stats.queue_depth, aio_stats.max_in_flight,
+                    aio_stats.writes, aio_stats.stalls, aio_stats.stall_time / 1000000.0);
+        }
         /* stderr could be line buffered */
         fflush(stderr);
     }
@@ -2597,6 +2702,95 @@ pcapng_pipe_dispatch(loop_data *ld, capture_src *pcap_src, char *errmsg, size_t
     return -1;
 }
 
+/*
+ * Try to open a network interface with a TPACKET_V3 ring rather than
+ * with libpcap.  Sets "*use_libpcap" if it should be opened the usual
+ * way instead, e.g. because it's a pipe rather than an interface.
+ * Returns FALSE, with a message in "errmsg", on failure.
+ */
+static gboolean
+capture_loop_open_tpacket(capture_src *pcap_src, interface_options *interface_opts,
+                          gboolean *use_libpcap, char *errmsg, size_t errmsg_len)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    int  err;
+    guint buffer_size = DEFAULT_CAPTURE_BUFFER_SIZE;
+
+    *use_libpcap = FALSE;
+#ifdef CAN_SET_CAPTURE_BUFFER_SIZE
+    buffer_size = interface_opts->buffer_size;
+#endif
+    pcap_src->tpacket = tpacket_open(interface_opts->name, interface_opts->snaplen,
+                                     interface_opts->promisc_mode, buffer_size * 1024 * 1024,
+                                     CAP_READ_TIMEOUT, &err, errbuf, sizeof errbuf);
+    if (pcap_src->tpacket == NULL) {
+        if (err == ENODEV || err == EAFNOSUPPORT) {
+            g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "%s: %s; trying libpcap",
+                  G_STRFUNC, errbuf);
+            *use_libpcap = TRUE;
+            return TRUE;
+        }
+        g_snprintf(errmsg, (gulong) errmsg_len,
+                   "The capture session could not be initiated on interface '%s' (%s).",
+                   interface_opts->name, errbuf);
+        return FALSE;
+    }
+    if (interface_opts->monitor_mode ||
+        (interface_opts->linktype != -1 && interface_opts->linktype != tpacket_datalink(pcap_src->tpacket))) {
+        g_snprintf(errmsg, (gulong) errmsg_len,
+                   "Monitor mode and link-layer header types other than Ethernet "
+                   "can't be used with --tpacket on interface '%s'.",
+                   interface_opts->name);
+        return FALSE;
+    }
+    pcap_src->linktype = tpacket_datalink(pcap_src->tpacket);
+    pcap_src->snaplen = interface_opts->snaplen;
+    pcap_src->ts_nsec = TRUE;
+    g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "%s: opened a TPACKET_V3 ring for %s",
+          G_STRFUNC, interface_opts->name);
+    return TRUE;
+}
+
+/*
+ * Open the other rings in the fanout group of each interface we're
+ * capturing on with TPACKET_V3.  Each ring gets a capture_src of its
+ * own, and so its own thread and packet queue; these come after the
+ * capture_srcs for the interfaces in ld->pcaps.
+ */
+static gboolean
+capture_loop_open_fanout(capture_options *capture_opts, loop_data *ld,
+                         char *errmsg, size_t errmsg_len)
+{
+    interface_options *interface_opts;
+    capture_src       *parent, *pcap_src;
+    gboolean           use_libpcap;
+    guint              i, j;
+
+    for (i = 0; i < capture_opts->ifaces->len; i++) {
+        parent = g_array_index(ld->pcaps, capture_src *, i);
+        if (parent->tpacket == NULL) {
+            continue;
+        }
+        interface_opts = &g_array_index(capture_opts->ifaces, interface_options, i);
+        for (j = 1; j < tpacket_fanout; j++) {
+            pcap_src = (capture_src *)g_malloc0(sizeof (capture_src));
+#ifdef MUST_DO_SELECT
+            pcap_src->pcap_fd = -1;
+#endif
+            pcap_src->interface_id = parent->interface_id;
+            pcap_src->fanout_parent = parent;
+            pcap_src->cap_pipe_fd = -1;
+            pcap_src->cap_pipe_err = PIPOK;
+            g_array_append_val(ld->pcaps, pcap_src);
+            if (!capture_loop_open_tpacket(pcap_src, interface_opts, &use_libpcap,
+                                           errmsg, errmsg_len)) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
 /** Open the capture input file (pcap or capture pipe).
  *  Returns TRUE if it succeeds, FALSE otherwise. */
 static gboolean
@@ -2661,6 +2855,17 @@ capture_loop_open_input(capture_options *capture_opts, loop_data *ld,
         g_array_append_val(ld->pcaps, pcap_src);
 
         g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_open_input : %s", interface_opts->name);
+        if (use_tpacket) {
+            gboolean use_libpcap;
+
+            if (!capture_loop_open_tpacket(pcap_src, interface_opts, &use_libpcap,
+                                           errmsg, errmsg_len)) {
+                return FALSE;
+            }
+            if (!use_libpcap) {
+                continue;
+            }
+        }
         pcap_src->pcap_h = open_capture_device(capture_opts, interface_opts,
             CAP_READ_TIMEOUT, &open_err, &open_err_str);
 
@@ -2780,6 +2985,10 @@ capture_loop_open_input(capture_options *capture_opts, loop_data *ld,
             pcapng_src_count++;
         }
     }
+    if (tpacket_fanout > 1 &&
+        !capture_loop_open_fanout(capture_opts, ld, errmsg, errmsg_len)) {
+        return FALSE;
+    }
     if (capture_opts->ifaces->len == 1 && pcapng_src_count == 1) {
         ld->pcapng_passthrough = TRUE;
         g_rw_lock_writer_lock (&ld->saved_shb_idb_lock);
@@ -2835,6 +3044,10 @@ static void capture_loop_close_input(loop_data *ld)
                 pcap_src->cap_pipe_info.pcapng.src_iface_to_global = NULL;
             }
         } else {
+            if (pcap_src->tpacket != NULL) {
+                tpacket_close(pcap_src->tpacket);
+                pcap_src->tpacket = NULL;
+            }
             /* Capture device.  If open, close the pcap_t. */
             if (pcap_src->pcap_h != NULL) {
                 g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_close_input: closing %p", (void *)pcap_src->pcap_h);
@@ -2880,6 +3093,84 @@ capture_loop_init_filter(pcap_t *pcap_h, gboolean from_cap_pipe,
     return INITFILTER_NO_ERROR;
 }
 
+/*
+ * init the capture filter of a TPACKET_V3 ring, then start capturing on it,
+ * in the interface's fanout group if we're using one
+ */
+static initfilter_status_t
+capture_loop_init_tpacket(capture_src *pcap_src, const gchar *name, const gchar *cfilter,
+                          char *errmsg, size_t errmsg_len)
+{
+    pcap_t            *pcap_h;
+    struct bpf_program fcode;
+    gboolean           filter_set;
+    int                fanout_group = -1;
+
+    g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_init_tpacket: %s", cfilter);
+
+    if (cfilter && *cfilter) {
+        /* libpcap compiles the filter; the kernel runs it on our socket. */
+        pcap_h = pcap_open_dead(pcap_src->linktype, pcap_src->snaplen);
+        if (pcap_h == NULL) {
+            g_snprintf(errmsg, (gulong) errmsg_len, "Can't compile the capture filter.");
+            return INITFILTER_OTHER_ERROR;
+        }
+        if (!compile_capture_filter(name, pcap_h, &fcode, cfilter)) {
+            g_snprintf(errmsg, (gulong) errmsg_len, "%s", pcap_geterr(pcap_h));
+            pcap_close(pcap_h);
+            return INITFILTER_BAD_FILTER;
+        }
+        filter_set = tpacket_set_filter(pcap_src->tpacket, &fcode, errmsg, errmsg_len);
+#ifdef HAVE_PCAP_FREECODE
+        pcap_freecode(&fcode);
+#endif
+        pcap_close(pcap_h);
+        if (!filter_set) {
+            return INITFILTER_OTHER_ERROR;
+        }
+    }
+
+    if (tpacket_fanout > 1) {
+        fanout_group = (int)pcap_src->interface_id;
+    }
+    if (!tpacket_start(pcap_src->tpacket, fanout_group, errmsg, errmsg_len)) {
+        return INITFILTER_OTHER_ERROR;
+    }
+    return INITFILTER_NO_ERROR;
+}
+
+/*
+ * Add up the counts for a TPACKET_V3 source and the other rings in its
+ * fanout group.  "kernel_dropped" is the number of packets the kernel
+ * dropped because a ring was full.
+ */
+static gboolean
+capture_loop_get_tpacket_counts(capture_src *pcap_src, guint32 *received, guint32 *dropped,
+                                guint32 *flushed, guint32 *kernel_dropped)
+{
+    tpacket_stats_t stats;
+    capture_src    *src;
+    gboolean        stats_ok = TRUE;
+    guint           i;
+
+    *received = *dropped = *flushed = *kernel_dropped = 0;
+    for (i = 0; i < global_ld.pcaps->len; i++) {
+        src = g_array_index(global_ld.pcaps, capture_src *, i);
+        if (src != pcap_src && src->fanout_parent != pcap_src) {
+            continue;
+        }
+        *received += src->received;
+        *dropped += src->dropped;
+        *flushed += src->flushed;
+        if (tpacket_get_stats(src->tpacket, &stats)) {
+            *kernel_dropped += (guint32)stats.dropped;
+        } else {
+            stats_ok = FALSE;
+        }
+    }
+    return stats_ok;
+}
+
 /*
  * Write the dumpcap pcapng SHB and IDBs if needed.
  * Called from capture_loop_init_output and do_file_switch_or_stop.
@@ -2967,7 +3258,7 @@ capture_loop_init_pcapng_output(capture_options *capture_opts, loop_data *ld)
             capture_src *pcap_src = g_array_index(ld->pcaps, capture_src *, if_id);
             if (pcap_src->from_cap_pipe) {
                 pcap_src->snaplen = pcap_src->cap_pipe_info.pcap.hdr.snaplen;
-            } else {
+            } else if (pcap_src->pcap_h != NULL) {
                 pcap_src->snaplen = pcap_snapshot(pcap_src->pcap_h);
             }
             successful = pcapng_write_interface_description_block(global_ld.pdh,
@@ -3011,6 +3302,9 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
     /* Set up to write to the capture file. */
     if (capture_opts->multi_files_on) {
         ld->pdh = ringbuf_init_libpcap_fdopen(&err);
+    } else if (aio_queue_depth != 0 && !capture_opts->output_to_pipe) {
+        /* aio_output does its own buffering */
+        ld->pdh = aio_output_fdopen(ld->save_file_fd, aio_queue_depth, &err);
     } else {
         ld->pdh = ws_fdopen(ld->save_file_fd, "wb");
         if (ld->pdh == NULL) {
@@ -3032,6 +3326,17 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
             g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_init_output: buffsize %zu", buffsize);
         }
     }
+    if (ld->pdh && !capture_opts->multi_files_on && compress_type != COMPRESS_OUTPUT_NONE) {
+        /* The ringbuffer code does this itself for each file */
+        FILE *compressed = compress_output_open(ld->pdh, compress_type, &err);
+
+        if (compressed == NULL) {
+            fclose(ld->pdh);
+            g_free(ld->io_buffer);
+            ld->io_buffer = NULL;
+        }
+        ld->pdh = compressed;
+    }
     if (ld->pdh) {
         gboolean successful;
         if (capture_opts->use_pcapng) {
@@ -3041,7 +3346,7 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
             pcap_src = g_array_index(ld->pcaps, capture_src *, 0);
             if (pcap_src->from_cap_pipe) {
                 pcap_src->snaplen = pcap_src->cap_pipe_info.pcap.hdr.snaplen;
-            } else {
+            } else if (pcap_src->pcap_h != NULL) {
                 pcap_src->snaplen = pcap_snapshot(pcap_src->pcap_h);
             }
             successful = libpcap_write_file_header(ld->pdh, pcap_src->linktype, pcap_src->snaplen,
@@ -3052,6 +3357,12 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
             ld->pdh = NULL;
             g_free(ld->io_buffer);
             ld->io_buffer = NULL;
+        } else if (write_batch_size != 0) {
+            ld->batch_buffer = (guint8 *)g_malloc(write_batch_size);
+            pcapio_batch_init(&ld->batch, ld->batch_buffer, write_batch_size,
+                              write_batch_delay * 1000);
+            g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_init_output: write batch %zu bytes, %" G_GINT64_MODIFIER "d ms",
+                  write_batch_size, write_batch_delay);
         }
     }
 
@@ -3075,6 +3386,23 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
     return TRUE;
 }
 
+/*
+ * Hand any batched packets to the output file and flush it.
+ */
+static void
+capture_loop_flush_output(loop_data *ld)
+{
+    int err;
+
+    if (ld->pdh == NULL)
+        return;
+    if (ld->batch_buffer != NULL && !pcapio_batch_flush(ld->pdh, &ld->batch, &err)) {
+        ld->go = FALSE;
+        ld->err = err;
+    }
+    fflush(ld->pdh);
+}
+
 static gboolean
 capture_loop_close_output(capture_options *capture_opts, loop_data *ld, int *err_close)
 {
@@ -3083,20 +3411,45 @@ capture_loop_close_output(capture_options *capture_opts, loop_data *ld, int *err
     capture_src *pcap_src;
     guint64      end_time = create_timestamp();
     gboolean success;
+    gboolean batch_ok = TRUE;
 
     g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "capture_loop_close_output");
 
+    if (ld->batch_buffer != NULL) {
+        /* The capture loop normally has flushed the batch already. */
+        if (ld->pdh != NULL) {
+            batch_ok = pcapio_batch_flush(ld->pdh, &ld->batch, err_close);
+        }
+        g_free(ld->batch_buffer);
+        ld->batch_buffer = NULL;
+    }
+
     if (capture_opts->multi_files_on) {
-        return ringbuf_libpcap_dump_close(&capture_opts->save_file, err_close);
+        success = ringbuf_libpcap_dump_close(&capture_opts->save_file, err_close);
+        return batch_ok && success;
     } else {
         if (capture_opts->use_pcapng) {
             for (i = 0; i < global_ld.pcaps->len; i++) {
                 pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+                if (pcap_src->fanout_parent != NULL) {
+                    /* Counted with the interface's first ring */
+                    continue;
+                }
                 if (!pcap_src->from_cap_pipe) {
                     guint64 isb_ifrecv, isb_ifdrop;
                     struct pcap_stat stats;
-
-                    if (pcap_stats(pcap_src->pcap_h, &stats) >= 0) {
+                    guint32 received, dropped, flushed, kernel_dropped;
+
+                    if (pcap_src->tpacket != NULL) {
+                        if (capture_loop_get_tpacket_counts(pcap_src, &received, &dropped,
+                                                            &flushed, &kernel_dropped)) {
+                            isb_ifrecv = received;
+                            isb_ifdrop = kernel_dropped + dropped + flushed;
+                        } else {
+                            isb_ifrecv = G_MAXUINT64;
+                            isb_ifdrop = G_MAXUINT64;
+                        }
+                    } else if (pcap_stats(pcap_src->pcap_h, &stats) >= 0) {
                         isb_ifrecv = pcap_src->received;
                         isb_ifdrop = stats.ps_drop + pcap_src->dropped + pcap_src->flushed;
                    } else {
@@ -3125,7 +3478,7 @@ capture_loop_close_output(capture_options *capture_opts, loop_data *ld, int *err
         }
         g_free(ld->io_buffer);
         ld->io_buffer = NULL;
-        return success;
+        return batch_ok && success;
     }
 }
 
@@ -3187,6 +3540,22 @@ capture_loop_dispatch(loop_data *ld,
             }
         }
     }
+    else if (pcap_src->tpacket != NULL)
+    {
+        /* dispatch whole blocks from the TPACKET_V3 ring */
+        if (use_threads) {
+            inpkts = tpacket_dispatch(pcap_src->tpacket, CAP_READ_TIMEOUT, capture_loop_queue_packet_cb, (u_char *)pcap_src);
+        } else {
+            inpkts = tpacket_dispatch(pcap_src->tpacket, CAP_READ_TIMEOUT, capture_loop_write_packet_cb, (u_char *)pcap_src);
+        }
+        if (inpkts < 0) {
+            if (inpkts == -1) {
+                /* Error, rather than tpacket_breakloop(). */
+                pcap_src->pcap_err = TRUE;
+            }
+            ld->go = FALSE; /* error or tpacket_breakloop() - stop capturing */
+        }
+    }
     else
     {
         /* dispatch from pcap */
@@ -3401,6 +3770,13 @@ capture_loop_open_output(capture_options *capture_opts, int *save_file_fd,
                 if (*save_file_fd != -1) {
                     g_free(capfile_name);
                     capfile_name = NULL;
+                    ringbuf_set_aio_output(aio_queue_depth);
+                    ringbuf_set_compress_output(compress_type);
+                    ringbuf_set_compress_files(compress_files_type);
+                    /* Files that switch on their size are allocated that much space */
+                    ringbuf_set_spare_files(ring_spare_files,
+                                            capture_opts->has_autostop_filesize ?
+                                            (guint64)capture_opts->autostop_filesize * 1000 : 0);
                 }
                 if (capture_opts->print_file_names) {
                     if (!ringbuf_set_print_name(capture_opts->print_name_to, NULL)) {
@@ -3554,6 +3930,13 @@ do_file_switch_or_stop(capture_options *capture_opts)
             return FALSE;
         }
 
+        /* The batch belongs to the file we're about to close. */
+        if (global_ld.batch_buffer != NULL &&
+            !pcapio_batch_flush(global_ld.pdh, &global_ld.batch, &global_ld.err)) {
+            global_ld.go = FALSE;
+            return FALSE;
+        }
+
         /* Switch to the next ringbuffer file */
         if (ringbuf_switch_file(&global_ld.pdh, &capture_opts->save_file,
                                 &global_ld.save_file_fd, &global_ld.err)) {
@@ -3584,7 +3967,7 @@ do_file_switch_or_stop(capture_options *capture_opts)
             if (global_ld.next_interval_time) {
                 global_ld.next_interval_time = get_next_time_interval(global_ld.interval_s);
             }
-            fflush(global_ld.pdh);
+            capture_loop_flush_output(&global_ld);
             if (!quiet)
                 report_packet_count(global_ld.inpkts_to_sync_pipe);
             global_ld.inpkts_to_sync_pipe = 0;
@@ -3623,46 +4006,216 @@ pcap_read_handler(void* arg)
     return (NULL);
 }
 
-/* Try to pop an item off the packet queue and if it exists, write it */
-static gboolean
-capture_loop_dequeue_packet(void) {
-    pcap_queue_element *queue_element;
+/* Allocate the packet queue of a capture source; see capture_queue */
+static void
+capture_queue_init(capture_queue *queue, guint32 size)
+{
+    queue->slab = (guint8 *)g_malloc(size);
+    queue->size = size;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->enqueued = 0;
+    queue->dequeued = 0;
+    queue->hwm_bytes = 0;
+    queue->hwm_packets = 0;
+    queue->full_drops = 0;
+}
+
+/* Free the slab of a packet queue; its counters are kept for reporting */
+static void
+capture_queue_free(capture_queue *queue)
+{
+    g_free(queue->slab);
+    queue->slab = NULL;
+}
+
+/*
+ * Reserve space at the tail of a packet queue for a record with
+ * "data_len" bytes of data.  Only the capture thread of the queue's
+ * source may call this.  Returns NULL if there's no room for it;
+ * otherwise, returns the header of the record, which must be filled
+ * in and then handed to capture_queue_commit() along with "*next_tail".
+ */
+static capture_queue_rec *
+capture_queue_reserve(capture_queue *queue, guint32 data_len, gint *next_tail)
+{
+    guint32 rec_len;
+    guint32 head, tail;
 
-    g_async_queue_lock(pcap_queue);
-    queue_element = (pcap_queue_element *)g_async_queue_timeout_pop_unlocked(pcap_queue, WRITER_THREAD_TIMEOUT);
-    if (queue_element) {
-        if (queue_element->pcap_src->from_pcapng) {
-            pcap_queue_bytes -= queue_element->u.bh.block_total_length;
+    if (data_len > queue->size / 2 - CAPTURE_QUEUE_HDR_LEN) {
+        queue->full_drops++;
+        return NULL;
+    }
+    if (pcap_queue_packet_limit > 0 &&
+        queue->enqueued - g_atomic_int_get(&queue->dequeued) >= pcap_queue_packet_limit) {
+        queue->full_drops++;
+        return NULL;
+    }
+    rec_len = CAPTURE_QUEUE_HDR_LEN + CAPTURE_QUEUE_ROUND(data_len);
+    head = (guint32)g_atomic_int_get(&queue->head);
+    tail = (guint32)queue->tail;
+
+    /*
+     * The tail never catches up with the head, as the queue would then
+     * look empty.
+     */
+    if (tail >= head) {
+        if (tail + rec_len < queue->size ||
+            (tail + rec_len == queue->size && head > 0)) {
+            *next_tail = (gint)((tail + rec_len) % queue->size);
+        } else if (rec_len < head) {
+            /* No room at the end; tell the writer to go back to the start. */
+            ((capture_queue_rec *)(queue->slab + tail))->rec_len = 0;
+            tail = 0;
+            *next_tail = (gint)rec_len;
         } else {
-            pcap_queue_bytes -= queue_element->u.phdr.caplen;
+            queue->full_drops++;
+            return NULL;
         }
-        pcap_queue_packets -= 1;
+    } else {
+        if (tail + rec_len >= head) {
+            queue->full_drops++;
+            return NULL;
+        }
+        *next_tail = (gint)(tail + rec_len);
     }
-    g_async_queue_unlock(pcap_queue);
-    if (queue_element) {
-        if (queue_element->pcap_src->from_pcapng) {
-            g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-                  "Dequeued a block of type 0x%08x of length %d captured on interface %d.",
-                  queue_element->u.bh.block_type, queue_element->u.bh.block_total_length,
-                  queue_element->pcap_src->interface_id);
+    ((capture_queue_rec *)(queue->slab + tail))->rec_len = rec_len;
+    return (capture_queue_rec *)(queue->slab + tail);
+}
 
-            capture_loop_write_pcapng_cb(queue_element->pcap_src,
-                                        &queue_element->u.bh,
-                                        queue_element->pd);
-        } else {
-            g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-                "Dequeued a packet of length %d captured on interface %d.",
-                queue_element->u.phdr.caplen, queue_element->pcap_src->interface_id);
+/* Make a record filled in after capture_queue_reserve() visible to the writer */
+static void
+capture_queue_commit(capture_queue *queue, gint next_tail)
+{
+    gint    head;
+    guint32 queued_bytes;
+    guint32 queued_packets;
+
+    g_atomic_int_set(&queue->tail, next_tail);
+    queue->enqueued++;
+
+    head = g_atomic_int_get(&queue->head);
+    queued_bytes = (next_tail >= head) ? (guint32)(next_tail - head) : queue->size - (guint32)(head - next_tail);
+    queued_packets = (guint32)(queue->enqueued - g_atomic_int_get(&queue->dequeued));
+    if (queued_bytes > queue->hwm_bytes)
+        queue->hwm_bytes = queued_bytes;
+    if (queued_packets > queue->hwm_packets)
+        queue->hwm_packets = queued_packets;
+}
+
+/* Get the oldest record in a packet queue without removing it, or NULL if it's empty */
+static capture_queue_rec *
+capture_queue_peek(capture_queue *queue)
+{
+    capture_queue_rec *rec;
+
+    if (queue->head == g_atomic_int_get(&queue->tail))
+        return NULL;
+    rec = (capture_queue_rec *)(queue->slab + queue->head);
+    if (rec->rec_len == 0) {
+        /* The reader wrapped around to the start of the slab. */
+        g_atomic_int_set(&queue->head, 0);
+        if (g_atomic_int_get(&queue->tail) == 0)
+            return NULL;
+        rec = (capture_queue_rec *)queue->slab;
+    }
+    return rec;
+}
+
+/* Remove the record returned by capture_queue_peek(), giving its space back to the reader */
+static void
+capture_queue_pop(capture_queue *queue, capture_queue_rec *rec)
+{
+    guint32 next_head = (guint32)((guint8 *)rec - queue->slab) + rec->rec_len;
 
-            capture_loop_write_packet_cb((u_char *) queue_element->pcap_src,
-                                        &queue_element->u.phdr,
-                                        queue_element->pd);
+    if (next_head == queue->size)
+        next_head = 0;
+    g_atomic_int_set(&queue->head, (gint)next_head);
+    g_atomic_int_set(&queue->dequeued, queue->dequeued + 1);
+}
+
+/*
+ * Write the oldest of the packets at the heads of the packet queues.
+ * Each queue holds its source's packets in the order in which they were
+ * captured, so this merges them in timestamp order, as far as the
+ * sources' clocks agree.  Returns TRUE if there was a packet to write.
+ */
+static gboolean
+capture_loop_dequeue_packet(void) {
+    capture_src       *pcap_src;
+    capture_src       *oldest_src = NULL;
+    capture_queue_rec *rec;
+    capture_queue_rec *oldest = NULL;
+    guint              i;
+
+    for (i = 0; i < global_ld.pcaps->len; i++) {
+        pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+        rec = capture_queue_peek(&pcap_src->queue);
+        if (rec != NULL && (oldest == NULL || rec->ts < oldest->ts)) {
+            oldest = rec;
+            oldest_src = pcap_src;
         }
-        g_free(queue_element->pd);
-        g_free(queue_element);
-        return TRUE;
     }
-    return FALSE;
+    if (oldest == NULL)
+        return FALSE;
+
+    if (oldest_src->from_pcapng) {
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
+              "Dequeued a block of type 0x%08x of length %d captured on interface %d.",
+              oldest->u.bh.block_type, oldest->u.bh.block_total_length,
+              oldest_src->interface_id);
+
+        capture_loop_write_pcapng_cb(oldest_src, &oldest->u.bh,
+                                     CAPTURE_QUEUE_REC_DATA(oldest));
+    } else {
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
+            "Dequeued a packet of length %d captured on interface %d.",
+            oldest->u.phdr.caplen, oldest_src->interface_id);
+
+        capture_loop_write_packet_cb((u_char *) oldest_src, &oldest->u.phdr,
+                                     CAPTURE_QUEUE_REC_DATA(oldest));
+    }
+    capture_queue_pop(&oldest_src->queue, oldest);
+    return TRUE;
+}
+
+/*
+ * Size of the packet queue for a capture source: the byte limit, but
+ * big enough for at least two of the biggest packets it can give us.
+ */
+static guint32
+capture_queue_size(capture_src *pcap_src)
+{
+    guint32 max_len = MAX((guint32)pcap_src->snaplen, pcap_src->cap_pipe_max_pkt_size);
+    guint32 min_size;
+    gint64  size;
+
+    if (max_len == 0)
+        max_len = WTAP_MAX_PACKET_SIZE_STANDARD;
+    /* Leave room for the rest of a pcapng block. */
+    min_size = 2 * (CAPTURE_QUEUE_HDR_LEN + CAPTURE_QUEUE_ROUND(max_len + 256));
+    size = pcap_queue_byte_limit > 0 ? pcap_queue_byte_limit : DEFAULT_QUEUE_BYTE_LIMIT;
+    if (size > G_MAXINT - CAPTURE_QUEUE_ALIGN)
+        size = G_MAXINT - CAPTURE_QUEUE_ALIGN;
+    return MAX(min_size, CAPTURE_QUEUE_ROUND((guint32)size));
+}
+
+/* Report the high-water mark and drops of the packet queue of a capture source */
+static void
+report_queue_stats(capture_src *pcap_src, gchar *name)
+{
+    capture_queue *queue = &pcap_src->queue;
+
+    if (capture_child) {
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG,
+            "Queue for interface '%s': high-water mark %u packets/%u bytes of %u, %u dropped because it was full",
+            name, queue->hwm_packets, queue->hwm_bytes, queue->size, queue->full_drops);
+    } else {
+        fprintf(stderr,
+            "Queue for interface '%s': high-water mark %u packets/%u bytes of %u, %u dropped because it was full\n",
+            name, queue->hwm_packets, queue->hwm_bytes, queue->size, queue->full_drops);
+        fflush(stderr);
+    }
 }
 
 /* Do the low-level work of a capture.
@@ -3701,6 +4254,7 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     global_ld.pdh                 = NULL;
     global_ld.save_file_fd        = -1;
     global_ld.io_buffer           = NULL;
+    global_ld.batch_buffer        = NULL;
     global_ld.file_count          = 0;
     global_ld.file_duration_timer = NULL;
     global_ld.next_interval_time  = 0;
@@ -3717,9 +4271,26 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
                                  secondary_errmsg, sizeof(secondary_errmsg))) {
         goto error;
     }
-    for (i = 0; i < capture_opts->ifaces->len; i++) {
+    for (i = 0; i < global_ld.pcaps->len; i++) {
         pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
-        interface_opts = &g_array_index(capture_opts->ifaces, interface_options, i);
+        interface_opts = &g_array_index(capture_opts->ifaces, interface_options, pcap_src->interface_id);
+        if (pcap_src->tpacket != NULL) {
+            switch (capture_loop_init_tpacket(pcap_src, interface_opts->name, interface_opts->cfilter,
+                                              errmsg, sizeof(errmsg))) {
+
+            case INITFILTER_NO_ERROR:
+                break;
+
+            case INITFILTER_BAD_FILTER:
+                cfilter_error = TRUE;
+                error_index = pcap_src->interface_id;
+                goto error;
+
+            case INITFILTER_OTHER_ERROR:
+                goto error;
+            }
+            continue;
+        }
         /* init the input filter from the network interface (capture pipe will do nothing) */
         /*
          * When remote capturing WinPCap crashes when the capture filter
@@ -3811,9 +4382,10 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     /* WOW, everything is prepared! */
     /* please fasten your seat belts, we will enter now the actual capture loop */
     if (use_threads) {
-        pcap_queue = g_async_queue_new();
-        pcap_queue_bytes = 0;
-        pcap_queue_packets = 0;
+        for (i = 0; i < global_ld.pcaps->len; i++) {
+            pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+            capture_queue_init(&pcap_src->queue, capture_queue_size(pcap_src));
+        }
         for (i = 0; i < global_ld.pcaps->len; i++) {
             pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
             /* XXX - Add an interface name here? */
@@ -3823,12 +4395,13 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     while (global_ld.go) {
         /* dispatch incoming packets */
         if (use_threads) {
-            gboolean dequeued = capture_loop_dequeue_packet();
-
-            if (dequeued) {
-                inpkts = 1;
-            } else {
-                inpkts = 0;
+            inpkts = 0;
+            while (global_ld.go && inpkts < WRITER_THREAD_BATCH &&
+                   capture_loop_dequeue_packet()) {
+                inpkts++;
+            }
+            if (inpkts == 0) {
+                g_usleep(WRITER_THREAD_IDLE_SLEEP);
             }
         } else {
             pcap_src = g_array_index(global_ld.pcaps, capture_src *, 0);
@@ -3869,10 +4442,16 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             global_ld.inpkts_to_sync_pipe += inpkts;
 
             if (capture_opts->output_to_pipe) {
-                fflush(global_ld.pdh);
+                capture_loop_flush_output(&global_ld);
             }
         } /* inpkts */
 
+        /* Don't hold on to batched packets for longer than we were told to. */
+        if (global_ld.batch_buffer != NULL && global_ld.pdh != NULL &&
+            !pcapio_batch_flush_if_due(global_ld.pdh, &global_ld.batch, &global_ld.err)) {
+            global_ld.go = FALSE;
+        }
+
         /* Only update once every 500ms so as not to overload slow displays.
          * This also prevents too much context-switching between the dumpcap
          * and wireshark processes.
@@ -3899,7 +4478,7 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             /* Let the parent process know. */
             if (global_ld.inpkts_to_sync_pipe) {
                 /* do sync here */
-                fflush(global_ld.pdh);
+                capture_loop_flush_output(&global_ld);
 
                 /* Send our parent a message saying we've written out
                    "global_ld.inpkts_to_sync_pipe" packets to the capture file. */
@@ -3950,9 +4529,18 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             }
             global_ld.inpkts_to_sync_pipe += 1;
             if (capture_opts->output_to_pipe) {
-                fflush(global_ld.pdh);
+                capture_loop_flush_output(&global_ld);
             }
         }
+        for (i = 0; i < global_ld.pcaps->len; i++) {
+            pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+            capture_queue_free(&pcap_src->queue);
+        }
+    }
+
+    /* Make sure a write error on the last batch is reported below. */
+    if (global_ld.batch_buffer != NULL) {
+        capture_loop_flush_output(&global_ld);
     }
 
 
@@ -3963,7 +4551,7 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
         g_timer_destroy(autostop_duration_timer);
 
     /* did we have a pcap (input) error? */
-    for (i = 0; i < capture_opts->ifaces->len; i++) {
+    for (i = 0; i < global_ld.pcaps->len; i++) {
         pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
         if (pcap_src->pcap_err) {
             /* On Linux, if an interface goes down while you're capturing on it,
@@ -3990,7 +4578,11 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
                These should *not* be reported to the Wireshark developers. */
             char *cap_err_str;
 
-            cap_err_str = pcap_geterr(pcap_src->pcap_h);
+            if (pcap_src->tpacket != NULL) {
+                cap_err_str = (char *)tpacket_geterr(pcap_src->tpacket);
+            } else {
+                cap_err_str = pcap_geterr(pcap_src->pcap_h);
+            }
             if (strcmp(cap_err_str, "The interface went down") == 0 ||
                 strcmp(cap_err_str, "recvfrom: Network is down") == 0) {
                 report_capture_error("The network adapter on which the capture was being done "
@@ -4061,13 +4653,27 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
 
     /* get packet drop statistics from pcap */
     for (i = 0; i < capture_opts->ifaces->len; i++) {
-        guint32 received;
+        guint32 received, dropped, flushed;
         guint32 pcap_dropped = 0;
 
         pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
         interface_opts = &g_array_index(capture_opts->ifaces, interface_options, i);
         received = pcap_src->received;
-        if (pcap_src->pcap_h != NULL) {
+        dropped = pcap_src->dropped;
+        flushed = pcap_src->flushed;
+        if (pcap_src->tpacket != NULL) {
+            if (capture_loop_get_tpacket_counts(pcap_src, &received, &dropped, &flushed, &pcap_dropped)) {
+                *stats_known = TRUE;
+                stats->ps_recv = received;
+                stats->ps_drop = pcap_dropped;
+                stats->ps_ifdrop = 0;
+            } else {
+                g_snprintf(errmsg, sizeof(errmsg),
+                           "Can't get packet-drop statistics: %s",
+                           tpacket_geterr(pcap_src->tpacket));
+                report_capture_error(errmsg, please_report_bug());
+            }
+        } else if (pcap_src->pcap_h != NULL) {
             g_assert(!pcap_src->from_cap_pipe);
             /* Get the capture statistics, so we know how many packets were dropped. */
             if (pcap_stats(pcap_src->pcap_h, stats) >= 0) {
@@ -4081,7 +4687,10 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
                 report_capture_error(errmsg, please_report_bug());
             }
         }
-        report_packet_drops(received, pcap_dropped, pcap_src->dropped, pcap_src->flushed, stats->ps_ifdrop, interface_opts->display_name);
+        report_packet_drops(received, pcap_dropped, dropped, flushed, stats->ps_ifdrop, interface_opts->display_name);
+        if (use_threads) {
+            report_queue_stats(pcap_src, interface_opts->display_name);
+        }
     }
 
     /* close the input file (pcap or capture pipe) */
@@ -4133,6 +4742,8 @@ capture_loop_stop(void)
         pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
         if (pcap_src->pcap_h != NULL)
             pcap_breakloop(pcap_src->pcap_h);
+        if (pcap_src->tpacket != NULL)
+            tpacket_breakloop(pcap_src->tpacket);
     }
     global_ld.go = FALSE;
 }
@@ -4205,7 +4816,7 @@ capture_loop_wrote_one_packet(capture_src *pcap_src) {
 
     /* check -c NUM / -a packets:NUM */
     if (global_capture_opts.has_autostop_packets && global_ld.packets_captured >= global_capture_opts.autostop_packets) {
-        fflush(global_ld.pdh);
+        capture_loop_flush_output(&global_ld);
         global_ld.go = FALSE;
         return;
     }
@@ -4264,12 +4875,20 @@ capture_loop_write_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t
         /* We're supposed to write the packet to a file; do so.
            If this fails, set "ld->go" to FALSE, to stop the capture, and set
            "ld->err" to the error. */
-        successful = pcapng_write_block(global_ld.pdh,
-                                       pd,
-                                       bh->block_total_length,
-                                       &global_ld.bytes_written, &err);
+        if (global_ld.batch_buffer != NULL) {
+            successful = pcapng_batch_block(global_ld.pdh,
+                                            &global_ld.batch,
+                                            pd,
+                                            bh->block_total_length,
+                                            &global_ld.bytes_written, &err);
+        } else {
+            successful = pcapng_write_block(global_ld.pdh,
+                                           pd,
+                                           bh->block_total_length,
+                                           &global_ld.bytes_written, &err);
 
-        fflush(global_ld.pdh);
+            fflush(global_ld.pdh);
+        }
         if (!successful) {
             global_ld.go = FALSE;
             global_ld.err = err;
@@ -4311,7 +4930,26 @@ capture_loop_write_packet_cb(u_char *pcap_src_p, const struct pcap_pkthdr *phdr,
         /* We're supposed to write the packet to a file; do so.
            If this fails, set "ld->go" to FALSE, to stop the capture, and set
            "ld->err" to the error. */
-        if (global_capture_opts.use_pcapng) {
+        if (global_ld.batch_buffer != NULL) {
+            if (global_capture_opts.use_pcapng) {
+                successful = pcapng_batch_enhanced_packet_block(global_ld.pdh,
+                                                                &global_ld.batch,
+                                                                NULL,
+                                                                phdr->ts.tv_sec, (gint32)phdr->ts.tv_usec,
+                                                                phdr->caplen, phdr->len,
+                                                                pcap_src->interface_id,
+                                                                ts_mul,
+                                                                pd, 0,
+                                                                &global_ld.bytes_written, &err);
+            } else {
+                successful = libpcap_batch_packet(global_ld.pdh,
+                                                  &global_ld.batch,
+                                                  phdr->ts.tv_sec, (gint32)phdr->ts.tv_usec,
+                                                  phdr->caplen, phdr->len,
+                                                  pd,
+                                                  &global_ld.bytes_written, &err);
+            }
+        } else if (global_capture_opts.use_pcapng) {
             successful = pcapng_write_enhanced_packet_block(global_ld.pdh,
                                                             NULL,
                                                             phdr->ts.tv_sec, (gint32)phdr->ts.tv_usec,
@@ -4347,9 +4985,9 @@ static void
 capture_loop_queue_packet_cb(u_char *pcap_src_p, const struct pcap_pkthdr *phdr,
                              const u_char *pd)
 {
-    capture_src        *pcap_src = (capture_src *) (void *) pcap_src_p;
-    pcap_queue_element *queue_element;
-    gboolean            limit_reached;
+    capture_src       *pcap_src = (capture_src *) (void *) pcap_src_p;
+    capture_queue_rec *rec;
+    gint               next_tail;
 
     /* We may be called multiple times from pcap_dispatch(); if we've set
        the "stop capturing" flag, ignore this packet, as we're not
@@ -4359,57 +4997,31 @@ capture_loop_queue_packet_cb(u_char *pcap_src_p, const struct pcap_pkthdr *phdr,
         return;
     }
 
-    queue_element = (pcap_queue_element *)g_malloc(sizeof(pcap_queue_element));
-    if (queue_element == NULL) {
-       pcap_src->dropped++;
-       return;
-    }
-    queue_element->pcap_src = pcap_src;
-    queue_element->u.phdr = *phdr;
-    queue_element->pd = (u_char *)g_malloc(phdr->caplen);
-    if (queue_element->pd == NULL) {
+    rec = capture_queue_reserve(&pcap_src->queue, phdr->caplen, &next_tail);
+    if (rec == NULL) {
         pcap_src->dropped++;
-        g_free(queue_element);
-        return;
-    }
-    memcpy(queue_element->pd, pd, phdr->caplen);
-    g_async_queue_lock(pcap_queue);
-    if (((pcap_queue_byte_limit == 0) || (pcap_queue_bytes < pcap_queue_byte_limit)) &&
-        ((pcap_queue_packet_limit == 0) || (pcap_queue_packets < pcap_queue_packet_limit))) {
-        limit_reached = FALSE;
-        g_async_queue_push_unlocked(pcap_queue, queue_element);
-        pcap_queue_bytes += phdr->caplen;
-        pcap_queue_packets += 1;
-    } else {
-        limit_reached = TRUE;
-    }
-    g_async_queue_unlock(pcap_queue);
-    if (limit_reached) {
-        pcap_src->dropped++;
-        g_free(queue_element->pd);
-        g_free(queue_element);
         g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
               "Dropped a packet of length %d captured on interface %u.",
               phdr->caplen, pcap_src->interface_id);
-    } else {
-        pcap_src->received++;
-        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-              "Queued a packet of length %d captured on interface %u.",
-              phdr->caplen, pcap_src->interface_id);
+        return;
     }
-    /* I don't want to hold the mutex over the debug output. So the
-       output may be wrong */
+    rec->u.phdr = *phdr;
+    rec->ts = (guint64)phdr->ts.tv_sec * 1000000000 +
+              (guint64)phdr->ts.tv_usec * (pcap_src->ts_nsec ? 1 : 1000);
+    memcpy(CAPTURE_QUEUE_REC_DATA(rec), pd, phdr->caplen);
+    capture_queue_commit(&pcap_src->queue, next_tail);
+    pcap_src->received++;
     g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-          "Queue size is now %" G_GINT64_MODIFIER "d bytes (%" G_GINT64_MODIFIER "d packets)",
-          pcap_queue_bytes, pcap_queue_packets);
+          "Queued a packet of length %d captured on interface %u.",
+          phdr->caplen, pcap_src->interface_id);
 }
 
 /* one pcapng block was captured, queue it */
 static void
 capture_loop_queue_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t *bh, u_char *pd)
 {
-    pcap_queue_element *queue_element;
-    gboolean            limit_reached;
+    capture_queue_rec *rec;
+    gint               next_tail;
 
     /* We may be called multiple times from pcap_dispatch(); if we've set
        the "stop capturing" flag, ignore this packet, as we're not
@@ -4419,49 +5031,23 @@ capture_loop_queue_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t
         return;
     }
 
-    queue_element = (pcap_queue_element *)g_malloc(sizeof(pcap_queue_element));
-    if (queue_element == NULL) {
-       pcap_src->dropped++;
-       return;
-    }
-    queue_element->pcap_src = pcap_src;
-    queue_element->u.bh = *bh;
-    queue_element->pd = (u_char *)g_malloc(bh->block_total_length);
-    if (queue_element->pd == NULL) {
+    rec = capture_queue_reserve(&pcap_src->queue, bh->block_total_length, &next_tail);
+    if (rec == NULL) {
         pcap_src->dropped++;
-        g_free(queue_element);
-        return;
-    }
-    memcpy(queue_element->pd, pd, bh->block_total_length);
-    g_async_queue_lock(pcap_queue);
-    if (((pcap_queue_byte_limit == 0) || (pcap_queue_bytes < pcap_queue_byte_limit)) &&
-        ((pcap_queue_packet_limit == 0) || (pcap_queue_packets < pcap_queue_packet_limit))) {
-        limit_reached = FALSE;
-        g_async_queue_push_unlocked(pcap_queue, queue_element);
-        pcap_queue_bytes += bh->block_total_length;
-        pcap_queue_packets += 1;
-    } else {
-        limit_reached = TRUE;
-    }
-    g_async_queue_unlock(pcap_queue);
-    if (limit_reached) {
-        pcap_src->dropped++;
-        g_free(queue_element->pd);
-        g_free(queue_element);
         g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
               "Dropped a packet of length %d captured on interface %u.",
               bh->block_total_length, pcap_src->interface_id);
-    } else {
-        pcap_src->received++;
-        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-              "Queued a block of type 0x%08x of length %d captured on interface %u.",
-              bh->block_type, bh->block_total_length, pcap_src->interface_id);
+        return;
     }
-    /* I don't want to hold the mutex over the debug output. So the
-       output may be wrong */
+    rec->u.bh = *bh;
+    /* The block's own time stamp, if any, depends on its IDB; use the arrival time. */
+    rec->ts = (guint64)g_get_real_time() * 1000;
+    memcpy(CAPTURE_QUEUE_REC_DATA(rec), pd, bh->block_total_length);
+    capture_queue_commit(&pcap_src->queue, next_tail);
+    pcap_src->received++;
     g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-          "Queue size is now %" G_GINT64_MODIFIER "d bytes (%" G_GINT64_MODIFIER "d packets)",
-          pcap_queue_bytes, pcap_queue_packets);
+          "Queued a block of type 0x%08x of length %d captured on interface %u.",
+          bh->block_type, bh->block_total_length, pcap_src->interface_id);
 }
 
 static int
@@ -4545,10 +5131,26 @@ main(int argc, char *argv[])
 {
     char             *err_msg;
     int               opt;
+#define LONGOPT_WRITE_BATCH_SIZE  LONGOPT_BASE_APPLICATION+1
+#define LONGOPT_WRITE_BATCH_DELAY LONGOPT_BASE_APPLICATION+2
+#define LONGOPT_ASYNC_OUTPUT      LONGOPT_BASE_APPLICATION+3
+#define LONGOPT_TPACKET           LONGOPT_BASE_APPLICATION+4
+#define LONGOPT_TPACKET_FANOUT    LONGOPT_BASE_APPLICATION+5
+#define LONGOPT_COMPRESS          LONGOPT_BASE_APPLICATION+6
+#define LONGOPT_RING_SPARE_FILES  LONGOPT_BASE_APPLICATION+7
+#define LONGOPT_COMPRESS_FILES    LONGOPT_BASE_APPLICATION+8
     static const struct option long_options[] = {
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'v'},
         LONGOPT_CAPTURE_COMMON
+        {"write-batch-size", required_argument, NULL, LONGOPT_WRITE_BATCH_SIZE},
+        {"write-batch-delay", required_argument, NULL, LONGOPT_WRITE_BATCH_DELAY},
+        {"async-output", required_argument, NULL, LONGOPT_ASYNC_OUTPUT},
+        {"tpacket", no_argument, NULL, LONGOPT_TPACKET},
+        {"tpacket-fanout", required_argument, NULL, LONGOPT_TPACKET_FANOUT},
+        {"compress", required_argument, NULL, LONGOPT_COMPRESS},
+        {"ring-spare-files", required_argument, NULL, LONGOPT_RING_SPARE_FILES},
+        {"compress-files", required_argument, NULL, LONGOPT_COMPRESS_FILES},
         {0, 0, 0, 0 }
     };
 
@@ -4977,6 +5579,61 @@ main(int argc, char *argv[])
         case 'N':
             pcap_queue_packet_limit = get_positive_int(optarg, "packet_limit");
             break;
+        case LONGOPT_WRITE_BATCH_SIZE:
+            write_batch_size = (size_t)get_natural_int(optarg, "write batch size") * 1024;
+            break;
+        case LONGOPT_WRITE_BATCH_DELAY:
+            write_batch_delay = get_positive_int(optarg, "write batch delay");
+            break;
+        case LONGOPT_ASYNC_OUTPUT:
+            if (!aio_output_supported()) {
+                cmdarg_err("Asynchronous output isn't supported on this platform");
+                arg_error = TRUE;
+                break;
+            }
+            aio_queue_depth = get_positive_int(optarg, "asynchronous output queue depth");
+            if (aio_queue_depth > AIO_OUTPUT_MAX_QUEUE_DEPTH) {
+                cmdarg_err("The asynchronous output queue depth can't be more than %d",
+                           AIO_OUTPUT_MAX_QUEUE_DEPTH);
+                arg_error = TRUE;
+            }
+            break;
+        case LONGOPT_COMPRESS:
+        case LONGOPT_COMPRESS_FILES:
+        {
+            int type = compress_output_type_from_name(optarg);
+
+            if (type < 0) {
+                cmdarg_err("\"%s\" isn't a compression type supported by this build; use one of: %s",
+                           optarg, compress_output_type_names());
+                arg_error = TRUE;
+                break;
+            }
+            if (opt == LONGOPT_COMPRESS)
+                compress_type = (compress_output_type_t)type;
+            else
+                compress_files_type = (compress_output_type_t)type;
+            break;
+        }
+        case LONGOPT_RING_SPARE_FILES:
+            if (!ringbuf_spare_files_supported()) {
+                cmdarg_err("Ring buffer spare files aren't supported on this platform");
+                arg_error = TRUE;
+                break;
+            }
+            ring_spare_files = get_positive_int(optarg, "number of ring buffer spare files");
+            break;
+        case LONGOPT_TPACKET_FANOUT:
+            tpacket_fanout = get_positive_int(optarg, "number of fanout rings");
+            /* FALLTHROUGH */
+        case LONGOPT_TPACKET:
+            if (!tpacket_supported()) {
+                cmdarg_err("TPACKET_V3 capture isn't supported on this platform");
+                arg_error = TRUE;
+                break;
+            }
+            use_tpacket = TRUE;
+            break;
         default:
             cmdarg_err("Invalid Option: %s", argv[optind-1]);
             /* FALLTHROUGH */
@@ -5007,11 +5664,9 @@ main(int argc, char *argv[])
     if ((pcap_queue_byte_limit > 0) || (pcap_queue_packet_limit > 0)) {
         use_threads = TRUE;
     }
-    if ((pcap_queue_byte_limit == 0) && (pcap_queue_packet_limit == 0)) {
-        /* Use some default if the user hasn't specified some */
-        /* XXX: Are these defaults good enough? */
-        pcap_queue_byte_limit = 1000 * 1000;
-        pcap_queue_packet_limit = 1000;
+    if (tpacket_fanout > 1) {
+        /* Each ring in a fanout group is read by its own thread. */
+        use_threads = TRUE;
     }
     if (arg_error) {
         print_usage(stderr);
@@ -5069,6 +5724,13 @@ main(int argc, char *argv[])
                 cmdarg_err("Ring buffer file duration and interval can't be used at the same time.");
                 exit_main(1);
             }
+            if (compress_type != COMPRESS_OUTPUT_NONE && compress_files_type != COMPRESS_OUTPUT_NONE) {
+                cmdarg_err("Ring buffer files can't be compressed both as they're written and once they're completed.");
+                exit_main(1);
+            }
+        } else if (compress_files_type != COMPRESS_OUTPUT_NONE) {
+            cmdarg_err("Compressing completed files requires a ring buffer.");
+            exit_main(1);
         }
     }
 
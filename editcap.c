@@ -68,6 +68,7 @@
 #include "wsutil/filesystem.h"
 #include "wsutil/file_util.h"
 #include "wsutil/wsgcrypt.h"
+#include "wsutil/xxhash64.h"
 #include "wsutil/plugins.h"
 #include "wsutil/privileges.h"
 #include "wsutil/report_message.h"
@@ -107,6 +108,8 @@ typedef struct _fd_hash_t {
     guint8     digest[16];
     guint32    len;
     nstime_t   frame_time;
+    int        prev;        /* newer entry in the same bucket, or -1 */
+    int        next;        /* older entry in the same bucket, or -1 */
 } fd_hash_t;
 
 #define DEFAULT_DUP_DEPTH       5   /* Used with -d */
@@ -116,6 +119,22 @@ static fd_hash_t fd_hash[MAX_DUP_DEPTH];
 static int       dup_window    = DEFAULT_DUP_DEPTH;
 static int       cur_dup_entry = 0;
 
+/*
+ * fd_hash[] is a ring of the last dup_window digests.  So that we don't
+ * have to scan all of it for every packet, each entry is also on a
+ * doubly-linked chain hanging off fd_hash_buckets[], newest first;
+ * an entry is unlinked when the ring wraps around and overwrites it.
+ */
+static int      *fd_hash_buckets = NULL;
+static guint32   fd_hash_mask    = 0;
+
+typedef enum {
+    DUP_HASH_XXHASH,    /* two 64-bit XXH64 hashes with different seeds */
+    DUP_HASH_MD5
+} dup_hash_t;
+
+static dup_hash_t dup_hash = DUP_HASH_XXHASH;
+
 static guint32   ignored_bytes  = 0;  /* Used with -I */
 
 #define ONE_BILLION 1000000000
@@ -157,6 +176,7 @@ static struct select_item     selectfrm[MAX_SELECTIONS];
 static guint                  max_selected              = 0;
 static int                    keep_em                   = 0;
 static int                    out_file_type_subtype     = WTAP_FILE_TYPE_SUBTYPE_PCAPNG; /* default to pcapng   */
+static wtap_compression_type  out_compression_type      = WTAP_UNCOMPRESSED;
 static int                    out_frame_type            = -2; /* Leave frame type alone */
 static int                    verbose                   = 0;  /* Not so verbose         */
 static struct time_adjustment time_adj                  = {NSTIME_INIT_ZERO, 0}; /* no adjustment */
@@ -586,10 +606,122 @@ remove_vlan_info(const wtap_packet_header *phdr, guint8* fd, guint32* len) {
     }
 }
 
+static const char *
+dup_hash_name(void)
+{
+    return dup_hash == DUP_HASH_MD5 ? "MD5" : "XXH64";
+}
+
+static void
+fd_hash_init(void)
+{
+    guint32 nbuckets = 1;
+    guint32 i;
+    int j;
+
+    /* Keep the load factor at or below 1/2 */
+    while (nbuckets < 2 * (guint32)dup_window)
+        nbuckets <<= 1;
+    fd_hash_buckets = g_new(int, nbuckets);
+    for (i = 0; i < nbuckets; i++)
+        fd_hash_buckets[i] = -1;
+    fd_hash_mask = nbuckets - 1;
+
+    /* A window of 0 still uses fd_hash[0] */
+    for (j = 0; j < MAX(dup_window, 1); j++) {
+        memset(&fd_hash[j].digest, 0, 16);
+        fd_hash[j].len = 0;
+        nstime_set_unset(&fd_hash[j].frame_time);
+        fd_hash[j].prev = -1;
+        fd_hash[j].next = -1;
+    }
+    cur_dup_entry = 0;
+}
+
+static guint32
+fd_hash_bucket(const fd_hash_t *entry)
+{
+    guint64 h;
+
+    /* Both digests are already well mixed; fold in the length */
+    memcpy(&h, entry->digest, sizeof h);
+    h ^= entry->len * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+    return (guint32)(h ^ (h >> 32)) & fd_hash_mask;
+}
+
+static void
+fd_hash_unlink(int i)
+{
+    fd_hash_t *entry = &fd_hash[i];
+
+    if (entry->prev != -1) {
+        fd_hash[entry->prev].next = entry->next;
+    } else {
+        guint32 bucket = fd_hash_bucket(entry);
+
+        if (fd_hash_buckets[bucket] != i)
+            return;     /* never filled in */
+        fd_hash_buckets[bucket] = entry->next;
+    }
+    if (entry->next != -1)
+        fd_hash[entry->next].prev = entry->prev;
+    entry->prev = -1;
+    entry->next = -1;
+}
+
+static void
+fd_hash_link(int i, guint32 bucket)
+{
+    fd_hash[i].prev = -1;
+    fd_hash[i].next = fd_hash_buckets[bucket];
+    if (fd_hash[i].next != -1)
+        fd_hash[fd_hash[i].next].prev = i;
+    fd_hash_buckets[bucket] = i;
+}
+
+/*
+ * Advance to the next (i.e. oldest) entry of the ring, evict it and
+ * fill it in with the digest of "data" and the frame length "len".
+ * Returns the entry's bucket; the caller links it in once it has
+ * looked for duplicates.
+ */
+static guint32
+fd_hash_store(const guint8 *data, guint32 data_len, guint32 len)
+{
+    fd_hash_t *entry;
+
+    cur_dup_entry++;
+    if (cur_dup_entry >= dup_window)
+        cur_dup_entry = 0;
+
+    entry = &fd_hash[cur_dup_entry];
+    fd_hash_unlink(cur_dup_entry);
+
+    /* Calculate our digest */
+    if (dup_hash == DUP_HASH_MD5) {
+        gcry_md_hash_buffer(GCRY_MD_MD5, entry->digest, data, data_len);
+    } else {
+        phton64(entry->digest, xxhash64(data, data_len, 0));
+        phton64(entry->digest + 8, xxhash64(data, data_len, G_GUINT64_CONSTANT(0x5A17D3C9E4B1F068)));
+    }
+    entry->len = len;
+
+    return fd_hash_bucket(entry);
+}
+
+static gboolean
+fd_hash_match(int i)
+{
+    return fd_hash[i].len == fd_hash[cur_dup_entry].len
+        && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0;
+}
+
 static gboolean
 is_duplicate(guint8* fd, guint32 len) {
     int i;
     const struct ieee80211_radiotap_header* tap_header;
+    gboolean found = FALSE;
+    guint32 bucket;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     guint32 offset = ignored_bytes;
@@ -611,32 +743,26 @@ is_duplicate(guint8* fd, guint32 len) {
     new_fd  = &fd[offset];
     new_len = len - (offset);
 
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
-
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
-
-    fd_hash[cur_dup_entry].len = len;
+    bucket = fd_hash_store(new_fd, new_len, len);
 
     /* Look for duplicates */
-    for (i = 0; i < dup_window; i++) {
-        if (i == cur_dup_entry)
-            continue;
-
-        if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-            && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return TRUE;
+    for (i = fd_hash_buckets[bucket]; i != -1; i = fd_hash[i].next) {
+        if (fd_hash_match(i)) {
+            found = TRUE;
+            break;
         }
     }
 
-    return FALSE;
+    fd_hash_link(cur_dup_entry, bucket);
+
+    return found;
 }
 
 static gboolean
 is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
     int i;
+    gboolean found = FALSE;
+    guint32 bucket;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     guint32 offset = ignored_bytes;
@@ -650,60 +776,28 @@ is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
     new_fd  = &fd[offset];
     new_len = len - (offset);
 
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
-
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
-
-    fd_hash[cur_dup_entry].len = len;
+    bucket = fd_hash_store(new_fd, new_len, len);
     fd_hash[cur_dup_entry].frame_time.secs = current->secs;
     fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
 
     /*
      * Look for relative time related duplicates.
-     * This is hopefully a reasonably efficient mechanism for
-     * finding duplicates by rel time in the fd_hash[] cache.
-     * We check starting from the most recently added hash
-     * entries and work backwards towards older packets.
-     * This approach allows the dup test to be terminated
-     * when the relative time of a cached entry is found to
-     * be beyond the dup time window.
+     * Only cached packets with the same length and digest are on
+     * the chain we walk, newest first, so we can stop as soon as
+     * one of them is beyond the dup time window.
      *
      * Of course this assumes that the input trace file is
      * "well-formed" in the sense that the packet timestamps are
      * in strict chronologically increasing order (which is NOT
      * always the case!!).
-     *
-     * The fd_hash[] table was deliberately created large (1,000,000).
-     * Looking for time related duplicates in large trace files with
-     * non-fractional dup time window values can potentially take
-     * a long time to complete.
      */
 
-    for (i = cur_dup_entry - 1;; i--) {
+    for (i = fd_hash_buckets[bucket]; i != -1; i = fd_hash[i].next) {
         nstime_t delta;
         int cmp;
 
-        if (i < 0)
-            i = dup_window - 1;
-
-        if (i == cur_dup_entry) {
-            /*
-             * We've decremented back to where we started.
-             * Check no more!
-             */
-            break;
-        }
-
-        if (nstime_is_unset(&(fd_hash[i].frame_time))) {
-            /*
-             * We've decremented to an unused fd_hash[] entry.
-             * Check no more!
-             */
-            break;
-        }
+        if (!fd_hash_match(i))
+            continue;
 
         nstime_delta(&delta, current, &fd_hash[i].frame_time);
 
@@ -738,13 +832,15 @@ is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
              * Check no more!
              */
             break;
-        } else if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-                   && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return TRUE;
         }
+
+        found = TRUE;
+        break;
     }
 
-    return FALSE;
+    fd_hash_link(cur_dup_entry, bucket);
+
+    return found;
 }
 
 static void
@@ -769,11 +865,13 @@ print_usage(FILE *output)
     fprintf(output, "  -D <dup window>        remove packet if duplicate; configurable <dup window>.\n");
     fprintf(output, "                         Valid <dup window> values are 0 to %d.\n", MAX_DUP_DEPTH);
     fprintf(output, "                         NOTE: A <dup window> of 0 with -v (verbose option) is\n");
-    fprintf(output, "                         useful to print MD5 hashes.\n");
+    fprintf(output, "                         useful to print packet hashes.\n");
     fprintf(output, "  -w <dup time window>   remove packet if duplicate packet is found EQUAL TO OR\n");
     fprintf(output, "                         LESS THAN <dup time window> prior to current packet.\n");
     fprintf(output, "                         A <dup time window> is specified in relative seconds\n");
     fprintf(output, "                         (e.g. 0.000001).\n");
+    fprintf(output, "  --dup-hash <xxhash|md5>\n");
+    fprintf(output, "                         hash used to compare packets; default is xxhash.\n");
     fprintf(output, "           NOTE: The use of the 'Duplicate packet removal' options with\n");
     fprintf(output, "           other editcap options except -v may not always work as expected.\n");
     fprintf(output, "           Specifically the -r, -t or -S options will very likely NOT have the\n");
@@ -814,7 +912,7 @@ print_usage(FILE *output)
     fprintf(output, "                         the pseudo-random number generator. This allows one to\n");
     fprintf(output, "                         repeat a particular sequence of errors.\n");
     fprintf(output, "  -I <bytes to ignore>   ignore the specified number of bytes at the beginning\n");
-    fprintf(output, "                         of the frame during MD5 hash calculation, unless the\n");
+    fprintf(output, "                         of the frame during hash calculation, unless the\n");
     fprintf(output, "                         frame is too short, then the full frame is used.\n");
     fprintf(output, "                         Useful to remove duplicated packets taken on\n");
     fprintf(output, "                         several routers (different mac addresses for\n");
@@ -835,6 +933,8 @@ print_usage(FILE *output)
     fprintf(output, "  -T <encap type>        set the output file encapsulation type; default is the\n");
     fprintf(output, "                         same as the input file. An empty \"-T\" option will\n");
     fprintf(output, "                         list the encapsulation types.\n");
+    fprintf(output, "  --compress <type>      compress the output file(s) with <type>, one of\n");
+    fprintf(output, "                         \"gz\", \"zst\" or \"lz4\"; default is \"none\".\n");
     fprintf(output, "  --inject-secrets <type>,<file>  Insert decryption secrets from <file>. List\n");
     fprintf(output, "                         supported secret types with \"--inject-secrets help\".\n");
     fprintf(output, "  --discard-all-secrets  Discard all decryption secrets from the input file\n");
@@ -854,7 +954,7 @@ print_usage(FILE *output)
     fprintf(output, "  -v                     verbose output.\n");
     fprintf(output, "                         If -v is used with any of the 'Duplicate Packet\n");
     fprintf(output, "                         Removal' options (-d, -D or -w) then Packet lengths\n");
-    fprintf(output, "                         and MD5 hashes are printed to standard-error.\n");
+    fprintf(output, "                         and hashes are printed to standard-error.\n");
 }
 
 struct string_elem {
@@ -1003,10 +1103,10 @@ editcap_dump_open(const char *filename, const wtap_dump_params *params,
 
     if (strcmp(filename, "-") == 0) {
         /* Write to the standard output. */
-        pdh = wtap_dump_open_stdout(out_file_type_subtype, WTAP_UNCOMPRESSED,
+        pdh = wtap_dump_open_stdout(out_file_type_subtype, out_compression_type,
                                     params, write_err);
     } else {
-        pdh = wtap_dump_open(filename, out_file_type_subtype, WTAP_UNCOMPRESSED,
+        pdh = wtap_dump_open(filename, out_file_type_subtype, out_compression_type,
                              params, write_err);
     }
     return pdh;
@@ -1028,6 +1128,8 @@ main(int argc, char *argv[])
 #define LONGOPT_DISCARD_ALL_SECRETS  LONGOPT_BASE_APPLICATION+5
 #define LONGOPT_CAPTURE_COMMENT      LONGOPT_BASE_APPLICATION+6
 #define LONGOPT_DISCARD_CAPTURE_COMMENT LONGOPT_BASE_APPLICATION+7
+#define LONGOPT_DUP_HASH             LONGOPT_BASE_APPLICATION+8
+#define LONGOPT_COMPRESS             LONGOPT_BASE_APPLICATION+9
 
     static const struct option long_options[] = {
         {"novlan", no_argument, NULL, LONGOPT_NO_VLAN},
@@ -1039,6 +1141,8 @@ main(int argc, char *argv[])
         {"version", no_argument, NULL, 'V'},
         {"capture-comment", required_argument, NULL, LONGOPT_CAPTURE_COMMENT},
         {"discard-capture-comment", no_argument, NULL, LONGOPT_DISCARD_CAPTURE_COMMENT},
+        {"dup-hash", required_argument, NULL, LONGOPT_DUP_HASH},
+        {"compress", required_argument, NULL, LONGOPT_COMPRESS},
         {0, 0, 0, 0 }
     };
 
@@ -1194,6 +1298,35 @@ main(int argc, char *argv[])
             break;
         }
 
+        case LONGOPT_DUP_HASH:
+        {
+            if (g_ascii_strcasecmp(optarg, "xxhash") == 0) {
+                dup_hash = DUP_HASH_XXHASH;
+            } else if (g_ascii_strcasecmp(optarg, "md5") == 0) {
+                dup_hash = DUP_HASH_MD5;
+            } else {
+                fprintf(stderr, "editcap: \"%s\" isn't a valid duplicate hash; use \"xxhash\" or \"md5\".\n",
+                        optarg);
+                ret = INVALID_OPTION;
+                goto clean_exit;
+            }
+            break;
+        }
+
+        case LONGOPT_COMPRESS:
+        {
+            int compression_type = wtap_name_to_compression_type(optarg);
+
+            if (compression_type < 0) {
+                fprintf(stderr, "editcap: \"%s\" isn't a valid compression type, or isn't supported in this build.\n",
+                        optarg);
+                ret = INVALID_OPTION;
+                goto clean_exit;
+            }
+            out_compression_type = (wtap_compression_type)compression_type;
+            break;
+        }
+
         case 'a':
         {
             guint frame_number;
@@ -1651,11 +1784,7 @@ invalid_time:
         max_packet_number = G_MAXUINT;
 
     if (dup_detect || dup_detect_by_time) {
-        for (i = 0; i < dup_window; i++) {
-            memset(&fd_hash[i].digest, 0, 16);
-            fd_hash[i].len = 0;
-            nstime_set_unset(&fd_hash[i].frame_time);
-        }
+        fd_hash_init();
     }
 
     /* Read all of the packets in turn */
@@ -1946,9 +2075,10 @@ invalid_time:
                 if (dup_detect) {
                     if (is_duplicate(buf, rec->rec_header.packet_header.caplen)) {
                         if (verbose) {
-                            fprintf(stderr, "Skipped: %u, Len: %u, MD5 Hash: ",
+                            fprintf(stderr, "Skipped: %u, Len: %u, %s Hash: ",
                                     count,
-                                    rec->rec_header.packet_header.caplen);
+                                    rec->rec_header.packet_header.caplen,
+                                    dup_hash_name());
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
                                         (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1959,9 +2089,10 @@ invalid_time:
                         continue;
                     } else {
                         if (verbose) {
-                            fprintf(stderr, "Packet: %u, Len: %u, MD5 Hash: ",
+                            fprintf(stderr, "Packet: %u, Len: %u, %s Hash: ",
                                     count,
-                                    rec->rec_header.packet_header.caplen);
+                                    rec->rec_header.packet_header.caplen,
+                                    dup_hash_name());
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
                                         (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1982,9 +2113,10 @@ invalid_time:
                                                   rec->rec_header.packet_header.caplen,
                                                   &current)) {
                             if (verbose) {
-                                fprintf(stderr, "Skipped: %u, Len: %u, MD5 Hash: ",
+                                fprintf(stderr, "Skipped: %u, Len: %u, %s Hash: ",
                                         count,
-                                        rec->rec_header.packet_header.caplen);
+                                        rec->rec_header.packet_header.caplen,
+                                        dup_hash_name());
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
                                             (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1995,9 +2127,10 @@ invalid_time:
                             continue;
                         } else {
                             if (verbose) {
-                                fprintf(stderr, "Packet: %u, Len: %u, MD5 Hash: ",
+                                fprintf(stderr, "Packet: %u, Len: %u, %s Hash: ",
                                         count,
-                                        rec->rec_header.packet_header.caplen);
+                                        rec->rec_header.packet_header.caplen,
+                                        dup_hash_name());
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
                                             (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -2203,6 +2336,7 @@ clean_exit:
         g_ptr_array_free(capture_comments, TRUE);
         capture_comments = NULL;
     }
+    g_free(fd_hash_buckets);
     return ret;
 }
 
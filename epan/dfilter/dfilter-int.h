@@ -19,6 +19,7 @@
 struct epan_dfilter {
 	GPtrArray	*insns;
 	GPtrArray	*consts;
+	struct _dfvm_code *code;	/* insns, linked by dfvm_link() */
 	guint		num_registers;
 	guint		max_registers;
 	GList		**registers;
@@ -27,11 +28,14 @@ struct epan_dfilter {
 	int		*interesting_fields;
 	int		num_interesting_fields;
 	GPtrArray	*deprecated;
+	GPtrArray	*optimizations;
+	struct _prefilter *prefilter;	/* NULL if there's none */
 };
 
 typedef struct {
 	/* Syntax Tree stuff */
 	stnode_t	*st_root;
+	guint		flags;		/* DF_ flags given to dfilter_compile_flags() */
 	gboolean	syntax_error;
 	gchar		*error_message;
 	GPtrArray	*insns;
@@ -42,6 +46,7 @@ typedef struct {
 	int		next_const_id;
 	int		next_register;
 	int		first_constant; /* first register used as a constant */
+	GPtrArray	*optimizations;	/* what dfw_optimize() and dfw_gencode() did */
 } dfwork_t;
 
 /*
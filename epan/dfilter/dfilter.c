@@ -14,6 +14,8 @@
 #include "dfilter-int.h"
 #include "syntax-tree.h"
 #include "gencode.h"
+#include "optimize.h"
+#include "prefilter.h"
 #include "semcheck.h"
 #include "dfvm.h"
 #include <epan/epan_dissect.h>
@@ -130,6 +132,7 @@ dfilter_free(dfilter_t *df)
 	if (df->consts) {
 		free_insns(df->consts);
 	}
+	g_free(df->code);
 
 	g_free(df->interesting_fields);
 
@@ -147,6 +150,12 @@ dfilter_free(dfilter_t *df)
 		g_ptr_array_free(df->deprecated, TRUE);
 	}
 
+	if (df->optimizations) {
+		g_ptr_array_free(df->optimizations, TRUE);
+	}
+
+	prefilter_free(df->prefilter);
+
 	g_free(df->registers);
 	g_free(df->attempted_load);
 	g_free(df->owns_memory);
@@ -161,6 +170,7 @@ dfwork_new(void)
 
 	dfw = g_new0(dfwork_t, 1);
 	dfw->first_constant = -1;
+	dfw->optimizations = g_ptr_array_new_with_free_func(g_free);
 
 	return dfw;
 }
@@ -188,6 +198,10 @@ dfwork_free(dfwork_t *dfw)
 		free_insns(dfw->consts);
 	}
 
+	if (dfw->optimizations) {
+		g_ptr_array_free(dfw->optimizations, TRUE);
+	}
+
 	/*
 	 * We don't free the error message string; our caller will return
 	 * it to its caller.
@@ -197,6 +211,13 @@ dfwork_free(dfwork_t *dfw)
 
 gboolean
 dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
+{
+	return dfilter_compile_flags(text, dfp, err_msg, 0);
+}
+
+gboolean
+dfilter_compile_flags(const gchar *text, dfilter_t **dfp, gchar **err_msg,
+		guint flags)
 {
 	gchar		*expanded_text;
 	int		token;
@@ -208,6 +229,7 @@ dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 	gboolean failure = FALSE;
 	const char	*depr_test;
 	guint		i;
+	prefilter_t	*prefilter;
 	/* XXX, GHashTable */
 	GPtrArray	*deprecated;
 
@@ -237,6 +259,7 @@ dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 	in_buffer = df__scan_string(expanded_text, scanner);
 
 	dfw = dfwork_new();
+	dfw->flags = flags;
 
 	state.dfw = dfw;
 	state.quoted_string = NULL;
@@ -334,15 +357,25 @@ dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 			goto FAILURE;
 		}
 
+		/* Make it cheaper to run */
+		dfw_optimize(dfw);
+
+		/* What packets have to look like to match; gencode takes
+		 * the constants out of the tree, so this comes first */
+		prefilter = dfw_prefilter(dfw);
+
 		/* Create bytecode */
 		dfw_gencode(dfw);
 
 		/* Tuck away the bytecode in the dfilter_t */
 		dfilter = dfilter_new();
+		dfilter->prefilter = prefilter;
 		dfilter->insns = dfw->insns;
 		dfilter->consts = dfw->consts;
+		dfilter->optimizations = dfw->optimizations;
 		dfw->insns = NULL;
 		dfw->consts = NULL;
+		dfw->optimizations = NULL;
 		dfilter->interesting_fields = dfw_interesting_fields(dfw,
 			&dfilter->num_interesting_fields);
 
@@ -356,6 +389,9 @@ dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 		/* Initialize constants */
 		dfvm_init_const(dfilter);
 
+		/* Link the bytecode for dfvm_apply() */
+		dfvm_link(dfilter);
+
 		/* Add any deprecated items */
 		dfilter->deprecated = deprecated;
 
@@ -427,6 +463,21 @@ dfilter_has_interesting_fields(const dfilter_t *df)
 	return (df->num_interesting_fields > 0);
 }
 
+gboolean
+dfilter_has_prefilter(const dfilter_t *df)
+{
+	return (df->prefilter != NULL);
+}
+
+gboolean
+dfilter_prefilter_packet(const dfilter_t *df, const guint8 *data,
+		guint32 caplen, guint32 len)
+{
+	if (df->prefilter == NULL)
+		return TRUE;
+	return prefilter_check(df->prefilter, data, caplen, len);
+}
+
 GPtrArray *
 dfilter_deprecated_tokens(dfilter_t *df) {
 	if (df->deprecated && df->deprecated->len > 0) {
@@ -435,11 +486,80 @@ dfilter_deprecated_tokens(dfilter_t *df) {
 	return NULL;
 }
 
+/* The whitespace the scanner skips */
+#define IS_DF_SPACE(c)	((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+gchar *
+dfilter_canonical_text(const gchar *text)
+{
+	GString		*str;
+	const gchar	*p;
+	gchar		quote;
+	gboolean	in_range = FALSE;
+	gboolean	in_set = FALSE;
+	gboolean	space = FALSE;
+	gchar		prev;
+
+	/* Macros are expanded before the filter is scanned, inside quotes
+	 * or not, so nothing around them can be told to be whitespace. */
+	if (strstr(text, "${") != NULL)
+		return g_strdup(text);
+
+	str = g_string_sized_new(strlen(text));
+	for (p = text; *p != '\0'; p++) {
+		/* Whitespace in a slice is an error; keep it */
+		if (IS_DF_SPACE(*p) && !in_range) {
+			space = TRUE;
+			continue;
+		}
+		if (space) {
+			/* One space separates as well as many.  None is
+			 * needed at either end, or inside parentheses
+			 * outside a set, where whitespace is a separator. */
+			prev = str->len ? str->str[str->len - 1] : '\0';
+			if (prev != '\0' && (in_set || (prev != '(' && *p != ')')))
+				g_string_append_c(str, ' ');
+			space = FALSE;
+		}
+
+		g_string_append_c(str, *p);
+		switch (*p) {
+			case '"':
+			case '\'':
+				/* Copy strings and character constants as
+				 * they are, escapes and all */
+				quote = *p;
+				while (p[1] != '\0' && p[1] != quote) {
+					if (p[1] == '\\' && p[2] != '\0')
+						g_string_append_c(str, *++p);
+					g_string_append_c(str, *++p);
+				}
+				if (p[1] != '\0')
+					g_string_append_c(str, *++p);
+				break;
+			case '[':
+				in_range = TRUE;
+				break;
+			case ']':
+				in_range = FALSE;
+				break;
+			case '{':
+				in_set = TRUE;
+				break;
+			case '}':
+				in_set = FALSE;
+				break;
+		}
+	}
+	return g_string_free(str, FALSE);
+}
+
 void
 dfilter_dump(dfilter_t *df)
 {
 	guint i;
 	const gchar *sep = "";
+	char *str;
 
 	dfvm_dump(stdout, df);
 
@@ -451,6 +571,19 @@ dfilter_dump(dfilter_t *df)
 		}
 		ws_debug_printf("\n");
 	}
+
+	if (df->optimizations && df->optimizations->len) {
+		ws_debug_printf("\nOptimizations:\n");
+		for (i = 0; i < df->optimizations->len; i++) {
+			ws_debug_printf("%s\n", (char *) g_ptr_array_index(df->optimizations, i));
+		}
+	}
+
+	if (df->prefilter) {
+		str = prefilter_to_str(df->prefilter);
+		ws_debug_printf("\nPrefilter:\n%s\n", str);
+		g_free(str);
+	}
 }
 
 /*
@@ -49,6 +49,25 @@ WS_DLL_PUBLIC
 gboolean
 dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg);
 
+/* Flags for dfilter_compile_flags() */
+#define DF_FILE_SETS	(1U << 0)	/* allow sets read from files, with $file("...") */
+
+/* Like dfilter_compile(), also allowing what the flags say.  Reading
+ * files is only for programs that take their filters from the user
+ * running them, not, e.g., from the clients of a server. */
+WS_DLL_PUBLIC
+gboolean
+dfilter_compile_flags(const gchar *text, dfilter_t **dfp, gchar **err_msg,
+		guint flags);
+
+/* Returns the text of a filter without the whitespace that doesn't
+ * change its meaning, so that filters which differ only in that have
+ * the same text and can share a dfilter_t.  Filters using macros are
+ * returned as they are.  The result must be freed with g_free(). */
+WS_DLL_PUBLIC
+gchar *
+dfilter_canonical_text(const gchar *text);
+
 /* Frees all memory used by dfilter, and frees
  * the dfilter itself. */
 WS_DLL_PUBLIC
@@ -72,6 +91,20 @@ dfilter_prime_proto_tree(const dfilter_t *df, proto_tree *tree);
 gboolean
 dfilter_has_interesting_fields(const dfilter_t *df);
 
+/* Check if dfilter places conditions on the raw data of a packet that
+ * dfilter_prefilter_packet() can check without dissecting it */
+WS_DLL_PUBLIC
+gboolean
+dfilter_has_prefilter(const dfilter_t *df);
+
+/* Returns FALSE if a packet with this raw data can't match the dfilter,
+ * so that it needn't be dissected.  TRUE doesn't mean that it matches.
+ * "caplen" and "len" are the captured and the original length. */
+WS_DLL_PUBLIC
+gboolean
+dfilter_prefilter_packet(const dfilter_t *df, const guint8 *data,
+		guint32 caplen, guint32 len);
+
 WS_DLL_PUBLIC
 GPtrArray *
 dfilter_deprecated_tokens(dfilter_t *df);
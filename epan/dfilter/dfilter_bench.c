@@ -0,0 +1,294 @@
+/* dfilter_bench.c
+ * Measures how long display filters take to run on the packets of a
+ * capture file, leaving out the time spent dissecting the packets.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <glib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <epan/epan.h>
+#include <epan/epan_dissect.h>
+#include <epan/frame_data.h>
+#include <epan/timestamp.h>
+#include <epan/prefs.h>
+#include <epan/tvbuff.h>
+#include <epan/dfilter/dfilter.h>
+
+#include <wsutil/filesystem.h>
+#include <wsutil/privileges.h>
+#include <wsutil/report_message.h>
+
+#include <wiretap/wtap.h>
+
+/* Each filter is run this many times on each packet by default */
+#define DEFAULT_RUNS	10
+
+/* We only keep the reference frame around */
+struct packet_provider_data {
+	frame_data	ref_frame;
+};
+
+typedef struct {
+	const char	*text;
+	dfilter_t	*df;
+	guint64		matches;
+	gint64		nsecs;
+} bench_filter_t;
+
+static void failure_warning_message(const char *msg_format, va_list ap);
+static void open_failure_message(const char *filename, int err,
+	gboolean for_writing);
+static void read_failure_message(const char *filename, int err);
+static void write_failure_message(const char *filename, int err);
+
+/*
+ * A monotonic clock with nanoseconds; g_get_monotonic_time() only has
+ * microseconds, and a filter often runs in less than one
+ */
+static gint64
+bench_get_nsecs(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (gint64)(count.QuadPart / freq.QuadPart) * 1000000000 +
+		(gint64)(count.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static const nstime_t *
+bench_get_frame_ts(struct packet_provider_data *prov, guint32 frame_num _U_)
+{
+	/* Close enough for the time fields */
+	return &prov->ref_frame.abs_ts;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: dfilter_bench [-n <runs>] <capture file> <filter> ...\n");
+	fprintf(stderr, "Each filter is run <runs> times (def: %d) on each packet.\n",
+		DEFAULT_RUNS);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct packet_provider_funcs funcs = {
+		bench_get_frame_ts,
+		NULL,
+		NULL,
+		NULL
+	};
+	struct packet_provider_data prov;
+	char		*init_progfile_dir_error;
+	int		arg = 1;
+	int		runs = DEFAULT_RUNS;
+	const char	*fname;
+	bench_filter_t	*filters;
+	int		num_filters;
+	int		i, r;
+	gchar		*err_msg;
+	wtap		*wth;
+	int		err;
+	gchar		*err_info = NULL;
+	epan_t		*epan;
+	epan_dissect_t	*edt;
+	wtap_rec	rec;
+	Buffer		buf;
+	gint64		data_offset;
+	frame_data	fdata;
+	const frame_data *ref = NULL;
+	nstime_t	elapsed_time = NSTIME_INIT_ZERO;
+	guint32		framenum = 0;
+	guint32		cum_bytes = 0;
+	gint64		start;
+
+	init_process_policies();
+
+	init_progfile_dir_error = init_progfile_dir(argv[0]);
+	if (init_progfile_dir_error != NULL) {
+		fprintf(stderr, "dfilter_bench: Can't get pathname of directory containing the dfilter_bench program: %s.\n",
+			init_progfile_dir_error);
+		g_free(init_progfile_dir_error);
+	}
+
+	init_report_message(failure_warning_message, failure_warning_message,
+			    open_failure_message, read_failure_message,
+			    write_failure_message);
+
+	if (argc > arg + 1 && strcmp(argv[arg], "-n") == 0) {
+		runs = atoi(argv[arg + 1]);
+		if (runs <= 0)
+			usage();
+		arg += 2;
+	}
+	if (argc < arg + 2)
+		usage();
+	fname = argv[arg++];
+
+	timestamp_set_type(TS_RELATIVE);
+	timestamp_set_seconds_type(TS_SECONDS_DEFAULT);
+
+	wtap_init(TRUE);
+
+	if (!epan_init(NULL, NULL, FALSE))
+		return 2;
+
+	epan_load_settings();
+	prefs_apply_all();
+
+	num_filters = argc - arg;
+	filters = g_new0(bench_filter_t, num_filters);
+	for (i = 0; i < num_filters; i++) {
+		filters[i].text = argv[arg + i];
+		if (!dfilter_compile(filters[i].text, &filters[i].df, &err_msg)) {
+			fprintf(stderr, "dfilter_bench: %s\n", err_msg);
+			g_free(err_msg);
+			exit(2);
+		}
+		if (filters[i].df == NULL) {
+			fprintf(stderr, "dfilter_bench: \"%s\" is empty\n",
+				filters[i].text);
+			exit(2);
+		}
+	}
+
+	wth = wtap_open_offline(fname, WTAP_TYPE_AUTO, &err, &err_info, TRUE);
+	if (wth == NULL) {
+		fprintf(stderr, "dfilter_bench: Can't open \"%s\": %s\n", fname,
+			wtap_strerror(err));
+		g_free(err_info);
+		exit(2);
+	}
+
+	memset(&prov, 0, sizeof prov);
+	epan = epan_new(&prov, &funcs);
+	edt = epan_dissect_new(epan, TRUE, FALSE);
+	wtap_rec_init(&rec);
+	ws_buffer_init(&buf, 1514);
+
+	while (wtap_read(wth, &rec, &buf, &err, &err_info, &data_offset)) {
+		framenum++;
+		frame_data_init(&fdata, framenum, &rec, data_offset, cum_bytes);
+		frame_data_set_before_dissect(&fdata, &elapsed_time, &ref, NULL);
+		if (ref == &fdata) {
+			prov.ref_frame = fdata;
+			ref = &prov.ref_frame;
+		}
+
+		for (i = 0; i < num_filters; i++)
+			epan_dissect_prime_with_dfilter(edt, filters[i].df);
+		epan_dissect_run(edt, wtap_file_type_subtype(wth), &rec,
+			tvb_new_real_data(ws_buffer_start_ptr(&buf),
+				rec.rec_header.packet_header.caplen,
+				rec.rec_header.packet_header.len),
+			&fdata, NULL);
+		frame_data_set_after_dissect(&fdata, &cum_bytes);
+
+		/* Now time the filters alone */
+		for (i = 0; i < num_filters; i++) {
+			start = bench_get_nsecs();
+			for (r = 0; r < runs; r++) {
+				if (dfilter_apply_edt(filters[i].df, edt) && r == 0)
+					filters[i].matches++;
+			}
+			filters[i].nsecs += bench_get_nsecs() - start;
+		}
+
+		epan_dissect_reset(edt);
+		frame_data_destroy(&fdata);
+	}
+	if (err != 0) {
+		fprintf(stderr, "dfilter_bench: Error reading \"%s\": %s\n", fname,
+			wtap_strerror(err));
+		g_free(err_info);
+	}
+
+	printf("%u packets, each filter run %d times per packet\n", framenum, runs);
+	for (i = 0; i < num_filters; i++) {
+		printf("%10.1f ns/run %10" G_GUINT64_FORMAT " matches  %s\n",
+			framenum ? filters[i].nsecs / ((double)framenum * runs) : 0.0,
+			filters[i].matches, filters[i].text);
+		dfilter_free(filters[i].df);
+	}
+	g_free(filters);
+
+	ws_buffer_free(&buf);
+	wtap_rec_cleanup(&rec);
+	epan_dissect_free(edt);
+	epan_free(epan);
+	wtap_close(wth);
+	epan_cleanup();
+	return err != 0 ? 2 : 0;
+}
+
+static void
+failure_warning_message(const char *msg_format, va_list ap)
+{
+	fprintf(stderr, "dfilter_bench: ");
+	vfprintf(stderr, msg_format, ap);
+	fprintf(stderr, "\n");
+}
+
+static void
+open_failure_message(const char *filename, int err, gboolean for_writing)
+{
+	fprintf(stderr, "dfilter_bench: ");
+	fprintf(stderr, file_open_error_message(err, for_writing), filename);
+	fprintf(stderr, "\n");
+}
+
+static void
+read_failure_message(const char *filename, int err)
+{
+	fprintf(stderr, "dfilter_bench: An error occurred while reading from the file \"%s\": %s.\n",
+		filename, g_strerror(err));
+}
+
+static void
+write_failure_message(const char *filename, int err)
+{
+	fprintf(stderr, "dfilter_bench: An error occurred while writing to the file \"%s\": %s.\n",
+		filename, g_strerror(err));
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -10,6 +10,8 @@
 
 #include "dfvm.h"
 
+#include <string.h>
+
 #include <ftypes/ftypes-int.h>
 
 dfvm_insn_t*
@@ -26,6 +28,322 @@ dfvm_insn_new(dfvm_opcode_t op)
 	return insn;
 }
 
+/* The specialized test for "== a constant" of a given type, or
+ * DFVM_ANY_CMP if the type has none. */
+static dfvm_code_op_t
+eq_const_op(ftenum_t ftype)
+{
+	switch (ftype) {
+		case FT_CHAR:
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+		case FT_IPXNET:
+		case FT_FRAMENUM:
+			return DFVM_UINT_EQ_CONST;
+
+		case FT_UINT40:
+		case FT_UINT48:
+		case FT_UINT56:
+		case FT_UINT64:
+		case FT_INT40:
+		case FT_INT48:
+		case FT_INT56:
+		case FT_INT64:
+		case FT_EUI64:
+			return DFVM_UINT64_EQ_CONST;
+
+		case FT_IPv4:
+			return DFVM_IPV4_IN_SUBNET;
+
+		case FT_BYTES:
+		case FT_UINT_BYTES:
+		case FT_AX25:
+		case FT_VINES:
+		case FT_ETHER:
+		case FT_OID:
+		case FT_REL_OID:
+		case FT_SYSTEM_ID:
+		case FT_FCWWN:
+			return DFVM_BYTES_EQ_CONST;
+
+		case FT_STRING:
+		case FT_STRINGZ:
+		case FT_UINT_STRING:
+		case FT_STRINGZPAD:
+		case FT_STRINGZTRUNC:
+			return DFVM_STRING_EQ_CONST;
+
+		default:
+			return DFVM_ANY_CMP;
+	}
+}
+
+/* How the values of a dfvm_set_t are looked up */
+enum {
+	SET_UINT,	/* by key, in the hash table or the intervals */
+	SET_INT,
+	SET_UINT64,
+	SET_INT64,
+	SET_IPV4,
+	SET_BYTES,	/* by fvalue, in the hash table; no ranges */
+	SET_STRING
+};
+
+/* Flips the sign bit, so that signed keys sort as unsigned ones */
+#define SET_SIGN_BIT	G_GUINT64_CONSTANT(0x8000000000000000)
+
+static int
+set_kind(ftenum_t ftype)
+{
+	switch (ftype) {
+		case FT_CHAR:
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_IPXNET:
+		case FT_FRAMENUM:
+			return SET_UINT;
+
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+			return SET_INT;
+
+		case FT_UINT40:
+		case FT_UINT48:
+		case FT_UINT56:
+		case FT_UINT64:
+		case FT_EUI64:
+			return SET_UINT64;
+
+		case FT_INT40:
+		case FT_INT48:
+		case FT_INT56:
+		case FT_INT64:
+			return SET_INT64;
+
+		case FT_IPv4:
+			return SET_IPV4;
+
+		default:
+			switch (eq_const_op(ftype)) {
+				case DFVM_BYTES_EQ_CONST:
+					return SET_BYTES;
+				case DFVM_STRING_EQ_CONST:
+					return SET_STRING;
+				default:
+					return -1;
+			}
+	}
+}
+
+/* Gets the key of a value of the set's type, which sorts as the type's
+ * cmp_ge and cmp_le have it.  Returns FALSE for values that aren't
+ * looked up by key, including IPv4 subnets; they match more than one
+ * address. */
+static gboolean
+set_key(const dfvm_set_t *set, const fvalue_t *fv, guint64 *key)
+{
+	if (fv->ftype != set->ftype) {
+		return FALSE;
+	}
+	switch (set->kind) {
+		case SET_UINT:
+			*key = fv->value.uinteger;
+			return TRUE;
+		case SET_INT:
+			*key = (guint64)(gint64)fv->value.sinteger ^ SET_SIGN_BIT;
+			return TRUE;
+		case SET_UINT64:
+			*key = fv->value.uinteger64;
+			return TRUE;
+		case SET_INT64:
+			*key = (guint64)fv->value.sinteger64 ^ SET_SIGN_BIT;
+			return TRUE;
+		case SET_IPV4:
+			if (fv->value.ipv4.nmask != 0xffffffff) {
+				return FALSE;
+			}
+			*key = fv->value.ipv4.addr;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/* Hash functions for byte and string values; equal values hash alike,
+ * as their cmp_eq's have it. */
+static guint
+set_bytes_hash(gconstpointer v)
+{
+	const GByteArray *bytes = ((const fvalue_t *)v)->value.bytes;
+	guint		hash = 5381;
+	guint		i;
+
+	for (i = 0; i < bytes->len; i++) {
+		hash = hash * 33 + bytes->data[i];
+	}
+	return hash;
+}
+
+static gboolean
+set_bytes_equal(gconstpointer a, gconstpointer b)
+{
+	const GByteArray *bytes_a = ((const fvalue_t *)a)->value.bytes;
+	const GByteArray *bytes_b = ((const fvalue_t *)b)->value.bytes;
+
+	return bytes_a->len == bytes_b->len &&
+		memcmp(bytes_a->data, bytes_b->data, bytes_a->len) == 0;
+}
+
+static guint
+set_string_hash(gconstpointer v)
+{
+	return g_str_hash(((const fvalue_t *)v)->value.string);
+}
+
+static gboolean
+set_string_equal(gconstpointer a, gconstpointer b)
+{
+	return strcmp(((const fvalue_t *)a)->value.string,
+		((const fvalue_t *)b)->value.string) == 0;
+}
+
+static gint
+compare_intervals(gconstpointer a, gconstpointer b)
+{
+	const dfvm_interval_t *interval_a = (const dfvm_interval_t *)a;
+	const dfvm_interval_t *interval_b = (const dfvm_interval_t *)b;
+
+	if (interval_a->lower < interval_b->lower)
+		return -1;
+	if (interval_a->lower > interval_b->lower)
+		return 1;
+	return 0;
+}
+
+static void
+dfvm_set_free(dfvm_set_t *set)
+{
+	guint		i;
+
+	if (set->hash) {
+		g_hash_table_destroy(set->hash);
+	}
+	g_free(set->keys);
+	g_free(set->intervals);
+	if (set->fvalues) {
+		for (i = 0; i < set->fvalues->len; i++) {
+			if (g_ptr_array_index(set->fvalues, i)) {
+				FVALUE_FREE((fvalue_t *)g_ptr_array_index(set->fvalues, i));
+			}
+		}
+		g_ptr_array_free(set->fvalues, TRUE);
+	}
+	g_free(set);
+}
+
+dfvm_set_t*
+dfvm_set_new(GPtrArray *fvalues)
+{
+	dfvm_set_t	*set;
+	const fvalue_t	*value, *upper;
+	dfvm_interval_t	interval, *last;
+	GArray		*intervals;
+	guint		i, num_keys = 0, num_intervals = 0;
+
+	if (fvalues->len == 0) {
+		return NULL;
+	}
+
+	set = g_new0(dfvm_set_t, 1);
+	set->ftype = ((fvalue_t *)g_ptr_array_index(fvalues, 0))->ftype;
+	set->kind = set_kind(set->ftype->ftype);
+	switch (set->kind) {
+		case -1:
+			g_free(set);
+			return NULL;
+		case SET_BYTES:
+			set->hash = g_hash_table_new(set_bytes_hash, set_bytes_equal);
+			break;
+		case SET_STRING:
+			set->hash = g_hash_table_new(set_string_hash, set_string_equal);
+			break;
+		default:
+			set->hash = g_hash_table_new(g_int64_hash, g_int64_equal);
+			set->keys = g_new(guint64, fvalues->len / 2);
+			break;
+	}
+
+	intervals = g_array_new(FALSE, FALSE, sizeof(dfvm_interval_t));
+	for (i = 0; i + 1 < fvalues->len; i += 2) {
+		value = (const fvalue_t *)g_ptr_array_index(fvalues, i);
+		upper = (const fvalue_t *)g_ptr_array_index(fvalues, i + 1);
+		if (value->ftype != set->ftype || (upper && upper->ftype != set->ftype)) {
+			goto fail;
+		}
+
+		if (set->kind == SET_BYTES || set->kind == SET_STRING) {
+			if (upper) {
+				goto fail;
+			}
+			g_hash_table_add(set->hash, (gpointer)value);
+		}
+		else if (upper) {
+			if (!set_key(set, value, &interval.lower) ||
+			    !set_key(set, upper, &interval.upper)) {
+				goto fail;
+			}
+			/* A range whose bounds are the wrong way round
+			 * matches nothing */
+			if (interval.lower <= interval.upper) {
+				g_array_append_val(intervals, interval);
+			}
+		}
+		else if (set_key(set, value, &set->keys[num_keys])) {
+			g_hash_table_add(set->hash, &set->keys[num_keys]);
+			num_keys++;
+		}
+		else {
+			/* An IPv4 subnet */
+			interval.lower = value->value.ipv4.addr & value->value.ipv4.nmask;
+			interval.upper = interval.lower | (guint32)~value->value.ipv4.nmask;
+			g_array_append_val(intervals, interval);
+		}
+	}
+
+	/* Merge the intervals that overlap */
+	g_array_sort(intervals, compare_intervals);
+	for (i = 0; i < intervals->len; i++) {
+		interval = g_array_index(intervals, dfvm_interval_t, i);
+		last = num_intervals > 0 ?
+			&g_array_index(intervals, dfvm_interval_t, num_intervals - 1) : NULL;
+		if (last && interval.lower <= last->upper) {
+			last->upper = MAX(last->upper, interval.upper);
+		}
+		else {
+			g_array_index(intervals, dfvm_interval_t, num_intervals++) = interval;
+		}
+	}
+	set->num_intervals = num_intervals;
+	set->intervals = (dfvm_interval_t *)g_array_free(intervals, FALSE);
+	set->fvalues = fvalues;
+	return set;
+
+fail:
+	g_array_free(intervals, TRUE);
+	dfvm_set_free(set);
+	return NULL;
+}
+
 static void
 dfvm_value_free(dfvm_value_t *v)
 {
@@ -36,6 +354,9 @@ dfvm_value_free(dfvm_value_t *v)
 		case DRANGE:
 			drange_free(v->value.drange);
 			break;
+		case FVALUE_SET:
+			dfvm_set_free(v->value.set);
+			break;
 		default:
 			/* nothing */
 			;
@@ -73,6 +394,45 @@ dfvm_value_new(dfvm_value_type_t type)
 }
 
 
+/* Dumps a test that dfvm_link() specialized for a constant; returns
+ * FALSE if it's not one of those. */
+static gboolean
+dump_const_test(FILE *f, int id, const dfvm_code_t *code)
+{
+	const char	*name;
+	char		*value_str;
+
+	switch (code->op) {
+		case DFVM_UINT_EQ_CONST:
+			name = "UINT_EQ_CONST";
+			break;
+		case DFVM_UINT64_EQ_CONST:
+			name = "UINT64_EQ_CONST";
+			break;
+		case DFVM_IPV4_IN_SUBNET:
+			name = "IPV4_IN_SUBNET";
+			break;
+		case DFVM_BYTES_EQ_CONST:
+			name = "BYTES_EQ_CONST";
+			break;
+		case DFVM_STRING_EQ_CONST:
+			name = "STRING_EQ_CONST";
+			break;
+		default:
+			return FALSE;
+	}
+	value_str = fvalue_to_string_repr(NULL, (fvalue_t *)code->p.fvalue,
+		FTREPR_DFILTER, BASE_NONE);
+	fprintf(f, "%05d %s\treg#%u == %s <%s>\n",
+		id, name, code->a, value_str,
+		fvalue_type_name((fvalue_t *)code->p.fvalue));
+	wmem_free(NULL, value_str);
+	return TRUE;
+}
+
+/* How many of a set's elements dfvm_dump() shows */
+#define DUMP_SET_ELEMENTS	8
+
 void
 dfvm_dump(FILE *f, dfilter_t *df)
 {
@@ -85,6 +445,8 @@ dfvm_dump(FILE *f, dfilter_t *df)
 	char		*value_str;
 	GSList		*range_list;
 	drange_node	*range_item;
+	dfvm_set_t	*set;
+	guint		i;
 
 	/* First dump the constant initializations */
 	fprintf(f, "Constants:\n");
@@ -119,6 +481,7 @@ dfvm_dump(FILE *f, dfilter_t *df)
 			case ANY_CONTAINS:
 			case ANY_MATCHES:
 			case ANY_IN_RANGE:
+			case ANY_IN_SET:
 			case NOT:
 			case RETURN:
 			case IF_TRUE_GOTO:
@@ -134,6 +497,10 @@ dfvm_dump(FILE *f, dfilter_t *df)
 	length = df->insns->len;
 	for (id = 0; id < length; id++) {
 
+		if (df->code && dump_const_test(f, id, &df->code[id])) {
+			continue;
+		}
+
 		insn = (dfvm_insn_t	*)g_ptr_array_index(df->insns, id);
 		arg1 = insn->arg1;
 		arg2 = insn->arg2;
@@ -259,6 +626,30 @@ dfvm_dump(FILE *f, dfilter_t *df)
 					arg3->value.numeric);
 				break;
 
+			case ANY_IN_SET:
+				set = arg2->value.set;
+				fprintf(f, "%05d ANY_IN_SET\treg#%u in {",
+					id, arg1->value.numeric);
+				for (i = 0; i < set->fvalues->len && i < 2 * DUMP_SET_ELEMENTS; i += 2) {
+					value_str = fvalue_to_string_repr(NULL,
+						(fvalue_t *)g_ptr_array_index(set->fvalues, i),
+						FTREPR_DFILTER, BASE_NONE);
+					fprintf(f, "%s%s", i ? " " : "", value_str);
+					wmem_free(NULL, value_str);
+					if (g_ptr_array_index(set->fvalues, i + 1)) {
+						value_str = fvalue_to_string_repr(NULL,
+							(fvalue_t *)g_ptr_array_index(set->fvalues, i + 1),
+							FTREPR_DFILTER, BASE_NONE);
+						fprintf(f, "..%s", value_str);
+						wmem_free(NULL, value_str);
+					}
+				}
+				fprintf(f, "%s} <%s, %u elements>\n",
+					i < set->fvalues->len ? " ..." : "",
+					fvalue_type_name((fvalue_t *)g_ptr_array_index(set->fvalues, 0)),
+					set->fvalues->len / 2);
+				break;
+
 			case NOT:
 				fprintf(f, "%05d NOT\n", id);
 				break;
@@ -347,8 +738,6 @@ put_fvalue(dfilter_t *df, fvalue_t *fv, int reg)
 	return TRUE;
 }
 
-typedef gboolean (*FvalueCmpFunc)(const fvalue_t*, const fvalue_t*);
-
 static gboolean
 any_test(dfilter_t *df, FvalueCmpFunc cmp, int reg1, int reg2)
 {
@@ -458,156 +847,261 @@ mk_range(dfilter_t *df, int from_reg, int to_reg, drange_t *d_range)
 
 
 
+/* The *_CONST tests compare the values of the constant's own type
+ * directly, with the same result as the type's cmp_eq, and fall back to
+ * fvalue_eq() for anything else (fields of the same name can have
+ * different types). */
+static gboolean
+any_uint_eq_const(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (fv->ftype == code->p.fvalue->ftype ?
+		    fv->value.uinteger == code->k.uinteger :
+		    fvalue_eq(fv, code->p.fvalue)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+any_uint64_eq_const(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (fv->ftype == code->p.fvalue->ftype ?
+		    fv->value.uinteger64 == code->k.uinteger64 :
+		    fvalue_eq(fv, code->p.fvalue)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+any_ipv4_in_subnet(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv;
+	guint32		nmask;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (fv->ftype != code->p.fvalue->ftype) {
+			if (fvalue_eq(fv, code->p.fvalue))
+				return TRUE;
+			continue;
+		}
+		/* As in ftype-ipv4.c, compare under the shorter netmask */
+		nmask = MIN(fv->value.ipv4.nmask, code->k.ipv4.nmask);
+		if ((fv->value.ipv4.addr & nmask) == (code->k.ipv4.addr & nmask)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+any_bytes_eq_const(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv;
+	const GByteArray *bytes = code->k.bytes;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (fv->ftype == code->p.fvalue->ftype ?
+		    (fv->value.bytes->len == bytes->len &&
+		     memcmp(fv->value.bytes->data, bytes->data, bytes->len) == 0) :
+		    fvalue_eq(fv, code->p.fvalue)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+any_string_eq_const(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (fv->ftype == code->p.fvalue->ftype ?
+		    strcmp(fv->value.string, code->k.string) == 0 :
+		    fvalue_eq(fv, code->p.fvalue)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Whether a key is one of the set's single values or in one of its
+ * intervals */
+static gboolean
+set_contains_key(const dfvm_set_t *set, guint64 key)
+{
+	guint		lower = 0, upper = set->num_intervals, mid;
+
+	if (g_hash_table_contains(set->hash, &key)) {
+		return TRUE;
+	}
+
+	/* Find the last interval that starts at or before the key */
+	while (lower < upper) {
+		mid = lower + (upper - lower) / 2;
+		if (set->intervals[mid].lower <= key)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+	return lower > 0 && key <= set->intervals[lower - 1].upper;
+}
+
+static gboolean
+any_in_set(dfilter_t *df, const dfvm_code_t *code)
+{
+	GList		*list;
+	const fvalue_t	*fv, *value, *upper;
+	const dfvm_set_t *set = code->p.set;
+	guint64		key;
+	guint		i;
+
+	for (list = df->registers[code->a]; list; list = list->next) {
+		fv = (const fvalue_t *)list->data;
+		if (set_key(set, fv, &key)) {
+			if (set_contains_key(set, key))
+				return TRUE;
+			continue;
+		}
+		if (fv->ftype == set->ftype &&
+		    (set->kind == SET_BYTES || set->kind == SET_STRING)) {
+			if (g_hash_table_contains(set->hash, fv))
+				return TRUE;
+			continue;
+		}
+
+		/* A field of the same name with another type, or an IPv4
+		 * subnet; compare as the linear code would. */
+		for (i = 0; i + 1 < set->fvalues->len; i += 2) {
+			value = (const fvalue_t *)g_ptr_array_index(set->fvalues, i);
+			upper = (const fvalue_t *)g_ptr_array_index(set->fvalues, i + 1);
+			if (upper ? fvalue_ge(fv, value) && fvalue_le(fv, upper) :
+			    fvalue_eq(fv, value))
+				return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
 gboolean
 dfvm_apply(dfilter_t *df, proto_tree *tree)
 {
-	int		id, length;
+	const dfvm_code_t	*code;
+	guint32		id = 0;
 	gboolean	accum = TRUE;
-	dfvm_insn_t	*insn;
-	dfvm_value_t	*arg1;
-	dfvm_value_t	*arg2;
-	dfvm_value_t	*arg3 = NULL;
-	dfvm_value_t	*arg4 = NULL;
 	header_field_info	*hfinfo;
-	GList		*param1;
-	GList		*param2;
 
 	g_assert(tree);
 
-	length = df->insns->len;
+	for (;;) {
 
-	for (id = 0; id < length; id++) {
-
-	  AGAIN:
-		insn = (dfvm_insn_t	*)g_ptr_array_index(df->insns, id);
-		arg1 = insn->arg1;
-		arg2 = insn->arg2;
+		code = &df->code[id++];
 
-		switch (insn->op) {
-			case CHECK_EXISTS:
-				hfinfo = arg1->value.hfinfo;
-				while(hfinfo) {
-					accum = proto_check_for_protocol_or_field(tree,
-							hfinfo->id);
-					if (accum) {
-						break;
-					}
-					else {
-						hfinfo = hfinfo->same_name_next;
-					}
+		switch (code->op) {
+			case DFVM_IF_TRUE_GOTO:
+				if (accum) {
+					id = code->a;
 				}
 				break;
 
-			case READ_TREE:
-				accum = read_tree(df, tree,
-						arg1->value.hfinfo, arg2->value.numeric);
-				break;
-
-			case CALL_FUNCTION:
-				arg3 = insn->arg3;
-				arg4 = insn->arg4;
-				param1 = NULL;
-				param2 = NULL;
-				if (arg3) {
-					param1 = df->registers[arg3->value.numeric];
-				}
-				if (arg4) {
-					param2 = df->registers[arg4->value.numeric];
+			case DFVM_IF_FALSE_GOTO:
+				if (!accum) {
+					id = code->a;
 				}
-				accum = arg1->value.funcdef->function(param1, param2,
-						&df->registers[arg2->value.numeric]);
-				// functions create a new value, so own it.
-				df->owns_memory[arg2->value.numeric] = TRUE;
 				break;
 
-			case MK_RANGE:
-				arg3 = insn->arg3;
-				mk_range(df,
-						arg1->value.numeric, arg2->value.numeric,
-						arg3->value.drange);
-				break;
-
-			case ANY_EQ:
-				accum = any_test(df, fvalue_eq,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_NE:
-				accum = any_test(df, fvalue_ne,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_READ_TREE:
+				accum = read_tree(df, tree,
+						code->p.hfinfo, code->a);
 				break;
 
-			case ANY_GT:
-				accum = any_test(df, fvalue_gt,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_ANY_IN_SET:
+				accum = any_in_set(df, code);
 				break;
 
-			case ANY_GE:
-				accum = any_test(df, fvalue_ge,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_UINT_EQ_CONST:
+				accum = any_uint_eq_const(df, code);
 				break;
 
-			case ANY_LT:
-				accum = any_test(df, fvalue_lt,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_UINT64_EQ_CONST:
+				accum = any_uint64_eq_const(df, code);
 				break;
 
-			case ANY_LE:
-				accum = any_test(df, fvalue_le,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_IPV4_IN_SUBNET:
+				accum = any_ipv4_in_subnet(df, code);
 				break;
 
-			case ANY_BITWISE_AND:
-				accum = any_test(df, fvalue_bitwise_and,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_BYTES_EQ_CONST:
+				accum = any_bytes_eq_const(df, code);
 				break;
 
-			case ANY_CONTAINS:
-				accum = any_test(df, fvalue_contains,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_STRING_EQ_CONST:
+				accum = any_string_eq_const(df, code);
 				break;
 
-			case ANY_MATCHES:
-				accum = any_test(df, fvalue_matches,
-						arg1->value.numeric, arg2->value.numeric);
+			case DFVM_ANY_CMP:
+				accum = any_test(df, code->p.cmp,
+						code->a, code->b);
 				break;
 
-			case ANY_IN_RANGE:
-				arg3 = insn->arg3;
-				accum = any_in_range(df, arg1->value.numeric,
-						arg2->value.numeric,
-						arg3->value.numeric);
+			case DFVM_CHECK_EXISTS:
+				hfinfo = code->p.hfinfo;
+				while(hfinfo) {
+					accum = proto_check_for_protocol_or_field(tree,
+							hfinfo->id);
+					if (accum) {
+						break;
+					}
+					else {
+						hfinfo = hfinfo->same_name_next;
+					}
+				}
 				break;
 
-			case NOT:
+			case DFVM_NOT:
 				accum = !accum;
 				break;
 
-			case RETURN:
+			case DFVM_RETURN:
 				free_register_overhead(df);
 				return accum;
 
-			case IF_TRUE_GOTO:
-				if (accum) {
-					id = arg1->value.numeric;
-					goto AGAIN;
-				}
+			case DFVM_CALL_FUNCTION:
+				accum = code->p.funcdef->function(
+						code->c != G_MAXUINT32 ? df->registers[code->c] : NULL,
+						code->d != G_MAXUINT32 ? df->registers[code->d] : NULL,
+						&df->registers[code->b]);
+				// functions create a new value, so own it.
+				df->owns_memory[code->b] = TRUE;
 				break;
 
-			case IF_FALSE_GOTO:
-				if (!accum) {
-					id = arg1->value.numeric;
-					goto AGAIN;
-				}
+			case DFVM_MK_RANGE:
+				mk_range(df, code->a, code->b, code->p.drange);
 				break;
 
-			case PUT_FVALUE:
-#if 0
-				/* These were handled in the constants initialization */
-				accum = put_fvalue(df,
-						arg1->value.fvalue, arg2->value.numeric);
+			case DFVM_ANY_IN_RANGE:
+				accum = any_in_range(df, code->a, code->b, code->c);
 				break;
-#endif
 
 			default:
 				g_assert_not_reached();
@@ -654,6 +1148,7 @@ dfvm_init_const(dfilter_t *df)
 			case ANY_CONTAINS:
 			case ANY_MATCHES:
 			case ANY_IN_RANGE:
+			case ANY_IN_SET:
 			case NOT:
 			case RETURN:
 			case IF_TRUE_GOTO:
@@ -667,6 +1162,191 @@ dfvm_init_const(dfilter_t *df)
 	return;
 }
 
+/* Returns the constant in a register, or NULL if it isn't one. */
+static const fvalue_t *
+const_fvalue(dfilter_t *df, dfvm_value_t *arg)
+{
+	if (arg->value.numeric < df->num_registers ||
+	    arg->value.numeric >= df->max_registers ||
+	    df->registers[arg->value.numeric] == NULL) {
+		return NULL;
+	}
+	return (const fvalue_t *)df->registers[arg->value.numeric]->data;
+}
+
+/* Turns "any value in a register == a constant" into a specialized test
+ * if the constant's type has one.  Returns FALSE if it doesn't. */
+static gboolean
+link_eq_const(dfvm_code_t *code, guint32 reg, const fvalue_t *fv)
+{
+	code->op = eq_const_op(fv->ftype->ftype);
+	switch (code->op) {
+		case DFVM_UINT_EQ_CONST:
+			code->k.uinteger = fv->value.uinteger;
+			break;
+
+		case DFVM_UINT64_EQ_CONST:
+			code->k.uinteger64 = fv->value.uinteger64;
+			break;
+
+		case DFVM_IPV4_IN_SUBNET:
+			code->k.ipv4 = fv->value.ipv4;
+			break;
+
+		case DFVM_BYTES_EQ_CONST:
+			code->k.bytes = fv->value.bytes;
+			break;
+
+		case DFVM_STRING_EQ_CONST:
+			code->k.string = fv->value.string;
+			break;
+
+		default:
+			return FALSE;
+	}
+	code->a = reg;
+	code->p.fvalue = fv;
+	return TRUE;
+}
+
+static void
+link_any_cmp(dfvm_code_t *code, dfvm_insn_t *insn, FvalueCmpFunc cmp)
+{
+	code->op = DFVM_ANY_CMP;
+	code->p.cmp = cmp;
+	code->a = insn->arg1->value.numeric;
+	code->b = insn->arg2->value.numeric;
+}
+
+/* Links the instructions into one array of dfvm_code_t's for
+ * dfvm_apply(), looking up what can be looked up once rather than per
+ * packet.  The constants must have been put in their registers by
+ * dfvm_init_const(). */
+void
+dfvm_link(dfilter_t *df)
+{
+	guint		id;
+	dfvm_insn_t	*insn;
+	dfvm_code_t	*code;
+	const fvalue_t	*fv;
+
+	df->code = g_new0(dfvm_code_t, df->insns->len);
+
+	for (id = 0; id < df->insns->len; id++) {
+
+		insn = (dfvm_insn_t	*)g_ptr_array_index(df->insns, id);
+		code = &df->code[id];
+
+		switch (insn->op) {
+			case IF_TRUE_GOTO:
+				code->op = DFVM_IF_TRUE_GOTO;
+				code->a = insn->arg1->value.numeric;
+				break;
+
+			case IF_FALSE_GOTO:
+				code->op = DFVM_IF_FALSE_GOTO;
+				code->a = insn->arg1->value.numeric;
+				break;
+
+			case CHECK_EXISTS:
+				code->op = DFVM_CHECK_EXISTS;
+				code->p.hfinfo = insn->arg1->value.hfinfo;
+				break;
+
+			case NOT:
+				code->op = DFVM_NOT;
+				break;
+
+			case RETURN:
+				code->op = DFVM_RETURN;
+				break;
+
+			case READ_TREE:
+				code->op = DFVM_READ_TREE;
+				code->p.hfinfo = insn->arg1->value.hfinfo;
+				code->a = insn->arg2->value.numeric;
+				break;
+
+			case CALL_FUNCTION:
+				code->op = DFVM_CALL_FUNCTION;
+				code->p.funcdef = insn->arg1->value.funcdef;
+				code->b = insn->arg2->value.numeric;
+				code->c = insn->arg3 ? insn->arg3->value.numeric : G_MAXUINT32;
+				code->d = insn->arg4 ? insn->arg4->value.numeric : G_MAXUINT32;
+				break;
+
+			case MK_RANGE:
+				code->op = DFVM_MK_RANGE;
+				code->a = insn->arg1->value.numeric;
+				code->b = insn->arg2->value.numeric;
+				code->p.drange = insn->arg3->value.drange;
+				break;
+
+			case ANY_IN_RANGE:
+				code->op = DFVM_ANY_IN_RANGE;
+				code->a = insn->arg1->value.numeric;
+				code->b = insn->arg2->value.numeric;
+				code->c = insn->arg3->value.numeric;
+				break;
+
+			case ANY_IN_SET:
+				code->op = DFVM_ANY_IN_SET;
+				code->a = insn->arg1->value.numeric;
+				code->p.set = insn->arg2->value.set;
+				break;
+
+			case ANY_EQ:
+				/* Equality is symmetric, so the constant can be on
+				 * either side */
+				if ((fv = const_fvalue(df, insn->arg2)) != NULL &&
+				    link_eq_const(code, insn->arg1->value.numeric, fv))
+					break;
+				if ((fv = const_fvalue(df, insn->arg1)) != NULL &&
+				    link_eq_const(code, insn->arg2->value.numeric, fv))
+					break;
+				link_any_cmp(code, insn, fvalue_eq);
+				break;
+
+			case ANY_NE:
+				link_any_cmp(code, insn, fvalue_ne);
+				break;
+
+			case ANY_GT:
+				link_any_cmp(code, insn, fvalue_gt);
+				break;
+
+			case ANY_GE:
+				link_any_cmp(code, insn, fvalue_ge);
+				break;
+
+			case ANY_LT:
+				link_any_cmp(code, insn, fvalue_lt);
+				break;
+
+			case ANY_LE:
+				link_any_cmp(code, insn, fvalue_le);
+				break;
+
+			case ANY_BITWISE_AND:
+				link_any_cmp(code, insn, fvalue_bitwise_and);
+				break;
+
+			case ANY_CONTAINS:
+				link_any_cmp(code, insn, fvalue_contains);
+				break;
+
+			case ANY_MATCHES:
+				link_any_cmp(code, insn, fvalue_matches);
+				break;
+
+			case PUT_FVALUE:
+			default:
+				g_assert_not_reached();
+				break;
+		}
+	}
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -23,9 +23,30 @@ typedef enum {
 	REGISTER,
 	INTEGER,
 	DRANGE,
-	FUNCTION_DEF
+	FUNCTION_DEF,
+	FVALUE_SET
 } dfvm_value_type_t;
 
+/* A range of values of a dfvm_set_t, as keys that sort like the values */
+typedef struct {
+	guint64		lower;
+	guint64		upper;
+} dfvm_interval_t;
+
+/* The constants of an "in" test, arranged so that dfvm_apply() can look
+ * the field's values up rather than compare them one by one: single
+ * values in a hash table, and ranges in a sorted array of intervals.
+ * All of them have the same type. */
+typedef struct {
+	const ftype_t	*ftype;
+	int		kind;		/* how values are looked up */
+	GHashTable	*hash;		/* the single values */
+	guint64		*keys;		/* the hash's keys, if they're integers */
+	dfvm_interval_t	*intervals;	/* sorted and disjoint */
+	guint		num_intervals;
+	GPtrArray	*fvalues;	/* (value, NULL) or (lower, upper) pairs; owned */
+} dfvm_set_t;
+
 typedef struct {
 	dfvm_value_type_t	type;
 
@@ -35,6 +56,7 @@ typedef struct {
 		drange_t		*drange;
 		header_field_info	*hfinfo;
         df_func_def_t   *funcdef;
+		dfvm_set_t		*set;
 	} value;
 
 } dfvm_value_t;
@@ -60,7 +82,8 @@ typedef enum {
 	ANY_MATCHES,
 	MK_RANGE,
 	CALL_FUNCTION,
-	ANY_IN_RANGE
+	ANY_IN_RANGE,
+	ANY_IN_SET
 
 } dfvm_opcode_t;
 
@@ -73,6 +96,57 @@ typedef struct {
 	dfvm_value_t	*arg4;
 } dfvm_insn_t;
 
+/* Opcodes of the linked code that dfvm_apply() runs.  The generic ones
+ * correspond to dfvm_opcode_t's; the *_CONST ones compare the values in
+ * a register with a constant of a given type directly. */
+typedef enum {
+
+	DFVM_IF_TRUE_GOTO,
+	DFVM_IF_FALSE_GOTO,
+	DFVM_CHECK_EXISTS,
+	DFVM_NOT,
+	DFVM_RETURN,
+	DFVM_READ_TREE,
+	DFVM_ANY_CMP,
+	DFVM_MK_RANGE,
+	DFVM_CALL_FUNCTION,
+	DFVM_ANY_IN_RANGE,
+	DFVM_ANY_IN_SET,
+	DFVM_UINT_EQ_CONST,
+	DFVM_UINT64_EQ_CONST,
+	DFVM_IPV4_IN_SUBNET,
+	DFVM_BYTES_EQ_CONST,
+	DFVM_STRING_EQ_CONST
+
+} dfvm_code_op_t;
+
+typedef gboolean (*FvalueCmpFunc)(const fvalue_t*, const fvalue_t*);
+
+/* One linked instruction; a filter's are kept in a single array, with
+ * the same numbering as its dfvm_insn_t's. */
+typedef struct _dfvm_code {
+	dfvm_code_op_t	op;
+	guint32		a;	/* register, or jump target */
+	guint32		b;	/* register */
+	guint32		c;	/* register */
+	guint32		d;	/* register */
+	union {
+		header_field_info	*hfinfo;
+		df_func_def_t		*funcdef;
+		drange_t		*drange;
+		FvalueCmpFunc		cmp;
+		const fvalue_t		*fvalue;	/* *_CONST: the constant */
+		const dfvm_set_t	*set;
+	} p;
+	union {				/* *_CONST: the constant's value */
+		guint32			uinteger;
+		guint64			uinteger64;
+		ipv4_addr_and_mask	ipv4;
+		const GByteArray	*bytes;
+		const char		*string;
+	} k;
+} dfvm_code_t;
+
 dfvm_insn_t*
 dfvm_insn_new(dfvm_opcode_t op);
 
@@ -82,6 +156,12 @@ dfvm_insn_free(dfvm_insn_t *insn);
 dfvm_value_t*
 dfvm_value_new(dfvm_value_type_t type);
 
+/* Takes over the array of (value, NULL) or (lower, upper) fvalue pairs,
+ * and the fvalues, if they can be looked up; returns NULL, leaving them
+ * to the caller, if they can't. */
+dfvm_set_t*
+dfvm_set_new(GPtrArray *fvalues);
+
 void
 dfvm_dump(FILE *f, dfilter_t *df);
 
@@ -91,4 +171,7 @@ dfvm_apply(dfilter_t *df, proto_tree *tree);
 void
 dfvm_init_const(dfilter_t *df);
 
+void
+dfvm_link(dfilter_t *df);
+
 #endif
@@ -17,6 +17,7 @@
 #include "sttype-set.h"
 #include "sttype-function.h"
 #include "ftypes/ftypes.h"
+#include <wsutil/str_util.h>
 
 static void
 gencode(dfwork_t *dfw, stnode_t *st_node);
@@ -287,6 +288,63 @@ fixup_jumps(gpointer data, gpointer user_data)
 	}
 }
 
+/* If all the elements of a set are constants that can be looked up,
+ * move them into a dfvm_set_t and generate a single test for them. */
+static gboolean
+gen_relation_in_set(dfwork_t *dfw, stnode_t *st_arg1, stnode_t *st_arg2)
+{
+	dfvm_insn_t	*insn;
+	dfvm_value_t	*val1, *val2;
+	dfvm_value_t	*jmp1 = NULL;
+	dfvm_set_t	*set;
+	int		reg1;
+	GPtrArray	*fvalues;
+	GSList		*nodelist;
+	stnode_t	*node;
+
+	fvalues = g_ptr_array_new();
+	for (nodelist = (GSList*)stnode_data(st_arg2); nodelist;
+	     nodelist = g_slist_next(nodelist)) {
+		/* (value, NULL) or (lower, upper) */
+		node = (stnode_t*)nodelist->data;
+		if (node && stnode_type_id(node) != STTYPE_FVALUE) {
+			g_ptr_array_free(fvalues, TRUE);
+			return FALSE;
+		}
+		g_ptr_array_add(fvalues, node ? stnode_data(node) : NULL);
+	}
+
+	set = dfvm_set_new(fvalues);
+	if (!set) {
+		g_ptr_array_free(fvalues, TRUE);
+		return FALSE;
+	}
+
+	/* The set owns the fvalues now */
+	for (nodelist = (GSList*)stnode_data(st_arg2); nodelist;
+	     nodelist = g_slist_next(nodelist)) {
+		if (nodelist->data) {
+			stnode_steal_data((stnode_t*)nodelist->data);
+		}
+	}
+
+	reg1 = gen_entity(dfw, st_arg1, &jmp1);
+
+	insn = dfvm_insn_new(ANY_IN_SET);
+	val1 = dfvm_value_new(REGISTER);
+	val1->value.numeric = reg1;
+	val2 = dfvm_value_new(FVALUE_SET);
+	val2->value.set = set;
+	insn->arg1 = val1;
+	insn->arg2 = val2;
+	dfw_append_insn(dfw, insn);
+
+	if (jmp1) {
+		jmp1->value.numeric = dfw->next_insn_id;
+	}
+	return TRUE;
+}
+
 /* Generate the code for the in operator.  It behaves much like an OR-ed
  * series of == tests, but without the redundant existence checks. */
 static void
@@ -300,6 +358,10 @@ gen_relation_in(dfwork_t *dfw, stnode_t *st_arg1, stnode_t *st_arg2)
 	GSList		*nodelist_head, *nodelist;
 	GSList		*jumplist = NULL;
 
+	if (gen_relation_in_set(dfw, st_arg1, st_arg2)) {
+		return;
+	}
+
 	/* Create code for the LHS of the relation */
 	reg1 = gen_entity(dfw, st_arg1, &jmp1);
 
@@ -537,10 +599,165 @@ gencode(dfwork_t *dfw, stnode_t *st_node)
 }
 
 
+/* Whether the instruction at "id", or after the MK_RANGEs that start
+ * there, sets the accumulator without looking at it first. */
+static gboolean
+sets_accum(dfwork_t *dfw, guint id)
+{
+	dfvm_insn_t	*insn;
+
+	for (; id < dfw->insns->len; id++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(dfw->insns, id);
+		switch (insn->op) {
+			case MK_RANGE:
+				continue;
+			case IF_TRUE_GOTO:
+			case IF_FALSE_GOTO:
+			case NOT:
+			case RETURN:
+			case PUT_FVALUE:
+				return FALSE;
+			default:
+				return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Merges the registers read on one path to "id" into what's known to
+ * have been read on every path there. */
+static void
+merge_loaded(guint8 **loaded, guint id, const guint8 *state, guint num_regs)
+{
+	guint		reg;
+
+	if (!loaded[id]) {
+		loaded[id] = (guint8 *)g_memdup(state, num_regs);
+		return;
+	}
+	for (reg = 0; reg < num_regs; reg++) {
+		loaded[id][reg] &= state[reg];
+	}
+}
+
+/* Removes the READ_TREEs of fields that were read successfully on every
+ * path to them, with their IF_FALSE_GOTOs.  read_tree() only reads a
+ * field once per run anyway, but this saves the two instructions; the
+ * jump can't be taken.  Returns the number of READ_TREEs removed. */
+static guint
+remove_redundant_reads(dfwork_t *dfw)
+{
+	guint		length = dfw->insns->len;
+	guint		num_regs = dfw->next_register;
+	guint8		**loaded;	/* per insn, or NULL if not reached yet */
+	guint8		*state;
+	gboolean	*jump_target, *removed;
+	guint		*new_id;
+	guint		id, reg, target, num_removed = 0;
+	dfvm_insn_t	*insn;
+	GPtrArray	*insns;
+
+	if (num_regs == 0) {
+		return 0;
+	}
+
+	jump_target = g_new0(gboolean, length);
+	for (id = 0; id < length; id++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(dfw->insns, id);
+		if (insn->op == IF_TRUE_GOTO || insn->op == IF_FALSE_GOTO) {
+			target = insn->arg1->value.numeric;
+			if (target <= id || target >= length) {
+				/* Not what gencode generates; leave it alone */
+				g_free(jump_target);
+				return 0;
+			}
+			jump_target[target] = TRUE;
+		}
+	}
+
+	/* All jumps go forward, so every path into an instruction has been
+	 * seen by the time we get to it. */
+	loaded = g_new0(guint8 *, length);
+	removed = g_new0(gboolean, length);
+	loaded[0] = (guint8 *)g_malloc0(num_regs);
+	for (id = 0; id < length; id++) {
+		state = loaded[id];
+		if (!state) {
+			continue;
+		}
+		insn = (dfvm_insn_t *)g_ptr_array_index(dfw->insns, id);
+
+		if (insn->op == READ_TREE && id + 2 < length && !jump_target[id + 1] &&
+		    ((dfvm_insn_t *)g_ptr_array_index(dfw->insns, id + 1))->op == IF_FALSE_GOTO) {
+			reg = insn->arg2->value.numeric;
+			target = ((dfvm_insn_t *)g_ptr_array_index(dfw->insns, id + 1))->arg1->value.numeric;
+			if (state[reg] && sets_accum(dfw, id + 2)) {
+				removed[id] = removed[id + 1] = TRUE;
+				num_removed++;
+			}
+			else {
+				merge_loaded(loaded, target, state, num_regs);
+				state[reg] = 1;
+			}
+			merge_loaded(loaded, id + 2, state, num_regs);
+			g_free(loaded[id]);
+			id++;
+			continue;
+		}
+
+		switch (insn->op) {
+			case IF_TRUE_GOTO:
+			case IF_FALSE_GOTO:
+				merge_loaded(loaded, insn->arg1->value.numeric, state, num_regs);
+				merge_loaded(loaded, id + 1, state, num_regs);
+				break;
+			case RETURN:
+				break;
+			default:
+				merge_loaded(loaded, id + 1, state, num_regs);
+				break;
+		}
+		g_free(loaded[id]);
+	}
+	g_free(loaded);
+
+	if (num_removed > 0) {
+		/* Renumber, sending jumps to a removed instruction to the
+		 * one after it */
+		new_id = g_new(guint, length);
+		insns = g_ptr_array_new();
+		for (id = 0; id < length; id++) {
+			new_id[id] = insns->len;
+			insn = (dfvm_insn_t *)g_ptr_array_index(dfw->insns, id);
+			if (removed[id]) {
+				dfvm_insn_free(insn);
+				continue;
+			}
+			insn->id = insns->len;
+			g_ptr_array_add(insns, insn);
+		}
+		for (id = 0; id < insns->len; id++) {
+			insn = (dfvm_insn_t *)g_ptr_array_index(insns, id);
+			if (insn->op == IF_TRUE_GOTO || insn->op == IF_FALSE_GOTO) {
+				insn->arg1->value.numeric = new_id[insn->arg1->value.numeric];
+			}
+		}
+		g_ptr_array_free(dfw->insns, TRUE);
+		dfw->insns = insns;
+		dfw->next_insn_id = insns->len;
+		g_free(new_id);
+	}
+
+	g_free(removed);
+	g_free(jump_target);
+	return num_removed;
+}
+
 void
 dfw_gencode(dfwork_t *dfw)
 {
 	int		id, id1, length;
+	guint		num_removed;
 	dfvm_insn_t	*insn, *insn1, *prev;
 	dfvm_value_t	*arg1;
 
@@ -587,6 +804,13 @@ dfw_gencode(dfwork_t *dfw)
 		}
 	}
 
+	num_removed = remove_redundant_reads(dfw);
+	if (num_removed > 0) {
+		g_ptr_array_add(dfw->optimizations, g_strdup_printf(
+			"Removed %u READ_TREE%s of fields already read",
+			num_removed, plurality(num_removed, "", "s")));
+	}
+
 	/* move constants after registers*/
 	if (dfw->first_constant == -1) {
 		/* NONE */
@@ -0,0 +1,469 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "dfilter-int.h"
+#include "optimize.h"
+#include "syntax-tree.h"
+#include "sttype-range.h"
+#include "sttype-test.h"
+#include "sttype-set.h"
+#include "sttype-function.h"
+
+/*
+ * Rough guesses at what the parts of a filter cost to run, in units of
+ * a comparison of two values, and at how often a test is true.  They
+ * only need to be good enough to put the cheap and selective tests of
+ * an "and" or an "or" first.
+ */
+#define COST_EXISTS		1.0
+#define COST_FIELD		2.0	/* READ_TREE */
+#define COST_RANGE		3.0
+#define COST_FUNCTION		5.0
+#define COST_CMP		1.0
+#define COST_CONTAINS		5.0
+#define COST_MATCHES		20.0
+
+#define PASS_EXISTS		0.5
+#define PASS_EQ			0.1
+#define PASS_IN			0.2
+#define PASS_CONTAINS		0.2
+#define PASS_OTHER		0.5
+
+/* Keeps the ranks finite */
+#define PASS_MIN		0.01
+#define PASS_MAX		0.99
+
+typedef struct {
+	stnode_t	*node;
+	double		cost;
+	double		pass;
+	double		rank;
+} operand_t;
+
+static stnode_t *
+optimize(dfwork_t *dfw, stnode_t *st_node);
+
+static void
+dfw_note(dfwork_t *dfw, const char *format, ...) G_GNUC_PRINTF(2, 3);
+
+static void
+dfw_note(dfwork_t *dfw, const char *format, ...)
+{
+	va_list	args;
+
+	va_start(args, format);
+	g_ptr_array_add(dfw->optimizations, g_strdup_vprintf(format, args));
+	va_end(args);
+}
+
+/* Collects the operands of a chain of tests joined by "op", freeing the
+ * nodes that joined them. */
+static void
+flatten(stnode_t *st_node, test_op_t op, GPtrArray *operands)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+
+	if (stnode_type_id(st_node) == STTYPE_TEST) {
+		sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+		if (st_op == op) {
+			sttype_test_set2_args(st_node, NULL, NULL);
+			stnode_free(st_node);
+			flatten(st_arg1, op, operands);
+			flatten(st_arg2, op, operands);
+			return;
+		}
+	}
+	g_ptr_array_add(operands, st_node);
+}
+
+/* Joins the operands back together, left to right, as the grammar does */
+static stnode_t *
+unflatten(GPtrArray *operands, test_op_t op)
+{
+	stnode_t	*st_node, *st_test;
+	guint		i;
+
+	st_node = (stnode_t *)g_ptr_array_index(operands, 0);
+	for (i = 1; i < operands->len; i++) {
+		st_test = stnode_new(STTYPE_TEST, NULL);
+		sttype_test_set2(st_test, op, st_node,
+			(stnode_t *)g_ptr_array_index(operands, i));
+		st_node = st_test;
+	}
+	return st_node;
+}
+
+/* Whether all the elements of a set are constants */
+static gboolean
+set_is_const(stnode_t *st_set)
+{
+	GSList		*nodelist;
+
+	for (nodelist = (GSList *)stnode_data(st_set); nodelist;
+	     nodelist = g_slist_next(nodelist)) {
+		/* Both bounds of a range, or a value and NULL */
+		if (nodelist->data &&
+		    stnode_type_id((stnode_t *)nodelist->data) != STTYPE_FVALUE) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* If a test is "field == constant", "constant == field" or "field in
+ * {constants}", returns the first field of that name, which is what
+ * gencode reads.  Otherwise returns NULL. */
+static header_field_info *
+eq_const_field(stnode_t *st_node)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	header_field_info *hfinfo;
+
+	if (stnode_type_id(st_node) != STTYPE_TEST) {
+		return NULL;
+	}
+	sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	if (st_op == TEST_OP_EQ) {
+		if (stnode_type_id(st_arg2) == STTYPE_FIELD &&
+		    stnode_type_id(st_arg1) == STTYPE_FVALUE) {
+			/* Put the field on the left */
+			sttype_test_set2_args(st_node, st_arg2, st_arg1);
+			st_arg1 = st_arg2;
+		}
+		else if (stnode_type_id(st_arg1) != STTYPE_FIELD ||
+			 stnode_type_id(st_arg2) != STTYPE_FVALUE) {
+			return NULL;
+		}
+	}
+	else if (st_op == TEST_OP_IN) {
+		if (stnode_type_id(st_arg1) != STTYPE_FIELD ||
+		    !set_is_const(st_arg2)) {
+			return NULL;
+		}
+	}
+	else {
+		return NULL;
+	}
+
+	hfinfo = (header_field_info *)stnode_data(st_arg1);
+	while (hfinfo->same_name_prev_id != -1) {
+		hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
+	}
+	return hfinfo;
+}
+
+/* Takes the set elements out of a test from eq_const_field() and frees
+ * what's left of it. */
+static GSList *
+steal_elements(stnode_t *st_node)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	GSList		*nodelist;
+
+	sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+	if (st_op == TEST_OP_IN) {
+		nodelist = (GSList *)stnode_steal_data(st_arg2);
+		stnode_free(st_arg2);
+	}
+	else {
+		nodelist = g_slist_append(NULL, st_arg2);
+		nodelist = g_slist_append(nodelist, NULL);
+	}
+	sttype_test_set2_args(st_node, NULL, NULL);
+	stnode_free(st_arg1);
+	stnode_free(st_node);
+	return nodelist;
+}
+
+/* Merges the operands of an "or" that test the same field for equality
+ * with constants into one "in" test, which gencode can turn into a
+ * single lookup.  The merged test takes the place of the first. */
+static void
+merge_eq_tests(dfwork_t *dfw, GPtrArray *operands)
+{
+	GHashTable	*counts;
+	GHashTable	*merged;
+	header_field_info *hfinfo;
+	stnode_t	*st_node, *st_first, *st_arg1, *st_arg2;
+	test_op_t	st_op;
+	GSList		*nodelist;
+	guint		i, j;
+
+	counts = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0; i < operands->len; i++) {
+		hfinfo = eq_const_field((stnode_t *)g_ptr_array_index(operands, i));
+		if (hfinfo) {
+			g_hash_table_insert(counts, hfinfo, GUINT_TO_POINTER(
+				GPOINTER_TO_UINT(g_hash_table_lookup(counts, hfinfo)) + 1));
+		}
+	}
+
+	/* hfinfo -> the operand the others are merged into */
+	merged = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (i = 0, j = 0; i < operands->len; i++) {
+		st_node = (stnode_t *)g_ptr_array_index(operands, i);
+		hfinfo = eq_const_field(st_node);
+		if (!hfinfo || GPOINTER_TO_UINT(g_hash_table_lookup(counts, hfinfo)) < 2) {
+			g_ptr_array_index(operands, j++) = st_node;
+			continue;
+		}
+
+		st_first = (stnode_t *)g_hash_table_lookup(merged, hfinfo);
+		if (!st_first) {
+			/* Make it the "in" test, if it isn't already */
+			sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+			if (st_op != TEST_OP_IN) {
+				nodelist = g_slist_append(NULL, st_arg2);
+				nodelist = g_slist_append(nodelist, NULL);
+				sttype_test_set2(st_node, TEST_OP_IN, st_arg1,
+					stnode_new(STTYPE_SET, nodelist));
+			}
+			g_hash_table_insert(merged, hfinfo, st_node);
+			g_ptr_array_index(operands, j++) = st_node;
+			dfw_note(dfw, "Merged %u tests of \"%s\" for equality into a set",
+				GPOINTER_TO_UINT(g_hash_table_lookup(counts, hfinfo)),
+				hfinfo->abbrev);
+			continue;
+		}
+
+		sttype_test_get(st_first, NULL, NULL, &st_arg2);
+		/* The set isn't empty, so this doesn't change its head */
+		g_slist_concat((GSList *)stnode_data(st_arg2),
+			steal_elements(st_node));
+	}
+	g_ptr_array_set_size(operands, j);
+
+	g_hash_table_destroy(merged);
+	g_hash_table_destroy(counts);
+}
+
+static double
+entity_cost(stnode_t *st_arg)
+{
+	GSList		*params;
+	double		cost;
+
+	switch (stnode_type_id(st_arg)) {
+		case STTYPE_FIELD:
+			return COST_FIELD;
+
+		case STTYPE_RANGE:
+			return COST_RANGE + entity_cost(sttype_range_entity(st_arg));
+
+		case STTYPE_FUNCTION:
+			cost = COST_FUNCTION;
+			for (params = sttype_function_params(st_arg); params;
+			     params = g_slist_next(params)) {
+				cost += entity_cost((stnode_t *)params->data);
+			}
+			return cost;
+
+		default:
+			/* Constants are loaded before the filter runs */
+			return 0.0;
+	}
+}
+
+/* Estimates what a test costs, and how likely it is to be true */
+static void
+estimate(stnode_t *st_node, double *p_cost, double *p_pass)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	GSList		*nodelist;
+	double		cost1, pass1, cost2, pass2;
+
+	sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	switch (st_op) {
+		case TEST_OP_EXISTS:
+			*p_cost = COST_EXISTS;
+			*p_pass = PASS_EXISTS;
+			return;
+
+		case TEST_OP_NOT:
+			estimate(st_arg1, p_cost, &pass1);
+			*p_pass = 1.0 - pass1;
+			return;
+
+		case TEST_OP_AND:
+			estimate(st_arg1, &cost1, &pass1);
+			estimate(st_arg2, &cost2, &pass2);
+			*p_cost = cost1 + pass1 * cost2;
+			*p_pass = pass1 * pass2;
+			return;
+
+		case TEST_OP_OR:
+			estimate(st_arg1, &cost1, &pass1);
+			estimate(st_arg2, &cost2, &pass2);
+			*p_cost = cost1 + (1.0 - pass1) * cost2;
+			*p_pass = 1.0 - (1.0 - pass1) * (1.0 - pass2);
+			return;
+
+		case TEST_OP_IN:
+			*p_cost = entity_cost(st_arg1);
+			if (set_is_const(st_arg2)) {
+				/* Possibly a single lookup */
+				*p_cost += COST_CMP;
+			}
+			else {
+				for (nodelist = (GSList *)stnode_data(st_arg2); nodelist;
+				     nodelist = g_slist_next(g_slist_next(nodelist))) {
+					*p_cost += COST_CMP + entity_cost((stnode_t *)nodelist->data);
+				}
+			}
+			*p_pass = PASS_IN;
+			return;
+
+		case TEST_OP_CONTAINS:
+			*p_cost = entity_cost(st_arg1) + entity_cost(st_arg2) + COST_CONTAINS;
+			*p_pass = PASS_CONTAINS;
+			return;
+
+		case TEST_OP_MATCHES:
+			*p_cost = entity_cost(st_arg1) + entity_cost(st_arg2) + COST_MATCHES;
+			*p_pass = PASS_CONTAINS;
+			return;
+
+		case TEST_OP_EQ:
+			*p_cost = entity_cost(st_arg1) + entity_cost(st_arg2) + COST_CMP;
+			*p_pass = PASS_EQ;
+			return;
+
+		case TEST_OP_NE:
+		case TEST_OP_GT:
+		case TEST_OP_GE:
+		case TEST_OP_LT:
+		case TEST_OP_LE:
+		case TEST_OP_BITWISE_AND:
+			*p_cost = entity_cost(st_arg1) + entity_cost(st_arg2) + COST_CMP;
+			*p_pass = PASS_OTHER;
+			return;
+
+		case TEST_OP_UNINITIALIZED:
+			break;
+	}
+	g_assert_not_reached();
+}
+
+static gint
+compare_rank(gconstpointer a, gconstpointer b, gpointer user_data _U_)
+{
+	const operand_t	*op_a = (const operand_t *)a;
+	const operand_t	*op_b = (const operand_t *)b;
+
+	if (op_a->rank < op_b->rank)
+		return -1;
+	if (op_a->rank > op_b->rank)
+		return 1;
+	return 0;
+}
+
+/* Puts the operands of an "and" or an "or" in the order that's cheapest
+ * on average: the tests are independent as far as we know, so that's
+ * by increasing cost per chance of deciding the outcome.  Tests have
+ * no side effects, so the order doesn't change the result. */
+static void
+order_by_cost(dfwork_t *dfw, GPtrArray *operands, test_op_t op)
+{
+	operand_t	*ops;
+	double		pass;
+	gboolean	reordered = FALSE;
+	guint		i;
+
+	ops = g_new(operand_t, operands->len);
+	for (i = 0; i < operands->len; i++) {
+		ops[i].node = (stnode_t *)g_ptr_array_index(operands, i);
+		estimate(ops[i].node, &ops[i].cost, &pass);
+		pass = CLAMP(pass, PASS_MIN, PASS_MAX);
+		/* An "and" is decided by a false operand, an "or" by a
+		 * true one */
+		ops[i].rank = ops[i].cost / (op == TEST_OP_AND ? 1.0 - pass : pass);
+	}
+
+	/* Stable, so ties keep the order they were written in */
+	g_qsort_with_data(ops, operands->len, sizeof(operand_t),
+		compare_rank, NULL);
+
+	for (i = 0; i < operands->len; i++) {
+		if (g_ptr_array_index(operands, i) != ops[i].node) {
+			g_ptr_array_index(operands, i) = ops[i].node;
+			reordered = TRUE;
+		}
+	}
+	g_free(ops);
+
+	if (reordered) {
+		dfw_note(dfw, "Reordered the %u operands of an \"%s\" by estimated cost",
+			operands->len, op == TEST_OP_AND ? "and" : "or");
+	}
+}
+
+static stnode_t *
+optimize(dfwork_t *dfw, stnode_t *st_node)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1;
+	GPtrArray	*operands;
+	guint		i;
+
+	if (stnode_type_id(st_node) != STTYPE_TEST) {
+		return st_node;
+	}
+
+	sttype_test_get(st_node, &st_op, &st_arg1, NULL);
+	switch (st_op) {
+		case TEST_OP_NOT:
+			sttype_test_set2_args(st_node, optimize(dfw, st_arg1), NULL);
+			return st_node;
+
+		case TEST_OP_AND:
+		case TEST_OP_OR:
+			operands = g_ptr_array_new();
+			flatten(st_node, st_op, operands);
+			for (i = 0; i < operands->len; i++) {
+				g_ptr_array_index(operands, i) = optimize(dfw,
+					(stnode_t *)g_ptr_array_index(operands, i));
+			}
+			if (st_op == TEST_OP_OR) {
+				merge_eq_tests(dfw, operands);
+			}
+			order_by_cost(dfw, operands, st_op);
+			st_node = unflatten(operands, st_op);
+			g_ptr_array_free(operands, TRUE);
+			return st_node;
+
+		default:
+			return st_node;
+	}
+}
+
+void
+dfw_optimize(dfwork_t *dfw)
+{
+	dfw->st_root = optimize(dfw, dfw->st_root);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,17 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+/* Rewrites the checked syntax tree into one that's cheaper to run, and
+ * notes what it did in dfw->optimizations. */
+void
+dfw_optimize(dfwork_t *dfw);
+
+#endif
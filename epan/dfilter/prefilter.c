@@ -0,0 +1,383 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "dfilter-int.h"
+#include "prefilter.h"
+#include "syntax-tree.h"
+#include "sttype-test.h"
+
+#include <epan/strutil.h>
+#include <epan/to_str.h>
+#include <epan/tvbuff.h>
+
+/*
+ * A prefilter is a condition on the raw data of a packet that has to
+ * hold for the filter to match it, so that packets which fail it needn't
+ * be dissected.  It's only built from tests whose outcome the raw data
+ * decides: the frame lengths, and "frame contains".  Tests on protocols
+ * and ports can't be decided that way, as heuristic dissectors, "Decode
+ * As" and tunnels put protocols where no port number says they are.
+ */
+typedef enum {
+	PF_AND,
+	PF_OR,
+	PF_NOT,
+	PF_LEN,		/* frame.len <op> value */
+	PF_CAP_LEN,	/* frame.cap_len <op> value */
+	PF_CONTAINS	/* frame contains bytes */
+} pf_type_t;
+
+struct _prefilter {
+	pf_type_t	type;
+	test_op_t	op;
+	guint32		value;
+	guint8		*bytes;
+	guint		bytes_len;
+	prefilter_t	*left;
+	prefilter_t	*right;
+};
+
+static prefilter_t *
+pf_new(pf_type_t type, prefilter_t *left, prefilter_t *right)
+{
+	prefilter_t	*pf;
+
+	pf = g_new0(prefilter_t, 1);
+	pf->type = type;
+	pf->left = left;
+	pf->right = right;
+	return pf;
+}
+
+void
+prefilter_free(prefilter_t *pf)
+{
+	if (!pf)
+		return;
+
+	prefilter_free(pf->left);
+	prefilter_free(pf->right);
+	g_free(pf->bytes);
+	g_free(pf);
+}
+
+/* The same comparison with its operands swapped */
+static test_op_t
+mirror_op(test_op_t op)
+{
+	switch (op) {
+		case TEST_OP_GT:
+			return TEST_OP_LT;
+		case TEST_OP_GE:
+			return TEST_OP_LE;
+		case TEST_OP_LT:
+			return TEST_OP_GT;
+		case TEST_OP_LE:
+			return TEST_OP_GE;
+		default:
+			return op;
+	}
+}
+
+/* "frame.len <op> constant" or "frame.cap_len <op> constant", either way
+ * around */
+static prefilter_t *
+derive_length(test_op_t st_op, stnode_t *st_arg1, stnode_t *st_arg2)
+{
+	stnode_t	*st_tmp;
+	header_field_info *hfinfo;
+	fvalue_t	*fv;
+	prefilter_t	*pf;
+
+	if (stnode_type_id(st_arg1) == STTYPE_FVALUE &&
+	    stnode_type_id(st_arg2) == STTYPE_FIELD) {
+		st_tmp = st_arg1;
+		st_arg1 = st_arg2;
+		st_arg2 = st_tmp;
+		st_op = mirror_op(st_op);
+	}
+	if (stnode_type_id(st_arg1) != STTYPE_FIELD ||
+	    stnode_type_id(st_arg2) != STTYPE_FVALUE) {
+		return NULL;
+	}
+
+	hfinfo = (header_field_info *)stnode_data(st_arg1);
+	fv = (fvalue_t *)stnode_data(st_arg2);
+	if (fvalue_type_ftenum(fv) != FT_UINT32) {
+		return NULL;
+	}
+
+	if (strcmp(hfinfo->abbrev, "frame.len") == 0) {
+		pf = pf_new(PF_LEN, NULL, NULL);
+	}
+	else if (strcmp(hfinfo->abbrev, "frame.cap_len") == 0) {
+		pf = pf_new(PF_CAP_LEN, NULL, NULL);
+	}
+	else {
+		return NULL;
+	}
+	pf->op = st_op;
+	pf->value = fvalue_get_uinteger(fv);
+	return pf;
+}
+
+/* "frame contains constant" */
+static prefilter_t *
+derive_contains(stnode_t *st_arg1, stnode_t *st_arg2)
+{
+	header_field_info *hfinfo;
+	fvalue_t	*fv;
+	tvbuff_t	*tvb;
+	prefilter_t	*pf;
+
+	if (stnode_type_id(st_arg1) != STTYPE_FIELD ||
+	    stnode_type_id(st_arg2) != STTYPE_FVALUE) {
+		return NULL;
+	}
+
+	hfinfo = (header_field_info *)stnode_data(st_arg1);
+	if (strcmp(hfinfo->abbrev, "frame") != 0) {
+		return NULL;
+	}
+
+	fv = (fvalue_t *)stnode_data(st_arg2);
+	if (fvalue_type_ftenum(fv) != FT_PROTOCOL) {
+		return NULL;
+	}
+	tvb = fv->value.protocol.tvb;
+	if (tvb == NULL || tvb_captured_length(tvb) == 0) {
+		return NULL;
+	}
+
+	pf = pf_new(PF_CONTAINS, NULL, NULL);
+	pf->bytes_len = tvb_captured_length(tvb);
+	pf->bytes = (guint8 *)tvb_memdup(NULL, tvb, 0, pf->bytes_len);
+	return pf;
+}
+
+/*
+ * Returns a condition that holds whenever st_node does, or NULL if there
+ * isn't one.  *exact is set if the condition holds only when st_node
+ * does, which is what it takes for a "not" to be derived from it.
+ */
+static prefilter_t *
+derive(stnode_t *st_node, gboolean *exact)
+{
+	test_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	prefilter_t	*pf1, *pf2;
+	gboolean	exact1, exact2;
+
+	*exact = FALSE;
+	if (stnode_type_id(st_node) != STTYPE_TEST) {
+		return NULL;
+	}
+	sttype_test_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	switch (st_op) {
+		case TEST_OP_AND:
+			pf1 = derive(st_arg1, &exact1);
+			pf2 = derive(st_arg2, &exact2);
+			/* Either side on its own is still necessary */
+			if (pf1 == NULL)
+				return pf2;
+			if (pf2 == NULL)
+				return pf1;
+			*exact = exact1 && exact2;
+			return pf_new(PF_AND, pf1, pf2);
+
+		case TEST_OP_OR:
+			pf1 = derive(st_arg1, &exact1);
+			pf2 = derive(st_arg2, &exact2);
+			if (pf1 == NULL || pf2 == NULL) {
+				prefilter_free(pf1);
+				prefilter_free(pf2);
+				return NULL;
+			}
+			*exact = exact1 && exact2;
+			return pf_new(PF_OR, pf1, pf2);
+
+		case TEST_OP_NOT:
+			pf1 = derive(st_arg1, &exact1);
+			if (!exact1) {
+				prefilter_free(pf1);
+				return NULL;
+			}
+			*exact = TRUE;
+			return pf_new(PF_NOT, pf1, NULL);
+
+		case TEST_OP_EQ:
+		case TEST_OP_NE:
+		case TEST_OP_GT:
+		case TEST_OP_GE:
+		case TEST_OP_LT:
+		case TEST_OP_LE:
+			/* Every packet has exactly one of each length */
+			pf1 = derive_length(st_op, st_arg1, st_arg2);
+			*exact = (pf1 != NULL);
+			return pf1;
+
+		case TEST_OP_CONTAINS:
+			/* The bytes being there doesn't say that the test
+			 * is true, so this is never exact. */
+			return derive_contains(st_arg1, st_arg2);
+
+		default:
+			return NULL;
+	}
+}
+
+prefilter_t *
+dfw_prefilter(dfwork_t *dfw)
+{
+	gboolean	exact;
+
+	return derive(dfw->st_root, &exact);
+}
+
+static gboolean
+compare(test_op_t op, guint32 a, guint32 b)
+{
+	switch (op) {
+		case TEST_OP_EQ:
+			return a == b;
+		case TEST_OP_NE:
+			return a != b;
+		case TEST_OP_GT:
+			return a > b;
+		case TEST_OP_GE:
+			return a >= b;
+		case TEST_OP_LT:
+			return a < b;
+		case TEST_OP_LE:
+			return a <= b;
+		default:
+			g_assert_not_reached();
+			return TRUE;
+	}
+}
+
+gboolean
+prefilter_check(const prefilter_t *pf, const guint8 *data, guint32 caplen,
+		guint32 len)
+{
+	switch (pf->type) {
+		case PF_AND:
+			return prefilter_check(pf->left, data, caplen, len) &&
+				prefilter_check(pf->right, data, caplen, len);
+		case PF_OR:
+			return prefilter_check(pf->left, data, caplen, len) ||
+				prefilter_check(pf->right, data, caplen, len);
+		case PF_NOT:
+			return !prefilter_check(pf->left, data, caplen, len);
+		case PF_LEN:
+			return compare(pf->op, len, pf->value);
+		case PF_CAP_LEN:
+			return compare(pf->op, caplen, pf->value);
+		case PF_CONTAINS:
+			return epan_memmem(data, caplen, pf->bytes,
+				pf->bytes_len) != NULL;
+	}
+	g_assert_not_reached();
+	return TRUE;
+}
+
+static const char *
+op_to_str(test_op_t op)
+{
+	switch (op) {
+		case TEST_OP_EQ:
+			return "==";
+		case TEST_OP_NE:
+			return "!=";
+		case TEST_OP_GT:
+			return ">";
+		case TEST_OP_GE:
+			return ">=";
+		case TEST_OP_LT:
+			return "<";
+		case TEST_OP_LE:
+			return "<=";
+		default:
+			return "?";
+	}
+}
+
+static void
+append_str(GString *str, const prefilter_t *pf);
+
+/* Parenthesizes an operand that binds less tightly than its parent */
+static void
+append_operand(GString *str, const prefilter_t *pf, pf_type_t parent)
+{
+	if ((pf->type == PF_AND || pf->type == PF_OR) && pf->type != parent) {
+		g_string_append_c(str, '(');
+		append_str(str, pf);
+		g_string_append_c(str, ')');
+	}
+	else {
+		append_str(str, pf);
+	}
+}
+
+static void
+append_str(GString *str, const prefilter_t *pf)
+{
+	char	*s;
+
+	switch (pf->type) {
+		case PF_AND:
+		case PF_OR:
+			append_operand(str, pf->left, pf->type);
+			g_string_append(str, pf->type == PF_AND ? " && " : " || ");
+			append_operand(str, pf->right, pf->type);
+			break;
+		case PF_NOT:
+			g_string_append_c(str, '!');
+			append_operand(str, pf->left, pf->type);
+			break;
+		case PF_LEN:
+		case PF_CAP_LEN:
+			g_string_append_printf(str, "%s %s %u",
+				pf->type == PF_LEN ? "frame.len" : "frame.cap_len",
+				op_to_str(pf->op), pf->value);
+			break;
+		case PF_CONTAINS:
+			s = bytestring_to_str(NULL, pf->bytes, pf->bytes_len, ':');
+			g_string_append_printf(str, "frame contains %s", s);
+			wmem_free(NULL, s);
+			break;
+	}
+}
+
+char *
+prefilter_to_str(const prefilter_t *pf)
+{
+	GString	*str;
+
+	str = g_string_new(NULL);
+	append_str(str, pf);
+	return g_string_free(str, FALSE);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,32 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+typedef struct _prefilter prefilter_t;
+
+/* Derives, from the checked syntax tree, the conditions that a packet's
+ * raw data must meet for the filter to match it.  Returns NULL if the
+ * filter doesn't place any that can be checked without dissecting. */
+prefilter_t *
+dfw_prefilter(dfwork_t *dfw);
+
+/* Returns FALSE if a packet with this data can't match the filter */
+gboolean
+prefilter_check(const prefilter_t *pf, const guint8 *data, guint32 caplen,
+		guint32 len);
+
+/* The conditions, in display filter syntax; g_free() the result */
+char *
+prefilter_to_str(const prefilter_t *pf);
+
+void
+prefilter_free(prefilter_t *pf);
+
+#endif
@@ -790,25 +790,53 @@ check_relation_LHS_FIELD(dfwork_t *dfw, const char *relation_string,
 				break;
 			}
 
+			/* The checks replace the element in the set they're
+			 * given, which they search from its head; give them the
+			 * set from this element on, as sets read from files
+			 * can be large. */
+			stnode_t *st_rest = stnode_new(STTYPE_SET, nodelist);
+			/* The checks free the element when they replace it */
+			guint file_line = stnode_file_line(node);
+
 			nodelist = g_slist_next(nodelist);
 			g_assert(nodelist);
 			stnode_t *node_right = (stnode_t *)nodelist->data;
-			if (node_right) {
-				/* range type, check if comparison is possible. */
-				if (!ftype_can_ge(ftype1)) {
-					dfilter_fail(dfw, "%s (type=%s) cannot participate in '%s' comparison.",
-							hfinfo1->abbrev, ftype_pretty_name(ftype1),
-							">=");
-					THROW(TypeError);
+			TRY {
+				if (node_right) {
+					/* range type, check if comparison is possible. */
+					if (!ftype_can_ge(ftype1)) {
+						dfilter_fail(dfw, "%s (type=%s) cannot participate in '%s' comparison.",
+								hfinfo1->abbrev, ftype_pretty_name(ftype1),
+								">=");
+						THROW(TypeError);
+					}
+					check_relation_LHS_FIELD(dfw, ">=", ftype_can_ge,
+							allow_partial_value, st_rest, st_arg1, node);
+					check_relation_LHS_FIELD(dfw, "<=", ftype_can_le,
+							allow_partial_value, st_rest, st_arg1, node_right);
+				} else {
+					check_relation_LHS_FIELD(dfw, "==", can_func,
+							allow_partial_value, st_rest, st_arg1, node);
+				}
+			}
+			CATCH(TypeError) {
+				/* An element read from a file is given by its
+				 * line, not by its value, which can be anything */
+				if (file_line != 0) {
+					g_free(dfw->error_message);
+					dfw->error_message = NULL;
+					dfilter_fail(dfw, "Line %u of the set isn't a valid value for %s (type=%s).",
+							file_line, hfinfo1->abbrev,
+							ftype_pretty_name(ftype1));
 				}
-				check_relation_LHS_FIELD(dfw, ">=", ftype_can_ge,
-						allow_partial_value, st_arg2, st_arg1, node);
-				check_relation_LHS_FIELD(dfw, "<=", ftype_can_le,
-						allow_partial_value, st_arg2, st_arg1, node_right);
-			} else {
-				check_relation_LHS_FIELD(dfw, "==", can_func,
-						allow_partial_value, st_arg2, st_arg1, node);
+				RETHROW;
+			}
+			FINALLY {
+				/* The elements belong to st_arg2 */
+				stnode_steal_data(st_rest);
+				stnode_free(st_rest);
 			}
+			ENDTRY;
 			nodelist = g_slist_next(nodelist);
 		}
 	}
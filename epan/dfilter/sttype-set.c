@@ -8,6 +8,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "syntax-tree.h"
 #include "sttype-set.h"
 
@@ -31,6 +33,78 @@ set_nodelist_free(GSList *params)
 	g_slist_free_full(params, slist_stnode_free);
 }
 
+/* A value read by set_nodelist_from_file(); it's modified in place.
+ * The node keeps its line, which errors give instead of the value. */
+static stnode_t *
+set_element_new(char *value, guint line)
+{
+	size_t	len = strlen(value);
+	stnode_t *node;
+
+	if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+		value[len - 1] = '\0';
+		node = stnode_new(STTYPE_STRING, value + 1);
+	}
+	else {
+		node = stnode_new(STTYPE_UNPARSED, value);
+	}
+	stnode_set_file_line(node, line);
+	return node;
+}
+
+gboolean
+set_nodelist_from_file(const char *path, GSList **p_nodelist, char **err_msg)
+{
+	gchar	*contents;
+	gchar	**lines;
+	gchar	*line, *upper;
+	GError	*error = NULL;
+	GSList	*nodelist = NULL;
+	guint	i;
+
+	if (!g_file_get_contents(path, &contents, NULL, &error)) {
+		*err_msg = g_strdup_printf("Couldn't read the set \"%s\": %s",
+			path, error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	/* Built backwards, so that it doesn't take time quadratic in the
+	 * number of elements */
+	for (i = 0; lines[i]; i++) {
+		line = g_strstrip(lines[i]);
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+
+		upper = strstr(line, "..");
+		if (upper) {
+			*upper = '\0';
+			upper = g_strstrip(upper + 2);
+			line = g_strstrip(line);
+			if (line[0] == '\0' || upper[0] == '\0') {
+				*err_msg = g_strdup_printf("Line %u of the set \"%s\" isn't a valid range.",
+					i + 1, path);
+				set_nodelist_free(nodelist);
+				g_strfreev(lines);
+				return FALSE;
+			}
+			nodelist = g_slist_prepend(nodelist, set_element_new(line, i + 1));
+			nodelist = g_slist_prepend(nodelist, set_element_new(upper, i + 1));
+		}
+		else {
+			nodelist = g_slist_prepend(nodelist, set_element_new(line, i + 1));
+			nodelist = g_slist_prepend(nodelist, NULL);
+		}
+	}
+	g_strfreev(lines);
+
+	*p_nodelist = g_slist_reverse(nodelist);
+	return TRUE;
+}
+
 static void
 sttype_set_free(gpointer value)
 {
@@ -23,4 +23,12 @@ sttype_set_convert_to_range(stnode_t **node_left, stnode_t **node_right);
 void
 set_nodelist_free(GSList *params);
 
+/* Reads the elements of a set from a file, one per line, written as they
+ * would be between braces: a value, or "lower..upper".  A value can be
+ * in double quotes.  Blank lines and lines starting with "#" are skipped.
+ * Returns FALSE and sets *err_msg if the file can't be read or a line
+ * isn't an element. */
+gboolean
+set_nodelist_from_file(const char *path, GSList **p_nodelist, char **err_msg);
+
 #endif
@@ -79,6 +79,7 @@ stnode_new(sttype_id_t type_id, gpointer data)
 	node->magic = STNODE_MAGIC;
 	node->deprecated_token = NULL;
 	node->inside_brackets = FALSE;
+	node->file_line = 0;
 
 	if (type_id == STTYPE_UNINITIALIZED) {
 		node->type = NULL;
@@ -106,6 +107,12 @@ stnode_set_bracket(stnode_t *node, gboolean bracket)
 	node->inside_brackets = bracket;
 }
 
+void
+stnode_set_file_line(stnode_t *node, guint line)
+{
+	node->file_line = line;
+}
+
 stnode_t*
 stnode_dup(const stnode_t *org)
 {
@@ -127,6 +134,7 @@ stnode_dup(const stnode_t *org)
 		node->data = org->data;
 	node->value = org->value;
 	node->inside_brackets = org->inside_brackets;
+	node->file_line = org->file_line;
 
 	return node;
 }
@@ -217,6 +225,13 @@ stnode_value(stnode_t *node)
 	return node->value;
 }
 
+guint
+stnode_file_line(stnode_t *node)
+{
+	assert_magic(node, STNODE_MAGIC);
+	return node->file_line;
+}
+
 const char *
 stnode_deprecated(stnode_t *node)
 {
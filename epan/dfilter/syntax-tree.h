@@ -55,6 +55,7 @@ typedef struct {
 	gint32		value;
 	gboolean	inside_brackets;
 	const char	*deprecated_token;
+	guint		file_line;	/* line of a set element read from a file, or 0 */
 } stnode_t;
 
 /* These are the sttype_t registration function prototypes. */
@@ -81,6 +82,9 @@ stnode_new(sttype_id_t type_id, gpointer data);
 void
 stnode_set_bracket(stnode_t *node, gboolean bracket);
 
+void
+stnode_set_file_line(stnode_t *node, guint line);
+
 stnode_t*
 stnode_dup(const stnode_t *org);
 
@@ -111,6 +115,9 @@ stnode_value(stnode_t *node);
 const char *
 stnode_deprecated(stnode_t *node);
 
+guint
+stnode_file_line(stnode_t *node);
+
 #define assert_magic(obj, mnum) \
 	g_assert((obj)); \
 	if ((obj)->magic != (mnum)) { \
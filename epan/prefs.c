@@ -3246,6 +3246,12 @@ prefs_register_modules(void)
                                    10,
                                    &prefs.gui_fileopen_preview);
 
+    prefs_register_bool_preference(gui_module, "fileopen.save_seek_index",
+                                   "Save seek indexes for compressed capture files",
+                                   "Save the positions that decompression can resume from in a \".seekidx\" file"
+                                   " next to each compressed capture file that is read, so it opens faster next time",
+                                   &prefs.gui_fileopen_save_seek_index);
+
     prefs_register_bool_preference(gui_module, "ask_unsaved",
                                    "Ask to save unsaved capture files",
                                    "Ask to save unsaved capture files?",
@@ -4109,6 +4115,7 @@ pre_init_prefs(void)
     g_free(prefs.gui_fileopen_dir);
     prefs.gui_fileopen_dir           = g_strdup(get_persdatafile_dir());
     prefs.gui_fileopen_preview       = 3;
+    prefs.gui_fileopen_save_seek_index = FALSE;
     prefs.gui_ask_unsaved            = TRUE;
     prefs.gui_autocomplete_filter    = TRUE;
     prefs.gui_find_wrap              = TRUE;
@@ -83,7 +83,7 @@ typedef struct _tap_listener_t {
 	gboolean failed;
 	guint flags;
 	gchar *fstring;
-	dfilter_t *code;
+	struct _tap_dfilter_t *dfilter;	/* NULL if there's no filter */
 	void *tapdata;
 	tap_reset_cb reset;
 	tap_packet_cb packet;
@@ -93,6 +93,26 @@ typedef struct _tap_listener_t {
 
 static tap_listener_t *tap_listener_queue=NULL;
 
+/*
+ * Tap listeners with the same filter share one compiled copy of it,
+ * looked up by the canonical text of the filter.  However many of them
+ * there are, the filter is applied at most once to each packet.
+ */
+typedef struct _tap_dfilter_t {
+	gchar *text;		/* canonical text, the key in tap_dfilters */
+	gchar *fstring;		/* text as the first listener using it gave it */
+	dfilter_t *code;
+	guint refcount;
+	guint32 applied_serial;	/* tap_packet_serial when result was found */
+	gboolean result;
+} tap_dfilter_t;
+
+static GHashTable *tap_dfilters=NULL;
+
+/* Counts the packets pushed to the tap listeners, so that a filter's
+   result is known to be for the current one */
+static guint32 tap_packet_serial=0;
+
 #ifdef HAVE_PLUGINS
 static GSList *tap_plugins = NULL;
 
@@ -243,18 +263,20 @@ tap_queue_packet(int tap_id, packet_info *pinfo, const void *tap_specific_data)
 
 void tap_build_interesting (epan_dissect_t *edt)
 {
-	tap_listener_t *tl;
+	GHashTableIter iter;
+	gpointer value;
 
 	/* nothing to do, just return */
 	if(!tap_listener_queue){
 		return;
 	}
 
-	/* loop over all tap listeners and build the list of all
+	/* loop over all tap listener filters and build the list of all
 	   interesting hf_fields */
-	for(tl=tap_listener_queue;tl;tl=tl->next){
-		if(tl->code){
-			epan_dissect_prime_with_dfilter(edt, tl->code);
+	if(tap_dfilters){
+		g_hash_table_iter_init(&iter, tap_dfilters);
+		while(g_hash_table_iter_next(&iter, NULL, &value)){
+			epan_dissect_prime_with_dfilter(edt, ((tap_dfilter_t *)value)->code);
 		}
 	}
 }
@@ -278,6 +300,18 @@ tap_queue_init(epan_dissect_t *edt)
 	tap_build_interesting (edt);
 }
 
+/* Applies a shared filter to the packet being pushed, unless another
+   listener has already done so. */
+static gboolean
+tap_dfilter_apply(tap_dfilter_t *df, epan_dissect_t *edt)
+{
+	if(df->applied_serial!=tap_packet_serial){
+		df->result=dfilter_apply_edt(df->code, edt);
+		df->applied_serial=tap_packet_serial;
+	}
+	return df->result;
+}
+
 /* this function is called after a packet has been fully dissected to push the tapped
    data to all extensions that has callbacks registered.
 */
@@ -300,6 +334,11 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 		return;
 	}
 
+	/* a new packet for the shared filters; 0 means never applied */
+	if(++tap_packet_serial==0){
+		tap_packet_serial=1;
+	}
+
 	/* loop over all tap listeners and call the listener callback
 	   for all packets that match the filter. */
 	for(i=0;i<tap_packet_index;i++){
@@ -329,8 +368,8 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 					/* If we have a filter, see if the
 					 * packet passes.
 					 */
-					if(tl->code){
-						if (!dfilter_apply_edt(tl->code, edt)){
+					if(tl->dfilter){
+						if (!tap_dfilter_apply(tl->dfilter, edt)){
 							/* The packet didn't
 							 * pass the filter. */
 							continue;
@@ -486,6 +525,65 @@ find_tap_id(const char *name)
 	return 0;
 }
 
+/* Gets the shared compiled copy of a filter, compiling the filter if no
+ * listener uses it yet, and takes a reference to it.  *dfp is set to NULL
+ * for an empty filter.
+ */
+static gboolean
+tap_dfilter_get(const char *fstring, tap_dfilter_t **dfp, gchar **err_msg)
+{
+	tap_dfilter_t *df;
+	dfilter_t *code=NULL;
+	gchar *text;
+
+	*dfp=NULL;
+	text=dfilter_canonical_text(fstring);
+	if(!tap_dfilters){
+		tap_dfilters=g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	df=(tap_dfilter_t *)g_hash_table_lookup(tap_dfilters, text);
+	if(df){
+		g_free(text);
+		df->refcount++;
+		*dfp=df;
+		return TRUE;
+	}
+
+	/* Compile what we were given, so that error messages are about it */
+	if(!dfilter_compile(fstring, &code, err_msg)){
+		g_free(text);
+		return FALSE;
+	}
+	if(!code){
+		g_free(text);
+		return TRUE;
+	}
+
+	df=g_new0(tap_dfilter_t, 1);
+	df->text=text;
+	df->fstring=g_strdup(fstring);
+	df->code=code;
+	df->refcount=1;
+	g_hash_table_insert(tap_dfilters, df->text, df);
+	*dfp=df;
+	return TRUE;
+}
+
+/* Drops a reference to a shared filter, freeing it with the last one */
+static void
+tap_dfilter_release(tap_dfilter_t *df)
+{
+	if(!df || --df->refcount){
+		return;
+	}
+	g_hash_table_remove(tap_dfilters, df->text);
+	dfilter_free(df->code);
+	g_free(df->text);
+	g_free(df->fstring);
+	g_free(df);
+}
+
 static void
 free_tap_listener(tap_listener_t *tl)
 {
@@ -498,7 +596,7 @@ free_tap_listener(tap_listener_t *tl)
 	if (tl->finish) {
 		tl->finish(tl->tapdata);
 	}
-	dfilter_free(tl->code);
+	tap_dfilter_release(tl->dfilter);
 	g_free(tl->fstring);
 	g_free(tl);
 }
@@ -516,7 +614,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 {
 	tap_listener_t *tl;
 	int tap_id;
-	dfilter_t *code=NULL;
+	tap_dfilter_t *dfilter=NULL;
 	GString *error_string;
 	gchar *err_msg;
 
@@ -532,7 +630,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 	tl->failed=FALSE;
 	tl->flags=flags;
 	if(fstring){
-		if(!dfilter_compile(fstring, &code, &err_msg)){
+		if(!tap_dfilter_get(fstring, &dfilter, &err_msg)){
 			error_string = g_string_new("");
 			g_string_printf(error_string,
 			    "Filter \"%s\" is invalid - %s",
@@ -543,7 +641,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 		}
 	}
 	tl->fstring=g_strdup(fstring);
-	tl->code=code;
+	tl->dfilter=dfilter;
 
 	tl->tap_id=tap_id;
 	tl->tapdata=tapdata;
@@ -564,7 +662,7 @@ GString *
 set_tap_dfilter(void *tapdata, const char *fstring)
 {
 	tap_listener_t *tl=NULL,*tl2;
-	dfilter_t *code=NULL;
+	tap_dfilter_t *dfilter=NULL;
 	GString *error_string;
 	gchar *err_msg;
 
@@ -585,14 +683,12 @@ set_tap_dfilter(void *tapdata, const char *fstring)
 	}
 
 	if(tl){
-		if(tl->code){
-			dfilter_free(tl->code);
-			tl->code=NULL;
-		}
+		tap_dfilter_release(tl->dfilter);
+		tl->dfilter=NULL;
 		tl->needs_redraw=TRUE;
 		g_free(tl->fstring);
 		if(fstring){
-			if(!dfilter_compile(fstring, &code, &err_msg)){
+			if(!tap_dfilter_get(fstring, &dfilter, &err_msg)){
 				tl->fstring=NULL;
 				error_string = g_string_new("");
 				g_string_printf(error_string,
@@ -603,7 +699,7 @@ set_tap_dfilter(void *tapdata, const char *fstring)
 			}
 		}
 		tl->fstring=g_strdup(fstring);
-		tl->code=code;
+		tl->dfilter=dfilter;
 	}
 
 	return NULL;
@@ -615,26 +711,36 @@ void
 tap_listeners_dfilter_recompile(void)
 {
 	tap_listener_t *tl;
+	tap_dfilter_t *df;
 	dfilter_t *code;
 	gchar *err_msg;
+	GHashTableIter iter;
+	gpointer value;
 
 	for(tl=tap_listener_queue;tl;tl=tl->next){
-		if(tl->code){
-			dfilter_free(tl->code);
-			tl->code=NULL;
-		}
 		tl->needs_redraw=TRUE;
+	}
+
+	if(!tap_dfilters){
+		return;
+	}
+
+	/* The listeners sharing a filter keep sharing it; compile what was
+	 * typed, as when it was first compiled, not the canonical text */
+	g_hash_table_iter_init(&iter, tap_dfilters);
+	while(g_hash_table_iter_next(&iter, NULL, &value)){
+		df=(tap_dfilter_t *)value;
+		dfilter_free(df->code);
 		code=NULL;
-		if(tl->fstring){
-			if(!dfilter_compile(tl->fstring, &code, &err_msg)){
+		if(!dfilter_compile(df->fstring, &code, &err_msg)){
+			g_free(err_msg);
+			err_msg = NULL;
+			/* Not valid, make a dfilter matching no packets */
+			if (!dfilter_compile("frame.number == 0", &code, &err_msg))
 				g_free(err_msg);
-				err_msg = NULL;
-				/* Not valid, make a dfilter matching no packets */
-				if (!dfilter_compile("frame.number == 0", &code, &err_msg))
-					g_free(err_msg);
-			}
 		}
-		tl->code=code;
+		df->code=code;
+		df->applied_serial=0;
 	}
 }
 
@@ -714,7 +820,7 @@ have_filtering_tap_listeners(void)
 	tap_listener_t *tl;
 
 	for(tl=tap_listener_queue;tl;tl=tl->next){
-		if(tl->code)
+		if(tl->dfilter)
 			return TRUE;
 	}
 	return FALSE;
@@ -750,6 +856,11 @@ void tap_cleanup(void)
 		free_tap_listener(elem_lq);
 	}
 
+	if(tap_dfilters){
+		g_hash_table_destroy(tap_dfilters);
+		tap_dfilters=NULL;
+	}
+
 	while(head_dl){
 		elem_dl = head_dl;
 		head_dl = head_dl->next;
@@ -248,6 +248,7 @@ cf_open(capture_file *cf, const char *fname, unsigned int type, gboolean is_temp
   wth = wtap_open_offline(fname, type, err, &err_info, TRUE);
   if (wth == NULL)
     goto fail;
+  wtap_set_save_seek_index(wth, prefs.gui_fileopen_save_seek_index);
 
   /* The open succeeded.  Close whatever capture file we had open,
      and fill in the information for this file. */
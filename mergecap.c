@@ -66,6 +66,8 @@ print_usage(FILE *output)
   fprintf(output, "  -w <outfile>|-    set the output filename to <outfile> or '-' for stdout.\n");
   fprintf(output, "  -F <capture type> set the output file type; default is pcapng.\n");
   fprintf(output, "                    an empty \"-F\" option will list the file types.\n");
+  fprintf(output, "  --compress <type> compress the output file with <type>, one of \"gz\",\n");
+  fprintf(output, "                    \"zst\" or \"lz4\"; default is \"none\".\n");
   fprintf(output, "  -I <IDB merge mode> set the merge mode for Interface Description Blocks; default is 'all'.\n");
   fprintf(output, "                    an empty \"-I\" option will list the merge modes.\n");
   fprintf(output, "\n");
@@ -227,9 +229,11 @@ main(int argc, char *argv[])
 {
   char               *init_progfile_dir_error;
   int                 opt;
+#define LONGOPT_COMPRESS LONGOPT_BASE_APPLICATION+1
   static const struct option long_options[] = {
       {"help", no_argument, NULL, 'h'},
       {"version", no_argument, NULL, 'V'},
+      {"compress", required_argument, NULL, LONGOPT_COMPRESS},
       {0, 0, 0, 0 }
   };
   gboolean            do_append          = FALSE;
@@ -237,6 +241,7 @@ main(int argc, char *argv[])
   int                 in_file_count      = 0;
   guint32             snaplen            = 0;
   int                 file_type          = WTAP_FILE_TYPE_SUBTYPE_PCAPNG; /* default to pcapng format */
+  int                 compression_type   = WTAP_UNCOMPRESSED;
   int                 err                = 0;
   gchar              *err_info           = NULL;
   int                 err_fileno;
@@ -296,6 +301,16 @@ main(int argc, char *argv[])
       }
       break;
 
+    case LONGOPT_COMPRESS:
+      compression_type = wtap_name_to_compression_type(optarg);
+      if (compression_type < 0) {
+        fprintf(stderr, "mergecap: \"%s\" isn't a valid compression type, or isn't supported in this build\n",
+                optarg);
+        status = MERGE_ERR_INVALID_OPTION;
+        goto clean_exit;
+      }
+      break;
+
     case 'h':
       show_help_header("Merge two or more capture files into one.");
       print_usage(stdout);
@@ -381,6 +396,7 @@ main(int argc, char *argv[])
   if (strcmp(out_filename, "-") == 0) {
     /* merge the files to the standard output */
     status = merge_files_to_stdout(file_type,
+                                   (wtap_compression_type)compression_type,
                                    (const char *const *) &argv[optind],
                                    in_file_count, do_append, mode, snaplen,
                                    get_appname_and_version(),
@@ -389,6 +405,7 @@ main(int argc, char *argv[])
   } else {
     /* merge the files to the outfile */
     status = merge_files(out_filename, file_type,
+                         (wtap_compression_type)compression_type,
                          (const char *const *) &argv[optind], in_file_count,
                          do_append, mode, snaplen, get_appname_and_version(),
                          verbose ? &cb : NULL,
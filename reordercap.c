@@ -25,6 +25,7 @@
 #include "wsutil/wsgetopt.h"
 #endif
 
+#include <ui/clopts_common.h>
 #include <ui/cmdarg_err.h>
 #include <wsutil/filesystem.h>
 #include <wsutil/file_util.h>
@@ -44,6 +45,7 @@
 #define INVALID_OPTION 1
 #define OPEN_ERROR 2
 #define OUTPUT_FILE_ERROR 1
+#define ORDER_ERROR 3
 
 /* Show command-line usage */
 static void
@@ -54,6 +56,10 @@ print_usage(FILE *output)
     fprintf(output, "\n");
     fprintf(output, "Options:\n");
     fprintf(output, "  -n        don't write to output file if the input file is ordered.\n");
+    fprintf(output, "  -w <n>    only move frames by up to <n> places, reading the input\n");
+    fprintf(output, "            file once and holding only <n> frames in memory.\n");
+    fprintf(output, "  -m <n>    hold at most <n> frames in memory, sorting them into\n");
+    fprintf(output, "            temporary files and then merging those.\n");
     fprintf(output, "  -h        display this help and exit.\n");
 }
 
@@ -61,6 +67,7 @@ print_usage(FILE *output)
 typedef struct FrameRecord_t {
     gint64       offset;
     guint        num;
+    guint        run;           /* sorted run it belongs to, with -m */
 
     nstime_t     frame_time;
 } FrameRecord_t;
@@ -80,7 +87,7 @@ typedef struct FrameRecord_t {
 /**************************************************/
 
 
-static void
+static gboolean
 frame_write(FrameRecord_t *frame, wtap *wth, wtap_dumper *pdh,
             wtap_rec *rec, Buffer *buf, const char *infile,
             const char *outfile)
@@ -100,7 +107,7 @@ frame_write(FrameRecord_t *frame, wtap *wth, wtap_dumper *pdh,
                     "reordercap: An error occurred while re-reading \"%s\".\n",
                     infile);
             cfile_read_failure_message("reordercap", infile, err, err_info);
-            exit(1);
+            return FALSE;
         }
     }
 
@@ -114,8 +121,9 @@ frame_write(FrameRecord_t *frame, wtap *wth, wtap_dumper *pdh,
         cfile_write_failure_message("reordercap", infile, outfile, err,
                                     err_info, frame->num,
                                     wtap_file_type_subtype(wth));
-        exit(1);
+        return FALSE;
     }
+    return TRUE;
 }
 
 /* Comparing timestamps between 2 frames.
@@ -135,6 +143,518 @@ frames_compare(gconstpointer a, gconstpointer b)
     return nstime_cmp(time1, time2);
 }
 
+static void
+frame_record_init(FrameRecord_t *frame, guint num, gint64 offset,
+                  const wtap_rec *rec)
+{
+    frame->num = num;
+    frame->offset = offset;
+    frame->run = 0;
+    if (rec->presence_flags & WTAP_HAS_TS) {
+        frame->frame_time = rec->ts;
+    } else {
+        nstime_set_unset(&frame->frame_time);
+    }
+}
+
+/* Whether frame a goes before frame b: by run, then by timestamp, then
+   in the order they were read, so that frames with the same timestamp
+   stay in the same order, as they do with g_ptr_array_sort(). */
+static gboolean
+frame_before(const FrameRecord_t *a, const FrameRecord_t *b)
+{
+    int cmp;
+
+    if (a->run != b->run)
+        return a->run < b->run;
+    cmp = nstime_cmp(&a->frame_time, &b->frame_time);
+    if (cmp != 0)
+        return cmp < 0;
+    return a->num < b->num;
+}
+
+/* Binary min-heap of frames, in frame_before() order */
+typedef struct FrameHeap_t {
+    FrameRecord_t *frames;
+    guint          count;
+} FrameHeap_t;
+
+static void
+frame_heap_push(FrameHeap_t *heap, const FrameRecord_t *frame)
+{
+    guint pos = heap->count++;
+
+    while (pos > 0) {
+        guint parent = (pos - 1) / 2;
+
+        if (!frame_before(frame, &heap->frames[parent]))
+            break;
+        heap->frames[pos] = heap->frames[parent];
+        pos = parent;
+    }
+    heap->frames[pos] = *frame;
+}
+
+static void
+frame_heap_pop(FrameHeap_t *heap, FrameRecord_t *frame)
+{
+    FrameRecord_t *last;
+    guint pos = 0;
+
+    *frame = heap->frames[0];
+    last = &heap->frames[--heap->count];
+    for (;;) {
+        guint child = 2 * pos + 1;
+
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+            frame_before(&heap->frames[child + 1], &heap->frames[child]))
+            child++;
+        if (!frame_before(&heap->frames[child], last))
+            break;
+        heap->frames[pos] = heap->frames[child];
+        pos = child;
+    }
+    heap->frames[pos] = *last;
+}
+
+/*
+ * Read through the input file, just counting the frames that are out
+ * of order, for -n with -w or -m, which write as they go.
+ */
+static gboolean
+count_wrong_order(const char *infile, guint *frame_count,
+                  guint *wrong_order_count)
+{
+    wtap *wth;
+    wtap_rec rec;
+    Buffer buf;
+    int err;
+    gchar *err_info;
+    gint64 data_offset;
+    FrameRecord_t frame, prev;
+
+    wth = wtap_open_offline(infile, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
+    if (wth == NULL) {
+        cfile_open_failure_message("reordercap", infile, err, err_info);
+        return FALSE;
+    }
+    *frame_count = 0;
+    *wrong_order_count = 0;
+    wtap_rec_init(&rec);
+    ws_buffer_init(&buf, 1514);
+    while (wtap_read(wth, &rec, &buf, &err, &err_info, &data_offset)) {
+        frame_record_init(&frame, ++*frame_count, data_offset, &rec);
+        if (*frame_count > 1 &&
+            nstime_cmp(&frame.frame_time, &prev.frame_time) < 0) {
+            (*wrong_order_count)++;
+        }
+        prev = frame;
+    }
+    wtap_rec_cleanup(&rec);
+    ws_buffer_free(&buf);
+    wtap_close(wth);
+    if (err != 0) {
+        cfile_read_failure_message("reordercap", infile, err, err_info);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Sort with -w: for files where frames are only a little out of order,
+ * as when they come from several queues on one NIC, keep the last
+ * "window" frames read in a heap, and each time another frame is read,
+ * write the earliest.  The input file is read once, and frames are
+ * re-read from close to where we're reading.
+ *
+ * Frames that were too far out of place to be put in order are written
+ * as soon as they're read, and counted in "late_count".  Returns FALSE
+ * if a frame couldn't be written.
+ */
+static gboolean
+reorder_window(wtap *wth, wtap_dumper *pdh, guint window,
+               const char *infile, const char *outfile,
+               guint *frame_count, guint *wrong_order_count,
+               guint *late_count)
+{
+    FrameHeap_t heap;
+    FrameRecord_t frame, prev, last;
+    gboolean have_last = FALSE;
+    gboolean ok = TRUE;
+    wtap_rec rec, out_rec;
+    Buffer buf, out_buf;
+    int err;
+    gchar *err_info;
+    gint64 data_offset;
+    gboolean reading = TRUE;
+
+    heap.frames = g_new(FrameRecord_t, window + 1);
+    heap.count = 0;
+    wtap_rec_init(&rec);
+    ws_buffer_init(&buf, 1514);
+    wtap_rec_init(&out_rec);
+    ws_buffer_init(&out_buf, 1514);
+    while (reading || heap.count > 0) {
+        if (reading) {
+            reading = wtap_read(wth, &rec, &buf, &err, &err_info, &data_offset);
+            if (reading) {
+                frame_record_init(&frame, ++*frame_count, data_offset, &rec);
+                if (*frame_count > 1 &&
+                    nstime_cmp(&frame.frame_time, &prev.frame_time) < 0) {
+                    (*wrong_order_count)++;
+                }
+                prev = frame;
+                frame_heap_push(&heap, &frame);
+                if (heap.count <= window)
+                    continue;
+            } else if (err != 0) {
+                /* Print a message noting that the read failed somewhere along the line. */
+                cfile_read_failure_message("reordercap", infile, err, err_info);
+            }
+        }
+
+        frame_heap_pop(&heap, &frame);
+        if (have_last && frame_before(&frame, &last)) {
+            (*late_count)++;
+        } else {
+            last = frame;
+            have_last = TRUE;
+        }
+        if (!frame_write(&frame, wth, pdh, &out_rec, &out_buf, infile, outfile)) {
+            ok = FALSE;
+            break;
+        }
+    }
+    wtap_rec_cleanup(&rec);
+    ws_buffer_free(&buf);
+    wtap_rec_cleanup(&out_rec);
+    ws_buffer_free(&out_buf);
+    g_free(heap.frames);
+    return ok;
+}
+
+/* Most runs we have open at once when merging them, with -m */
+#define MAX_MERGE_RUNS 64
+
+/* Writes the sorted runs for -m */
+typedef struct RunWriter_t {
+    wtap                   *wth;
+    const char             *infile;
+    const wtap_dump_params *params;
+    FrameHeap_t             heap;
+    GPtrArray              *run_names;  /* temporary files, in run order; see reorder_external() */
+    wtap_dumper            *pdh;        /* the run being written */
+    guint                   run;        /* ...its number */
+    FrameRecord_t           last;       /* ...and the last frame in it */
+    wtap_rec                rec;
+    Buffer                  buf;
+} RunWriter_t;
+
+/* Create a temporary file for a run, and add it to "run_names", so that
+   it's removed if we fail; returns NULL if it can't be created */
+static wtap_dumper *
+run_create(int file_type_subtype, const wtap_dump_params *params,
+           GPtrArray *run_names)
+{
+    wtap_dumper *pdh;
+    char *run_name = NULL;
+    int err;
+
+    pdh = wtap_dump_open_tempfile(&run_name, "reordercap", file_type_subtype,
+                                  WTAP_UNCOMPRESSED, params, &err);
+    if (pdh == NULL) {
+        cfile_dump_open_failure_message("reordercap",
+                                        run_name ? run_name : "temporary file",
+                                        err, file_type_subtype);
+        if (run_name != NULL)
+            ws_unlink(run_name);
+        g_free(run_name);
+        return NULL;
+    }
+    g_ptr_array_add(run_names, run_name);
+    return pdh;
+}
+
+static gboolean
+run_close(wtap_dumper *pdh, const char *run_name)
+{
+    int err;
+
+    if (!wtap_dump_close(pdh, &err)) {
+        cfile_close_failure_message(run_name, err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Remove the temporary files for the runs that are still there */
+static void
+runs_remove(GPtrArray *run_names)
+{
+    guint i;
+
+    for (i = 0; i < run_names->len; i++) {
+        if (run_names->pdata[i] != NULL)
+            ws_unlink((const char *)run_names->pdata[i]);
+    }
+    g_ptr_array_free(run_names, TRUE);
+}
+
+/* Write the earliest frame in the heap to its run, starting the run if
+   it's a new one */
+static gboolean
+run_write_next(RunWriter_t *rw)
+{
+    FrameRecord_t frame;
+    wtap_dumper *pdh;
+
+    frame_heap_pop(&rw->heap, &frame);
+    if (rw->pdh == NULL || frame.run != rw->run) {
+        if (rw->pdh != NULL) {
+            pdh = rw->pdh;
+            rw->pdh = NULL;
+            if (!run_close(pdh, (const char *)rw->run_names->pdata[rw->run_names->len - 1]))
+                return FALSE;
+        }
+        rw->pdh = run_create(wtap_file_type_subtype(rw->wth), rw->params,
+                             rw->run_names);
+        if (rw->pdh == NULL)
+            return FALSE;
+        rw->run = frame.run;
+    }
+    if (!frame_write(&frame, rw->wth, rw->pdh, &rw->rec, &rw->buf, rw->infile,
+                     (const char *)rw->run_names->pdata[rw->run_names->len - 1]))
+        return FALSE;
+    rw->last = frame;
+    return TRUE;
+}
+
+/* Read the next frame of a run into the merge heap, if there is one;
+   returns FALSE on a read error */
+static gboolean
+run_read(wtap *run, const char *run_name, guint run_num, wtap_rec *rec,
+         Buffer *buf, FrameHeap_t *heap)
+{
+    FrameRecord_t head;
+    int err;
+    gchar *err_info;
+    gint64 data_offset;
+
+    if (wtap_read(run, rec, buf, &err, &err_info, &data_offset)) {
+        /* The frame number is the run number, for frame_before() */
+        frame_record_init(&head, run_num, data_offset, rec);
+        frame_heap_push(heap, &head);
+    } else if (err != 0) {
+        cfile_read_failure_message("reordercap", run_name, err, err_info);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Merge "count" sorted runs, starting with run "first", into "pdh", and
+ * remove them, leaving NULL in their place in "run_names".  Frames with
+ * the same timestamp in different runs go in the order of the runs,
+ * which is the order in which they were read.
+ *
+ * On failure, the runs are left for the caller to remove.
+ */
+static gboolean
+runs_merge(GPtrArray *run_names, guint first, guint count, wtap_dumper *pdh,
+           int file_type_subtype, const char *infile, const char *outfile)
+{
+    char **names = (char **)&run_names->pdata[first];
+    wtap **runs = g_new0(wtap *, count);
+    wtap_rec *recs = g_new(wtap_rec, count);
+    Buffer *bufs = g_new(Buffer, count);
+    FrameHeap_t heap;
+    FrameRecord_t head;
+    guint i, opened, written = 0;
+    int err;
+    gchar *err_info;
+    gboolean ok = TRUE;
+
+    heap.frames = g_new(FrameRecord_t, count);
+    heap.count = 0;
+    for (opened = 0; opened < count; opened++) {
+        runs[opened] = wtap_open_offline(names[opened], WTAP_TYPE_AUTO, &err,
+                                         &err_info, FALSE);
+        if (runs[opened] == NULL) {
+            cfile_open_failure_message("reordercap", names[opened], err, err_info);
+            ok = FALSE;
+            break;
+        }
+        wtap_rec_init(&recs[opened]);
+        ws_buffer_init(&bufs[opened], 1514);
+        if (!run_read(runs[opened], names[opened], opened, &recs[opened],
+                      &bufs[opened], &heap)) {
+            opened++;
+            ok = FALSE;
+            break;
+        }
+    }
+
+    while (ok && heap.count > 0) {
+        frame_heap_pop(&heap, &head);
+        i = head.num;
+        if (!wtap_dump(pdh, &recs[i], ws_buffer_start_ptr(&bufs[i]), &err,
+                       &err_info)) {
+            cfile_write_failure_message("reordercap", infile, outfile, err,
+                                        err_info, written + 1,
+                                        file_type_subtype);
+            ok = FALSE;
+            break;
+        }
+        written++;
+        ok = run_read(runs[i], names[i], i, &recs[i], &bufs[i], &heap);
+    }
+
+    for (i = 0; i < opened; i++) {
+        wtap_rec_cleanup(&recs[i]);
+        ws_buffer_free(&bufs[i]);
+        wtap_close(runs[i]);
+    }
+    if (ok) {
+        for (i = 0; i < count; i++) {
+            ws_unlink(names[i]);
+            g_free(names[i]);
+            names[i] = NULL;
+        }
+    }
+    g_free(heap.frames);
+    g_free(bufs);
+    g_free(recs);
+    g_free(runs);
+    return ok;
+}
+
+/*
+ * Sort with -m, holding at most "max_frames" frames in memory.  The
+ * frames go through a heap of that size into sorted runs in temporary
+ * files: a frame read while a run is being written goes in it if it
+ * isn't earlier than the last one written there, and in the next run
+ * otherwise.  Runs are about twice as long as the heap when frames are
+ * in random order, and if no frame is more than "max_frames" frames
+ * out of place, there's only one.  The runs are then merged into the
+ * output file, MAX_MERGE_RUNS at a time.
+ *
+ * The names of the temporary files go in "run_names" as they're
+ * created, and are replaced by NULL as they're merged and removed, so
+ * that, if we fail, the caller can remove the ones that are left.  The
+ * runs to be merged next are always the ones at the end of it.
+ */
+static gboolean
+reorder_external(wtap *wth, wtap_dumper *pdh, const wtap_dump_params *params,
+                 guint max_frames, const char *infile, const char *outfile,
+                 GPtrArray *run_names, guint *frame_count,
+                 guint *wrong_order_count)
+{
+    RunWriter_t rw;
+    wtap_dump_params run_params;
+    int file_type_subtype = wtap_file_type_subtype(wth);
+    FrameRecord_t frame, prev;
+    wtap_rec rec;
+    Buffer buf;
+    int err;
+    gchar *err_info;
+    gint64 data_offset;
+    guint live;
+    gboolean ok = TRUE;
+
+    /* Decryption secrets go straight to the output file */
+    run_params = *params;
+    wtap_dump_params_discard_decryption_secrets(&run_params);
+
+    rw.wth = wth;
+    rw.infile = infile;
+    rw.params = &run_params;
+    rw.heap.frames = g_new(FrameRecord_t, max_frames + 1);
+    rw.heap.count = 0;
+    rw.run_names = run_names;
+    rw.pdh = NULL;
+    rw.run = 0;
+    wtap_rec_init(&rw.rec);
+    ws_buffer_init(&rw.buf, 1514);
+
+    wtap_rec_init(&rec);
+    ws_buffer_init(&buf, 1514);
+    while (wtap_read(wth, &rec, &buf, &err, &err_info, &data_offset)) {
+        frame_record_init(&frame, ++*frame_count, data_offset, &rec);
+        if (*frame_count > 1 &&
+            nstime_cmp(&frame.frame_time, &prev.frame_time) < 0) {
+            (*wrong_order_count)++;
+        }
+        prev = frame;
+
+        frame.run = rw.run;
+        if (rw.pdh != NULL && frame_before(&frame, &rw.last))
+            frame.run++;
+        frame_heap_push(&rw.heap, &frame);
+        if (rw.heap.count > max_frames && !run_write_next(&rw)) {
+            ok = FALSE;
+            break;
+        }
+    }
+    if (ok && err != 0) {
+        /* Print a message noting that the read failed somewhere along the line. */
+        cfile_read_failure_message("reordercap", infile, err, err_info);
+    }
+    wtap_rec_cleanup(&rec);
+    ws_buffer_free(&buf);
+
+    while (ok && rw.heap.count > 0)
+        ok = run_write_next(&rw);
+    if (rw.pdh != NULL) {
+        if (ok) {
+            ok = run_close(rw.pdh, (const char *)run_names->pdata[run_names->len - 1]);
+        } else {
+            /* Just close it, so it can be removed */
+            (void)wtap_dump_close(rw.pdh, &err);
+        }
+    }
+    wtap_rec_cleanup(&rw.rec);
+    ws_buffer_free(&rw.buf);
+    g_free(rw.heap.frames);
+    if (!ok)
+        return FALSE;
+
+    /* If there are too many runs to open at once, merge groups of them
+       into longer runs, keeping them in order */
+    live = 0;
+    while (run_names->len - live > MAX_MERGE_RUNS) {
+        guint end = run_names->len;
+        guint first, count;
+
+        for (first = live; first < end; first += count) {
+            wtap_dumper *run_pdh;
+
+            count = MIN(MAX_MERGE_RUNS, end - first);
+            if (count == 1) {
+                /* Nothing to merge it with */
+                g_ptr_array_add(run_names, run_names->pdata[first]);
+                run_names->pdata[first] = NULL;
+                break;
+            }
+            run_pdh = run_create(file_type_subtype, &run_params, run_names);
+            if (run_pdh == NULL)
+                return FALSE;
+            if (!runs_merge(run_names, first, count, run_pdh, file_type_subtype,
+                            infile, (const char *)run_names->pdata[run_names->len - 1])) {
+                (void)wtap_dump_close(run_pdh, &err);
+                return FALSE;
+            }
+            if (!run_close(run_pdh, (const char *)run_names->pdata[run_names->len - 1]))
+                return FALSE;
+        }
+        live = end;
+    }
+
+    return runs_merge(run_names, live, run_names->len - live, pdh,
+                      file_type_subtype, infile, outfile);
+}
+
 /*
  * General errors and warnings are reported with an console message
  * in reordercap.
@@ -173,8 +693,11 @@ main(int argc, char *argv[])
     gint64 data_offset;
     guint wrong_order_count = 0;
     gboolean write_output_regardless = TRUE;
+    guint window_size = 0;
+    guint max_frames = 0;
     guint i;
     wtap_dump_params params;
+    GPtrArray *run_names = NULL;
     int                          ret = EXIT_SUCCESS;
 
     GPtrArray *frames;
@@ -218,11 +741,17 @@ main(int argc, char *argv[])
     wtap_init(TRUE);
 
     /* Process the options first */
-    while ((opt = getopt_long(argc, argv, "hnv", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hm:nvw:", long_options, NULL)) != -1) {
         switch (opt) {
+            case 'm':
+                max_frames = get_nonzero_guint32(optarg, "number of frames in memory");
+                break;
             case 'n':
                 write_output_regardless = FALSE;
                 break;
+            case 'w':
+                window_size = get_nonzero_guint32(optarg, "reorder window");
+                break;
             case 'h':
                 show_help_header("Reorder timestamps of input file frames into output file.");
                 print_usage(stdout);
@@ -237,6 +766,12 @@ main(int argc, char *argv[])
         }
     }
 
+    if (max_frames != 0 && window_size != 0) {
+        cmdarg_err("-m and -w can't be used together.");
+        ret = INVALID_OPTION;
+        goto clean_exit;
+    }
+
     /* Remaining args are file names */
     file_count = argc - optind;
     if (file_count == 2) {
@@ -268,17 +803,52 @@ main(int argc, char *argv[])
     } else {
       pdh = wtap_dump_open(outfile, wtap_file_type_subtype(wth), WTAP_UNCOMPRESSED, &params, &err);
     }
-    g_free(params.idb_inf);
-    params.idb_inf = NULL;
 
     if (pdh == NULL) {
         cfile_dump_open_failure_message("reordercap", outfile, err,
                                         wtap_file_type_subtype(wth));
+        g_free(params.idb_inf);
         wtap_dump_params_cleanup(&params);
         ret = OUTPUT_FILE_ERROR;
         goto clean_exit;
     }
 
+    if (window_size != 0 || max_frames != 0) {
+        guint frame_count = 0;
+        guint late_count = 0;
+
+        /* These write frames as they go, so for -n, find out first whether
+           there's anything to do */
+        if (!write_output_regardless &&
+            !count_wrong_order(infile, &frame_count, &wrong_order_count)) {
+            ret = OPEN_ERROR;
+        } else if (write_output_regardless || (wrong_order_count > 0)) {
+            frame_count = 0;
+            wrong_order_count = 0;
+            if (window_size != 0) {
+                if (!reorder_window(wth, pdh, window_size, infile, outfile,
+                                    &frame_count, &wrong_order_count,
+                                    &late_count))
+                    ret = OUTPUT_FILE_ERROR;
+            } else {
+                run_names = g_ptr_array_new_with_free_func(g_free);
+                if (!reorder_external(wth, pdh, &params, max_frames, infile,
+                                      outfile, run_names, &frame_count,
+                                      &wrong_order_count))
+                    ret = OUTPUT_FILE_ERROR;
+            }
+        }
+        if (ret != EXIT_SUCCESS)
+            goto sorted;
+        printf("%u frames, %u out of order\n", frame_count, wrong_order_count);
+        if (late_count > 0) {
+            fprintf(stderr, "reordercap: %u frames were more than %u frames out of place, and are still out of order.\n",
+                    late_count, window_size);
+            ret = ORDER_ERROR;
+        }
+        goto sorted;
+    }
+
     /* Allocate the array of frame pointers. */
     frames = g_ptr_array_new();
 
@@ -325,27 +895,30 @@ main(int argc, char *argv[])
         FrameRecord_t *frame = (FrameRecord_t *)frames->pdata[i];
 
         /* Avoid writing if already sorted and configured to */
-        if (write_output_regardless || (wrong_order_count > 0)) {
-            frame_write(frame, wth, pdh, &rec, &buf, infile, outfile);
+        if ((write_output_regardless || (wrong_order_count > 0)) &&
+            ret == EXIT_SUCCESS &&
+            !frame_write(frame, wth, pdh, &rec, &buf, infile, outfile)) {
+            ret = OUTPUT_FILE_ERROR;
         }
         g_slice_free(FrameRecord_t, frame);
     }
     wtap_rec_cleanup(&rec);
     ws_buffer_free(&buf);
 
-    if (!write_output_regardless && (wrong_order_count == 0)) {
-        printf("Not writing output file because input file is already in order.\n");
-    }
-
     /* Free the whole array */
     g_ptr_array_free(frames, TRUE);
 
+sorted:
+    if (ret == EXIT_SUCCESS && !write_output_regardless && (wrong_order_count == 0)) {
+        printf("Not writing output file because input file is already in order.\n");
+    }
+
     /* Close outfile */
+    g_free(params.idb_inf);
+    params.idb_inf = NULL;
     if (!wtap_dump_close(pdh, &err)) {
         cfile_close_failure_message(outfile, err);
-        wtap_dump_params_cleanup(&params);
         ret = OUTPUT_FILE_ERROR;
-        goto clean_exit;
     }
     wtap_dump_params_cleanup(&params);
 
@@ -353,6 +926,9 @@ main(int argc, char *argv[])
     wtap_close(wth);
 
 clean_exit:
+    /* Remove any temporary files that are left, if sorting with -m failed */
+    if (run_names != NULL)
+        runs_remove(run_names);
     wtap_cleanup();
     free_progdirs();
     return ret;
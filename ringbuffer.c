@@ -26,30 +26,104 @@
  * the files at switch and not the capture stop, and by closing them which
  * makes possible their move or deletion after a switch).
  *
+ * With ringbuf_set_spare_files(), a helper thread creates the next files
+ * ahead of time, so that a switch only has to rename one of them, and it
+ * closes, truncates and removes the old ones, so that the capture thread
+ * never waits for the file system at a switch.
+ *
+ * With ringbuf_set_compress_files(), completed files are compressed by
+ * low-priority worker threads and replaced by the compressed files, whose
+ * names the ring then keeps track of.
+ *
  */
 
 // #include <config.h>
 
 #ifdef HAVE_LIBPCAP
 
+#ifdef __linux__
+#define _GNU_SOURCE /* Otherwise fallocate() won't be defined */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 #include "wspcap.h"
 
 #include <glib.h>
 
+#include "ws_attributes.h"
+
 #include "ringbuffer.h"
+#include "writecap/aio_output.h"
+#include "writecap/compress_output.h"
 #include <wsutil/file_util.h>
 
 
+/* Worker threads compressing completed files; they only get idle time */
+#define RINGBUF_COMPRESS_THREADS 2
+
+/* Bytes read from a completed file at a time while compressing it */
+#define RINGBUF_COMPRESS_CHUNK (256 * 1024)
+
+/* A completed file being compressed */
+typedef struct _rb_compress_job {
+  gchar         *name;               /* the file as written */
+  gchar         *compressed_name;    /* the file replacing it */
+  gboolean       done;               /* the worker is done with it; under rb_data.lock */
+  gboolean       failed;             /* it wasn't replaced; under rb_data.lock */
+  gboolean       removed;            /* the ring is done with it; under rb_data.lock */
+  guint          seq;                /* its place in the ring, to print its name in order */
+  gint           ref_count;          /* the ring's and the worker's */
+} rb_compress_job;
+
 /* Ringbuffer file structure */
 typedef struct _rb_file {
   gchar         *name;
+  rb_compress_job *compress_job;     /* set if the file is being or was compressed */
 } rb_file;
 
+/* A file the helper thread has created for a later switch; if it couldn't,
+   name is NULL and fd is -1, so that the switch asks for another one */
+typedef struct _rb_spare {
+  gchar         *name;
+  int            fd;
+} rb_spare;
+
+/* Spare files are named <prefix>.spare-<pid>-<n>, so that the files a
+   crashed dumpcap left behind can be told from those of one that's running */
+#define RINGBUF_SPARE_INFIX ".spare-"
+
+typedef enum {
+  RB_JOB_CREATE,                     /* create a spare file */
+  RB_JOB_CLOSE,                      /* close a completed file */
+  RB_JOB_UNLINK,                     /* remove an old file */
+  RB_JOB_STOP
+} rb_job_type;
+
+/* Work for the helper thread */
+typedef struct _rb_job {
+  rb_job_type    type;
+  FILE          *pdh;                /* RB_JOB_CLOSE: the file's stream */
+  int            fd;                 /* RB_JOB_CLOSE: a dup of its descriptor */
+  char          *io_buffer;          /* RB_JOB_CLOSE: the stream's buffer, if we set one */
+  rb_compress_job *compress;         /* RB_JOB_CLOSE: compress the file once it's closed */
+  gchar         *name;               /* RB_JOB_CLOSE, RB_JOB_UNLINK: the file's name */
+} rb_job;
+
 /** Ringbuffer data structure */
 typedef struct _ringbuf_data {
   rb_file      *files;
@@ -64,11 +138,414 @@ typedef struct _ringbuf_data {
   char         *io_buffer;              /**< The IO buffer used to write to the file */
   gboolean      group_read_access;   /**< TRUE if files need to be opened with group read access */
   FILE         *name_h;              /**< write names of completed files to this handle */
+  guint         aio_queue_depth;     /**< If non-zero, write files with aio_output_fdopen() */
+  compress_output_type_t compress_type; /**< Compression for the files, if any */
+
+  guint         num_spares;          /**< Files to create ahead of time; 0 if we don't */
+  guint64       prealloc_size;       /**< Space to allocate for each of them, in bytes */
+  guint         spare_seq;           /**< Number of the next spare file (helper thread only) */
+  GThread      *helper;              /**< Thread creating and closing files */
+  GAsyncQueue  *jobs;                /**< rb_job's for the helper */
+  GAsyncQueue  *spares;              /**< rb_spare's ready for a switch */
+  gint          helper_err;          /**< First error the helper got closing a file */
+
+  compress_output_type_t compress_files_type; /**< Compression for completed files, if any */
+  GThreadPool  *compress_pool;       /**< Workers compressing completed files */
+  guint         compress_seq;        /**< Place of the next file to be compressed */
+  guint         print_seq;           /**< Place of the next compressed file to print; under lock */
+  GHashTable   *print_pending;       /**< Names to print after that one, by place; under lock */
+  GMutex        lock;                /**< Guards name_h and the compress jobs' state */
 } ringbuf_data;
 
 static ringbuf_data rb_data;
 
 
+/*
+ * Print the name of a completed file, if we've been asked to
+ */
+static void
+ringbuf_print_name(const char *name)
+{
+  g_mutex_lock(&rb_data.lock);
+  if (rb_data.name_h != NULL) {
+    fprintf(rb_data.name_h, "%s\n", name);
+    fflush(rb_data.name_h);
+  }
+  g_mutex_unlock(&rb_data.lock);
+}
+
+/*
+ * Print the name of a compressed file, or NULL if it was removed, once
+ * those of the files before it in the ring have been printed; the
+ * workers can finish them in any order
+ */
+static void
+ringbuf_compress_print_name(rb_compress_job *job, const char *name)
+{
+  const gchar *pending;
+
+  g_mutex_lock(&rb_data.lock);
+  g_hash_table_insert(rb_data.print_pending, GUINT_TO_POINTER(job->seq),
+                      g_strdup(name != NULL ? name : ""));
+  while ((pending = (const gchar *)g_hash_table_lookup(rb_data.print_pending,
+                                                       GUINT_TO_POINTER(rb_data.print_seq))) != NULL) {
+    if (rb_data.name_h != NULL && *pending != '\0') {
+      fprintf(rb_data.name_h, "%s\n", pending);
+      fflush(rb_data.name_h);
+    }
+    g_hash_table_remove(rb_data.print_pending, GUINT_TO_POINTER(rb_data.print_seq));
+    rb_data.print_seq++;
+  }
+  g_mutex_unlock(&rb_data.lock);
+}
+
+static void
+ringbuf_compress_unref(rb_compress_job *job)
+{
+  if (g_atomic_int_dec_and_test(&job->ref_count)) {
+    g_free(job->name);
+    g_free(job->compressed_name);
+    g_free(job);
+  }
+}
+
+/*
+ * Have a completed file compressed once it's closed; from now on, the
+ * ring knows it by its compressed name.  Returns NULL if we aren't
+ * compressing completed files.
+ */
+static rb_compress_job *
+ringbuf_compress_prepare(rb_file *rfile)
+{
+  rb_compress_job *job;
+
+  if (rb_data.compress_pool == NULL)
+    return NULL;
+
+  job = g_new0(rb_compress_job, 1);
+  job->name = rfile->name;
+  job->compressed_name = g_strconcat(rfile->name, ".",
+                                     compress_output_type_name(rb_data.compress_files_type),
+                                     NULL);
+  job->ref_count = 2;
+  job->seq = rb_data.compress_seq++;
+  rfile->name = g_strdup(job->compressed_name);
+  rfile->compress_job = job;
+  return job;
+}
+
+/*
+ * Drop the ring's hold on the compression of a file.  If "remove" is set,
+ * the file is about to be removed; returns FALSE if it's still being
+ * compressed, in which case the worker removes it when it's done.  If
+ * compressing it failed, the ring gets its original name back.
+ */
+static gboolean
+ringbuf_compress_forget(rb_file *rfile, gboolean remove)
+{
+  rb_compress_job *job = rfile->compress_job;
+  gboolean done;
+
+  if (job == NULL)
+    return TRUE;
+  rfile->compress_job = NULL;
+
+  g_mutex_lock(&rb_data.lock);
+  done = job->done;
+  if (!done) {
+    job->removed = remove;
+  } else if (job->failed) {
+    g_free(rfile->name);
+    rfile->name = g_strdup(job->name);
+  }
+  g_mutex_unlock(&rb_data.lock);
+
+  ringbuf_compress_unref(job);
+  return done;
+}
+
+/*
+ * Keep compression from getting in the way of the capture
+ */
+static void
+ringbuf_compress_lower_priority(void)
+{
+#ifdef __linux__
+  /* On Linux, both of these apply to the calling thread only */
+  (void) setpriority(PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+  /* IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE; glibc doesn't define them */
+  (void) syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+#endif
+}
+
+/*
+ * Write a compressed copy of a completed file next to it, then replace
+ * the file with it.  Returns FALSE, leaving the file as it is, on
+ * failure.
+ */
+static gboolean
+ringbuf_compress_copy(rb_compress_job *job)
+{
+  FILE     *in;
+  FILE     *out = NULL;
+  FILE     *cfh = NULL;
+  gchar    *tmp_name;
+  char     *buf;
+  size_t    len;
+  int       fd;
+  int       err;
+  gboolean  ok = TRUE;
+
+  in = ws_fopen(job->name, "rb");
+  if (in == NULL)
+    return FALSE;
+
+  tmp_name = g_strconcat(job->compressed_name, ".tmp", NULL);
+  fd = ws_open(tmp_name, O_WRONLY|O_BINARY|O_TRUNC|O_CREAT,
+               rb_data.group_read_access ? 0640 : 0600);
+  if (fd != -1) {
+    out = ws_fdopen(fd, "wb");
+    if (out == NULL)
+      ws_close(fd);
+  }
+  if (out != NULL) {
+    cfh = compress_output_open(out, rb_data.compress_files_type, &err);
+    if (cfh == NULL)
+      fclose(out);
+  }
+  if (cfh == NULL) {
+    fclose(in);
+    ws_unlink(tmp_name);
+    g_free(tmp_name);
+    return FALSE;
+  }
+
+  buf = (char *)g_malloc(RINGBUF_COMPRESS_CHUNK);
+  while ((len = fread(buf, 1, RINGBUF_COMPRESS_CHUNK, in)) != 0) {
+    if (fwrite(buf, 1, len, cfh) != len) {
+      ok = FALSE;
+      break;
+    }
+  }
+  if (ferror(in))
+    ok = FALSE;
+  if (fclose(cfh) == EOF)
+    ok = FALSE;
+  fclose(in);
+  g_free(buf);
+
+  if (ok && ws_rename(tmp_name, job->compressed_name) == 0) {
+    ws_unlink(job->name);
+  } else {
+    ok = FALSE;
+    ws_unlink(tmp_name);
+  }
+  g_free(tmp_name);
+  return ok;
+}
+
+/*
+ * Finish with a completed file, which was replaced with its compressed
+ * copy if "ok" is set
+ */
+static void
+ringbuf_compress_done(rb_compress_job *job, gboolean ok)
+{
+  gboolean removed;
+
+  g_mutex_lock(&rb_data.lock);
+  job->done = TRUE;
+  job->failed = !ok;
+  removed = job->removed;
+  g_mutex_unlock(&rb_data.lock);
+
+  if (removed) {
+    /* the ring has moved past it while we were compressing it */
+    ws_unlink(ok ? job->compressed_name : job->name);
+    ringbuf_compress_print_name(job, NULL);
+  } else {
+    ringbuf_compress_print_name(job, ok ? job->compressed_name : job->name);
+  }
+  ringbuf_compress_unref(job);
+}
+
+/*
+ * Compress a completed file; called by the worker threads
+ */
+static void
+ringbuf_compress_file(gpointer data, gpointer user_data _U_)
+{
+  rb_compress_job *job = (rb_compress_job *)data;
+
+  ringbuf_compress_lower_priority();
+  ringbuf_compress_done(job, ringbuf_compress_copy(job));
+}
+
+/*
+ * Wait for the workers to compress the completed files
+ */
+static void
+ringbuf_compress_finish(void)
+{
+  unsigned int i;
+
+  if (rb_data.compress_pool == NULL)
+    return;
+
+  g_thread_pool_free(rb_data.compress_pool, FALSE, TRUE);
+  rb_data.compress_pool = NULL;
+  g_hash_table_destroy(rb_data.print_pending);
+  rb_data.print_pending = NULL;
+
+  for (i=0; i < rb_data.num_files; i++) {
+    ringbuf_compress_forget(&rb_data.files[i], FALSE);
+  }
+}
+
+/*
+ * Queue work for the helper thread
+ */
+static void
+ringbuf_helper_push(rb_job_type type, FILE *pdh, int fd, gchar *name,
+                    rb_compress_job *compress)
+{
+  rb_job *job = g_new(rb_job, 1);
+
+  job->type = type;
+  job->pdh = pdh;
+  job->fd = fd;
+  job->io_buffer = pdh != NULL ? rb_data.io_buffer : NULL;
+  job->name = name;
+  job->compress = compress;
+  g_async_queue_push(rb_data.jobs, job);
+}
+
+/*
+ * Create a spare file and, if we know how large the files get, allocate
+ * space for it, so that writing it doesn't have to
+ */
+static void
+ringbuf_helper_create(void)
+{
+  rb_spare *spare;
+
+  spare = g_new(rb_spare, 1);
+  spare->name = g_strdup_printf("%s" RINGBUF_SPARE_INFIX "%lu-%u", rb_data.fprefix,
+                                (unsigned long)getpid(), rb_data.spare_seq++);
+  spare->fd = ws_open(spare->name, O_RDWR|O_BINARY|O_TRUNC|O_CREAT,
+                      rb_data.group_read_access ? 0640 : 0600);
+  if (spare->fd == -1) {
+    /* the switch will open the file itself, and ask for another spare */
+    g_free(spare->name);
+    spare->name = NULL;
+    g_async_queue_push(rb_data.spares, spare);
+    return;
+  }
+#ifdef __linux__
+  /* Keep the size, so that the file never has unwritten bytes in it;
+     if the file system can't do this, we just do without */
+  if (rb_data.prealloc_size != 0)
+    (void) fallocate(spare->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)rb_data.prealloc_size);
+#endif
+  g_async_queue_push(rb_data.spares, spare);
+}
+
+/*
+ * Close a completed file, give back the space allocated for it beyond
+ * what was written, and report its name
+ */
+static void
+ringbuf_helper_close(rb_job *job)
+{
+  int close_err = 0;
+
+  if (fclose(job->pdh) == EOF)
+    close_err = errno;
+  g_free(job->io_buffer);
+#ifdef __linux__
+  if (close_err == 0 && rb_data.prealloc_size != 0) {
+    ws_statb64 statb;
+
+    if (ws_fstat64(job->fd, &statb) == 0 && ftruncate(job->fd, statb.st_size) == -1)
+      close_err = errno;
+  }
+#endif
+  ws_close(job->fd);
+  if (close_err != 0) {
+    g_atomic_int_compare_and_exchange(&rb_data.helper_err, 0, close_err);
+    if (job->compress != NULL) {
+      /* leave it as it is */
+      ringbuf_compress_done(job->compress, FALSE);
+    }
+  } else if (job->compress != NULL) {
+    g_thread_pool_push(rb_data.compress_pool, job->compress, NULL);
+  } else if (job->name != NULL) {
+    ringbuf_print_name(job->name);
+  }
+}
+
+static gpointer
+ringbuf_helper_thread(gpointer data _U_)
+{
+  rb_job *job;
+
+  for (;;) {
+    job = (rb_job *)g_async_queue_pop(rb_data.jobs);
+    switch (job->type) {
+
+    case RB_JOB_CREATE:
+      ringbuf_helper_create();
+      break;
+
+    case RB_JOB_CLOSE:
+      ringbuf_helper_close(job);
+      break;
+
+    case RB_JOB_UNLINK:
+      ws_unlink(job->name);
+      break;
+
+    case RB_JOB_STOP:
+      g_free(job);
+      return NULL;
+    }
+    g_free(job->name);
+    g_free(job);
+  }
+}
+
+/*
+ * Wait for the helper thread to finish its work, and remove the spare
+ * files it created
+ */
+static void
+ringbuf_helper_stop(void)
+{
+  rb_spare *spare;
+
+  if (rb_data.helper == NULL)
+    return;
+
+  ringbuf_helper_push(RB_JOB_STOP, NULL, -1, NULL, NULL);
+  g_thread_join(rb_data.helper);
+  rb_data.helper = NULL;
+  g_async_queue_unref(rb_data.jobs);
+  rb_data.jobs = NULL;
+
+  while ((spare = (rb_spare *)g_async_queue_try_pop(rb_data.spares)) != NULL) {
+    if (spare->fd != -1) {
+      ws_close(spare->fd);
+      ws_unlink(spare->name);
+    }
+    g_free(spare->name);
+    g_free(spare);
+  }
+  g_async_queue_unref(rb_data.spares);
+  rb_data.spares = NULL;
+}
+
 /*
  * create the next filename and open a new binary file with that name
  */
@@ -78,11 +555,19 @@ static int ringbuf_open_file(rb_file *rfile, int *err)
   char    timestr[14+1];
   time_t  current_time;
   struct tm *tm;
+  rb_spare *spare = NULL;
 
   if (rfile->name != NULL) {
-    if (rb_data.unlimited == FALSE) {
+    /* if it's still being compressed, the worker removes it */
+    if (ringbuf_compress_forget(rfile, !rb_data.unlimited) &&
+        rb_data.unlimited == FALSE) {
       /* remove old file (if any, so ignore error) */
-      ws_unlink(rfile->name);
+      if (rb_data.helper != NULL) {
+        ringbuf_helper_push(RB_JOB_UNLINK, NULL, -1, rfile->name, NULL);
+        rfile->name = NULL;
+      } else {
+        ws_unlink(rfile->name);
+      }
     }
     g_free(rfile->name);
   }
@@ -107,6 +592,26 @@ static int ringbuf_open_file(rb_file *rfile, int *err)
     return -1;
   }
 
+  if (rb_data.spares != NULL)
+    spare = (rb_spare *)g_async_queue_try_pop(rb_data.spares);
+  if (spare != NULL) {
+    /* replace it, whether or not the helper managed to create it */
+    ringbuf_helper_push(RB_JOB_CREATE, NULL, -1, NULL, NULL);
+    if (spare->fd != -1 && ws_rename(spare->name, rfile->name) == 0) {
+      rb_data.fd = spare->fd;
+      g_free(spare->name);
+      g_free(spare);
+      return rb_data.fd;
+    }
+    /* open a new one after all */
+    if (spare->fd != -1) {
+      ws_close(spare->fd);
+      ws_unlink(spare->name);
+    }
+    g_free(spare->name);
+    g_free(spare);
+  }
+
   rb_data.fd = ws_open(rfile->name, O_RDWR|O_BINARY|O_TRUNC|O_CREAT,
                             rb_data.group_read_access ? 0640 : 0600);
 
@@ -137,6 +642,20 @@ ringbuf_init(const char *capfile_name, guint num_files, gboolean group_read_acce
   rb_data.io_buffer = NULL;
   rb_data.group_read_access = group_read_access;
   rb_data.name_h = NULL;
+  rb_data.aio_queue_depth = 0;
+  rb_data.compress_type = COMPRESS_OUTPUT_NONE;
+  rb_data.num_spares = 0;
+  rb_data.prealloc_size = 0;
+  rb_data.spare_seq = 0;
+  rb_data.helper = NULL;
+  rb_data.jobs = NULL;
+  rb_data.spares = NULL;
+  rb_data.helper_err = 0;
+  rb_data.compress_files_type = COMPRESS_OUTPUT_NONE;
+  rb_data.compress_pool = NULL;
+  rb_data.compress_seq = 0;
+  rb_data.print_seq = 0;
+  rb_data.print_pending = NULL;
 
   /* just to be sure ... */
   if (num_files <= RINGBUFFER_MAX_NUM_FILES) {
@@ -195,6 +714,7 @@ ringbuf_init(const char *capfile_name, guint num_files, gboolean group_read_acce
 
   for (i=0; i < rb_data.num_files; i++) {
     rb_data.files[i].name = NULL;
+    rb_data.files[i].compress_job = NULL;
   }
 
   /* create the first file */
@@ -235,6 +755,119 @@ ringbuf_set_print_name(gchar *name, int *err)
   return TRUE;
 }
 
+/*
+ * Write the ringbuffer files asynchronously, with up to queue_depth
+ * writes in flight; 0 means use stdio.
+ */
+void
+ringbuf_set_aio_output(guint queue_depth)
+{
+  rb_data.aio_queue_depth = queue_depth;
+}
+
+/*
+ * Compress the ringbuffer files as they're written.
+ */
+void
+ringbuf_set_compress_output(compress_output_type_t type)
+{
+  rb_data.compress_type = type;
+}
+
+/*
+ * Compress the ringbuffer files once they're completed, in low-priority
+ * worker threads, and replace them with the compressed files.
+ */
+void
+ringbuf_set_compress_files(compress_output_type_t type)
+{
+  if (type == COMPRESS_OUTPUT_NONE || rb_data.compress_pool != NULL)
+    return;
+
+  rb_data.compress_files_type = type;
+  rb_data.print_pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  /* exclusive, so that no one else gets the threads we lowered the priority of */
+  rb_data.compress_pool = g_thread_pool_new(ringbuf_compress_file, NULL,
+                                            RINGBUF_COMPRESS_THREADS, TRUE, NULL);
+}
+
+/*
+ * Whether ringbuf_set_spare_files() can be used on this platform.
+ */
+gboolean
+ringbuf_spare_files_supported(void)
+{
+#ifdef _WIN32
+  /* We can't rename a file while it's open */
+  return FALSE;
+#else
+  return TRUE;
+#endif
+}
+
+/*
+ * Remove the spare files that dumpcaps writing files with our prefix left
+ * behind when they crashed; those of the ones still running are theirs
+ */
+static void
+ringbuf_remove_stale_spares(void)
+{
+#ifndef _WIN32
+  gchar       *dir_name, *base_name, *spare_prefix, *path;
+  const gchar *name;
+  GDir        *dir;
+  unsigned long pid;
+  char        *end;
+
+  dir_name = g_path_get_dirname(rb_data.fprefix);
+  base_name = g_path_get_basename(rb_data.fprefix);
+  spare_prefix = g_strconcat(base_name, RINGBUF_SPARE_INFIX, NULL);
+  dir = g_dir_open(dir_name, 0, NULL);
+  if (dir != NULL) {
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      if (!g_str_has_prefix(name, spare_prefix))
+        continue;
+      errno = 0;
+      pid = strtoul(name + strlen(spare_prefix), &end, 10);
+      if (errno != 0 || *end != '-' || pid == (unsigned long)getpid())
+        continue;
+      if (kill((pid_t)pid, 0) == -1 && errno == ESRCH) {
+        path = g_build_filename(dir_name, name, NULL);
+        ws_unlink(path);
+        g_free(path);
+      }
+    }
+    g_dir_close(dir);
+  }
+  g_free(spare_prefix);
+  g_free(base_name);
+  g_free(dir_name);
+#endif
+}
+
+/*
+ * Create num_spares files ahead of the switches, each with prealloc_size
+ * bytes allocated if that's non-zero, and close the completed files, in
+ * another thread.
+ */
+void
+ringbuf_set_spare_files(guint num_spares, guint64 prealloc_size)
+{
+  guint i;
+
+  if (num_spares == 0 || rb_data.helper != NULL)
+    return;
+
+  ringbuf_remove_stale_spares();
+  rb_data.num_spares = num_spares;
+  rb_data.prealloc_size = prealloc_size;
+  rb_data.jobs = g_async_queue_new();
+  rb_data.spares = g_async_queue_new();
+  for (i = 0; i < num_spares; i++)
+    ringbuf_helper_push(RB_JOB_CREATE, NULL, -1, NULL, NULL);
+  rb_data.helper = g_thread_new("ringbuffer helper", ringbuf_helper_thread, NULL);
+}
+
 /*
  * Whether the ringbuf filenames are ready.
  * (Whether ringbuf_init is called and ringbuf_free is not called.)
@@ -253,9 +886,20 @@ const gchar *ringbuf_current_filename(void)
 /*
  * Calls ws_fdopen() for the current ringbuffer file
  */
-FILE *
-ringbuf_init_libpcap_fdopen(int *err)
+static FILE *
+ringbuf_fdopen(int *err)
 {
+  if (rb_data.aio_queue_depth != 0) {
+    int aio_err;
+
+    /* aio_output does its own buffering */
+    rb_data.pdh = aio_output_fdopen(rb_data.fd, rb_data.aio_queue_depth, &aio_err);
+    if (rb_data.pdh == NULL && err != NULL) {
+      *err = aio_err;
+    }
+    return rb_data.pdh;
+  }
+
   rb_data.pdh = ws_fdopen(rb_data.fd, "wb");
   if (rb_data.pdh == NULL) {
     if (err != NULL) {
@@ -280,6 +924,32 @@ ringbuf_init_libpcap_fdopen(int *err)
   return rb_data.pdh;
 }
 
+/*
+ * Opens a stream for the current ringbuffer file, compressing what's
+ * written to it if we've been asked to
+ */
+FILE *
+ringbuf_init_libpcap_fdopen(int *err)
+{
+  FILE *fh;
+  int compress_err;
+
+  if (ringbuf_fdopen(err) == NULL || rb_data.compress_type == COMPRESS_OUTPUT_NONE) {
+    return rb_data.pdh;
+  }
+
+  fh = compress_output_open(rb_data.pdh, rb_data.compress_type, &compress_err);
+  if (fh == NULL) {
+    fclose(rb_data.pdh);
+    rb_data.fd = -1;
+    if (err != NULL) {
+      *err = compress_err;
+    }
+  }
+  rb_data.pdh = fh;
+  return rb_data.pdh;
+}
+
 /*
  * Switches to the next ringbuffer file
  */
@@ -287,28 +957,54 @@ gboolean
 ringbuf_switch_file(FILE **pdh, gchar **save_file, int *save_file_fd, int *err)
 {
   int     next_file_index;
+  rb_file *curr_rfile = &rb_data.files[rb_data.curr_file_num % rb_data.num_files];
   rb_file *next_rfile = NULL;
+  rb_compress_job *compress;
+  int     helper_err;
 
-  /* close current file */
+  if (rb_data.helper != NULL) {
+    /* did closing an earlier file fail? */
+    helper_err = g_atomic_int_get(&rb_data.helper_err);
+    if (helper_err != 0) {
+      if (err != NULL) {
+        *err = helper_err;
+      }
+      return FALSE;
+    }
 
-  if (fclose(rb_data.pdh) == EOF) {
-    if (err != NULL) {
-      *err = errno;
+    /* have the helper close the current file; it needs a descriptor of
+       its own to truncate the file after closing the stream */
+    compress = ringbuf_compress_prepare(curr_rfile);
+    ringbuf_helper_push(RB_JOB_CLOSE, rb_data.pdh, ws_dup(rb_data.fd),
+                        compress == NULL ? g_strdup(curr_rfile->name) : NULL,
+                        compress);
+    rb_data.pdh = NULL;
+    rb_data.fd  = -1;
+    rb_data.io_buffer = NULL;  /* the helper frees it after closing */
+  } else {
+    /* close current file */
+
+    if (fclose(rb_data.pdh) == EOF) {
+      if (err != NULL) {
+        *err = errno;
+      }
+      ws_close(rb_data.fd);  /* XXX - the above should have closed this already */
+      rb_data.pdh = NULL;    /* it's still closed, we just got an error while closing */
+      rb_data.fd = -1;
+      g_free(rb_data.io_buffer);
+      rb_data.io_buffer = NULL;
+      return FALSE;
     }
-    ws_close(rb_data.fd);  /* XXX - the above should have closed this already */
-    rb_data.pdh = NULL;    /* it's still closed, we just got an error while closing */
-    rb_data.fd = -1;
-    g_free(rb_data.io_buffer);
-    rb_data.io_buffer = NULL;
-    return FALSE;
-  }
 
-  rb_data.pdh = NULL;
-  rb_data.fd  = -1;
+    rb_data.pdh = NULL;
+    rb_data.fd  = -1;
 
-  if (rb_data.name_h != NULL) {
-    fprintf(rb_data.name_h, "%s\n", ringbuf_current_filename());
-    fflush(rb_data.name_h);
+    compress = ringbuf_compress_prepare(curr_rfile);
+    if (compress != NULL) {
+      g_thread_pool_push(rb_data.compress_pool, compress, NULL);
+    } else {
+      ringbuf_print_name(curr_rfile->name);
+    }
   }
 
   /* get the next file number and open it */
@@ -340,6 +1036,33 @@ gboolean
 ringbuf_libpcap_dump_close(gchar **save_file, int *err)
 {
   gboolean  ret_val = TRUE;
+  rb_file  *rfile = &rb_data.files[rb_data.curr_file_num % rb_data.num_files];
+  rb_compress_job *compress = NULL;
+
+  if (rb_data.num_spares != 0) {
+    /* let the helper finish, then close the current file the same way */
+    ringbuf_helper_stop();
+    if (rb_data.pdh != NULL) {
+      rb_job job;
+
+      job.type = RB_JOB_CLOSE;
+      job.pdh = rb_data.pdh;
+      job.fd = ws_dup(rb_data.fd);
+      job.io_buffer = rb_data.io_buffer;
+      job.name = NULL;
+      job.compress = compress = ringbuf_compress_prepare(rfile);
+      ringbuf_helper_close(&job);
+      rb_data.pdh = NULL;
+      rb_data.fd  = -1;
+      rb_data.io_buffer = NULL;
+    }
+    if (rb_data.helper_err != 0) {
+      if (err != NULL) {
+        *err = rb_data.helper_err;
+      }
+      ret_val = FALSE;
+    }
+  }
 
   /* close current file, if it's open */
   if (rb_data.pdh != NULL) {
@@ -349,6 +1072,10 @@ ringbuf_libpcap_dump_close(gchar **save_file, int *err)
       }
       ws_close(rb_data.fd);
       ret_val = FALSE;
+    } else {
+      compress = ringbuf_compress_prepare(rfile);
+      if (compress != NULL)
+        g_thread_pool_push(rb_data.compress_pool, compress, NULL);
     }
     rb_data.pdh = NULL;
     rb_data.fd  = -1;
@@ -357,9 +1084,15 @@ ringbuf_libpcap_dump_close(gchar **save_file, int *err)
 
   }
 
+  /* wait for the completed files, this one included, to be compressed */
+  ringbuf_compress_finish();
+
   if (rb_data.name_h != NULL) {
-    fprintf(rb_data.name_h, "%s\n", ringbuf_current_filename());
-    fflush(rb_data.name_h);
+    /* if it was compressed, its name has been printed */
+    if (compress == NULL) {
+      fprintf(rb_data.name_h, "%s\n", ringbuf_current_filename());
+      fflush(rb_data.name_h);
+    }
 
     if (EOF == fclose(rb_data.name_h)) {
       /* Can't really do much about this, can we? */
@@ -367,7 +1100,7 @@ ringbuf_libpcap_dump_close(gchar **save_file, int *err)
   }
 
   /* set the save file name to the current file */
-  *save_file = rb_data.files[rb_data.curr_file_num % rb_data.num_files].name;
+  *save_file = rfile->name;
   return ret_val;
 }
 
@@ -379,6 +1112,10 @@ ringbuf_free(void)
 {
   unsigned int i;
 
+  ringbuf_helper_stop();
+  if (rb_data.files != NULL)
+    ringbuf_compress_finish();
+
   if (rb_data.files != NULL) {
     for (i=0; i < rb_data.num_files; i++) {
       if (rb_data.files[i].name != NULL) {
@@ -407,6 +1144,12 @@ ringbuf_error_cleanup(void)
 {
   unsigned int i;
 
+  /* finish closing and compressing the completed files, so that we can
+     remove them */
+  ringbuf_helper_stop();
+  if (rb_data.files != NULL)
+    ringbuf_compress_finish();
+
   /* try to close via wtap */
   if (rb_data.pdh != NULL) {
     if (fclose(rb_data.pdh) == 0) {
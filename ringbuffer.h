@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include "wiretap/wtap.h"
+#include "writecap/compress_output.h"
 
 #define RINGBUFFER_UNLIMITED_FILES 0
 /* Minimum number of ringbuffer files */
@@ -26,6 +27,11 @@
 int ringbuf_init(const char *capture_name, guint num_files, gboolean group_read_access);
 gboolean ringbuf_is_initialized(void);
 const gchar *ringbuf_current_filename(void);
+void ringbuf_set_aio_output(guint queue_depth);
+void ringbuf_set_compress_output(compress_output_type_t type);
+void ringbuf_set_compress_files(compress_output_type_t type);
+gboolean ringbuf_spare_files_supported(void);
+void ringbuf_set_spare_files(guint num_spares, guint64 prealloc_size);
 FILE *ringbuf_init_libpcap_fdopen(int *err);
 gboolean ringbuf_switch_file(FILE **pdh, gchar **save_file, int *save_file_fd,
                              int *err);
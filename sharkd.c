@@ -583,6 +583,179 @@ sharkd_dissect_request(guint32 framenum, guint32 frame_ref_num, guint32 prev_dis
   return 0;
 }
 
+static gboolean
+sharkd_field_value_get(fvalue_t *fv, enum ftenum ftype, sharkd_field_value_t *value)
+{
+  switch (ftype) {
+    case FT_UINT8:
+    case FT_UINT16:
+    case FT_UINT24:
+    case FT_UINT32:
+      value->uinteger64 = fvalue_get_uinteger(fv);
+      return TRUE;
+    case FT_INT8:
+    case FT_INT16:
+    case FT_INT24:
+    case FT_INT32:
+      value->sinteger64 = fvalue_get_sinteger(fv);
+      return TRUE;
+    case FT_UINT40:
+    case FT_UINT48:
+    case FT_UINT56:
+    case FT_UINT64:
+      value->uinteger64 = fvalue_get_uinteger64(fv);
+      return TRUE;
+    case FT_INT40:
+    case FT_INT48:
+    case FT_INT56:
+    case FT_INT64:
+      value->sinteger64 = fvalue_get_sinteger64(fv);
+      return TRUE;
+    case FT_FLOAT:
+    case FT_DOUBLE:
+      value->floating = fvalue_get_floating(fv);
+      return TRUE;
+    case FT_RELATIVE_TIME:
+      value->time = *(nstime_t *) fvalue_get(fv);
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/*
+ * Turn a value kept by sharkd_field_columns() back into an fvalue_t.
+ *
+ * Returns FALSE if values of that type aren't kept.
+ */
+gboolean
+sharkd_field_value_set(fvalue_t *fv, enum ftenum ftype, const sharkd_field_value_t *value)
+{
+  fvalue_init(fv, ftype);
+  switch (ftype) {
+    case FT_UINT8:
+    case FT_UINT16:
+    case FT_UINT24:
+    case FT_UINT32:
+      fvalue_set_uinteger(fv, (guint32) value->uinteger64);
+      return TRUE;
+    case FT_INT8:
+    case FT_INT16:
+    case FT_INT24:
+    case FT_INT32:
+      fvalue_set_sinteger(fv, (gint32) value->sinteger64);
+      return TRUE;
+    case FT_UINT40:
+    case FT_UINT48:
+    case FT_UINT56:
+    case FT_UINT64:
+      fvalue_set_uinteger64(fv, value->uinteger64);
+      return TRUE;
+    case FT_INT40:
+    case FT_INT48:
+    case FT_INT56:
+    case FT_INT64:
+      fvalue_set_sinteger64(fv, value->sinteger64);
+      return TRUE;
+    case FT_FLOAT:
+    case FT_DOUBLE:
+      fvalue_set_floating(fv, value->floating);
+      return TRUE;
+    case FT_RELATIVE_TIME:
+      fvalue_set_time(fv, &value->time);
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/*
+ * Collect the values of some fields in every frame with a single
+ * dissection pass, so that requests about them can be answered
+ * without dissecting again.  The hf_index of every column must be set.
+ */
+int
+sharkd_field_columns(struct sharkd_field_column *columns, guint num_columns)
+{
+  guint32 framenum;
+  Buffer buf;
+  wtap_rec rec;
+  int err;
+  char *err_info = NULL;
+  GArray **values;
+  guint i;
+
+  epan_dissect_t edt;
+
+  values = g_new(GArray *, num_columns);
+  for (i = 0; i < num_columns; i++) {
+    columns[i].first = g_new0(guint32, cfile.count + 1);
+    values[i] = g_array_new(FALSE, FALSE, sizeof(sharkd_field_value_t));
+  }
+
+  wtap_rec_init(&rec);
+  ws_buffer_init(&buf, 1514);
+  epan_dissect_init(&edt, cfile.epan, TRUE, FALSE);
+
+  for (framenum = 1; framenum <= cfile.count; framenum++) {
+    frame_data *fdata = sharkd_get_frame(framenum);
+
+    if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, &rec, &buf, &err, &err_info)) {
+      g_free(err_info);
+      break;
+    }
+
+    for (i = 0; i < num_columns; i++)
+      epan_dissect_prime_with_hfid(&edt, columns[i].hf_index);
+
+    /* same references as sharkd_retap() */
+    fdata->ref_time = FALSE;
+    fdata->frame_ref_num = (framenum != 1) ? 1 : 0;
+    fdata->prev_dis_num = framenum - 1;
+    epan_dissect_run(&edt, cfile.cd_t, &rec,
+                     frame_tvbuff_new_buffer(&cfile.provider, fdata, &buf),
+                     fdata, NULL);
+
+    for (i = 0; i < num_columns; i++) {
+      GPtrArray *finfos = proto_get_finfo_ptr_array(edt.tree, columns[i].hf_index);
+      enum ftenum ftype = proto_registrar_get_ftype(columns[i].hf_index);
+      guint32 count = 0;
+      guint j;
+
+      for (j = 0; finfos && j < finfos->len; j++) {
+        sharkd_field_value_t value;
+
+        if (sharkd_field_value_get(&((field_info *) finfos->pdata[j])->value, ftype, &value))
+          g_array_append_val(values[i], value);
+        count++;
+      }
+      columns[i].first[framenum] = columns[i].first[framenum - 1] + count;
+    }
+
+    epan_dissect_reset(&edt);
+  }
+
+  /* frames which can't be read have no values */
+  for (; framenum <= cfile.count; framenum++) {
+    for (i = 0; i < num_columns; i++)
+      columns[i].first[framenum] = columns[i].first[framenum - 1];
+  }
+
+  for (i = 0; i < num_columns; i++) {
+    /* nothing stored if the field isn't numeric, or never there */
+    gboolean have_values = (values[i]->len != 0);
+
+    columns[i].values = (sharkd_field_value_t *) g_array_free(values[i], !have_values);
+  }
+  g_free(values);
+
+  wtap_rec_cleanup(&rec);
+  ws_buffer_free(&buf);
+  epan_dissect_cleanup(&edt);
+
+  return 0;
+}
+
 /* based on packet_list_dissect_and_cache_record */
 int
 sharkd_dissect_columns(frame_data *fdata, guint32 frame_ref_num, guint32 prev_dis_num, column_info *cinfo, gboolean dissect_color)
@@ -701,67 +874,59 @@ sharkd_retap(void)
   return 0;
 }
 
-int
-sharkd_filter(const char *dftext, guint8 **result)
+/*
+ * Run a display filter over the frames from first_frame to last_frame,
+ * setting the bit of every matching frame in result.  *prev_dis_num is
+ * the last matching frame before first_frame, and is updated so that
+ * the next range can carry on where this one stopped.
+ *
+ * Returns the number of the last frame filtered, which is less than
+ * last_frame if reading a frame failed.
+ */
+guint32
+sharkd_filter(dfilter_t *dfcode, guint32 first_frame, guint32 last_frame, guint32 *prev_dis_num, guint8 *result)
 {
-  dfilter_t  *dfcode = NULL;
-
-  guint32 framenum, prev_dis_num = 0;
-  guint32 frames_count;
+  guint32 framenum;
   Buffer buf;
   wtap_rec rec;
   int err;
   char *err_info = NULL;
 
-  guint8 *result_bits;
-  guint8  passed_bits;
-
   epan_dissect_t edt;
 
-  if (!dfilter_compile(dftext, &dfcode, &err_info)) {
-    g_free(err_info);
-    return -1;
-  }
-
-  /* if dfilter_compile() success, but (dfcode == NULL) all frames are matching */
-  if (dfcode == NULL) {
-    *result = NULL;
-    return 0;
-  }
-
-  frames_count = cfile.count;
-
   wtap_rec_init(&rec);
   ws_buffer_init(&buf, 1514);
   epan_dissect_init(&edt, cfile.epan, TRUE, FALSE);
 
-  passed_bits = 0;
-  result_bits = (guint8 *) g_malloc(2 + (frames_count / 8));
-
-  for (framenum = 1; framenum <= frames_count; framenum++) {
+  for (framenum = first_frame; framenum <= last_frame; framenum++) {
     frame_data *fdata = sharkd_get_frame(framenum);
 
-    if ((framenum & 7) == 0) {
-      result_bits[(framenum / 8) - 1] = passed_bits;
-      passed_bits = 0;
+    if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, &rec, &buf, &err, &err_info)) {
+      g_free(err_info);
+      break;
     }
 
-    if (!wtap_seek_read(cfile.provider.wth, fdata->file_off, &rec, &buf, &err, &err_info))
-      break;
+    /* The file has been dissected once already, so a frame that can't
+       match needn't be dissected again. */
+    if (rec.rec_type == REC_TYPE_PACKET &&
+        !dfilter_prefilter_packet(dfcode, ws_buffer_start_ptr(&buf),
+                                  rec.rec_header.packet_header.caplen,
+                                  rec.rec_header.packet_header.len))
+      continue;
 
     /* frame_data_set_before_dissect */
     epan_dissect_prime_with_dfilter(&edt, dfcode);
 
     fdata->ref_time = FALSE;
     fdata->frame_ref_num = (framenum != 1) ? 1 : 0;
-    fdata->prev_dis_num = prev_dis_num;
+    fdata->prev_dis_num = *prev_dis_num;
     epan_dissect_run(&edt, cfile.cd_t, &rec,
                      frame_tvbuff_new_buffer(&cfile.provider, fdata, &buf),
                      fdata, NULL);
 
     if (dfilter_apply_edt(dfcode, &edt)) {
-      passed_bits |= (1 << (framenum % 8));
-      prev_dis_num = framenum;
+      result[framenum / 8] |= (1 << (framenum % 8));
+      *prev_dis_num = framenum;
     }
 
     /* if passed or ref -> frame_data_set_after_dissect */
@@ -769,19 +934,11 @@ sharkd_filter(const char *dftext, guint8 **result)
     epan_dissect_reset(&edt);
   }
 
-  if ((framenum & 7) == 0)
-      framenum--;
-  result_bits[framenum / 8] = passed_bits;
-
   wtap_rec_cleanup(&rec);
   ws_buffer_free(&buf);
   epan_dissect_cleanup(&edt);
 
-  dfilter_free(dfcode);
-
-  *result = result_bits;
-
-  return framenum;
+  return framenum - 1;
 }
 
 const char *
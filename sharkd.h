@@ -20,14 +20,33 @@
 #define SHARKD_DISSECT_FLAG_PROTO_TREE 0x04u
 #define SHARKD_DISSECT_FLAG_COLOR      0x08u
 
+/* Value of a numeric field, as kept by sharkd_field_columns() */
+typedef union
+{
+	guint64 uinteger64;
+	gint64 sinteger64;
+	gdouble floating;
+	nstime_t time;
+} sharkd_field_value_t;
+
+/* Values of one field in every frame */
+struct sharkd_field_column
+{
+	int hf_index;
+	guint32 *first;  /* values of frame n are values[first[n - 1]] up to values[first[n]] */
+	sharkd_field_value_t *values; /* NULL if the field isn't numeric, only the number of values is kept then */
+};
+
 typedef void (*sharkd_dissect_func_t)(epan_dissect_t *edt, proto_tree *tree, struct epan_column_info *cinfo, const GSList *data_src, void *data);
 
 /* sharkd.c */
 cf_status_t sharkd_cf_open(const char *fname, unsigned int type, gboolean is_tempfile, int *err);
 int sharkd_load_cap_file(void);
 int sharkd_retap(void);
-int sharkd_filter(const char *dftext, guint8 **result);
+guint32 sharkd_filter(dfilter_t *dfcode, guint32 first_frame, guint32 last_frame, guint32 *prev_dis_num, guint8 *result);
 frame_data *sharkd_get_frame(guint32 framenum);
+gboolean sharkd_field_value_set(fvalue_t *fv, enum ftenum ftype, const sharkd_field_value_t *value);
+int sharkd_field_columns(struct sharkd_field_column *columns, guint num_columns);
 int sharkd_dissect_columns(frame_data *fdata, guint32 frame_ref_num, guint32 prev_dis_num, column_info *cinfo, gboolean dissect_color);
 int sharkd_dissect_request(guint32 framenum, guint32 frame_ref_num, guint32 prev_dis_num, sharkd_dissect_func_t cb, guint32 dissect_flags, void *data);
 const char *sharkd_get_user_comment(const frame_data *fd);
@@ -40,6 +59,8 @@ int sharkd_loop(void);
 
 /* sharkd_session.c */
 int sharkd_session_main(void);
+int sharkd_session_shared_init(const char *fname);
+int sharkd_session_shared_main(FILE *in, FILE *out);
 
 #endif /* __SHARKD_H */
 
@@ -52,6 +52,9 @@
 
 static int _use_stdinout = 0;
 static socket_handle_t _server_fd = INVALID_SOCKET;
+#ifndef _WIN32
+static const char *_shared_file = NULL;
+#endif
 
 static socket_handle_t
 socket_init(char *path)
@@ -165,9 +168,18 @@ sharkd_init(int argc, char **argv)
 #endif
 	socket_handle_t fd;
 
+#ifndef _WIN32
+	if (argc == 3 && strcmp(argv[1], "-") != 0)
+		_shared_file = argv[2];
+	else
+#endif
 	if (argc != 2)
 	{
+#ifndef _WIN32
+		fprintf(stderr, "Usage: %s <-|socket [capture file]>\n", argv[0]);
+#else
 		fprintf(stderr, "Usage: %s <-|socket>\n", argv[0]);
+#endif
 		fprintf(stderr, "\n");
 
 		fprintf(stderr, "<socket> examples:\n");
@@ -178,6 +190,11 @@ sharkd_init(int argc, char **argv)
 		fprintf(stderr, " - tcp:127.0.0.1:4446 - listen on TCP port 4446\n");
 #endif
 		fprintf(stderr, "\n");
+#ifndef _WIN32
+		fprintf(stderr, "With a capture file, it is loaded once and shared by all connections,\n");
+		fprintf(stderr, "which are served by threads of a single process.\n");
+		fprintf(stderr, "\n");
+#endif
 		return -1;
 	}
 
@@ -216,6 +233,92 @@ sharkd_init(int argc, char **argv)
 	return 0;
 }
 
+#ifndef _WIN32
+static void
+sharkd_shared_client(gpointer data, gpointer user_data _U_)
+{
+	socket_handle_t fd = GPOINTER_TO_INT(data);
+	FILE *in, *out;
+	int out_fd;
+
+	in = NULL;
+	out = NULL;
+	out_fd = dup(fd);
+	if (out_fd != -1)
+	{
+		in = fdopen(fd, "r");
+		out = fdopen(out_fd, "w");
+	}
+
+	if (in == NULL || out == NULL)
+	{
+		fprintf(stderr, "cannot set up connection: %s\n", g_strerror(errno));
+		if (in != NULL)
+			fclose(in);
+		else
+			closesocket(fd);
+		if (out != NULL)
+			fclose(out);
+		else if (out_fd != -1)
+			close(out_fd);
+		return;
+	}
+
+	sharkd_session_shared_main(in, out);
+
+	fclose(out);
+	fclose(in);
+}
+
+/*
+ * Serve every connection from this process, with the capture file loaded
+ * only once.  Each connection has its own thread reading its requests;
+ * the requests themselves are run one at a time, as the dissection engine
+ * isn't thread-safe, but nobody waits for a whole dissection pass when
+ * another analyst connects.
+ */
+static int
+sharkd_shared_loop(void)
+{
+	GThreadPool *pool;
+	GError *error = NULL;
+
+	/* a client going away must not take the whole daemon down */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (sharkd_session_shared_init(_shared_file) != 0)
+		return 1;
+
+	pool = g_thread_pool_new(sharkd_shared_client, NULL, -1, FALSE, &error);
+	if (pool == NULL)
+	{
+		fprintf(stderr, "cannot create thread pool: %s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	while (1)
+	{
+		socket_handle_t fd;
+
+		fd = accept(_server_fd, NULL, NULL);
+		if (fd == INVALID_SOCKET)
+		{
+			fprintf(stderr, "cannot accept(): %s\n", g_strerror(errno));
+			continue;
+		}
+
+		if (!g_thread_pool_push(pool, GINT_TO_POINTER(fd), &error))
+		{
+			fprintf(stderr, "cannot start connection thread: %s\n", error->message);
+			g_clear_error(&error);
+			closesocket(fd);
+		}
+	}
+	return 0;
+}
+#endif
+
 int
 sharkd_loop(void)
 {
@@ -224,6 +327,13 @@ sharkd_loop(void)
 		return sharkd_session_main();
 	}
 
+#ifndef _WIN32
+	if (_shared_file)
+	{
+		return sharkd_shared_loop();
+	}
+#endif
+
 	while (1)
 	{
 #ifndef _WIN32
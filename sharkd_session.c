@@ -73,15 +73,39 @@
 
 #include "sharkd.h"
 
+/* frames filtered at once when a request needs more of the bitmap */
+#define SHARKD_FILTER_CHUNK 4096
+
 struct sharkd_filter_item
 {
 	guint8 *filtered; /* can be NULL if all frames are matching for given filter. */
+	dfilter_t *dfcode; /* NULL once every frame has been filtered. */
+	guint32 filtered_count; /* bits of frames up to this one are valid. */
+	guint32 prev_dis_num; /* last matching frame so far. */
 };
 
 static GHashTable *filter_table = NULL;
 
+/* fields whose values are kept for every frame, at most this many */
+#define SHARKD_FIELD_TABLE_MAX 32
+
+static GHashTable *field_table = NULL;
+
 static json_dumper dumper = {0};
 
+/*
+ * When the capture is shared (see sharkd_session_shared_main()), requests
+ * from all connections are run one at a time under session_lock, so the
+ * state above and the capture file are only touched by one of them.
+ */
+static gboolean session_shared = FALSE;
+static gboolean session_bye = FALSE;
+static int session_next_flags = 0;
+
+/* CBOR simple value which ends every reply when the encoding is "cbor" */
+#define SHARKD_CBOR_UNDEFINED 0xf7
+static GMutex session_lock;
+
 static const char *
 json_find_attr(const char *buf, const jsmntok_t *tokens, int count, const char *attr)
 {
@@ -185,34 +209,138 @@ sharkd_session_filter_free(gpointer data)
 {
 	struct sharkd_filter_item *l = (struct sharkd_filter_item *) data;
 
+	dfilter_free(l->dfcode);
 	g_free(l->filtered);
 	g_free(l);
 }
 
-static const struct sharkd_filter_item *
+/*
+ * The bitmap of a filter is only computed as far as requests need it;
+ * use sharkd_session_filter_run() before looking at the bit of a frame.
+ */
+static struct sharkd_filter_item *
 sharkd_session_filter_data(const char *filter)
 {
 	struct sharkd_filter_item *l;
+	char *text;
 
-	l = (struct sharkd_filter_item *) g_hash_table_lookup(filter_table, filter);
+	/* Requests spell the same filter in different ways; share its bitmap */
+	text = dfilter_canonical_text(filter);
+	l = (struct sharkd_filter_item *) g_hash_table_lookup(filter_table, text);
 	if (!l)
 	{
-		guint8 *filtered = NULL;
-
-		int ret = sharkd_filter(filter, &filtered);
+		dfilter_t *dfcode = NULL;
+		char *err_info = NULL;
 
-		if (ret == -1)
+		if (!dfilter_compile(filter, &dfcode, &err_info))
+		{
+			g_free(err_info);
+			g_free(text);
 			return NULL;
+		}
+
+		l = (struct sharkd_filter_item *) g_malloc0(sizeof(struct sharkd_filter_item));
 
-		l = (struct sharkd_filter_item *) g_malloc(sizeof(struct sharkd_filter_item));
-		l->filtered = filtered;
+		/* if dfilter_compile() success, but (dfcode == NULL) all frames are matching */
+		if (dfcode)
+		{
+			l->filtered = (guint8 *) g_malloc0(2 + (cfile.count / 8));
+			l->dfcode = dfcode;
+		}
 
-		g_hash_table_insert(filter_table, g_strdup(filter), l);
+		g_hash_table_insert(filter_table, text, l);
 	}
+	else
+		g_free(text);
 
 	return l;
 }
 
+/*
+ * Make the bits of the frames up to framenum valid.  Some frames past it
+ * are filtered as well, as the next request most likely wants them.
+ */
+static void
+sharkd_session_filter_run(struct sharkd_filter_item *l, guint32 framenum)
+{
+	guint32 last_frame;
+
+	if (!l->dfcode || framenum <= l->filtered_count)
+		return;
+
+	last_frame = cfile.count;
+	if (cfile.count - framenum > SHARKD_FILTER_CHUNK)
+		last_frame = framenum + SHARKD_FILTER_CHUNK;
+
+	/* frames which can't be read are left as not matching */
+	sharkd_filter(l->dfcode, l->filtered_count + 1, last_frame, &l->prev_dis_num, l->filtered);
+	l->filtered_count = last_frame;
+
+	if (l->filtered_count == cfile.count)
+	{
+		dfilter_free(l->dfcode);
+		l->dfcode = NULL;
+	}
+}
+
+static void
+sharkd_session_field_free(gpointer data)
+{
+	struct sharkd_field_column *column = (struct sharkd_field_column *) data;
+
+	g_free(column->first);
+	g_free(column->values);
+	g_free(column);
+}
+
+/*
+ * Make sure the values of the fields are kept, collecting those which
+ * aren't yet in one dissection pass.  Returns FALSE if some of them
+ * can't be kept, as there are already too many fields in the table.
+ */
+static gboolean
+sharkd_session_field_columns(const int *hf_indexes, guint count)
+{
+	struct sharkd_field_column *columns;
+	guint num_columns = 0;
+	guint i, j;
+
+	columns = g_new0(struct sharkd_field_column, count);
+	for (i = 0; i < count; i++)
+	{
+		if (g_hash_table_contains(field_table, GINT_TO_POINTER(hf_indexes[i])))
+			continue;
+
+		for (j = 0; j < num_columns; j++)
+		{
+			if (columns[j].hf_index == hf_indexes[i])
+				break;
+		}
+
+		if (j == num_columns)
+			columns[num_columns++].hf_index = hf_indexes[i];
+	}
+
+	if (g_hash_table_size(field_table) + num_columns > SHARKD_FIELD_TABLE_MAX)
+	{
+		g_free(columns);
+		return FALSE;
+	}
+
+	if (num_columns)
+		sharkd_field_columns(columns, num_columns);
+
+	for (i = 0; i < num_columns; i++)
+	{
+		struct sharkd_field_column *column = (struct sharkd_field_column *) g_memdup(&columns[i], sizeof(*column));
+
+		g_hash_table_insert(field_table, GINT_TO_POINTER(column->hf_index), column);
+	}
+
+	g_free(columns);
+	return TRUE;
+}
+
 static gboolean
 sharkd_rtp_match_init(rtpstream_id_t *id, const char *init_str)
 {
@@ -544,6 +672,15 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 	if (!tok_file)
 		return;
 
+	if (session_shared)
+	{
+		/* the capture was loaded when the daemon started; other sessions are using it */
+		if (strcmp(tok_file, cfile.filename) != 0)
+			err = EBUSY;
+		sharkd_json_simple_reply(err, err ? "another capture file is shared by this sharkd" : NULL);
+		return;
+	}
+
 	fprintf(stderr, "load: filename=%s\n", tok_file);
 
 	if (sharkd_cf_open(tok_file, WTAP_TYPE_AUTO, FALSE, &err) != CF_OK)
@@ -552,6 +689,10 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 		return;
 	}
 
+	/* bitmaps and field values of the previous file are sized and computed for it */
+	g_hash_table_remove_all(filter_table);
+	g_hash_table_remove_all(field_table);
+
 	TRY
 	{
 		err = sharkd_load_cap_file();
@@ -761,6 +902,8 @@ sharkd_session_create_columns(column_info *cinfo, const char *buf, const jsmntok
 	return cinfo;
 }
 
+#define SHARKD_FRAMES_FLUSH_ROWS 1000
+
 /**
  * sharkd_session_process_frames()
  *
@@ -773,6 +916,9 @@ sharkd_session_create_columns(column_info *cinfo, const char *buf, const jsmntok
  *   (o) skip=N   - skip N frames
  *   (o) limit=N  - show only N frames
  *   (o) refs  - list (comma separated) with sorted time reference frame numbers.
+ *   (o) cursor - continue after this frame number, 0 to start.  The reply is an object
+ *                with the array of frames as "frames", and "cursor" to pass in the
+ *                request for the next frames, only if there is another frame to send.
  *
  * Output array of frames with attributes:
  *   (m) c   - array of column data
@@ -791,7 +937,9 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 	const char *tok_skip   = json_find_attr(buf, tokens, count, "skip");
 	const char *tok_limit  = json_find_attr(buf, tokens, count, "limit");
 	const char *tok_refs   = json_find_attr(buf, tokens, count, "refs");
+	const char *tok_cursor = json_find_attr(buf, tokens, count, "cursor");
 
+	struct sharkd_filter_item *filter_item = NULL;
 	const guint8 *filter_data = NULL;
 
 	int col;
@@ -800,6 +948,8 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 	guint32 current_ref_frame = 0, next_ref_frame = G_MAXUINT32;
 	guint32 skip;
 	guint32 limit;
+	guint32 cursor = 0;
+	guint32 rows = 0;
 
 	column_info *cinfo = &cfile.cinfo;
 	column_info user_cinfo;
@@ -814,8 +964,6 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 
 	if (tok_filter)
 	{
-		const struct sharkd_filter_item *filter_item;
-
 		filter_item = sharkd_session_filter_data(tok_filter);
 		if (!filter_item)
 			return;
@@ -842,12 +990,31 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 			return;
 	}
 
-	sharkd_json_array_open(NULL);
-	for (framenum = 1; framenum <= cfile.count; framenum++)
+	if (tok_cursor)
+	{
+		if (!ws_strtou32(tok_cursor, NULL, &cursor))
+			return;
+		/* the frame of the cursor was the last one displayed */
+		prev_dis_num = cursor;
+	}
+
+	if (tok_cursor)
+	{
+		json_dumper_begin_object(&dumper);
+		sharkd_json_array_open("frames");
+	}
+	else
+		sharkd_json_array_open(NULL);
+
+	for (framenum = cursor + 1; framenum <= cfile.count; framenum++)
 	{
 		frame_data *fdata;
 		guint32 ref_frame = (framenum != 1) ? 1 : 0;
 
+		/* stop filtering when the limit is reached, the rest is filtered when asked for */
+		if (filter_item)
+			sharkd_session_filter_run(filter_item, framenum);
+
 		if (filter_data && !(filter_data[framenum / 8] & (1 << (framenum % 8))))
 			continue;
 
@@ -926,10 +1093,36 @@ sharkd_session_process_frames(const char *buf, const jsmntok_t *tokens, int coun
 		json_dumper_end_object(&dumper);
 		prev_dis_num = framenum;
 
+		/* let the client work on the first frames of a long reply */
+		if (++rows % SHARKD_FRAMES_FLUSH_ROWS == 0)
+			fflush(dumper.output_file);
+
 		if (limit && --limit == 0)
 			break;
 	}
 	sharkd_json_array_close();
+
+	if (tok_cursor)
+	{
+		guint32 next;
+
+		/*
+		 * If we stopped at the limit, look for the next frame that the
+		 * filter lets through, so that a client isn't given a cursor only
+		 * to get no frames for it.
+		 */
+		for (next = framenum + 1; next <= cfile.count; next++)
+		{
+			if (filter_item)
+				sharkd_session_filter_run(filter_item, next);
+
+			if (!filter_data || (filter_data[next / 8] & (1 << (next % 8))))
+				break;
+		}
+		if (next <= cfile.count)
+			sharkd_json_value_anyf("cursor", "%u", framenum);
+		json_dumper_end_object(&dumper);
+	}
 	json_dumper_finish(&dumper);
 
 	if (cinfo != &cfile.cinfo)
@@ -2925,6 +3118,11 @@ struct sharkd_iograph
 	int hf_index;
 	io_graph_item_unit_t calc_type;
 	guint32 interval;
+	const char *filter;
+
+	/* computed from the filter and field caches instead of a tap, if set */
+	gboolean cached;
+	struct sharkd_filter_item *filter_item;
 
 	/* result */
 	int space_items;
@@ -2933,17 +3131,9 @@ struct sharkd_iograph
 	GString *error;
 };
 
-static tap_packet_status
-sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const void *dummy _U_)
+static void
+sharkd_iograph_grow(struct sharkd_iograph *graph, int idx)
 {
-	struct sharkd_iograph *graph = (struct sharkd_iograph *) g;
-	int idx;
-	gboolean update_succeeded;
-
-	idx = get_io_graph_index(pinfo, graph->interval);
-	if (idx < 0 || idx >= SHARKD_IOGRAPH_MAX_ITEMS)
-		return TAP_PACKET_DONT_REDRAW;
-
 	if (idx + 1 > graph->num_items)
 	{
 		if (idx + 1 > graph->space_items)
@@ -2963,12 +3153,109 @@ sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const vo
 
 		graph->num_items = idx + 1;
 	}
+}
+
+static tap_packet_status
+sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const void *dummy _U_)
+{
+	struct sharkd_iograph *graph = (struct sharkd_iograph *) g;
+	int idx;
+	gboolean update_succeeded;
+
+	idx = get_io_graph_index(pinfo, graph->interval);
+	if (idx < 0 || idx >= SHARKD_IOGRAPH_MAX_ITEMS)
+		return TAP_PACKET_DONT_REDRAW;
+
+	sharkd_iograph_grow(graph, idx);
 
 	update_succeeded = update_io_graph_item(graph->items, idx, pinfo, edt, graph->hf_index, graph->calc_type, graph->interval);
 	/* XXX - TAP_PACKET_FAILED if the item couldn't be updated, with an error message? */
 	return update_succeeded ? TAP_PACKET_REDRAW : TAP_PACKET_DONT_REDRAW;
 }
 
+/*
+ * Same as the tap does with sharkd_iograph_packet(), but from frame_data,
+ * the filter bitmap and the values kept of the field, without dissecting.
+ */
+static void
+sharkd_iograph_from_cache(struct sharkd_iograph *graph)
+{
+	const guint8 *filter_data = (graph->filter_item) ? graph->filter_item->filtered : NULL;
+	const struct sharkd_field_column *column = NULL;
+	enum ftenum ftype = FT_NONE;
+	const nstime_t *start_ts;
+	guint32 framenum;
+
+	if (cfile.count == 0)
+		return;
+
+	if (graph->hf_index >= 0)
+	{
+		column = (const struct sharkd_field_column *) g_hash_table_lookup(field_table, GINT_TO_POINTER(graph->hf_index));
+		ftype = proto_registrar_get_ftype(graph->hf_index);
+	}
+
+	start_ts = &(sharkd_get_frame(1)->abs_ts);
+
+	for (framenum = 1; framenum <= cfile.count; framenum++)
+	{
+		frame_data *fdata;
+		io_graph_item_t *item;
+		nstime_t rel_ts;
+		gint64 msec_rel;
+		int idx;
+
+		if (filter_data && !(filter_data[framenum / 8] & (1 << (framenum % 8))))
+			continue;
+
+		fdata = sharkd_get_frame(framenum);
+
+		/* get_io_graph_index(), with the time relative to the first frame as sharkd_retap() does */
+		nstime_delta(&rel_ts, &fdata->abs_ts, start_ts);
+		if (rel_ts.nsecs < 0)
+		{
+			rel_ts.secs--;
+			rel_ts.nsecs += 1000000000;
+		}
+		if (rel_ts.secs < 0)
+			continue;
+
+		msec_rel = rel_ts.secs * (gint64) 1000 + rel_ts.nsecs / 1000000;
+		if (msec_rel / graph->interval >= SHARKD_IOGRAPH_MAX_ITEMS)
+			continue;
+		idx = (int) (msec_rel / graph->interval);
+
+		sharkd_iograph_grow(graph, idx);
+		item = &graph->items[idx];
+
+		if (item->first_frame_in_invl == 0)
+			item->first_frame_in_invl = framenum;
+		item->last_frame_in_invl = framenum;
+
+		if (column)
+		{
+			guint32 i;
+
+			/* update_io_graph_item() doesn't count frames without the field */
+			if (column->first[framenum - 1] == column->first[framenum])
+				continue;
+
+			for (i = column->first[framenum - 1]; i < column->first[framenum]; i++)
+			{
+				fvalue_t fv;
+
+				if (column->values && sharkd_field_value_set(&fv, ftype, &column->values[i]))
+					update_io_graph_item_value(graph->items, idx, framenum, &rel_ts, &fv, graph->hf_index, graph->calc_type, graph->interval);
+				else
+					item->fields++;
+			}
+		}
+
+		item->frames++;
+		item->bytes += fdata->pkt_len;
+	}
+}
+
 /**
  * sharkd_session_process_iograph()
  *
@@ -2994,7 +3281,9 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
 {
 	const char *tok_interval = json_find_attr(buf, tokens, count, "interval");
 	struct sharkd_iograph graphs[10];
-	gboolean is_any_ok = FALSE;
+	int hf_indexes[G_N_ELEMENTS(graphs)];
+	guint num_hf_indexes = 0;
+	gboolean is_any_tap = FALSE;
 	int graph_count;
 
 	guint32 interval_ms = 1000; /* default: one per second */
@@ -3062,19 +3351,67 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
 		graph->num_items = 0;
 		graph->items = NULL;
 
+		graph->filter = tok_filter;
+		graph->cached = FALSE;
+		graph->filter_item = NULL;
+
 		if (!graph->error)
-			graph->error = register_tap_listener("frame", graph, tok_filter, TL_REQUIRES_PROTO_TREE, NULL, sharkd_iograph_packet, NULL, NULL);
+		{
+			/*
+			 * Use the filter cache if the filter compiles, else let
+			 * register_tap_listener() report the error.
+			 */
+			if (tok_filter)
+				graph->filter_item = sharkd_session_filter_data(tok_filter);
+
+			if (!tok_filter || graph->filter_item)
+			{
+				graph->cached = TRUE;
+				if (graph->hf_index >= 0)
+					hf_indexes[num_hf_indexes++] = graph->hf_index;
+			}
+		}
 
 		graph_count++;
+	}
 
-		if (graph->error == NULL)
-			is_any_ok = TRUE;
+	/* fields are collected once, in a single pass for all the graphs */
+	if (!sharkd_session_field_columns(hf_indexes, num_hf_indexes))
+	{
+		for (i = 0; i < graph_count; i++)
+		{
+			if (graphs[i].hf_index >= 0)
+				graphs[i].cached = FALSE;
+		}
+	}
+
+	for (i = 0; i < graph_count; i++)
+	{
+		struct sharkd_iograph *graph = &graphs[i];
+
+		if (!graph->error && !graph->cached)
+			graph->error = register_tap_listener("frame", graph, graph->filter, TL_REQUIRES_PROTO_TREE, NULL, sharkd_iograph_packet, NULL, NULL);
+
+		if (graph->error == NULL && !graph->cached)
+			is_any_tap = TRUE;
 	}
 
-	/* retap only if we have at least one ok */
-	if (is_any_ok)
+	/* retap only if we have at least one graph which isn't cached */
+	if (is_any_tap)
 		sharkd_retap();
 
+	for (i = 0; i < graph_count; i++)
+	{
+		struct sharkd_iograph *graph = &graphs[i];
+
+		if (graph->cached)
+		{
+			if (graph->filter_item)
+				sharkd_session_filter_run(graph->filter_item, cfile.count);
+			sharkd_iograph_from_cache(graph);
+		}
+	}
+
 	json_dumper_begin_object(&dumper);
 
 	sharkd_json_array_open("iograph");
@@ -3116,7 +3453,8 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
 		}
 		json_dumper_end_object(&dumper);
 
-		remove_tap_listener(graph);
+		if (!graph->cached)
+			remove_tap_listener(graph);
 		g_free(graph->items);
 	}
 	sharkd_json_array_close();
@@ -3179,11 +3517,12 @@ sharkd_session_process_intervals(char *buf, const jsmntok_t *tokens, int count)
 
 	if (tok_filter)
 	{
-		const struct sharkd_filter_item *filter_item;
+		struct sharkd_filter_item *filter_item;
 
 		filter_item = sharkd_session_filter_data(tok_filter);
 		if (!filter_item)
 			return;
+		sharkd_session_filter_run(filter_item, cfile.count);
 		filter_data = filter_item->filtered;
 	}
 
@@ -3585,6 +3924,12 @@ sharkd_session_process_setcomment(char *buf, const jsmntok_t *tokens, int count)
 	if (!fdata)
 		return;
 
+	if (session_shared)
+	{
+		sharkd_json_simple_reply(EPERM, "capture is shared read-only");
+		return;
+	}
+
 	ret = sharkd_set_user_comment(fdata, tok_comment);
 
 	sharkd_json_simple_reply(ret, NULL);
@@ -3615,6 +3960,13 @@ sharkd_session_process_setconf(char *buf, const jsmntok_t *tokens, int count)
 	if (!tok_name || tok_name[0] == '\0' || !tok_value)
 		return;
 
+	if (session_shared)
+	{
+		/* preferences change the dissection of every session */
+		sharkd_json_simple_reply(EPERM, "capture is shared read-only");
+		return;
+	}
+
 	ws_snprintf(pref, sizeof(pref), "%s:%s", tok_name, tok_value);
 
 	ret = prefs_set_pref(pref, &errmsg);
@@ -4136,6 +4488,42 @@ sharkd_session_process_download(char *buf, const jsmntok_t *tokens, int count)
 	}
 }
 
+/**
+ * sharkd_session_process_encoding()
+ *
+ * Process encoding request
+ *
+ * Input:
+ *   (m) value - encoding of the replies to the next requests:
+ *               "json" - lines of JSON, each reply finished by an empty line (default)
+ *               "cbor" - CBOR data items, objects and arrays with indefinite lengths so that
+ *                        long replies can be decoded while they are streamed, base64 data
+ *                        as byte strings; each reply finished by the "undefined" simple value
+ *
+ * Output object with attributes, still in the previous encoding:
+ *   (m) err   - error code: 0 succeed
+ */
+static void
+sharkd_session_process_encoding(char *buf, const jsmntok_t *tokens, int count)
+{
+	const char *tok_value = json_find_attr(buf, tokens, count, "value");
+
+	if (!tok_value)
+		return;
+
+	if (!strcmp(tok_value, "json"))
+		session_next_flags = dumper.flags & ~JSON_DUMPER_FLAGS_CBOR;
+	else if (!strcmp(tok_value, "cbor"))
+		session_next_flags = dumper.flags | JSON_DUMPER_FLAGS_CBOR;
+	else
+	{
+		sharkd_json_simple_reply(EINVAL, "unknown encoding");
+		return;
+	}
+
+	sharkd_json_simple_reply(0, NULL);
+}
+
 static void
 sharkd_session_process(char *buf, const jsmntok_t *tokens, int count)
 {
@@ -4224,14 +4612,24 @@ sharkd_session_process(char *buf, const jsmntok_t *tokens, int count)
 			sharkd_session_process_dumpconf(buf, tokens, count);
 		else if (!strcmp(tok_req, "download"))
 			sharkd_session_process_download(buf, tokens, count);
+		else if (!strcmp(tok_req, "encoding"))
+			sharkd_session_process_encoding(buf, tokens, count);
 		else if (!strcmp(tok_req, "bye"))
-			exit(0);
+		{
+			if (!session_shared)
+				exit(0);
+			session_bye = TRUE;
+		}
 		else
 			fprintf(stderr, "::: req = %s\n", tok_req);
 
 		/* reply for every command are 0+ lines of JSON reply (outputed above), finished by empty new line */
 		json_dumper_finish(&dumper);
 
+		/* with CBOR, 0+ data items finished by the "undefined" simple value */
+		if (dumper.flags & JSON_DUMPER_FLAGS_CBOR)
+			fputc(SHARKD_CBOR_UNDEFINED, dumper.output_file);
+
 		/*
 		 * We do an explicit fflush after every line, because
 		 * we want output to be written to the socket as soon
@@ -4246,29 +4644,21 @@ sharkd_session_process(char *buf, const jsmntok_t *tokens, int count)
 		 * which is too inefficient, and full buffering,
 		 * which is what you get if you request line buffering.
 		 */
-		fflush(stdout);
+		fflush(dumper.output_file);
 	}
 }
 
-int
-sharkd_session_main(void)
+static int
+sharkd_session_loop(FILE *in, FILE *out)
 {
 	char buf[2 * 1024];
 	jsmntok_t *tokens = NULL;
 	int tokens_max = -1;
+	int status = 0;
+	int flags = 0;
+	gboolean bye;
 
-	fprintf(stderr, "Hello in child.\n");
-
-	dumper.output_file = stdout;
-
-	filter_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_session_filter_free);
-
-#ifdef HAVE_MAXMINDDB
-	/* mmdbresolve was stopped before fork(), force starting it */
-	uat_get_table_by_name("MaxMind Database Paths")->post_update_cb();
-#endif
-
-	while (fgets(buf, sizeof(buf), stdin))
+	while (fgets(buf, sizeof(buf), in))
 	{
 		/* every command is line seperated JSON */
 		int ret;
@@ -4277,7 +4667,8 @@ sharkd_session_main(void)
 		if (ret <= 0)
 		{
 			fprintf(stderr, "invalid JSON -> closing\n");
-			return 1;
+			status = 1;
+			break;
 		}
 
 		/* fprintf(stderr, "JSON: %d tokens\n", ret); */
@@ -4295,20 +4686,119 @@ sharkd_session_main(void)
 		if (ret <= 0)
 		{
 			fprintf(stderr, "invalid JSON(2) -> closing\n");
-			return 2;
+			status = 2;
+			break;
 		}
 
+		if (session_shared)
+			g_mutex_lock(&session_lock);
+
+		dumper.output_file = out;
+		dumper.flags = flags;
+		session_next_flags = flags;
+
 		host_name_lookup_process();
 
 		sharkd_session_process(buf, tokens, ret);
+
+		/* an encoding request changes it for the next replies of this session */
+		flags = session_next_flags;
+		bye = session_bye;
+		session_bye = FALSE;
+
+		if (session_shared)
+			g_mutex_unlock(&session_lock);
+
+		if (bye)
+			break;
 	}
 
-	g_hash_table_destroy(filter_table);
 	g_free(tokens);
 
+	return status;
+}
+
+int
+sharkd_session_main(void)
+{
+	int ret;
+
+	fprintf(stderr, "Hello in child.\n");
+
+	filter_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_session_filter_free);
+	field_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, sharkd_session_field_free);
+
+#ifdef HAVE_MAXMINDDB
+	/* mmdbresolve was stopped before fork(), force starting it */
+	uat_get_table_by_name("MaxMind Database Paths")->post_update_cb();
+#endif
+
+	ret = sharkd_session_loop(stdin, stdout);
+
+	g_hash_table_destroy(filter_table);
+	g_hash_table_destroy(field_table);
+
+	return ret;
+}
+
+/**
+ * sharkd_session_shared_init()
+ *
+ * Load the capture file once for all connections served by
+ * sharkd_session_shared_main().  The frame index, the results of the
+ * first pass and the filter bitmaps are shared by every session.
+ */
+int
+sharkd_session_shared_init(const char *fname)
+{
+	int err = 0;
+
+	filter_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_session_filter_free);
+	field_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, sharkd_session_field_free);
+
+#ifdef HAVE_MAXMINDDB
+	/* mmdbresolve was stopped in main(), start it for this process */
+	uat_get_table_by_name("MaxMind Database Paths")->post_update_cb();
+#endif
+
+	fprintf(stderr, "load: filename=%s\n", fname);
+
+	if (sharkd_cf_open(fname, WTAP_TYPE_AUTO, FALSE, &err) != CF_OK)
+		return -1;
+
+	TRY
+	{
+		err = sharkd_load_cap_file();
+	}
+	CATCH(OutOfMemoryError)
+	{
+		fprintf(stderr, "load: OutOfMemoryError\n");
+		err = ENOMEM;
+	}
+	ENDTRY;
+
+	if (err != 0)
+		return -1;
+
+	session_shared = TRUE;
 	return 0;
 }
 
+/**
+ * sharkd_session_shared_main()
+ *
+ * Serve one connection to the capture loaded by sharkd_session_shared_init().
+ * Called from a thread per connection; requests which would change the
+ * capture or the preferences for the other sessions are refused.
+ */
+int
+sharkd_session_shared_main(FILE *in, FILE *out)
+{
+	fprintf(stderr, "Hello in shared session.\n");
+
+	return sharkd_session_loop(in, out);
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -115,6 +115,11 @@ def cmd_rawshark(program):
     return program('rawshark')
 
 
+@fixtures.fixture(scope='session')
+def cmd_reordercap(program):
+    return program('reordercap')
+
+
 @fixtures.fixture(scope='session')
 def cmd_tshark(program):
     return program('tshark')
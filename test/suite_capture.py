@@ -13,12 +13,16 @@ import fixtures
 import glob
 import hashlib
 import os
+import re
+import shutil
 import socket
 import subprocess
 import subprocesstest
 import sys
+import tempfile
 import threading
 import time
+import unittest
 import uuid
 
 capture_duration = 5
@@ -113,7 +117,7 @@ def check_capture_10_packets(capture_interface, cmd_dumpcap, traffic_generator):
         capture_returncode = capture_proc.returncode
         if capture_returncode != 0:
             self.log_fd.write('{} -D output:\n'.format(cmd))
-            self.runProcess((cmd, '-D'))
+            self.runProcess(capture_command(cmd, '-D'))
         self.assertEqual(capture_returncode, 0)
         self.checkPacketCount(10)
     return check_capture_10_packets_real
@@ -302,6 +306,60 @@ def check_dumpcap_ringbuffer_stdin(cmd_dumpcap):
     return check_dumpcap_ringbuffer_stdin_real
 
 
+@fixtures.fixture
+def run_dumpcap_ringbuffer(cmd_dumpcap, request):
+    '''Capture 100 packets from stdin into ring buffer files of 10 packets each.
+
+    The files are written to a directory of their own as out_*.pcapng.
+    Returns the directory and the names printed with "-b printname".'''
+    self = request.instance
+    def run_dumpcap_ringbuffer_real(*options, out_dir=None):
+        if out_dir is None:
+            out_dir = tempfile.mkdtemp(prefix='dumpcap_rb_')
+            self.addCleanup(shutil.rmtree, out_dir, True)
+        names_file = os.path.join(out_dir, 'names.txt')
+        capture_cmd = capture_command(cmd_dumpcap,
+            '-i', '-',
+            '-w', os.path.join(out_dir, 'out.pcapng'),
+            '-b', 'packets:10',
+            '-b', 'printname:' + names_file,
+            *options,
+            shell=True
+        )
+        self.assertRun(subprocesstest.cat_dhcp_command('cat100') + ' | ' + capture_cmd, shell=True)
+        with open(names_file) as f:
+            printed_names = f.read().splitlines()
+        os.unlink(names_file)
+        return out_dir, printed_names
+    return run_dumpcap_ringbuffer_real
+
+
+@fixtures.fixture
+def check_dumpcap_same_output(cmd_dumpcap, cmd_tshark):
+    def check_dumpcap_same_output_real(self, *options):
+        '''Capture from stdin with and without options, and compare the packets written.'''
+        cat100_dhcp_cmd = subprocesstest.cat_dhcp_command('cat100')
+        packets = []
+        for variant, extra_args in (('plain', ()), ('options', options)):
+            testout_file = self.filename_from_id('{}.pcapng'.format(variant))
+            capture_cmd = capture_command(cmd_dumpcap,
+                '-i', '-',
+                '-w', testout_file,
+                *extra_args,
+                shell=True
+            )
+            self.assertRun(cat100_dhcp_cmd + ' | ' + capture_cmd, shell=True)
+            self.checkPacketCount(100, cap_file=testout_file)
+            tshark_proc = self.assertRun((cmd_tshark,
+                '-r', testout_file,
+                '-T', 'fields', '-e', 'frame.time_epoch', '-e', 'frame.len',
+                '-x',
+            ))
+            packets.append(tshark_proc.stdout_str)
+        self.assertEqual(packets[0], packets[1])
+    return check_dumpcap_same_output_real
+
+
 @fixtures.fixture
 def check_dumpcap_pcapng_sections(cmd_dumpcap, cmd_tshark, capture_file):
     if sys.platform == 'win32':
@@ -544,6 +602,18 @@ class case_dumpcap_capture(subprocesstest.SubprocessTestCase):
         '''Capture truncated packets using Dumpcap'''
         check_capture_snapshot_len(self, cmd=cmd_dumpcap)
 
+    def test_dumpcap_capture_tpacket(self, cmd_dumpcap, check_capture_10_packets):
+        '''Capture 10 packets from the network through a TPACKET_V3 ring using Dumpcap'''
+        if not sys.platform.startswith('linux'):
+            fixtures.skip('Test requires Linux.')
+        check_capture_10_packets(self, cmd=(cmd_dumpcap, '--tpacket'))
+
+    def test_dumpcap_capture_tpacket_fanout(self, cmd_dumpcap, check_capture_10_packets):
+        '''Capture 10 packets from the network through a TPACKET_V3 fanout group using Dumpcap'''
+        if not sys.platform.startswith('linux'):
+            fixtures.skip('Test requires Linux.')
+        check_capture_10_packets(self, cmd=(cmd_dumpcap, '--tpacket-fanout', '2'))
+
 
 @fixtures.mark_usefixtures('base_env')
 @fixtures.uses_fixtures
@@ -571,6 +641,119 @@ class case_dumpcap_ringbuffer(subprocesstest.SubprocessTestCase):
         check_dumpcap_ringbuffer_stdin(self, packets=47) # Last prime before 50. Arbitrary.
 
 
+@unittest.skipIf(sys.platform == 'win32', 'Ring buffer spare files aren\'t supported on Windows')
+@fixtures.mark_usefixtures('base_env')
+@fixtures.uses_fixtures
+class case_dumpcap_ringbuffer_spare_files(subprocesstest.SubprocessTestCase):
+    def test_dumpcap_ringbuffer_spare_files(self, run_dumpcap_ringbuffer):
+        '''Write ring buffer files that a helper thread creates ahead of the switches'''
+        out_dir, printed_names = run_dumpcap_ringbuffer('--ring-spare-files', '2')
+        rb_files = sorted(glob.glob(os.path.join(out_dir, 'out_*.pcapng')))
+        self.assertEqual(len(rb_files), 10)
+        self.assertEqual(printed_names, rb_files)
+        for rbf in rb_files:
+            self.checkPacketCount(10, cap_file=rbf)
+        # The spare files that weren't used are removed.
+        self.assertEqual(sorted(os.listdir(out_dir)), [os.path.basename(f) for f in rb_files])
+
+    def test_dumpcap_ringbuffer_spare_files_ring(self, run_dumpcap_ringbuffer):
+        '''Keep the last 3 ring buffer files, removing the old ones in the helper thread'''
+        out_dir, printed_names = run_dumpcap_ringbuffer('--ring-spare-files', '4', '-b', 'files:3')
+        rb_files = sorted(glob.glob(os.path.join(out_dir, 'out_*.pcapng')))
+        self.assertEqual(len(printed_names), 10)
+        self.assertEqual(printed_names[-3:], rb_files)
+        self.assertEqual(len(os.listdir(out_dir)), 3)
+
+    def test_dumpcap_ringbuffer_spare_files_filesize(self, run_dumpcap_ringbuffer):
+        '''Write ring buffer files with space allocated for them ahead of time'''
+        out_dir, printed_names = run_dumpcap_ringbuffer('--ring-spare-files', '2', '-b', 'filesize:2')
+        packet_count = 0
+        for rbf in printed_names:
+            # The space that wasn't used is given back, and never read.
+            self.assertLess(os.path.getsize(rbf), 3000)
+            capinfos_out = self.getCaptureInfo(capinfos_args=('-c',), cap_file=rbf)
+            packet_count += int(re.search(r'Number of packets:\s+(\d+)', capinfos_out).group(1))
+        self.assertEqual(packet_count, 100)
+
+    def test_dumpcap_ringbuffer_stale_spare_files(self, run_dumpcap_ringbuffer):
+        '''Remove the spare files a dumpcap that isn't running any more left behind'''
+        out_dir = tempfile.mkdtemp(prefix='dumpcap_rb_')
+        self.addCleanup(shutil.rmtree, out_dir, True)
+        # A process that has exited, and the test, which is still running
+        exited_proc = subprocess.Popen((sys.executable, '-c', 'pass'))
+        exited_proc.wait()
+        stale_spare = os.path.join(out_dir, 'out.spare-{}-0'.format(exited_proc.pid))
+        live_spare = os.path.join(out_dir, 'out.spare-{}-0'.format(os.getpid()))
+        for spare in (stale_spare, live_spare):
+            with open(spare, 'wb'):
+                pass
+        run_dumpcap_ringbuffer('--ring-spare-files', '2', out_dir=out_dir)
+        self.assertFalse(os.path.exists(stale_spare))
+        self.assertTrue(os.path.exists(live_spare))
+        self.assertEqual(len(glob.glob(os.path.join(out_dir, '*.spare-*'))), 1)
+
+
+@fixtures.fixture
+def dumpcap_compress_gz(cmd_dumpcap):
+    '''Skip the test if dumpcap can't write gzip files.'''
+    help_proc = subprocess.run((cmd_dumpcap, '-h'), stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    if not re.search(r'--compress <type>.*\n\s+.*\bgz\b', help_proc.stdout):
+        fixtures.skip('dumpcap was built without gzip support.')
+
+
+@fixtures.mark_usefixtures('base_env', 'dumpcap_compress_gz')
+@fixtures.uses_fixtures
+class case_dumpcap_ringbuffer_compress_files(subprocesstest.SubprocessTestCase):
+    def check_compressed_files(self, out_dir, printed_names, num_files):
+        # Only the compressed files are left, and their names were printed
+        # in ring order, whichever worker finished first. Files the ring
+        # removed before they were compressed aren't printed.
+        rb_files = sorted(glob.glob(os.path.join(out_dir, 'out_*.pcapng.gz')))
+        self.assertEqual(len(rb_files), num_files)
+        self.assertEqual(sorted(os.listdir(out_dir)), [os.path.basename(f) for f in rb_files])
+        if num_files == 10:
+            self.assertEqual(len(printed_names), 10)
+        self.assertEqual(printed_names, sorted(printed_names))
+        self.assertEqual(printed_names[-num_files:], rb_files)
+        for rbf in rb_files:
+            self.checkPacketCount(10, cap_file=rbf)
+
+    def test_dumpcap_ringbuffer_compress_files(self, run_dumpcap_ringbuffer):
+        '''Compress completed ring buffer files in the background'''
+        self.check_compressed_files(*run_dumpcap_ringbuffer('--compress-files', 'gz'), 10)
+
+    def test_dumpcap_ringbuffer_compress_files_ring(self, run_dumpcap_ringbuffer):
+        '''Compress completed ring buffer files, keeping the last 3'''
+        self.check_compressed_files(*run_dumpcap_ringbuffer('--compress-files', 'gz', '-b', 'files:3'), 3)
+
+    def test_dumpcap_ringbuffer_compress_files_spare_files(self, run_dumpcap_ringbuffer):
+        '''Compress completed ring buffer files that the spare files helper closes'''
+        if sys.platform == 'win32':
+            self.skipTest('Ring buffer spare files aren\'t supported on Windows')
+        self.check_compressed_files(*run_dumpcap_ringbuffer('--compress-files', 'gz',
+            '--ring-spare-files', '2', '-b', 'files:3'), 3)
+
+    def test_dumpcap_ringbuffer_compress_files_and_compress(self, cmd_dumpcap):
+        '''--compress-files can't be combined with --compress'''
+        self.assertRun((cmd_dumpcap, '-i', '-', '-w', self.filename_from_id('testout.pcapng'),
+            '-b', 'packets:10', '--compress', 'gz', '--compress-files', 'gz'),
+            expected_return=1)
+
+
+@fixtures.mark_usefixtures('base_env')
+@fixtures.uses_fixtures
+class case_dumpcap_output_options(subprocesstest.SubprocessTestCase):
+    def test_dumpcap_write_batch(self, check_dumpcap_same_output):
+        '''Capture from stdin using Dumpcap, writing packets in batches'''
+        # Small enough that the batch fills many times
+        check_dumpcap_same_output(self, '--write-batch-size', '4', '--write-batch-delay', '1')
+
+    def test_dumpcap_threads(self, check_dumpcap_same_output):
+        '''Capture from stdin using Dumpcap, passing packets through a per-interface queue'''
+        check_dumpcap_same_output(self, '-t')
+
+
 @fixtures.mark_usefixtures('base_env')
 @fixtures.uses_fixtures
 class case_dumpcap_pcapng_sections(subprocesstest.SubprocessTestCase):
@@ -112,6 +112,31 @@ class case_tshark_options(subprocesstest.SubprocessTestCase):
             self.assertIn(process.returncode, valid_returns)
 
 
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_tshark_two_pass(subprocesstest.SubprocessTestCase):
+    def test_tshark_two_pass_prefilter(self, cmd_tshark, capture_file):
+        '''Skip dissecting the packets the display filter can't match in the second pass'''
+        # The packets that fail the prefilter, on lengths or "frame contains",
+        # aren't dissected; the packets shown mustn't change.
+        for cap_file, dfilter, expected_count in (
+                ('http.pcap', 'frame contains "HEAD" and frame.len > 200', 1),
+                ('http.pcap', 'frame contains "POST" or frame.len < 10', 0),
+                ('http.pcap', '!(frame.len <= 200) and http', 1),
+                # The packets without the string are those that match.
+                ('http.pcap', '!(frame contains "x")', None),
+                ('dhcp.pcap', '!(frame contains "x")', None),
+                ('dhcp.pcap', '!(frame contains "HEAD")', 4),
+                ('dhcp.pcap', '!(frame contains "HEAD") and frame.len > 10', 4)):
+            one_pass_proc = self.assertRun((cmd_tshark, '-n',
+                '-r', capture_file(cap_file), '-Y', dfilter))
+            two_pass_proc = self.assertRun((cmd_tshark, '-n', '-2',
+                '-r', capture_file(cap_file), '-Y', dfilter))
+            self.assertEqual(two_pass_proc.stdout_str, one_pass_proc.stdout_str, dfilter)
+            if expected_count is not None:
+                self.assertEqual(self.countOutput(proc=two_pass_proc), expected_count, dfilter)
+
+
 @fixtures.mark_usefixtures('test_env')
 @fixtures.uses_fixtures
 class case_tshark_capture_clopts(subprocesstest.SubprocessTestCase):
@@ -283,6 +308,13 @@ class case_tshark_z_expert(subprocesstest.SubprocessTestCase):
         self.assertFalse(self.grepOutput('Warns'))
         self.assertFalse(self.grepOutput('Chats'))
 
+    def test_tshark_z_expert_shared_filter(self, cmd_tshark, capture_file):
+        # Both taps use one compiled copy of "tcp", applied once per packet
+        self.assertRun((cmd_tshark, '-q', '-z', 'expert,tcp',
+            '-z', 'expert,error, tcp ', '-z', 'expert,udp',
+            '-r', capture_file('http-ooo.pcap')))
+        self.assertEqual(self.countOutput('^Errors'), 2)
+
 
 @fixtures.mark_usefixtures('test_env')
 @fixtures.uses_fixtures
@@ -2,6 +2,7 @@
 #
 # SPDX-License-Identifier: GPL-2.0-or-later
 
+import os.path
 import unittest
 import fixtures
 from suite_dfilter.dfiltertest import *
@@ -58,3 +59,43 @@ class case_membership(unittest.TestCase):
         dfilter = 'frame.number in {1 "foo"}'
         error = '"foo" cannot be converted to Unsigned integer, 4 bytes.'
         checkDFilterFail(dfilter, error)
+
+    def test_membership_12_merged_or_chain(self, checkDFilterCount):
+        # Merged into "tcp.port in {1 80 2}" by the optimizer.
+        dfilter = 'tcp.port == 1 or tcp.port == 80 or ip.len == 1 or 2 == tcp.port'
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_13_merged_or_chain_no_match(self, checkDFilterCount):
+        dfilter = 'ip.addr == 10.0.0.2 or ip.addr in {10.0.0.3 10.0.0.4} or ip.addr == 10.0.0.6'
+        checkDFilterCount(dfilter, 0)
+
+    def test_membership_14_reordered_and(self, checkDFilterCount):
+        dfilter = 'http.request.method matches "^G" and tcp.port in {80 81} and tcp'
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_15_ip_subnet(self, checkDFilterCount):
+        dfilter = 'ip.addr in {192.168.0.0/16 10.0.0.0/24}'
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_16_file(self, checkDFilterCount, home_path):
+        set_file = os.path.join(home_path, 'ports.txt')
+        with open(set_file, 'w') as f:
+            f.write('# Ports\n1\n  3000 .. 3300\n\n22\n')
+        dfilter = 'tcp.port in $file("%s")' % set_file.replace('\\', '\\\\')
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_17_file_empty(self, checkDFilterFail, home_path):
+        set_file = os.path.join(home_path, 'empty.txt')
+        with open(set_file, 'w') as f:
+            f.write('# Nothing here\n')
+        dfilter = 'tcp.port in $file("%s")' % set_file.replace('\\', '\\\\')
+        error = 'The set "%s" is empty.' % set_file
+        checkDFilterFail(dfilter, error)
+
+    def test_membership_18_file_bad_line(self, checkDFilterFail, home_path):
+        set_file = os.path.join(home_path, 'bad.txt')
+        with open(set_file, 'w') as f:
+            f.write('# Ports\n80\n\nsecret-value\n')
+        dfilter = 'tcp.port in $file("%s")' % set_file.replace('\\', '\\\\')
+        error = 'Line 4 of the set isn\'t a valid value for tcp.port (type=Unsigned integer, 2 bytes).'
+        checkDFilterFail(dfilter, error)
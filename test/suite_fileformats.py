@@ -247,3 +247,25 @@ class case_fileformat_mime(subprocesstest.SubprocessTestCase):
                 '-Tfields', '-e', 'frame.len', '-e', 'pcapng.block.length',
             ))
         self.assertEqual(proc.stdout_str.strip(), '480\t128,128,88,88,132,132,132,132')
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_editcap_duplicates(subprocesstest.SubprocessTestCase):
+    def test_editcap_dup_hash(self, cmd_mergecap, cmd_editcap, cmd_tshark, capture_file):
+        '''Both duplicate hashes remove the same packets'''
+        # dhcp.pcap twice over; each packet repeats four packets later
+        dup_file = self.filename_from_id('dup.pcap')
+        self.assertRun((cmd_mergecap, '-a', '-F', 'pcap', '-w', dup_file,
+            capture_file('dhcp.pcap'), capture_file('dhcp.pcap')))
+        for dup_args, num_packets in ((('-d',), 4), (('-D', '5'), 4), (('-D', '3'), 8)):
+            kept = []
+            for dup_hash in ('xxhash', 'md5'):
+                outfile = self.filename_from_id('dedup-{}.pcap'.format(dup_hash))
+                self.assertRun((cmd_editcap, '--dup-hash', dup_hash) + dup_args +
+                    (dup_file, outfile))
+                self.checkPacketCount(num_packets, cap_file=outfile)
+                tshark_proc = self.assertRun((cmd_tshark, '-r', outfile,
+                    '-Tfields', '-e', 'frame.time_epoch', '-e', 'frame.len'))
+                kept.append(tshark_proc.stdout_str)
+            self.assertEqual(kept[0], kept[1])
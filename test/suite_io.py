@@ -9,10 +9,14 @@
 #
 '''File I/O tests'''
 
+import gzip
 import io
 import os.path
+import shutil
+import struct
 import subprocesstest
 import sys
+import zlib
 import unittest
 import fixtures
 
@@ -55,6 +59,50 @@ def check_io_4_packets(self, capture_file, cmd=None, from_stdin=False, to_stdout
     self.checkPacketCount(4)
 
 
+def make_large_capture(self, cmd_mergecap, capture_file, doublings=11):
+    '''Concatenate dhcp.pcap with itself until it is a few megabytes'''
+    cap_file = capture_file('dhcp.pcap')
+    for i in range(doublings):
+        out_file = self.filename_from_id('large{}.pcap'.format(i))
+        self.assertRun((cmd_mergecap, '-a', '-F', 'pcap', '-w', out_file, cap_file, cap_file))
+        cap_file = out_file
+    return cap_file
+
+
+def bgzf_block(data):
+    '''Compress data as a BGZF block: a gzip member whose "BC" extra field gives its size'''
+    compressor = zlib.compressobj(6, zlib.DEFLATED, -zlib.MAX_WBITS)
+    cdata = compressor.compress(data) + compressor.flush()
+    block_size = 18 + len(cdata) + 8
+    header = struct.pack('<4BI2BH2BHH', 0x1f, 0x8b, 8, 4, 0, 0, 0xff,
+        6, ord('B'), ord('C'), 2, block_size - 1)
+    return header + cdata + struct.pack('<II', zlib.crc32(data), len(data))
+
+
+def write_bgzf(in_file, out_file):
+    with open(in_file, 'rb') as f_in, open(out_file, 'wb') as f_out:
+        while True:
+            data = f_in.read(0xff00)
+            if not data:
+                break
+            f_out.write(bgzf_block(data))
+        # Empty end-of-file block
+        f_out.write(bgzf_block(b''))
+
+
+def tshark_packet_summary(self, cmd_tshark, cap_file, from_stdin=False, extra_args=''):
+    '''Return the number, time stamp, length and MD5 hash of every packet'''
+    fields_args = '-T fields -e frame.number -e frame.time_epoch -e frame.len -e frame.md5_hash' \
+        ' -o frame.generate_md5_hash:TRUE ' + extra_args
+    if from_stdin:
+        # Pipes are read as they always were, so this is the reference.
+        tshark_cmd = '{0} | "{1}" -r - {2}'.format(
+            subprocesstest.cat_cap_file_command(cap_file), cmd_tshark, fields_args)
+    else:
+        tshark_cmd = '"{0}" -r "{1}" {2}'.format(cmd_tshark, cap_file, fields_args)
+    return self.assertRun(tshark_cmd, shell=True).stdout_str
+
+
 @fixtures.mark_usefixtures('test_env')
 @fixtures.uses_fixtures
 class case_tshark_io(subprocesstest.SubprocessTestCase):
@@ -85,3 +133,159 @@ class case_rawshark_io(subprocesstest.SubprocessTestCase):
         rawshark_cmd = '{0} | "{1}" -r - -n -dencap:1 -R "udp.port==68"'.format(raw_dhcp_cmd, cmd_rawshark)
         rawshark_proc = self.assertRun(rawshark_cmd, shell=True)
         self.assertTrue(self.diffOutput(rawshark_proc.stdout_str, io_baseline_str, 'rawshark', baseline_file))
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_io_read_ahead(subprocesstest.SubprocessTestCase):
+    def test_io_read_ahead_gzip(self, cmd_tshark, cmd_mergecap, capture_file):
+        '''Decompress a gzip file in the background and get the same packets'''
+        large_file = make_large_capture(self, cmd_mergecap, capture_file)
+        expected = tshark_packet_summary(self, cmd_tshark, large_file, from_stdin=True)
+        self.assertEqual(len(expected.splitlines()), 4 * 2048)
+        gz_file = self.filename_from_id('large.pcap.gz')
+        with open(large_file, 'rb') as f_in, gzip.open(gz_file, 'wb') as f_out:
+            shutil.copyfileobj(f_in, f_out)
+        self.assertTrue(self.diffOutput(expected,
+            tshark_packet_summary(self, cmd_tshark, gz_file), 'stdin', 'gzip'))
+        # Two passes re-read the file through a random-access handle.
+        self.assertTrue(self.diffOutput(expected,
+            tshark_packet_summary(self, cmd_tshark, gz_file, extra_args='-2'), 'stdin', 'gzip -2'))
+
+    def test_io_read_ahead_bgzf(self, cmd_tshark, cmd_mergecap, capture_file):
+        '''Decompress BGZF blocks in parallel and get the same packets'''
+        large_file = make_large_capture(self, cmd_mergecap, capture_file)
+        expected = tshark_packet_summary(self, cmd_tshark, large_file, from_stdin=True)
+        bgzf_file = self.filename_from_id('large.pcap.gz')
+        write_bgzf(large_file, bgzf_file)
+        self.assertTrue(self.diffOutput(expected,
+            tshark_packet_summary(self, cmd_tshark, bgzf_file), 'stdin', 'bgzf'))
+
+    def test_io_read_ahead_tshark(self, cmd_tshark, cmd_mergecap, capture_file):
+        '''Read a file in a thread ahead of the dissection and get the same output'''
+        large_file = make_large_capture(self, cmd_mergecap, capture_file)
+        # Filtering, stopping early, and both passes of -2, which read
+        # ahead differently.
+        for extra_args in ('-Y "dhcp.option.dhcp == 3"', '-c 100', '-2', '-2 -Y "dhcp.option.dhcp == 3"'):
+            expected = tshark_packet_summary(self, cmd_tshark, large_file, from_stdin=True,
+                extra_args=extra_args.replace('-2', '').strip())
+            self.assertTrue(self.diffOutput(expected,
+                tshark_packet_summary(self, cmd_tshark, large_file, extra_args=extra_args),
+                'stdin', extra_args))
+
+    def test_io_read_ahead_secrets(self, cmd_tshark, capture_file):
+        '''Hand decryption secrets read ahead to the dissectors before the packets after them'''
+        cap_file = capture_file('tls12-dsb.pcapng')
+        expected = tshark_packet_summary(self, cmd_tshark, cap_file, from_stdin=True,
+            extra_args='-e http.host -e http.response.code')
+        self.assertEqual(self.countOutput('example.com'), 1)
+        for extra_args in ('', '-2'):
+            self.assertTrue(self.diffOutput(expected,
+                tshark_packet_summary(self, cmd_tshark, cap_file,
+                    extra_args='-e http.host -e http.response.code ' + extra_args),
+                'stdin', 'tls12-dsb.pcapng ' + extra_args))
+
+    def test_io_read_ahead_sections(self, cmd_tshark, capture_file):
+        '''Read the second pass of a pcapng file with several sections ahead of the dissection'''
+        # Each section has its own interfaces, which a reader only learns
+        # by reading the file in order.
+        multi_file = self.filename_from_id('sections.pcapng')
+        with open(multi_file, 'wb') as f_out:
+            for cap_name in ('dhcp.pcapng', 'tls12-dsb.pcapng', 'sip.pcapng', 'dhcp.pcapng'):
+                with open(capture_file(cap_name), 'rb') as f_in:
+                    shutil.copyfileobj(f_in, f_out)
+        fields_args = '-e frame.interface_id -e frame.encap_type -e frame.protocols'
+        for filter_args in ('', '-Y "dhcp or sip"'):
+            expected = tshark_packet_summary(self, cmd_tshark, multi_file, from_stdin=True,
+                extra_args=fields_args + ' ' + filter_args)
+            self.assertTrue(self.diffOutput(expected,
+                tshark_packet_summary(self, cmd_tshark, multi_file,
+                    extra_args=fields_args + ' -2 ' + filter_args),
+                'stdin', 'sections.pcapng -2 ' + filter_args))
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_io_seek_index(subprocesstest.SubprocessTestCase):
+    def test_io_seek_index(self, cmd_tshark, cmd_mergecap, capture_file):
+        '''Save a gzip seek index only if asked, and don't trust a stale or damaged one'''
+        large_file = make_large_capture(self, cmd_mergecap, capture_file)
+        expected = tshark_packet_summary(self, cmd_tshark, large_file, from_stdin=True)
+        gz_file = self.filename_from_id('large.pcap.gz')
+        index_file = gz_file + '.seekidx'
+        with open(large_file, 'rb') as f_in, gzip.open(gz_file, 'wb') as f_out:
+            shutil.copyfileobj(f_in, f_out)
+
+        def read_gz(save_index=True):
+            extra_args = '-2'
+            if save_index:
+                extra_args += ' -o gui.fileopen.save_seek_index:TRUE'
+            self.assertTrue(self.diffOutput(expected,
+                tshark_packet_summary(self, cmd_tshark, gz_file, extra_args=extra_args),
+                'stdin', 'gzip'))
+
+        def read_index():
+            with open(index_file, 'rb') as f:
+                return f.read()
+
+        # Off by default
+        read_gz(save_index=False)
+        self.assertFalse(os.path.exists(index_file))
+
+        read_gz()
+        good_index = read_index()
+        self.assertEqual(good_index[:8], b'WTSEEKIX')
+
+        # An up to date index is used, so it isn't written again.
+        os.utime(index_file, (0, 0))
+        read_gz()
+        self.assertEqual(os.stat(index_file).st_mtime, 0)
+
+        # A damaged index is ignored and replaced.
+        damaged_index = bytearray(good_index)
+        damaged_index[len(damaged_index) // 2] ^= 0xff
+        with open(index_file, 'wb') as f:
+            f.write(damaged_index)
+        read_gz()
+        self.assertEqual(read_index(), good_index)
+
+        # So is one for a file with the same size and time stamp, down
+        # to the second, but different contents; here, the time stamp in
+        # the gzip header.
+        gz_stat = os.stat(gz_file)
+        with open(gz_file, 'r+b') as f:
+            f.seek(4)
+            f.write(struct.pack('<I', 0x12345678))
+        os.utime(gz_file, ns=(gz_stat.st_atime_ns, gz_stat.st_mtime_ns))
+        read_gz()
+        new_index = read_index()
+        self.assertNotEqual(new_index[32:36], good_index[32:36])
+        self.assertEqual(new_index[:32], good_index[:32])
+
+        # And one for a file whose time stamp differs by less than a second.
+        new_mtime_ns = gz_stat.st_mtime_ns - gz_stat.st_mtime_ns % 1000000000 + 500000000
+        if new_mtime_ns == gz_stat.st_mtime_ns:
+            new_mtime_ns += 1000
+        os.utime(gz_file, ns=(gz_stat.st_atime_ns, new_mtime_ns))
+        if os.stat(gz_file).st_mtime_ns != gz_stat.st_mtime_ns:
+            read_gz()
+            self.assertEqual(struct.unpack_from('<I', read_index(), 28)[0],
+                os.stat(gz_file).st_mtime_ns % 1000000000)
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_io_mmap(subprocesstest.SubprocessTestCase):
+    def test_io_mmap_same_packets(self, cmd_tshark, capture_file):
+        '''Read files through a mapping and get the same packets as reading them from a pipe'''
+        # TShark maps pcap and pcapng files it reads directly; pipes are read as before.
+        for cap_name in ('dhcp.pcap', 'dhcp-nanosecond.pcap', 'segmented_fpm.pcap',
+                         'dvb-ci_UV1_0000.pcap', 'dhcp.pcapng', 'dmgr.pcapng', 'tls12-dsb.pcapng'):
+            cap_file = capture_file(cap_name)
+            expected = tshark_packet_summary(self, cmd_tshark, cap_file, from_stdin=True, extra_args='-x')
+            # Two passes read the packets again with wtap_seek_read().
+            for extra_args in ('-x', '-2 -x'):
+                self.assertTrue(self.diffOutput(expected,
+                    tshark_packet_summary(self, cmd_tshark, cap_file, extra_args=extra_args),
+                    'stdin', '{} {}'.format(cap_name, extra_args)))
+
@@ -286,3 +286,47 @@ class case_mergecap_pcapng(subprocesstest.SubprocessTestCase):
         ))
         # check for 11 IDBs, 88*3=264 total pkts, 86*3=258 in first IDB
         check_mergecap(self, mergecap_proc, 'pcapng', 'Per packet', 264, 11, 258)
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_mergecap_compress(subprocesstest.SubprocessTestCase):
+    def test_mergecap_compress_zst(self, cmd_mergecap, capture_file):
+        '''Merge two pcap files to a zstd-compressed pcapng, and read it back'''
+        testout_file = self.filename_from_id(testout_pcapng + '.zst')
+        mergecap_proc = self.runProcess((cmd_mergecap,
+            '-v',
+            '--compress', 'zst',
+            '-w', testout_file,
+            capture_file('dhcp.pcap'), capture_file('dhcp.pcap'),
+        ))
+        if mergecap_proc.returncode != 0 and self.grepOutput('supported in this build'):
+            self.skipTest('Requires zstd support.')
+        self.assertEqual(mergecap_proc.returncode, 0)
+        with open(testout_file, 'rb') as f:
+            # Zstandard frame magic number
+            self.assertEqual(f.read(4), b'\x28\xb5\x2f\xfd')
+        self.checkPacketCount(8, cap_file=testout_file)
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_mergecap_order(subprocesstest.SubprocessTestCase):
+    def test_mergecap_many_inputs(self, cmd_editcap, cmd_mergecap, cmd_tshark, capture_file):
+        '''Merge many inputs whose packets interleave in time stamp order'''
+        num_inputs = 40
+        infiles = []
+        for i in range(num_inputs):
+            infile = self.filename_from_id('in{}.pcap'.format(i))
+            # Later inputs start earlier, so the order has to come from the merge
+            self.assertRun((cmd_editcap, '-t', '-{:.2f}'.format(i * 0.01),
+                capture_file('dhcp.pcap'), infile))
+            infiles.append(infile)
+        testout_file = self.filename_from_id(testout_pcapng)
+        self.assertRun((cmd_mergecap, '-w', testout_file) + tuple(infiles))
+        self.checkPacketCount(num_inputs * 4, cap_file=testout_file)
+        tshark_proc = self.assertRun((cmd_tshark, '-r', testout_file,
+            '-Tfields', '-e', 'frame.time_epoch'))
+        times = [float(t) for t in tshark_proc.stdout_str.split()]
+        self.assertEqual(len(times), num_inputs * 4)
+        self.assertEqual(times, sorted(times))
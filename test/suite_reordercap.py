@@ -0,0 +1,98 @@
+#
+# -*- coding: utf-8 -*-
+# Wireshark tests
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+'''Reordercap tests'''
+
+import os
+import os.path
+import subprocesstest
+import fixtures
+
+# Enough frames in reverse order that -m 1 writes more runs than
+# reordercap merges at once (64).
+reversed_frames = 150
+
+
+@fixtures.fixture
+def reversed_capture(cmd_editcap, cmd_mergecap, capture_file, request):
+    '''Return a capture file whose frames are in reverse time order.'''
+    self = request.instance
+    one_frame = self.filename_from_id('one.pcap')
+    self.assertRun((cmd_editcap, '-F', 'pcap', '-r', capture_file('dhcp.pcap'), one_frame, '1'))
+    infiles = []
+    for i in range(reversed_frames):
+        infile = self.filename_from_id('frame{}.pcap'.format(i))
+        self.assertRun((cmd_editcap, '-F', 'pcap', '-t', '-{}'.format(i), one_frame, infile))
+        infiles.append(infile)
+    reversed_file = self.filename_from_id('reversed.pcap')
+    self.assertRun((cmd_mergecap, '-a', '-F', 'pcap', '-w', reversed_file) + tuple(infiles))
+    return reversed_file
+
+
+@fixtures.fixture
+def run_reordercap(cmd_reordercap, test_env, request):
+    '''Run reordercap with its temporary files in a directory of their own.
+    Return the output file and whatever was left in that directory.'''
+    self = request.instance
+    runs = []
+    def run_reordercap_real(infile, *args, outfile=None, expected_return=0):
+        runs.append(infile)
+        tmp_dir = self.filename_from_id('tmp{}'.format(len(runs)))
+        os.mkdir(tmp_dir)
+        env = dict(test_env)
+        for var in ('TMPDIR', 'TMP', 'TEMP'):
+            env[var] = tmp_dir
+        if outfile is None:
+            outfile = self.filename_from_id('sorted{}.pcap'.format(len(runs)))
+        self.assertRun((cmd_reordercap,) + args + (infile, outfile),
+            env=env, expected_return=expected_return)
+        return outfile, os.listdir(tmp_dir)
+    return run_reordercap_real
+
+
+def read_file(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_reordercap(subprocesstest.SubprocessTestCase):
+    def test_reordercap_memory(self, run_reordercap, reversed_capture):
+        '''Sort in memory'''
+        sorted_file, _ = run_reordercap(reversed_capture)
+        self.assertTrue(self.grepOutput('{} frames, {} out of order'.format(
+            reversed_frames, reversed_frames - 1)))
+        resorted_file, _ = run_reordercap(sorted_file)
+        self.assertTrue(self.grepOutput('{} frames, 0 out of order'.format(reversed_frames)))
+        self.assertEqual(read_file(resorted_file), read_file(sorted_file))
+
+    def test_reordercap_window(self, run_reordercap, reversed_capture):
+        '''Sort with -w and get the same file as sorting in memory'''
+        expected_file, _ = run_reordercap(reversed_capture)
+        sorted_file, _ = run_reordercap(reversed_capture, '-w', str(reversed_frames))
+        self.assertEqual(read_file(sorted_file), read_file(expected_file))
+
+    def test_reordercap_window_too_small(self, run_reordercap, reversed_capture):
+        '''Report frames that -w leaves out of order'''
+        run_reordercap(reversed_capture, '-w', '2', expected_return=3)
+        self.assertTrue(self.grepOutput('still out of order'))
+
+    def test_reordercap_runs(self, run_reordercap, reversed_capture):
+        '''Sort with -m, through more runs than are merged at once, and remove the runs'''
+        expected_file, _ = run_reordercap(reversed_capture)
+        for max_frames in ('1', '10', str(reversed_frames)):
+            sorted_file, left_over = run_reordercap(reversed_capture, '-m', max_frames)
+            self.assertEqual(read_file(sorted_file), read_file(expected_file))
+            self.assertEqual(left_over, [])
+
+    def test_reordercap_runs_write_error(self, run_reordercap, reversed_capture):
+        '''Remove the runs when the output can't be written'''
+        if not os.path.exists('/dev/full'):
+            fixtures.skip('Test requires /dev/full.')
+        _, left_over = run_reordercap(reversed_capture, '-m', '1',
+            outfile='/dev/full', expected_return=1)
+        self.assertEqual(left_over, [])
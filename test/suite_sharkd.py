@@ -9,14 +9,95 @@
 #
 '''sharkd tests'''
 
+import errno
 import json
+import os
+import shutil
+import socket
+import struct
 import subprocess
+import sys
+import tempfile
+import time
 import unittest
 import subprocesstest
 import fixtures
 from matchers import *
 
 
+class CborIndefiniteMap(dict):
+    '''A CBOR map that was sent with an indefinite length'''
+
+
+class CborIndefiniteList(list):
+    '''A CBOR array that was sent with an indefinite length'''
+
+
+CBOR_BREAK = object()
+CBOR_UNDEFINED = object()
+
+
+def cbor_decode(data, pos=0):
+    '''Decode the CBOR data item at data[pos]. Returns it and the position after it.
+
+    Only what sharkd sends is supported.'''
+    initial = data[pos]
+    pos += 1
+    major, info = initial >> 5, initial & 0x1f
+    if major == 7:
+        if initial == 0xfb:
+            return struct.unpack_from('>d', data, pos)[0], pos + 8
+        simple = {0xf4: False, 0xf5: True, 0xf6: None, 0xf7: CBOR_UNDEFINED, 0xff: CBOR_BREAK}
+        return simple[initial], pos
+    if info == 31:
+        if major in (2, 3):
+            chunks = []
+            while data[pos] != 0xff:
+                chunk, pos = cbor_decode(data, pos)
+                chunks.append(chunk)
+            return (b'' if major == 2 else '').join(chunks), pos + 1
+        items = []
+        while data[pos] != 0xff:
+            item, pos = cbor_decode(data, pos)
+            items.append(item)
+        if major == 4:
+            return CborIndefiniteList(items), pos + 1
+        return CborIndefiniteMap(zip(items[::2], items[1::2])), pos + 1
+    if info < 24:
+        value = info
+    else:
+        size = 1 << (info - 24)
+        value = int.from_bytes(data[pos:pos + size], 'big')
+        pos += size
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 2:
+        return data[pos:pos + value], pos + value
+    if major == 3:
+        return data[pos:pos + value].decode('utf8'), pos + value
+    items = []
+    for _ in range(value * (2 if major == 5 else 1)):
+        item, pos = cbor_decode(data, pos)
+        items.append(item)
+    if major == 4:
+        return items, pos
+    return dict(zip(items[::2], items[1::2])), pos
+
+
+def cbor_decode_replies(data):
+    '''Split sharkd CBOR output into replies, each a data item followed by "undefined" (0xf7)'''
+    replies = []
+    pos = 0
+    while pos < len(data):
+        reply, pos = cbor_decode(data, pos)
+        replies.append(reply)
+        end, pos = cbor_decode(data, pos)
+        assert end is CBOR_UNDEFINED, 'reply not followed by 0xf7'
+    return replies
+
+
 @fixtures.fixture(scope='session')
 def cmd_sharkd(program):
     return program('sharkd')
@@ -133,6 +214,14 @@ class case_sharkd(subprocesstest.SubprocessTestCase):
             {"err": 0, "filter": "ok", "field": "ok"},
         ))
 
+    def test_sharkd_req_check_file_set(self, check_sharkd_session, capture_file):
+        # Clients can't have sharkd read files through filters.
+        check_sharkd_session((
+            {"req": "check", "filter": 'tcp.port in $file("%s")' % capture_file('dhcp.pcap')},
+        ), (
+            {"err": 0, "filter": "Sets can't be read from files here."},
+        ))
+
     def test_sharkd_req_complete_field(self, check_sharkd_session):
         check_sharkd_session((
             {"req": "complete"},
@@ -170,6 +259,77 @@ class case_sharkd(subprocesstest.SubprocessTestCase):
             }),
         ))
 
+    def test_sharkd_req_frames_cursor(self, check_sharkd_session, capture_file):
+        check_sharkd_session((
+            {"req": "load", "file": capture_file('dhcp.pcap')},
+            {"req": "frames", "limit": 2, "cursor": 0},
+            {"req": "frames", "limit": 2, "cursor": 2},
+        ), (
+            {"err": 0},
+            {"frames": [MatchObject({"num": 1}), MatchObject({"num": 2})], "cursor": 2},
+            {"frames": [MatchObject({"num": 3}), MatchObject({"num": 4})]},
+        ))
+
+    def test_sharkd_req_frames_cursor_filter(self, check_sharkd_session, capture_file):
+        # A cursor is given only if another frame matches after the last one sent.
+        check_sharkd_session((
+            {"req": "load", "file": capture_file('dhcp.pcap')},
+            {"req": "frames", "filter": "dhcp.option.dhcp == 3", "limit": 1, "cursor": 0},
+            {"req": "frames", "filter": "dhcp.option.dhcp <= 3", "limit": 2, "cursor": 0},
+            {"req": "frames", "filter": "dhcp.option.dhcp <= 3", "limit": 2, "cursor": 2},
+        ), (
+            {"err": 0},
+            {"frames": [MatchObject({"num": 3})]},
+            {"frames": [MatchObject({"num": 1}), MatchObject({"num": 2})], "cursor": 2},
+            {"frames": [MatchObject({"num": 3})]},
+        ))
+
+    def test_sharkd_req_encoding_bad(self, check_sharkd_session):
+        check_sharkd_session((
+            {"req": "encoding", "value": "xml"},
+        ), (
+            {"err": 22, "errmsg": "unknown encoding"},
+        ))
+
+    def test_sharkd_req_encoding_cbor(self, cmd_sharkd, base_env, capture_file):
+        cap_file = capture_file('dhcp.pcap')
+        requests = (
+            {"req": "encoding", "value": "cbor"},
+            {"req": "load", "file": cap_file},
+            {"req": "frames", "limit": 2, "cursor": 0},
+            {"req": "frames"},
+            {"req": "frame", "frame": 1, "bytes": "yes"},
+        )
+        sharkd_proc = subprocess.run((cmd_sharkd, '-'),
+            input='\n'.join(json.dumps(x) for x in requests).encode('utf8'),
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE, env=base_env, timeout=60)
+        # The reply to "encoding" is still JSON; the rest is CBOR.
+        json_reply, cbor_replies = sharkd_proc.stdout.split(b'\n', 1)
+        self.assertEqual(json.loads(json_reply), {"err": 0})
+        replies = cbor_decode_replies(cbor_replies)
+        self.assertEqual(len(replies), 4)
+
+        self.assertEqual(replies[0], {"err": 0})
+        self.assertIsInstance(replies[0], CborIndefiniteMap)
+
+        frames_cursor = replies[1]
+        self.assertIsInstance(frames_cursor, CborIndefiniteMap)
+        self.assertIsInstance(frames_cursor["frames"], CborIndefiniteList)
+        self.assertEqual([frame["num"] for frame in frames_cursor["frames"]], [1, 2])
+        self.assertEqual(frames_cursor["cursor"], 2)
+
+        frames = replies[2]
+        self.assertIsInstance(frames, CborIndefiniteList)
+        self.assertEqual([frame["num"] for frame in frames], [1, 2, 3, 4])
+        self.assertIsInstance(frames[0]["c"], CborIndefiniteList)
+
+        # Base64 data is sent as a byte string.
+        with open(cap_file, 'rb') as f:
+            pcap_data = f.read()
+        (incl_len,) = struct.unpack_from('<I', pcap_data, 24 + 8)
+        self.assertIsInstance(replies[3]["bytes"], bytes)
+        self.assertEqual(replies[3]["bytes"], pcap_data[24 + 16:24 + 16 + incl_len])
+
     def test_sharkd_req_tap_invalid(self, check_sharkd_session, capture_file):
         # XXX Unrecognized taps result in an empty line, modify
         #     run_sharkd_session such that checking for it is possible.
@@ -459,4 +619,61 @@ class case_sharkd(subprocesstest.SubprocessTestCase):
         ), (
             {"err": 0},
             MatchAny(),
-        ))
\ No newline at end of file
+        ))
+
+
+@fixtures.mark_usefixtures('base_env')
+@fixtures.uses_fixtures
+@unittest.skipIf(sys.platform == 'win32', 'Shared sessions are not available on Windows')
+class case_sharkd_shared(subprocesstest.SubprocessTestCase):
+    def connect(self, sock_path):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(sock_path)
+        self.addCleanup(sock.close)
+        return sock, sock.makefile('rw', encoding='utf8')
+
+    def request(self, conn, req):
+        conn.write(json.dumps(req) + '\n')
+        conn.flush()
+        line = conn.readline()
+        self.assertTrue(line, 'sharkd closed the connection')
+        return json.loads(line)
+
+    def test_sharkd_shared(self, cmd_sharkd, capture_file):
+        '''Serve one capture file to two connections at once, read-only'''
+        # Keep the socket path short; sockaddr_un has room for about 100 bytes.
+        sock_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, sock_dir, True)
+        sock_path = os.path.join(sock_dir, 'sharkd.sock')
+        cap_file = capture_file('dhcp.pcap')
+        self.startProcess((cmd_sharkd, 'unix:' + sock_path, cap_file))
+        for _ in range(100):
+            if os.path.exists(sock_path):
+                break
+            time.sleep(0.1)
+
+        sock1, conn1 = self.connect(sock_path)
+        sock2, conn2 = self.connect(sock_path)
+        status = {"frames": 4, "duration": 0.070345000,
+                  "filename": "dhcp.pcap", "filesize": 1400}
+        self.assertEqual(self.request(conn1, {"req": "status"}), status)
+        self.assertEqual(self.request(conn2, {"req": "status"}), status)
+
+        # Only the shared file can be loaded, and nothing can be changed.
+        self.assertEqual(self.request(conn1, {"req": "load", "file": cap_file}),
+            {"err": 0})
+        self.assertEqual(self.request(conn1, {"req": "load", "file": capture_file('http.pcap')})["err"],
+            errno.EBUSY)
+        self.assertEqual(self.request(conn1, {"req": "setconf", "name": "uat:ssl_keys", "value": ""}),
+            {"err": errno.EPERM, "errmsg": "capture is shared read-only"})
+        self.assertEqual(self.request(conn2, {"req": "setcomment", "frame": 1, "comment": "x"}),
+            {"err": errno.EPERM, "errmsg": "capture is shared read-only"})
+
+        frames = self.request(conn2, {"req": "frames", "filter": "dhcp.option.dhcp == 3"})
+        self.assertEqual([frame["num"] for frame in frames], [3])
+
+        # "bye" closes only that connection.
+        conn2.write(json.dumps({"req": "bye"}) + '\n')
+        conn2.flush()
+        self.assertEqual(conn2.readline(), '')
+        self.assertEqual(self.request(conn1, {"req": "status"}), status)
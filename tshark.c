@@ -1888,7 +1888,7 @@ main(int argc, char *argv[])
 
   if (rfilter != NULL) {
     tshark_debug("Compiling read filter: '%s'", rfilter);
-    if (!dfilter_compile(rfilter, &rfcode, &err_msg)) {
+    if (!dfilter_compile_flags(rfilter, &rfcode, &err_msg, DF_FILE_SETS)) {
       cmdarg_err("%s", err_msg);
       g_free(err_msg);
       epan_cleanup();
@@ -1915,7 +1915,7 @@ main(int argc, char *argv[])
 
   if (dfilter != NULL) {
     tshark_debug("Compiling display filter: '%s'", dfilter);
-    if (!dfilter_compile(dfilter, &dfcode, &err_msg)) {
+    if (!dfilter_compile_flags(dfilter, &dfcode, &err_msg, DF_FILE_SETS)) {
       cmdarg_err("%s", err_msg);
       g_free(err_msg);
       epan_cleanup();
@@ -2033,6 +2033,10 @@ main(int argc, char *argv[])
       goto clean_exit;
     }
 
+    /* Dissect packets straight out of the file if we can, rather than
+       copying each of them into a buffer. */
+    (void)wtap_use_mmap(cfile.provider.wth);
+
     /* Start statistics taps; we do so after successfully opening the
        capture file, so we know we have something to compute stats
        on, and after registering all dissectors, so that MATE will
@@ -2401,6 +2405,35 @@ pipe_input_set_handler(gint source, gpointer user_data, ws_process_id *child_pro
 #endif
 }
 
+/*
+ * Held while reading ahead of the dissection in another thread (see
+ * read_ahead_start()), as wtap_read() may add interfaces to the file's
+ * list of them, and while looking at that list.
+ */
+static GMutex read_ahead_wth_lock;
+
+static const char *
+tshark_get_interface_name(struct packet_provider_data *prov, guint32 interface_id)
+{
+  const char *name;
+
+  g_mutex_lock(&read_ahead_wth_lock);
+  name = cap_file_provider_get_interface_name(prov, interface_id);
+  g_mutex_unlock(&read_ahead_wth_lock);
+  return name;
+}
+
+static const char *
+tshark_get_interface_description(struct packet_provider_data *prov, guint32 interface_id)
+{
+  const char *description;
+
+  g_mutex_lock(&read_ahead_wth_lock);
+  description = cap_file_provider_get_interface_description(prov, interface_id);
+  g_mutex_unlock(&read_ahead_wth_lock);
+  return description;
+}
+
 static const nstime_t *
 tshark_get_frame_ts(struct packet_provider_data *prov, guint32 frame_num)
 {
@@ -2427,8 +2460,8 @@ tshark_epan_new(capture_file *cf)
 {
   static const struct packet_provider_funcs funcs = {
     tshark_get_frame_ts,
-    cap_file_provider_get_interface_name,
-    cap_file_provider_get_interface_description,
+    tshark_get_interface_name,
+    tshark_get_interface_description,
     NULL,
   };
 
@@ -3189,18 +3222,32 @@ process_packet_second_pass(capture_file *cf, epan_dissect_t *edt,
       cf->provider.ref = &ref_frame;
     }
 
-    if (dissect_color) {
-      color_filters_prime_edt(edt);
-      fdata->need_colorize = 1;
-    }
+    /* If the packet's raw data shows that it can't match the display
+       filter, and no tap wants to see it, don't dissect it.  The first
+       pass has already dissected it, so no dissector misses state that
+       it would have kept; that's not so in the first pass, or in one
+       pass, so the prefilter is only used here. */
+    if (cf->dfcode && rec->rec_type == REC_TYPE_PACKET &&
+        dfilter_has_prefilter(cf->dfcode) &&
+        !tap_listeners_require_dissection() &&
+        !dfilter_prefilter_packet(cf->dfcode, ws_buffer_start_ptr(buf),
+                                  rec->rec_header.packet_header.caplen,
+                                  rec->rec_header.packet_header.len)) {
+      passed = FALSE;
+    } else {
+      if (dissect_color) {
+        color_filters_prime_edt(edt);
+        fdata->need_colorize = 1;
+      }
 
-    epan_dissect_run_with_taps(edt, cf->cd_t, rec,
-                               frame_tvbuff_new_buffer(&cf->provider, fdata, buf),
-                               fdata, cinfo);
+      epan_dissect_run_with_taps(edt, cf->cd_t, rec,
+                                 frame_tvbuff_new_buffer(&cf->provider, fdata, buf),
+                                 fdata, cinfo);
 
-    /* Run the read/display filter if we have one. */
-    if (cf->dfcode)
-      passed = dfilter_apply_edt(cf->dfcode, edt);
+      /* Run the read/display filter if we have one. */
+      if (cf->dfcode)
+        passed = dfilter_apply_edt(cf->dfcode, edt);
+    }
   }
 
   if (passed) {
@@ -3232,6 +3279,384 @@ process_packet_second_pass(capture_file *cf, epan_dissect_t *edt,
   return passed || fdata->dependent_of_displayed;
 }
 
+/*
+ * Reading ahead of the dissection.
+ *
+ * A separate thread reads records into a ring of slots while we dissect
+ * earlier ones, so that reading and decompressing the file overlaps with
+ * dissecting it.  In one pass, it reads the file sequentially; in the
+ * second pass of two, it reads the frames found by the first pass in
+ * order, with a random-access wtap of its own.
+ *
+ * The dissection engine isn't thread-safe, so only reading happens in
+ * that thread.  The name resolution and decryption secrets that
+ * wiretap hands us while reading are queued with the record that
+ * follows them, and handed to epan just before that record is
+ * dissected, just as they would be without the thread.
+ */
+#define READ_AHEAD_SLOTS  512
+
+typedef enum {
+  READ_AHEAD_IPV4,
+  READ_AHEAD_IPV6,
+  READ_AHEAD_SECRETS
+} read_ahead_event_type_e;
+
+typedef struct {
+  read_ahead_event_type_e type;
+  guint                   ipv4;
+  ws_in6_addr             ipv6;
+  guint32                 secrets_type;
+  guint                   size;       /* of data, for secrets */
+  gchar                  *data;       /* host name, or secrets */
+} read_ahead_event_t;
+
+typedef struct {
+  wtap_rec                rec;
+  Buffer                  buf;
+  gint64                  data_offset;
+  GSList                 *events;     /* read_ahead_event_t's from before this record */
+} read_ahead_slot_t;
+
+typedef struct {
+  wtap                   *wth;
+  frame_data_sequence    *frames;     /* frames to read, in the second pass */
+  guint32                 num_frames;
+  guint32                 framenum;   /* next frame to read, in the second pass */
+  GThread                *thread;
+  GMutex                  lock;       /* protects what follows */
+  GCond                   not_empty;
+  GCond                   not_full;
+  guint                   head;       /* number of slots filled */
+  guint                   tail;       /* number of slots handed back */
+  gboolean                have_slot;  /* the slot at the tail is in use */
+  gboolean                stop;       /* the reader is to stop */
+  gboolean                done;       /* the reader got an EOF or an error */
+  int                     err;
+  gchar                  *err_info;
+  GSList                 *events;     /* events since the last record, newest first */
+  read_ahead_slot_t       slots[READ_AHEAD_SLOTS];
+} read_ahead_t;
+
+/* The read-ahead being done, for the wiretap callbacks; only one at a time */
+static read_ahead_t *read_ahead;
+
+static void
+read_ahead_ipv4_name(const guint addr, const gchar *name)
+{
+  read_ahead_event_t *event = g_new0(read_ahead_event_t, 1);
+
+  event->type = READ_AHEAD_IPV4;
+  event->ipv4 = addr;
+  event->data = g_strdup(name);
+  read_ahead->events = g_slist_prepend(read_ahead->events, event);
+}
+
+static void
+read_ahead_ipv6_name(const void *addrp, const gchar *name)
+{
+  read_ahead_event_t *event = g_new0(read_ahead_event_t, 1);
+
+  event->type = READ_AHEAD_IPV6;
+  memcpy(&event->ipv6, addrp, sizeof event->ipv6);
+  event->data = g_strdup(name);
+  read_ahead->events = g_slist_prepend(read_ahead->events, event);
+}
+
+static void
+read_ahead_secrets(guint32 secrets_type, const void *secrets, guint size)
+{
+  read_ahead_event_t *event = g_new0(read_ahead_event_t, 1);
+
+  event->type = READ_AHEAD_SECRETS;
+  event->secrets_type = secrets_type;
+  event->size = size;
+  event->data = (gchar *)g_memdup(secrets, size);
+  read_ahead->events = g_slist_prepend(read_ahead->events, event);
+}
+
+static void
+read_ahead_event_free(gpointer data)
+{
+  read_ahead_event_t *event = (read_ahead_event_t *)data;
+
+  g_free(event->data);
+  g_free(event);
+}
+
+/* Hand events, oldest first, to epan, and free them. */
+static void
+read_ahead_deliver(GSList *events)
+{
+  GSList *elem;
+
+  for (elem = events; elem != NULL; elem = g_slist_next(elem)) {
+    read_ahead_event_t *event = (read_ahead_event_t *)elem->data;
+
+    switch (event->type) {
+
+    case READ_AHEAD_IPV4:
+      add_ipv4_name(event->ipv4, event->data);
+      break;
+
+    case READ_AHEAD_IPV6:
+      add_ipv6_name(&event->ipv6, event->data);
+      break;
+
+    case READ_AHEAD_SECRETS:
+      secrets_wtap_callback(event->secrets_type, event->data, event->size);
+      break;
+    }
+  }
+  g_slist_free_full(events, read_ahead_event_free);
+}
+
+static gpointer
+read_ahead_thread(gpointer data)
+{
+  read_ahead_t *ra = (read_ahead_t *)data;
+  read_ahead_slot_t *slot;
+  gboolean ok;
+  int err;
+  gchar *err_info;
+
+  for (;;) {
+    g_mutex_lock(&ra->lock);
+    while (ra->head - ra->tail == READ_AHEAD_SLOTS && !ra->stop)
+      g_cond_wait(&ra->not_full, &ra->lock);
+    if (ra->stop) {
+      g_mutex_unlock(&ra->lock);
+      break;
+    }
+    slot = &ra->slots[ra->head % READ_AHEAD_SLOTS];
+    g_mutex_unlock(&ra->lock);
+
+    if (ra->frames != NULL) {
+      /*
+       * This wth is ours, no need for the lock.  We read it in order,
+       * not with wtap_seek_read(), as a newly opened file only knows the
+       * sections and interfaces that come before its first record, and
+       * skip the records that aren't frames, as the read filter dropped
+       * them.
+       */
+      ok = FALSE;
+      err = 0;
+      err_info = NULL;
+      if (ra->framenum <= ra->num_frames) {
+        gint64 file_off = frame_data_sequence_find(ra->frames, ra->framenum)->file_off;
+
+        while ((ok = wtap_read(ra->wth, &slot->rec, &slot->buf, &err, &err_info,
+                               &slot->data_offset)) &&
+               slot->data_offset < file_off)
+          ;
+        if (ok && slot->data_offset != file_off) {
+          ok = FALSE;
+          err = WTAP_ERR_INTERNAL;
+          err_info = g_strdup_printf("frame %u isn't at offset %" G_GINT64_FORMAT " any more",
+                                     ra->framenum, file_off);
+        } else if (!ok && err == 0) {
+          /* The file got shorter since the first pass */
+          err = WTAP_ERR_SHORT_READ;
+        }
+        ra->framenum++;
+      }
+    } else {
+      g_mutex_lock(&read_ahead_wth_lock);
+      ok = wtap_read(ra->wth, &slot->rec, &slot->buf, &err, &err_info, &slot->data_offset);
+      g_mutex_unlock(&read_ahead_wth_lock);
+    }
+
+    g_mutex_lock(&ra->lock);
+    if (!ok) {
+      ra->err = err;
+      ra->err_info = err_info;
+      ra->done = TRUE;
+      g_cond_signal(&ra->not_empty);
+      g_mutex_unlock(&ra->lock);
+      break;
+    }
+    slot->events = g_slist_reverse(ra->events);
+    ra->events = NULL;
+    ra->head++;
+    g_cond_signal(&ra->not_empty);
+    g_mutex_unlock(&ra->lock);
+  }
+  return NULL;
+}
+
+/* Is reading the file in another thread worth doing and safe? */
+static gboolean
+read_ahead_wanted(capture_file *cf)
+{
+#if GLIB_CHECK_VERSION(2,36,0)
+  if (g_get_num_processors() < 2)
+    return FALSE;
+#endif
+  /*
+   * Don't read ahead from a pipe; if we stop early, we'd have to wait
+   * for the thread, and it might be waiting for more input.
+   */
+  if (strcmp(cf->filename, "-") == 0 ||
+      !g_file_test(cf->filename, G_FILE_TEST_IS_REGULAR))
+    return FALSE;
+  return wtap_can_read_in_thread(cf->provider.wth);
+}
+
+static read_ahead_t *
+read_ahead_new(wtap *wth)
+{
+  read_ahead_t *ra;
+  guint i;
+
+  ra = g_new0(read_ahead_t, 1);
+  ra->wth = wth;
+  g_mutex_init(&ra->lock);
+  g_cond_init(&ra->not_empty);
+  g_cond_init(&ra->not_full);
+  for (i = 0; i < READ_AHEAD_SLOTS; i++) {
+    wtap_rec_init(&ra->slots[i].rec);
+    ws_buffer_init(&ra->slots[i].buf, 1514);
+  }
+  return ra;
+}
+
+/*
+ * Start reading the file in another thread, if that's worth doing and
+ * safe.  Returns NULL if it isn't, in which case we just read the file
+ * with wtap_read().
+ */
+static read_ahead_t *
+read_ahead_start(capture_file *cf)
+{
+  read_ahead_t *ra;
+
+  if (!read_ahead_wanted(cf))
+    return NULL;
+
+  ra = read_ahead_new(cf->provider.wth);
+
+  read_ahead = ra;
+  wtap_set_cb_new_ipv4(ra->wth, read_ahead_ipv4_name);
+  wtap_set_cb_new_ipv6(ra->wth, read_ahead_ipv6_name);
+  wtap_set_cb_new_secrets(ra->wth, read_ahead_secrets);
+
+  ra->thread = g_thread_new("tshark read-ahead", read_ahead_thread, ra);
+  return ra;
+}
+
+/*
+ * Start reading the frames of the second pass in another thread, if
+ * that's worth doing and safe.  Returns NULL if it isn't, in which case
+ * we just read them with wtap_seek_read().
+ *
+ * The thread opens the file again, as the dissectors may read frames
+ * through cf->provider.wth while it's reading, and reads it from the
+ * start.  Its name resolution and decryption secrets were handed to
+ * epan in the first pass, so it doesn't hand them over again.
+ */
+static read_ahead_t *
+read_ahead_start_frames(capture_file *cf)
+{
+  read_ahead_t *ra;
+  wtap *wth;
+  int err;
+  gchar *err_info = NULL;
+
+  if (cf->count == 0 || !read_ahead_wanted(cf))
+    return NULL;
+
+  wth = wtap_open_offline(cf->filename, cf->open_type, &err, &err_info, TRUE);
+  if (wth == NULL) {
+    /* Just read without the thread */
+    g_free(err_info);
+    return NULL;
+  }
+
+  ra = read_ahead_new(wth);
+  ra->frames = cf->provider.frames;
+  ra->num_frames = cf->count;
+  ra->framenum = 1;
+
+  ra->thread = g_thread_new("tshark read-ahead", read_ahead_thread, ra);
+  return ra;
+}
+
+/*
+ * Get the next record, handing the previous one back.  The record stays
+ * valid until the next call, or read_ahead_finish().
+ */
+static gboolean
+read_ahead_next(read_ahead_t *ra, wtap_rec **rec, Buffer **buf, gint64 *data_offset,
+                int *err, gchar **err_info)
+{
+  read_ahead_slot_t *slot;
+  GSList *events;
+
+  g_mutex_lock(&ra->lock);
+  if (ra->have_slot) {
+    ra->tail++;
+    ra->have_slot = FALSE;
+    g_cond_signal(&ra->not_full);
+  }
+  while (ra->head == ra->tail && !ra->done)
+    g_cond_wait(&ra->not_empty, &ra->lock);
+  if (ra->head == ra->tail) {
+    /* The reader has stopped, so it's done with the events */
+    events = g_slist_reverse(ra->events);
+    ra->events = NULL;
+    *err = ra->err;
+    *err_info = ra->err_info;
+    ra->err_info = NULL;
+    g_mutex_unlock(&ra->lock);
+    read_ahead_deliver(events);
+    return FALSE;
+  }
+  slot = &ra->slots[ra->tail % READ_AHEAD_SLOTS];
+  ra->have_slot = TRUE;
+  g_mutex_unlock(&ra->lock);
+
+  read_ahead_deliver(slot->events);
+  slot->events = NULL;
+  *rec = &slot->rec;
+  *buf = &slot->buf;
+  *data_offset = slot->data_offset;
+  return TRUE;
+}
+
+/* Stop the reader, if it's still going, and clean up. */
+static void
+read_ahead_finish(read_ahead_t *ra)
+{
+  guint i;
+
+  g_mutex_lock(&ra->lock);
+  ra->stop = TRUE;
+  g_cond_signal(&ra->not_full);
+  g_mutex_unlock(&ra->lock);
+  g_thread_join(ra->thread);
+
+  if (ra->frames != NULL) {
+    wtap_close(ra->wth);
+  } else {
+    wtap_set_cb_new_ipv4(ra->wth, add_ipv4_name);
+    wtap_set_cb_new_ipv6(ra->wth, (wtap_new_ipv6_callback_t) add_ipv6_name);
+    wtap_set_cb_new_secrets(ra->wth, secrets_wtap_callback);
+    read_ahead = NULL;
+  }
+
+  for (i = 0; i < READ_AHEAD_SLOTS; i++) {
+    g_slist_free_full(ra->slots[i].events, read_ahead_event_free);
+    ws_buffer_free(&ra->slots[i].buf);
+    wtap_rec_cleanup(&ra->slots[i].rec);
+  }
+  g_slist_free_full(ra->events, read_ahead_event_free);
+  g_free(ra->err_info);
+  g_cond_clear(&ra->not_full);
+  g_cond_clear(&ra->not_empty);
+  g_mutex_clear(&ra->lock);
+  g_free(ra);
+}
+
 static pass_status_t
 process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
                              int *err, gchar **err_info,
@@ -3239,6 +3664,9 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
 {
   wtap_rec        rec;
   Buffer          buf;
+  wtap_rec       *recp = &rec;
+  Buffer         *bufp = &buf;
+  read_ahead_t   *ra;
   guint32         framenum;
   frame_data     *fdata;
   gboolean        filtering_tap_listeners;
@@ -3290,26 +3718,31 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
    */
   set_resolution_synchrony(TRUE);
 
+  ra = read_ahead_start_frames(cf);
+
   for (framenum = 1; framenum <= cf->count; framenum++) {
+    gint64 data_offset;
+
     if (read_interrupted) {
       status = PASS_INTERRUPTED;
       break;
     }
     fdata = frame_data_sequence_find(cf->provider.frames, framenum);
-    if (!wtap_seek_read(cf->provider.wth, fdata->file_off, &rec, &buf, err,
-                        err_info)) {
+    if (ra ? !read_ahead_next(ra, &recp, &bufp, &data_offset, err, err_info) :
+             !wtap_seek_read(cf->provider.wth, fdata->file_off, &rec, &buf, err,
+                             err_info)) {
       /* Error reading from the input file. */
       status = PASS_READ_ERROR;
       break;
     }
     tshark_debug("tshark: invoking process_packet_second_pass() for frame #%d", framenum);
-    if (process_packet_second_pass(cf, edt, fdata, &rec, &buf, tap_flags)) {
+    if (process_packet_second_pass(cf, edt, fdata, recp, bufp, tap_flags)) {
       /* Either there's no read filtering or this packet passed the
          filter, so, if we're writing to a capture file, write
          this packet out. */
       if (pdh != NULL) {
         tshark_debug("tshark: writing packet #%d to outfile", framenum);
-        if (!wtap_dump(pdh, &rec, ws_buffer_start_ptr(&buf), err, err_info)) {
+        if (!wtap_dump(pdh, recp, ws_buffer_start_ptr(bufp), err, err_info)) {
           /* Error writing to the output file. */
           tshark_debug("tshark: error writing to a capture file (%d)", *err);
           *err_framenum = framenum;
@@ -3320,6 +3753,9 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
     }
   }
 
+  if (ra)
+    read_ahead_finish(ra);
+
   if (edt)
     epan_dissect_free(edt);
 
@@ -3337,6 +3773,9 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
 {
   wtap_rec        rec;
   Buffer          buf;
+  wtap_rec       *recp = &rec;
+  Buffer         *bufp = &buf;
+  read_ahead_t   *ra;
   gboolean create_proto_tree = FALSE;
   gboolean        filtering_tap_listeners;
   guint           tap_flags;
@@ -3398,8 +3837,12 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
    */
   set_resolution_synchrony(TRUE);
 
+  ra = read_ahead_start(cf);
+
   *err = 0;
-  while (wtap_read(cf->provider.wth, &rec, &buf, err, err_info, &data_offset)) {
+  while (ra != NULL ?
+         read_ahead_next(ra, &recp, &bufp, &data_offset, err, err_info) :
+         wtap_read(cf->provider.wth, &rec, &buf, err, err_info, &data_offset)) {
     if (read_interrupted) {
       status = PASS_INTERRUPTED;
       break;
@@ -3410,13 +3853,13 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
 
     reset_epan_mem(cf, edt, create_proto_tree, print_packet_info && print_details);
 
-    if (process_packet_single_pass(cf, edt, data_offset, &rec, &buf, tap_flags)) {
+    if (process_packet_single_pass(cf, edt, data_offset, recp, bufp, tap_flags)) {
       /* Either there's no read filtering or this packet passed the
          filter, so, if we're writing to a capture file, write
          this packet out. */
       if (pdh != NULL) {
         tshark_debug("tshark: writing packet #%d to outfile", framenum);
-        if (!wtap_dump(pdh, &rec, ws_buffer_start_ptr(&buf), err, err_info)) {
+        if (!wtap_dump(pdh, recp, ws_buffer_start_ptr(bufp), err, err_info)) {
           /* Error writing to the output file. */
           tshark_debug("tshark: error writing to a capture file (%d)", *err);
           *err_framenum = framenum;
@@ -3442,6 +3885,9 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
     status = PASS_READ_ERROR;
   }
 
+  if (ra != NULL)
+    read_ahead_finish(ra);
+
   if (edt)
     epan_dissect_free(edt);
 
@@ -4278,6 +4724,7 @@ cf_open(capture_file *cf, const char *fname, unsigned int type, gboolean is_temp
   wth = wtap_open_offline(fname, type, err, &err_info, perform_two_pass_analysis);
   if (wth == NULL)
     goto fail;
+  wtap_set_save_seek_index(wth, prefs.gui_fileopen_save_seek_index);
 
   /* The open succeeded.  Fill in the information for this file. */
 
@@ -126,6 +126,247 @@ GString *check_field_unit(const char *field_name, int *hf_index, io_graph_item_u
  */
 double get_io_graph_item(const io_graph_item_t *items, io_graph_item_unit_t val_units, int idx, int hf_index, const capture_file *cap_file, int interval, int cur_idx);
 
+/** Update the advanced statistics of an io_graph_item_t with one value
+ * of a field. If fields == 0, this is the first seen value so min/max
+ * values are set accordingly.
+ *
+ * @param items [in,out] Array containing the item to update.
+ * @param idx [in] Index of the item to update.
+ * @param num [in] Number of the frame containing the value.
+ * @param rel_ts [in] Time of that frame, relative to the first one.
+ * @param value [in] Value of the field.
+ * @param hf_index [in] Header field index for advanced statistics.
+ * @param item_unit [in] The type of unit to calculate. From IOG_ITEM_UNITS.
+ * @param interval [in] Timing interval in ms.
+ */
+static inline void
+update_io_graph_item_value(io_graph_item_t *items, int idx, guint32 num, const nstime_t *rel_ts, fvalue_t *value, int hf_index, int item_unit, guint32 interval) {
+    io_graph_item_t *item = &items[idx];
+    gint64 new_int64;
+    guint64 new_uint64;
+    float new_float;
+    double new_double;
+    nstime_t *new_time;
+
+    switch (proto_registrar_get_ftype(hf_index)) {
+    case FT_UINT8:
+    case FT_UINT16:
+    case FT_UINT24:
+    case FT_UINT32:
+        new_uint64 = fvalue_get_uinteger(value);
+
+        if ((new_uint64 > (guint64)item->int_max) || (item->fields == 0)) {
+            item->int_max = new_uint64;
+            item->double_max = (gdouble)new_uint64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_uint64 < (guint64)item->int_min) || (item->fields == 0)) {
+            item->int_min = new_uint64;
+            item->double_min = (gdouble)new_uint64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->int_tot += new_uint64;
+        item->double_tot += (gdouble)new_uint64;
+        item->fields++;
+        break;
+    case FT_INT8:
+    case FT_INT16:
+    case FT_INT24:
+    case FT_INT32:
+        new_int64 = fvalue_get_sinteger(value);
+        if ((new_int64 > item->int_max) || (item->fields == 0)) {
+            item->int_max = new_int64;
+            item->double_max = (gdouble)new_int64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_int64 < item->int_min) || (item->fields == 0)) {
+            item->int_min = new_int64;
+            item->double_min = (gdouble)new_int64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->int_tot += new_int64;
+        item->double_tot += (gdouble)new_int64;
+        item->fields++;
+        break;
+    case FT_UINT40:
+    case FT_UINT48:
+    case FT_UINT56:
+    case FT_UINT64:
+        new_uint64 = fvalue_get_uinteger64(value);
+        if ((new_uint64 > (guint64)item->int_max) || (item->fields == 0)) {
+            item->int_max = new_uint64;
+            item->double_max = (gdouble)new_uint64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_uint64 < (guint64)item->int_min) || (item->fields == 0)) {
+            item->int_min = new_uint64;
+            item->double_min = (gdouble)new_uint64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->int_tot += new_uint64;
+        item->double_tot += (gdouble)new_uint64;
+        item->fields++;
+        break;
+    case FT_INT40:
+    case FT_INT48:
+    case FT_INT56:
+    case FT_INT64:
+        new_int64 = fvalue_get_sinteger64(value);
+        if ((new_int64 > item->int_max) || (item->fields == 0)) {
+            item->int_max = new_int64;
+            item->double_max = (gdouble)new_int64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_int64 < item->int_min) || (item->fields == 0)) {
+            item->int_min = new_int64;
+            item->double_min = (gdouble)new_int64;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->int_tot += new_int64;
+        item->double_tot += (gdouble)new_int64;
+        item->fields++;
+        break;
+    case FT_FLOAT:
+        new_float = (gfloat)fvalue_get_floating(value);
+        if ((new_float > item->float_max) || (item->fields == 0)) {
+            item->float_max = new_float;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_float < item->float_min) || (item->fields == 0)) {
+            item->float_min = new_float;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->float_tot += new_float;
+        item->fields++;
+        break;
+    case FT_DOUBLE:
+        new_double = fvalue_get_floating(value);
+        if ((new_double > item->double_max) || (item->fields == 0)) {
+            item->double_max = new_double;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        if ((new_double < item->double_min) || (item->fields == 0)) {
+            item->double_min = new_double;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                item->extreme_frame_in_invl = num;
+            }
+        }
+        item->double_tot += new_double;
+        item->fields++;
+        break;
+    case FT_RELATIVE_TIME:
+        new_time = (nstime_t *)fvalue_get(value);
+
+        switch (item_unit) {
+        case IOG_ITEM_UNIT_CALC_LOAD:
+        {
+            guint64 t, pt; /* time in us */
+            int j;
+            /*
+             * Add the time this call spanned each interval according to its contribution
+             * to that interval.
+             */
+            t = new_time->secs;
+            t = t * 1000000 + new_time->nsecs / 1000;
+            j = idx;
+            /*
+             * Handle current interval
+             */
+            pt = rel_ts->secs * 1000000 + rel_ts->nsecs / 1000;
+            pt = pt % (interval * 1000);
+            if (pt > t) {
+                pt = t;
+            }
+            while (t) {
+                io_graph_item_t *load_item;
+
+                load_item = &items[j];
+                load_item->time_tot.nsecs += (int) (pt * 1000);
+                if (load_item->time_tot.nsecs > 1000000000) {
+                    load_item->time_tot.secs++;
+                    load_item->time_tot.nsecs -= 1000000000;
+                }
+
+                if (j == 0) {
+                    break;
+                }
+                j--;
+                t -= pt;
+                if (t > (guint64) interval * 1000) {
+                    pt = (guint64) interval * 1000;
+                } else {
+                    pt = t;
+                }
+            }
+            break;
+        }
+        default:
+            if ( (new_time->secs > item->time_max.secs)
+                 || ( (new_time->secs == item->time_max.secs)
+                      && (new_time->nsecs > item->time_max.nsecs))
+                 || (item->fields == 0)) {
+                item->time_max = *new_time;
+                if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                    item->extreme_frame_in_invl = num;
+                }
+            }
+            if ( (new_time->secs<item->time_min.secs)
+                 || ( (new_time->secs == item->time_min.secs)
+                      && (new_time->nsecs < item->time_min.nsecs))
+                 || (item->fields == 0)) {
+                item->time_min = *new_time;
+                if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                    item->extreme_frame_in_invl = num;
+                }
+            }
+            nstime_add(&item->time_tot, new_time);
+            item->fields++;
+        }
+        break;
+    default:
+        if ((item_unit == IOG_ITEM_UNIT_CALC_FRAMES) ||
+            (item_unit == IOG_ITEM_UNIT_CALC_FIELDS)) {
+            /*
+             * It's not an integeresque type, but
+             * all we want to do is count it, so
+             * that's all right.
+             */
+            item->fields++;
+        }
+        else {
+            /*
+             * "Can't happen"; see the "check that the
+             * type is compatible" check in
+             * filter_callback().
+             */
+            g_assert_not_reached();
+        }
+        break;
+    }
+}
+
 /** Update the values of an io_graph_item_t.
  *
  * Frame and byte counts are always calculated. If edt is non-NULL advanced
@@ -162,229 +403,7 @@ update_io_graph_item(io_graph_item_t *items, int idx, packet_info *pinfo, epan_d
         /* Update the appropriate counters. If fields == 0, this is the first seen
          *  value so set any min/max values accordingly. */
         for (i=0; i < gp->len; i++) {
-            gint64 new_int64;
-            guint64 new_uint64;
-            float new_float;
-            double new_double;
-            nstime_t *new_time;
-
-            switch (proto_registrar_get_ftype(hf_index)) {
-            case FT_UINT8:
-            case FT_UINT16:
-            case FT_UINT24:
-            case FT_UINT32:
-                new_uint64 = fvalue_get_uinteger(&((field_info *)gp->pdata[i])->value);
-
-                if ((new_uint64 > (guint64)item->int_max) || (item->fields == 0)) {
-                    item->int_max = new_uint64;
-                    item->double_max = (gdouble)new_uint64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_uint64 < (guint64)item->int_min) || (item->fields == 0)) {
-                    item->int_min = new_uint64;
-                    item->double_min = (gdouble)new_uint64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->int_tot += new_uint64;
-                item->double_tot += (gdouble)new_uint64;
-                item->fields++;
-                break;
-            case FT_INT8:
-            case FT_INT16:
-            case FT_INT24:
-            case FT_INT32:
-                new_int64 = fvalue_get_sinteger(&((field_info *)gp->pdata[i])->value);
-                if ((new_int64 > item->int_max) || (item->fields == 0)) {
-                    item->int_max = new_int64;
-                    item->double_max = (gdouble)new_int64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_int64 < item->int_min) || (item->fields == 0)) {
-                    item->int_min = new_int64;
-                    item->double_min = (gdouble)new_int64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->int_tot += new_int64;
-                item->double_tot += (gdouble)new_int64;
-                item->fields++;
-                break;
-            case FT_UINT40:
-            case FT_UINT48:
-            case FT_UINT56:
-            case FT_UINT64:
-                new_uint64 = fvalue_get_uinteger64(&((field_info *)gp->pdata[i])->value);
-                if ((new_uint64 > (guint64)item->int_max) || (item->fields == 0)) {
-                    item->int_max = new_uint64;
-                    item->double_max = (gdouble)new_uint64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_uint64 < (guint64)item->int_min) || (item->fields == 0)) {
-                    item->int_min = new_uint64;
-                    item->double_min = (gdouble)new_uint64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->int_tot += new_uint64;
-                item->double_tot += (gdouble)new_uint64;
-                item->fields++;
-                break;
-            case FT_INT40:
-            case FT_INT48:
-            case FT_INT56:
-            case FT_INT64:
-                new_int64 = fvalue_get_sinteger64(&((field_info *)gp->pdata[i])->value);
-                if ((new_int64 > item->int_max) || (item->fields == 0)) {
-                    item->int_max = new_int64;
-                    item->double_max = (gdouble)new_int64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_int64 < item->int_min) || (item->fields == 0)) {
-                    item->int_min = new_int64;
-                    item->double_min = (gdouble)new_int64;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->int_tot += new_int64;
-                item->double_tot += (gdouble)new_int64;
-                item->fields++;
-                break;
-            case FT_FLOAT:
-                new_float = (gfloat)fvalue_get_floating(&((field_info *)gp->pdata[i])->value);
-                if ((new_float > item->float_max) || (item->fields == 0)) {
-                    item->float_max = new_float;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_float < item->float_min) || (item->fields == 0)) {
-                    item->float_min = new_float;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->float_tot += new_float;
-                item->fields++;
-                break;
-            case FT_DOUBLE:
-                new_double = fvalue_get_floating(&((field_info *)gp->pdata[i])->value);
-                if ((new_double > item->double_max) || (item->fields == 0)) {
-                    item->double_max = new_double;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                if ((new_double < item->double_min) || (item->fields == 0)) {
-                    item->double_min = new_double;
-                    if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                        item->extreme_frame_in_invl = pinfo->num;
-                    }
-                }
-                item->double_tot += new_double;
-                item->fields++;
-                break;
-            case FT_RELATIVE_TIME:
-                new_time = (nstime_t *)fvalue_get(&((field_info *)gp->pdata[i])->value);
-
-                switch (item_unit) {
-                case IOG_ITEM_UNIT_CALC_LOAD:
-                {
-                    guint64 t, pt; /* time in us */
-                    int j;
-                    /*
-                     * Add the time this call spanned each interval according to its contribution
-                     * to that interval.
-                     */
-                    t = new_time->secs;
-                    t = t * 1000000 + new_time->nsecs / 1000;
-                    j = idx;
-                    /*
-                     * Handle current interval
-                     */
-                    pt = pinfo->rel_ts.secs * 1000000 + pinfo->rel_ts.nsecs / 1000;
-                    pt = pt % (interval * 1000);
-                    if (pt > t) {
-                        pt = t;
-                    }
-                    while (t) {
-                        io_graph_item_t *load_item;
-
-                        load_item = &items[j];
-                        load_item->time_tot.nsecs += (int) (pt * 1000);
-                        if (load_item->time_tot.nsecs > 1000000000) {
-                            load_item->time_tot.secs++;
-                            load_item->time_tot.nsecs -= 1000000000;
-                        }
-
-                        if (j == 0) {
-                            break;
-                        }
-                        j--;
-                        t -= pt;
-                        if (t > (guint64) interval * 1000) {
-                            pt = (guint64) interval * 1000;
-                        } else {
-                            pt = t;
-                        }
-                    }
-                    break;
-                }
-                default:
-                    if ( (new_time->secs > item->time_max.secs)
-                         || ( (new_time->secs == item->time_max.secs)
-                              && (new_time->nsecs > item->time_max.nsecs))
-                         || (item->fields == 0)) {
-                        item->time_max = *new_time;
-                        if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
-                            item->extreme_frame_in_invl = pinfo->num;
-                        }
-                    }
-                    if ( (new_time->secs<item->time_min.secs)
-                         || ( (new_time->secs == item->time_min.secs)
-                              && (new_time->nsecs < item->time_min.nsecs))
-                         || (item->fields == 0)) {
-                        item->time_min = *new_time;
-                        if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
-                            item->extreme_frame_in_invl = pinfo->num;
-                        }
-                    }
-                    nstime_add(&item->time_tot, new_time);
-                    item->fields++;
-                }
-                break;
-            default:
-                if ((item_unit == IOG_ITEM_UNIT_CALC_FRAMES) ||
-                    (item_unit == IOG_ITEM_UNIT_CALC_FIELDS)) {
-                    /*
-                     * It's not an integeresque type, but
-                     * all we want to do is count it, so
-                     * that's all right.
-                     */
-                    item->fields++;
-                }
-                else {
-                    /*
-                     * "Can't happen"; see the "check that the
-                     * type is compatible" check in
-                     * filter_callback().
-                     */
-                    g_assert_not_reached();
-                }
-                break;
-            }
+            update_io_graph_item_value(items, idx, pinfo->num, &pinfo->rel_ts, &((field_info *)gp->pdata[i])->value, hf_index, item_unit, interval);
         }
     }
 
@@ -21,12 +21,30 @@
 #include "wtap-int.h"
 #include "file_wrappers.h"
 #include <wsutil/file_util.h>
+#include <wsutil/pint.h>
+
+#ifdef HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #ifdef HAVE_ZLIB
 #define ZLIB_CONST
 #include <zlib.h>
 #endif /* HAVE_ZLIB */
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif /* HAVE_LZ4FRAME_H */
+
 /*
  * See RFC 1952:
  *
@@ -34,6 +52,16 @@
  *
  * for a description of the gzip file format.
  *
+ * See
+ *
+ *      https://tools.ietf.org/html/rfc8878
+ *
+ * for a description of the Zstandard format, and
+ *
+ *      https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+ *
+ * for a description of the LZ4 frame format.
+ *
  * Some other compressed file formats we might want to support:
  *
  *      XZ format: https://tukaani.org/xz/
@@ -53,6 +81,12 @@ static struct compression_type {
 } compression_types[] = {
 #ifdef HAVE_ZLIB
     { WTAP_GZIP_COMPRESSED, "gz", "gzip compressed" },
+#endif
+#ifdef HAVE_ZSTD
+    { WTAP_ZSTD_COMPRESSED, "zst", "Zstandard compressed" },
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    { WTAP_LZ4_COMPRESSED, "lz4", "LZ4 compressed" },
 #endif
     { WTAP_UNCOMPRESSED, NULL, NULL }
 };
@@ -60,10 +94,7 @@ static struct compression_type {
 wtap_compression_type
 wtap_get_compression_type(wtap *wth)
 {
-	gboolean is_compressed;
-
-	is_compressed = file_iscompressed((wth->fh == NULL) ? wth->random_fh : wth->fh);
-	return is_compressed ? WTAP_GZIP_COMPRESSED : WTAP_UNCOMPRESSED;
+	return file_get_compression_type((wth->fh == NULL) ? wth->random_fh : wth->fh);
 }
 
 const char *
@@ -88,6 +119,25 @@ wtap_compression_type_extension(wtap_compression_type compression_type)
 	return NULL;
 }
 
+/*
+ * The compression type with the given name, as used for command-line
+ * options; the name is the type's file name extension, or "none" for
+ * no compression.  Returns -1 if there's no such type, or if it's not
+ * supported in this build.
+ */
+int
+wtap_name_to_compression_type(const char *name)
+{
+	if (g_ascii_strcasecmp(name, "none") == 0)
+		return WTAP_UNCOMPRESSED;
+	for (struct compression_type *p = compression_types;
+	    p->type != WTAP_UNCOMPRESSED; p++) {
+		if (g_ascii_strcasecmp(name, p->extension) == 0)
+			return p->type;
+	}
+	return -1;
+}
+
 GSList *
 wtap_get_all_compression_type_extensions_list(void)
 {
@@ -105,16 +155,36 @@ wtap_get_all_compression_type_extensions_list(void)
 /* #define GZBUFSIZE 8192 */
 #define GZBUFSIZE 4096
 
+/* Background decompression; see readahead_start() */
+#define READAHEAD_MIN_FILLS  16             /* fills before starting the thread */
+#define READAHEAD_BUFSIZE    (128 * 1024)   /* input buffer size; chunks are twice that */
+#define READAHEAD_MAX_CHUNKS 32
+
+#ifndef S_ISREG
+#define S_ISREG(mode)   (((mode) & S_IFMT) == S_IFREG)
+#endif
+
 /* values for wtap_reader compression */
 typedef enum {
     UNKNOWN,       /* unknown - look for a gzip header */
     UNCOMPRESSED,  /* uncompressed - copy input directly */
 #ifdef HAVE_ZLIB
     ZLIB,          /* decompress a zlib stream */
-    GZIP_AFTER_HEADER
+    GZIP_AFTER_HEADER,
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD,          /* decompress a Zstandard frame */
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    LZ4,           /* decompress an LZ4 frame */
 #endif
 } compression_t;
 
+/* Frame magic numbers; see gz_head() */
+#define ZSTD_FRAME_MAGIC        0xFD2FB528U
+#define LZ4_FRAME_MAGIC         0x184D2204U
+#define SKIPPABLE_FRAME_MAGIC   0x184D2A50U     /* low 4 bits are any value */
+
 struct wtap_reader_buf {
     guint8 *buf;  /* buffer */
     guint8 *next; /* next byte to deliver from buffer */
@@ -134,7 +204,7 @@ struct wtap_reader {
     gint64 start;               /* where the gzip data started, for rewinding */
     gint64 raw;                 /* where the raw data started, for seeking */
     compression_t compression;  /* type of compression, if any */
-    gboolean is_compressed;     /* FALSE if completely uncompressed, TRUE otherwise */
+    wtap_compression_type compression_type; /* WTAP_UNCOMPRESSED unless we've seen compressed data */
 
     /* seek request */
     gint64 skip;                /* amount to skip (already rewound if backwards) */
@@ -148,10 +218,30 @@ struct wtap_reader {
     /* zlib inflate stream */
     z_stream strm;              /* stream structure in-place (not a pointer) */
     gboolean dont_check_crc;    /* TRUE if we aren't supposed to check the CRC */
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstd_dstream; /* Zstandard decompression stream, if we've needed one */
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    LZ4F_dctx *lz4_dctx;        /* LZ4 decompression context, if we've needed one */
 #endif
     /* fast seeking */
     GPtrArray *fast_seek;
     void *fast_seek_cur;
+    char *index_path;           /* sidecar fast seek index, or NULL */
+    guint index_loaded;         /* number of fast seek points read from it */
+    gboolean index_save;        /* TRUE to save new fast seek points to it on close */
+
+    /* background decompression */
+    gboolean random_access;     /* TRUE if used for random access, so don't read ahead */
+    guint seq_fills;            /* output buffer fills since the last seek */
+    guint bgzf_block_size;      /* size of the current BGZF block, or 0 if it isn't one */
+    struct readahead *readahead; /* decompression thread, if one is running */
+
+    /* memory-mapped uncompressed file */
+    const guint8 *map;          /* the whole file, if it's mapped, else NULL */
+    gint64 map_len;             /* length of the mapping */
+    gint64 map_checked;         /* end of what the last check found still in the file */
 };
 
 /* Current read offset within a buffer. */
@@ -181,6 +271,35 @@ bytes_in_buffer(struct wtap_reader_buf *buf)
     return (guint)((buf->next + buf->avail) - buf->buf);
 }
 
+/*
+ * Bytes of a mapped file checked at a time; see map_avail().
+ */
+#define MAP_CHECK_SPAN  (1024 * 1024)
+
+/*
+ * Number of bytes of a mapped file after the current position, if
+ * that's less than "want"; otherwise at least "want".
+ *
+ * The file may have been truncated since we mapped it - a ring buffer
+ * file being reused, say - and touching the mapping past its new end
+ * gets us a SIGBUS.  So before reading past what we last found still in
+ * the file, or at the end of the mapping, check its size and stop
+ * reading where it now ends, as if it had been that long all along.
+ * That's a system call per MAP_CHECK_SPAN bytes, not per read.
+ */
+static gint64
+map_avail(FILE_T state, gint64 want)
+{
+    ws_statb64 statb;
+
+    if (state->pos + want > state->map_checked) {
+        if (ws_fstat64(state->fd, &statb) == 0 && statb.st_size < state->map_len)
+            state->map_len = statb.st_size;
+        state->map_checked = MIN(state->map_len, state->pos + MAX(want, MAP_CHECK_SPAN));
+    }
+    return state->pos < state->map_len ? state->map_len - state->pos : 0;
+}
+
 /* Reset a buffer, discarding all data in the buffer, so we read into
    it starting at the beginning. */
 static void
@@ -240,6 +359,22 @@ fill_in_buffer(FILE_T state)
     return 0;
 }
 
+/* Get at least "n" bytes into the input buffer, unless we hit EOF first. */
+static int
+fill_in_buffer_min(FILE_T state, guint n)
+{
+    while (state->in.avail < n && !state->eof) {
+        /* buf_read() would discard what we have if we're at the end */
+        if (bytes_in_buffer(&state->in) == state->size) {
+            memmove(state->in.buf, state->in.next, state->in.avail);
+            state->in.next = state->in.buf;
+        }
+        if (fill_in_buffer(state) == -1)
+            return -1;
+    }
+    return 0;
+}
+
 #define ZLIB_WINSIZE 32768
 
 struct fast_seek_point {
@@ -304,7 +439,8 @@ fast_seek_header(FILE_T file, gint64 in_pos, gint64 out_pos,
         item = (struct fast_seek_point *)file->fast_seek->pdata[file->fast_seek->len - 1];
 
     if (!item || item->out < out_pos) {
-        struct fast_seek_point *val = g_new(struct fast_seek_point,1);
+        /* There's no inflate window for these; leave off the space for it */
+        struct fast_seek_point *val = (struct fast_seek_point *)g_malloc(G_STRUCT_OFFSET(struct fast_seek_point, data));
         val->in = in_pos;
         val->out = out_pos;
         val->compression = compression;
@@ -313,6 +449,21 @@ fast_seek_header(FILE_T file, gint64 in_pos, gint64 out_pos,
     }
 }
 
+/* Is this a fast seek point at the start of a Zstandard or LZ4 frame? */
+static gboolean
+is_frame_start(compression_t compression _U_)
+{
+#ifdef HAVE_ZSTD
+    if (compression == ZSTD)
+        return TRUE;
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    if (compression == LZ4)
+        return TRUE;
+#endif
+    return FALSE;
+}
+
 static void
 fast_seek_reset(
 #ifdef HAVE_ZLIB
@@ -642,6 +793,192 @@ DIAG_ON(cast-qual)
 }
 #endif
 
+#ifdef HAVE_ZSTD
+static void
+zstd_read(FILE_T state, unsigned char *buf, unsigned int count)
+{
+    ZSTD_outBuffer output;
+    ZSTD_inBuffer input;
+    size_t ret;
+
+    output.dst = buf;
+    output.size = count;
+    output.pos = 0;
+
+    /* fill output buffer up to end of frame or error */
+    while (output.pos < output.size) {
+        /* get more input */
+        if (state->in.avail == 0 && fill_in_buffer(state) == -1)
+            break;
+        if (state->in.avail == 0) {
+            /* EOF */
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            break;
+        }
+
+        input.src = state->in.next;
+        input.size = state->in.avail;
+        input.pos = 0;
+        ret = ZSTD_decompressStream(state->zstd_dstream, &output, &input);
+        state->in.next += input.pos;
+        state->in.avail -= (guint)input.pos;
+        if (ZSTD_isError(ret)) {
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = ZSTD_getErrorName(ret);
+            break;
+        }
+        if (ret == 0) {
+            /* End of the frame, with all of it flushed */
+            state->compression = UNKNOWN;      /* look for the next frame */
+            break;
+        }
+    }
+
+    state->out.next = buf;
+    state->out.avail = (guint)output.pos;
+}
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4FRAME_H
+static void
+lz4_read(FILE_T state, unsigned char *buf, unsigned int count)
+{
+    size_t have = 0;
+    size_t in_len, out_len, ret;
+
+    /* fill output buffer up to end of frame or error */
+    while (have < count) {
+        /* get more input */
+        if (state->in.avail == 0 && fill_in_buffer(state) == -1)
+            break;
+        if (state->in.avail == 0) {
+            /* EOF */
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            break;
+        }
+
+        in_len = state->in.avail;
+        out_len = count - have;
+        ret = LZ4F_decompress(state->lz4_dctx, buf + have, &out_len,
+                              state->in.next, &in_len, NULL);
+        state->in.next += in_len;
+        state->in.avail -= (guint)in_len;
+        have += out_len;
+        if (LZ4F_isError(ret)) {
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = LZ4F_getErrorName(ret);
+            break;
+        }
+        if (ret == 0) {
+            /* End of the frame, with all of it flushed */
+            state->compression = UNKNOWN;      /* look for the next frame */
+            break;
+        }
+    }
+
+    state->out.next = buf;
+    state->out.avail = (guint)have;
+}
+#endif /* HAVE_LZ4FRAME_H */
+
+/*
+ * Look for a Zstandard or LZ4 frame at the current input position,
+ * skipping any skippable frames before it.  Returns 1, with the
+ * decoder set up, if we found one, 0 if we didn't, and -1 on error.
+ */
+static int
+frame_head(FILE_T state)
+{
+    guint32 magic, skip, n;
+
+    for (;;) {
+        if (fill_in_buffer_min(state, 4) == -1)
+            return -1;
+        if (state->in.avail < 4)
+            return 0;
+        magic = pletoh32(state->in.next);
+
+        if ((magic & 0xFFFFFFF0U) == SKIPPABLE_FRAME_MAGIC) {
+            /* magic number, 4-byte length, and that many bytes of data */
+            if (fill_in_buffer_min(state, 8) == -1)
+                return -1;
+            if (state->in.avail < 8)
+                return 0;
+            skip = pletoh32(state->in.next + 4);
+            state->in.next += 8;
+            state->in.avail -= 8;
+            while (skip != 0) {
+                if (state->in.avail == 0 && fill_in_buffer(state) == -1)
+                    return -1;
+                if (state->in.avail == 0) {
+                    /* EOF */
+                    state->err = WTAP_ERR_SHORT_READ;
+                    state->err_info = NULL;
+                    return -1;
+                }
+                n = MIN(skip, state->in.avail);
+                state->in.next += n;
+                state->in.avail -= n;
+                skip -= n;
+            }
+            continue;
+        }
+
+        if (magic == ZSTD_FRAME_MAGIC) {
+#ifdef HAVE_ZSTD
+            if (state->zstd_dstream == NULL &&
+                (state->zstd_dstream = ZSTD_createDStream()) == NULL) {
+                state->err = ENOMEM;
+                state->err_info = NULL;
+                return -1;
+            }
+            /* We may have left the last frame half-read when seeking */
+            if (ZSTD_isError(ZSTD_initDStream(state->zstd_dstream))) {
+                state->err = WTAP_ERR_INTERNAL;
+                state->err_info = "ZSTD_initDStream failed";
+                return -1;
+            }
+            if (state->fast_seek)
+                fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, ZSTD);
+            state->compression = ZSTD;
+            state->compression_type = WTAP_ZSTD_COMPRESSED;
+            return 1;
+#else
+            state->err = WTAP_ERR_DECOMPRESSION_NOT_SUPPORTED;
+            state->err_info = "reading zstd-compressed files isn't supported";
+            return -1;
+#endif
+        }
+
+        if (magic == LZ4_FRAME_MAGIC) {
+#ifdef HAVE_LZ4FRAME_H
+            /* We may have left the last frame half-read when seeking */
+            if (state->lz4_dctx != NULL)
+                LZ4F_freeDecompressionContext(state->lz4_dctx);
+            if (LZ4F_isError(LZ4F_createDecompressionContext(&state->lz4_dctx, LZ4F_VERSION))) {
+                state->lz4_dctx = NULL;
+                state->err = ENOMEM;
+                state->err_info = NULL;
+                return -1;
+            }
+            if (state->fast_seek)
+                fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, LZ4);
+            state->compression = LZ4;
+            state->compression_type = WTAP_LZ4_COMPRESSED;
+            return 1;
+#else
+            state->err = WTAP_ERR_DECOMPRESSION_NOT_SUPPORTED;
+            state->err_info = "reading lz4-compressed files isn't supported";
+            return -1;
+#endif
+        }
+
+        return 0;
+    }
+}
+
 static int
 gz_head(FILE_T state)
 {
@@ -726,6 +1063,7 @@ gz_head(FILE_T state)
                     return -1;
                 }
 
+                state->bgzf_block_size = 0;
                 if (flags & 4) {
                     /* extra field - get XLEN */
                     if (gz_next2(state, &len) == -1) {
@@ -733,7 +1071,38 @@ gz_head(FILE_T state)
                         return -1;
                     }
 
-                    /* skip the extra field */
+                    /*
+                     * Look through the subfields for a BGZF "BC"
+                     * subfield, giving the size of this member, and
+                     * skip the rest.
+                     */
+                    while (len >= 4) {
+                        guint8 si1, si2;
+                        guint16 slen;
+
+                        if (gz_next1(state, &si1) == -1 ||
+                            gz_next1(state, &si2) == -1 ||
+                            gz_next2(state, &slen) == -1) {
+                            /* Read error. */
+                            return -1;
+                        }
+                        len -= 4;
+                        if (slen > len)
+                            break;      /* malformed; skip the rest */
+                        len -= slen;
+                        if (si1 == 'B' && si2 == 'C' && slen == 2) {
+                            guint16 bsize;
+
+                            if (gz_next2(state, &bsize) == -1) {
+                                /* Read error. */
+                                return -1;
+                            }
+                            state->bgzf_block_size = (guint)bsize + 1;
+                        } else if (gz_skipn(state, slen) == -1) {
+                            /* Read error. */
+                            return -1;
+                        }
+                    }
                     if (gz_skipn(state, len) == -1) {
                         /* Read error. */
                         return -1;
@@ -766,7 +1135,7 @@ gz_head(FILE_T state)
                 inflateReset(&(state->strm));
                 state->strm.adler = crc32(0L, Z_NULL, 0);
                 state->compression = ZLIB;
-                state->is_compressed = TRUE;
+                state->compression_type = WTAP_GZIP_COMPRESSED;
 #ifdef Z_BLOCK
                 if (state->fast_seek) {
                     struct zlib_cur_seek_point *cur = g_new(struct zlib_cur_seek_point,1);
@@ -804,6 +1173,19 @@ gz_head(FILE_T state)
             state->in.next--;
         }
     }
+    switch (frame_head(state)) {
+
+    case -1:
+        return -1;
+
+    case 1:
+        return 0;
+    }
+    if (state->in.avail == 0) {
+        /* Nothing after the last frame but skippable frames */
+        return 0;
+    }
+
 #ifdef HAVE_LIBXZ
     /* { 0xFD, '7', 'z', 'X', 'Z', 0x00 } */
     /* FD 37 7A 58 5A 00 */
@@ -819,9 +1201,9 @@ gz_head(FILE_T state)
     state->out.next = state->out.buf;
     /* not a compressed file -- copy everything we've read into the
        input buffer to the output buffer and fall to raw i/o */
-    already_read = bytes_in_buffer(&state->in);
+    already_read = state->in.avail;
     if (already_read != 0) {
-        memcpy(state->out.buf, state->in.buf, already_read);
+        memcpy(state->out.buf, state->in.next, already_read);
         state->out.avail = already_read;
 
         /* Now discard everything in the input buffer */
@@ -831,9 +1213,32 @@ gz_head(FILE_T state)
     return 0;
 }
 
+#ifdef HAVE_ZLIB
+static gboolean readahead_start(FILE_T state);
+static gboolean readahead_fill(FILE_T state);
+#endif
+
 static int /* gz_make */
 fill_out_buffer(FILE_T state)
 {
+#ifdef HAVE_ZLIB
+    if (state->readahead == NULL && state->compression == ZLIB &&
+        ++state->seq_fills == READAHEAD_MIN_FILLS)
+        (void)readahead_start(state);
+    if (state->readahead != NULL) {
+        if (readahead_fill(state))
+            return 0;
+        /*
+         * The decompression thread has stopped, and we have taken
+         * over where it left off; carry on as we would have if we'd
+         * got here ourselves.
+         */
+        if (state->err != 0)
+            return -1;
+        if (state->eof && state->in.avail == 0)
+            return 0;
+    }
+#endif
     if (state->compression == UNKNOWN) {           /* look for gzip header */
         if (gz_head(state) == -1)
             return -1;
@@ -848,6 +1253,16 @@ fill_out_buffer(FILE_T state)
     else if (state->compression == ZLIB) {      /* decompress */
         zlib_read(state, state->out.buf, state->size << 1);
     }
+#endif
+#ifdef HAVE_ZSTD
+    else if (state->compression == ZSTD) {
+        zstd_read(state, state->out.buf, state->size << 1);
+    }
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    else if (state->compression == LZ4) {
+        lz4_read(state, state->out.buf, state->size << 1);
+    }
 #endif
     return 0;
 }
@@ -902,71 +1317,932 @@ gz_reset(FILE_T state)
     buf_reset(&state->in);        /* no input data yet */
 }
 
-FILE_T
-file_fdopen(int fd)
-{
-    /*
-     * XXX - we now check whether we have st_blksize in struct stat;
-     * it's not available on all platforms.
-     *
-     * I'm not sure why we're testing _STATBUF_ST_BLKSIZE; it's not
-     * set on all platforms that have st_blksize in struct stat.
-     * (Not all platforms have st_blksize in struct stat.)
-     *
-     * Is there some reason *not* to make the buffer size the maximum
-     * of GBUFSIZE and st_blksize?  On most UN*Xes, the standard I/O
-     * library does I/O with st_blksize as the buffer size; on others,
-     * and on Windows, it's a 4K buffer size.  If st_blksize is bigger
-     * than GBUFSIZE (which is currently 4KB), that's probably a
-     * hint that reading in st_blksize chunks is considered a good
-     * idea (e.g., an 8K/1K Berkeley fast file system with st_blksize
-     * being 8K, or APFS, where st_blksize is big on at least some
-     * versions of macOS).
-     */
-#ifdef _STATBUF_ST_BLKSIZE
-    ws_statb64 st;
-#endif
-    int want = GZBUFSIZE;
-    FILE_T state;
+#ifdef HAVE_ZLIB
+/*
+ * Background decompression.
+ *
+ * Once we have read sequentially through a compressed file for a while,
+ * we start a thread that carries on decompressing ahead of the reader
+ * into a bounded queue of chunks; fill_out_buffer() then just hands the
+ * reader the next chunk.  The thread works on a reader of its own (the
+ * "shadow"), which is set up as a copy of ours, so that the existing
+ * decompression code can be used unchanged; when the thread stops,
+ * we copy the shadow's state back.
+ *
+ * BGZF files, and other gzip files whose members have a BGZF "BC"
+ * subfield giving their size, consist of independent members that
+ * can be found without decompressing them; the thread reads those
+ * members and has them inflated in parallel by a pool of threads.
+ *
+ * Fast seek points found by the thread are passed back with the chunk
+ * after which they were found, and added to the fast seek array only
+ * when the reader gets that chunk, as the array is shared with the
+ * random access reader.
+ *
+ * Seeking backwards out of the current chunk stops the thread and
+ * throws the chunks away.  We only read ahead on regular files that
+ * aren't being read randomly.
+ */
 
-    if (fd == -1)
-        return NULL;
+struct readahead_chunk {
+    struct readahead *ra;
+    guint8 *data;
+    guint len;
+    gint64 pos;                 /* offset of data in the uncompressed stream */
+    gint64 raw_end;             /* offset in the file after reading it */
+    GPtrArray *seek_points;     /* fast seek points found before it, or NULL */
+    gboolean ready;             /* FALSE while a BGZF block is being inflated */
+    int err;                    /* error inflating a BGZF block */
+    const char *err_info;
+
+    /* BGZF block to inflate */
+    guint8 *cdata;
+    guint clen;
+    guint32 crc;
+};
 
-    /* allocate FILE_T structure to return */
-    state = (FILE_T)g_try_malloc0(sizeof *state);
-    if (state == NULL)
-        return NULL;
+struct readahead {
+    FILE_T src;                 /* shadow reader, used by the thread */
+    GThread *thread;
+    GMutex lock;
+    GCond cond;
+    GQueue chunks;              /* chunks produced, in order */
+    GQueue free_chunks;
+    guint nchunks;              /* chunks allocated */
+    guint jobs;                 /* BGZF blocks being inflated */
+    gboolean stop;              /* the thread is to stop */
+    gboolean done;              /* the thread has stopped */
+    struct readahead_chunk *cur;/* chunk the reader's output buffer is in */
+    guint8 *out_buf;            /* the reader's own output buffer */
+    gint64 raw_pos;             /* raw position for file_tell_raw() */
+};
 
-    state->fast_seek_cur = NULL;
-    state->fast_seek = NULL;
+/* Read "len" bytes of compressed data; returns -1 and sets state->err on failure. */
+static int
+gz_read_raw(FILE_T state, guint8 *buf, guint len)
+{
+    guint n;
 
-    /* open the file with the appropriate mode (or just use fd) */
-    state->fd = fd;
+    while (len != 0) {
+        if (state->in.avail == 0 && fill_in_buffer(state) == -1)
+            return -1;
+        if (state->in.avail == 0) {
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            return -1;
+        }
+        n = MIN(len, state->in.avail);
+        memcpy(buf, state->in.next, n);
+        state->in.next += n;
+        state->in.avail -= n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
 
-    /* we don't yet know whether it's compressed */
-    state->is_compressed = FALSE;
+static void
+readahead_inflate_block(gpointer data, gpointer user_data _U_)
+{
+    struct readahead_chunk *chunk = (struct readahead_chunk *)data;
+    struct readahead *ra = chunk->ra;
+    z_stream strm;
+    int ret;
 
-    /* save the current position for rewinding (only if reading) */
-    state->start = ws_lseek64(state->fd, 0, SEEK_CUR);
-    if (state->start == -1) state->start = 0;
-    state->raw_pos = state->start;
+    memset(&strm, 0, sizeof strm);
+    if (inflateInit2(&strm, -15) != Z_OK) {
+        chunk->err = ENOMEM;
+    } else {
+        strm.next_in = chunk->cdata;
+        strm.avail_in = chunk->clen;
+        strm.next_out = chunk->data;
+        strm.avail_out = chunk->len;
+        ret = inflate(&strm, Z_FINISH);
+        if (ret == Z_MEM_ERROR) {
+            chunk->err = ENOMEM;
+        } else if (ret == Z_BUF_ERROR ||
+                   (ret == Z_STREAM_END && strm.total_out != chunk->len)) {
+            chunk->err = WTAP_ERR_DECOMPRESS;
+            chunk->err_info = "length field wrong";
+        } else if (ret != Z_STREAM_END) {
+            chunk->err = WTAP_ERR_DECOMPRESS;
+            chunk->err_info = strm.msg;
+        } else if (!ra->src->dont_check_crc &&
+                   crc32(crc32(0L, Z_NULL, 0), chunk->data, chunk->len) != chunk->crc) {
+            chunk->err = WTAP_ERR_DECOMPRESS;
+            chunk->err_info = "bad CRC";
+        }
+        inflateEnd(&strm);
+    }
 
-    /* initialize stream */
-    gz_reset(state);
+    g_mutex_lock(&ra->lock);
+    chunk->ready = TRUE;
+    ra->jobs--;
+    g_cond_broadcast(&ra->cond);
+    g_mutex_unlock(&ra->lock);
+}
 
-#ifdef _STATBUF_ST_BLKSIZE
-    if (ws_fstat64(fd, &st) >= 0) {
-        /*
-         * Yes, st_blksize can be bigger than an int; apparently,
-         * it's a long on LP64 Linux, for example.
-         *
-         * If the value is too big to fit into an int, just
-         * use the default.
-         */
-        if (st.st_blksize <= G_MAXINT)
-            want = (int)st.st_blksize;
-        /* XXX, verify result? */
-    }
+/* Pool of threads inflating BGZF blocks, shared by all readers. */
+static GThreadPool *
+readahead_pool(void)
+{
+    static gsize pool_initialized = 0;
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter(&pool_initialized)) {
+#if GLIB_CHECK_VERSION(2,36,0)
+        gint nthreads = (gint)g_get_num_processors();
+#else
+        gint nthreads = 4;
+#endif
+        if (nthreads > 1)
+            pool = g_thread_pool_new(readahead_inflate_block, NULL, nthreads, FALSE, NULL);
+        g_once_init_leave(&pool_initialized, 1);
+    }
+    return pool;
+}
+
+/*
+ * Produce the next chunk from the shadow reader.  Returns FALSE if
+ * there's nothing more to produce; otherwise the chunk is to be
+ * queued if chunk->len is non-zero.
+ */
+static gboolean
+readahead_produce(struct readahead *ra, struct readahead_chunk *chunk)
+{
+    FILE_T state = ra->src;
+    gint64 member_start = state->raw_pos - state->in.avail;
+    GThreadPool *pool;
+
+    chunk->len = 0;
+    chunk->ready = TRUE;
+    chunk->err = 0;
+    chunk->err_info = NULL;
+    chunk->seek_points = NULL;
+
+    if (state->err != 0 || (state->eof && state->in.avail == 0))
+        return FALSE;
+
+    state->out.buf = chunk->data;
+    buf_reset(&state->out);
+
+    if (state->compression == UNKNOWN) {
+        if (gz_head(state) == -1)
+            return TRUE;
+        if (state->compression == ZLIB && state->bgzf_block_size != 0 &&
+            (pool = readahead_pool()) != NULL) {
+            /*
+             * A BGZF block; the block size includes the header we've
+             * just read and the CRC and length trailer.
+             */
+            guint hdr_len = (guint)(state->raw_pos - state->in.avail - member_start);
+            guint32 isize;
+
+            if (state->bgzf_block_size < hdr_len + 8) {
+                state->err = WTAP_ERR_DECOMPRESS;
+                state->err_info = "BGZF block size too small";
+                return TRUE;
+            }
+            chunk->clen = state->bgzf_block_size - hdr_len - 8;
+            chunk->cdata = (guint8 *)g_realloc(chunk->cdata, chunk->clen);
+            if (gz_read_raw(state, chunk->cdata, chunk->clen) == -1 ||
+                gz_next4(state, &chunk->crc) == -1 ||
+                gz_next4(state, &isize) == -1)
+                return TRUE;
+            if (isize > (guint32)state->size << 1) {
+                state->err = WTAP_ERR_DECOMPRESS;
+                state->err_info = "BGZF block too large";
+                return TRUE;
+            }
+            state->compression = UNKNOWN;
+            g_free(state->fast_seek_cur);
+            state->fast_seek_cur = NULL;
+            if (isize == 0)
+                return TRUE;    /* e.g., the empty end-of-file block */
+
+            chunk->len = isize;
+            chunk->ready = FALSE;
+            g_mutex_lock(&ra->lock);
+            ra->jobs++;
+            g_mutex_unlock(&ra->lock);
+            g_thread_pool_push(pool, chunk, NULL);
+            return TRUE;
+        }
+    }
+    if (state->out.avail == 0 && fill_out_buffer(state) == -1)
+        return TRUE;
+    chunk->len = state->out.avail;
+    return TRUE;
+}
+
+static gpointer
+readahead_thread(gpointer data)
+{
+    struct readahead *ra = (struct readahead *)data;
+    FILE_T state = ra->src;
+    struct readahead_chunk *chunk;
+    gboolean more;
+
+    g_mutex_lock(&ra->lock);
+    for (;;) {
+        while (!ra->stop && g_queue_is_empty(&ra->free_chunks) &&
+               ra->nchunks >= READAHEAD_MAX_CHUNKS)
+            g_cond_wait(&ra->cond, &ra->lock);
+        if (ra->stop)
+            break;
+        chunk = (struct readahead_chunk *)g_queue_pop_head(&ra->free_chunks);
+        if (chunk == NULL) {
+            chunk = g_new0(struct readahead_chunk, 1);
+            chunk->ra = ra;
+            chunk->data = (guint8 *)g_malloc(((gsize)state->size) << 1);
+            ra->nchunks++;
+        }
+        g_mutex_unlock(&ra->lock);
+
+        chunk->pos = state->pos;
+        more = readahead_produce(ra, chunk);
+        state->pos += chunk->len;
+        chunk->raw_end = state->raw_pos - state->in.avail;
+        if (state->fast_seek != NULL && state->fast_seek->len > 1) {
+            /*
+             * Pass the new fast seek points on with this chunk,
+             * keeping the last one, which zlib_fast_seek_add() and
+             * fast_seek_header() look at.
+             */
+            gpointer last = g_ptr_array_index(state->fast_seek, state->fast_seek->len - 1);
+
+            g_ptr_array_remove_index(state->fast_seek, 0);
+            chunk->seek_points = state->fast_seek;
+            state->fast_seek = g_ptr_array_new();
+            g_ptr_array_add(state->fast_seek, last);
+        }
+
+        g_mutex_lock(&ra->lock);
+        if (chunk->len != 0 || chunk->seek_points != NULL)
+            g_queue_push_tail(&ra->chunks, chunk);
+        else
+            g_queue_push_head(&ra->free_chunks, chunk);
+        g_cond_broadcast(&ra->cond);
+        if (!more)
+            break;
+    }
+    ra->done = TRUE;
+    g_cond_broadcast(&ra->cond);
+    g_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+/* Add fast seek points passed back by the thread to the shared array. */
+static void
+readahead_add_seek_points(FILE_T state, struct readahead_chunk *chunk)
+{
+    guint i;
+
+    if (chunk->seek_points == NULL)
+        return;
+    for (i = 0; i < chunk->seek_points->len; i++) {
+        struct fast_seek_point *point = (struct fast_seek_point *)g_ptr_array_index(chunk->seek_points, i);
+        struct fast_seek_point *last = NULL;
+
+        if (state->fast_seek->len != 0)
+            last = (struct fast_seek_point *)g_ptr_array_index(state->fast_seek, state->fast_seek->len - 1);
+        /* The random access reader may have added points meanwhile */
+        if (last == NULL || last->out < point->out)
+            g_ptr_array_add(state->fast_seek, point);
+        else
+            g_free(point);
+    }
+    g_ptr_array_free(chunk->seek_points, TRUE);
+    chunk->seek_points = NULL;
+}
+
+/*
+ * Start a decompression thread for a reader whose output buffer has
+ * just been emptied.  Returns FALSE, leaving the reader as it was,
+ * if we shouldn't or can't.
+ */
+static gboolean
+readahead_start(FILE_T state)
+{
+    ws_statb64 st;
+    struct readahead *ra;
+    FILE_T src;
+
+    if (state->random_access || state->out.avail != 0 || state->eof ||
+        state->err != 0 || state->seek_pending)
+        return FALSE;
+    if (ws_fstat64(state->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return FALSE;
+    /* We hand the thread the last fast seek point; see readahead_thread() */
+    if (state->fast_seek != NULL && state->fast_seek->len == 0)
+        return FALSE;
+
+    src = g_new0(struct wtap_reader, 1);
+    if (inflateCopy(&src->strm, &state->strm) != Z_OK) {
+        g_free(src);
+        return FALSE;
+    }
+    src->fd = state->fd;
+    src->raw_pos = state->raw_pos;
+    src->pos = state->pos;
+    src->size = MAX(state->size, READAHEAD_BUFSIZE);
+    src->in.buf = (guint8 *)g_malloc(src->size);
+    memcpy(src->in.buf, state->in.next, state->in.avail);
+    src->in.next = src->in.buf;
+    src->in.avail = state->in.avail;
+    src->eof = state->eof;
+    src->start = state->start;
+    src->raw = state->raw;
+    src->compression = state->compression;
+    src->compression_type = state->compression_type;
+    src->dont_check_crc = state->dont_check_crc;
+    src->random_access = TRUE;  /* the shadow reader mustn't read ahead itself */
+    if (state->fast_seek != NULL) {
+        src->fast_seek = g_ptr_array_new();
+        g_ptr_array_add(src->fast_seek,
+            g_ptr_array_index(state->fast_seek, state->fast_seek->len - 1));
+    }
+    if (state->fast_seek_cur != NULL)
+        src->fast_seek_cur = g_memdup(state->fast_seek_cur, sizeof (struct zlib_cur_seek_point));
+
+    ra = g_new0(struct readahead, 1);
+    ra->src = src;
+    g_mutex_init(&ra->lock);
+    g_cond_init(&ra->cond);
+    g_queue_init(&ra->chunks);
+    g_queue_init(&ra->free_chunks);
+    ra->out_buf = state->out.buf;
+    ra->raw_pos = state->raw_pos;
+
+    ra->thread = g_thread_try_new("file readahead", readahead_thread, ra, NULL);
+    if (ra->thread == NULL) {
+        g_mutex_clear(&ra->lock);
+        g_cond_clear(&ra->cond);
+        g_free(ra);
+        inflateEnd(&src->strm);
+        if (src->fast_seek != NULL)
+            g_ptr_array_free(src->fast_seek, TRUE);
+        g_free(src->fast_seek_cur);
+        g_free(src->in.buf);
+        g_free(src);
+        return FALSE;
+    }
+    state->readahead = ra;
+    return TRUE;
+}
+
+/* Stop the thread, and wait for blocks being inflated; the chunks are kept. */
+static void
+readahead_stop(struct readahead *ra)
+{
+    g_mutex_lock(&ra->lock);
+    ra->stop = TRUE;
+    g_cond_broadcast(&ra->cond);
+    g_mutex_unlock(&ra->lock);
+    if (ra->thread != NULL) {
+        g_thread_join(ra->thread);
+        ra->thread = NULL;
+    }
+    g_mutex_lock(&ra->lock);
+    while (ra->jobs != 0)
+        g_cond_wait(&ra->cond, &ra->lock);
+    g_mutex_unlock(&ra->lock);
+}
+
+static void
+readahead_free_chunk(gpointer data)
+{
+    struct readahead_chunk *chunk = (struct readahead_chunk *)data;
+
+    g_free(chunk->data);
+    g_free(chunk->cdata);
+    g_free(chunk);
+}
+
+/*
+ * Stop the thread, if it's still running, and throw away any chunks
+ * that haven't been read, then take over the shadow reader's state,
+ * so that we're positioned where it stopped.
+ */
+static void
+readahead_finish(FILE_T state)
+{
+    struct readahead *ra = state->readahead;
+    FILE_T src = ra->src;
+    struct readahead_chunk *chunk;
+
+    readahead_stop(ra);
+
+    while ((chunk = (struct readahead_chunk *)g_queue_pop_head(&ra->chunks)) != NULL) {
+        readahead_add_seek_points(state, chunk);
+        readahead_free_chunk(chunk);
+    }
+    while ((chunk = (struct readahead_chunk *)g_queue_pop_head(&ra->free_chunks)) != NULL)
+        readahead_free_chunk(chunk);
+    if (ra->cur != NULL)
+        readahead_free_chunk(ra->cur);
+
+    /* Take over the shadow's state */
+    inflateEnd(&state->strm);
+    (void)inflateCopy(&state->strm, &src->strm);
+    inflateEnd(&src->strm);
+    g_free(state->in.buf);
+    state->in = src->in;
+    state->out.buf = (guint8 *)g_realloc(ra->out_buf, ((gsize)src->size) << 1);
+    buf_reset(&state->out);
+    state->size = src->size;
+    state->raw_pos = src->raw_pos;
+    state->pos = src->pos;
+    state->eof = src->eof;
+    state->err = src->err;
+    state->err_info = src->err_info;
+    state->raw = src->raw;
+    state->compression = src->compression;
+    state->compression_type = src->compression_type;
+#ifdef HAVE_ZSTD
+    /* The shadow may have gone on into a Zstandard or LZ4 frame */
+    if (state->zstd_dstream != NULL)
+        ZSTD_freeDStream(state->zstd_dstream);
+    state->zstd_dstream = src->zstd_dstream;
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    if (state->lz4_dctx != NULL)
+        LZ4F_freeDecompressionContext(state->lz4_dctx);
+    state->lz4_dctx = src->lz4_dctx;
+#endif
+    state->bgzf_block_size = src->bgzf_block_size;
+    g_free(state->fast_seek_cur);
+    state->fast_seek_cur = src->fast_seek_cur;
+    if (src->fast_seek != NULL)
+        g_ptr_array_free(src->fast_seek, TRUE);     /* the points belong to the reader */
+    g_free(src);
+
+    g_mutex_clear(&ra->lock);
+    g_cond_clear(&ra->cond);
+    g_free(ra);
+    state->readahead = NULL;
+    state->seq_fills = 0;
+}
+
+/*
+ * Point the output buffer at the next chunk from the thread.  Returns
+ * FALSE if there are no more chunks, in which case the thread has been
+ * finished off with readahead_finish().
+ */
+static gboolean
+readahead_fill(FILE_T state)
+{
+    struct readahead *ra = state->readahead;
+    struct readahead_chunk *chunk;
+
+    for (;;) {
+        g_mutex_lock(&ra->lock);
+        if (ra->cur != NULL) {
+            g_queue_push_head(&ra->free_chunks, ra->cur);
+            ra->cur = NULL;
+            g_cond_broadcast(&ra->cond);
+        }
+        for (;;) {
+            chunk = (struct readahead_chunk *)g_queue_peek_head(&ra->chunks);
+            if (chunk != NULL ? chunk->ready : ra->done)
+                break;
+            g_cond_wait(&ra->cond, &ra->lock);
+        }
+        if (chunk != NULL)
+            g_queue_pop_head(&ra->chunks);
+        g_mutex_unlock(&ra->lock);
+
+        if (chunk == NULL) {
+            readahead_finish(state);
+            return FALSE;
+        }
+
+        if (state->fast_seek != NULL)
+            readahead_add_seek_points(state, chunk);
+        ra->raw_pos = chunk->raw_end;
+        ra->cur = chunk;
+        if (chunk->err != 0) {
+            gint64 pos = chunk->pos;
+            int err = chunk->err;
+            const char *err_info = chunk->err_info;
+
+            readahead_finish(state);
+            state->pos = pos;
+            state->err = err;
+            state->err_info = err_info;
+            return TRUE;
+        }
+        if (chunk->len != 0) {
+            state->out.buf = chunk->data;
+            state->out.next = chunk->data;
+            state->out.avail = chunk->len;
+            return TRUE;
+        }
+        /* Just fast seek points; get the next one */
+    }
+}
+
+/*
+ * Sidecar fast seek index.
+ *
+ * Finding the fast seek points in a gzipped file means decompressing
+ * all of it, so, once we've done that, we save the points - inflate
+ * windows and all - in a file next to it, and load them from there
+ * when the file is next opened.  The index is used only if the size,
+ * modification time (to the nanosecond, where the OS gives us that)
+ * and a CRC-32 of the start of the file are the ones recorded in it;
+ * the CRC catches a file replaced by another of the same size within
+ * the resolution of the timestamp.  It's saved only if the application
+ * asks for that.
+ *
+ * All values are little-endian.  The header is
+ *
+ *     magic (8 bytes), version (4), file size (8),
+ *     file modification time in seconds (8) and nanoseconds (4),
+ *     CRC-32 of the first SEEK_INDEX_CHECK_LEN bytes of the file (4),
+ *     number of points (4)
+ *
+ * and each point is
+ *
+ *     out (8), in (8), type (4)
+ *
+ * followed, for SEEK_INDEX_ZLIB points, by
+ *
+ *     bits (4), adler (4), total_out (4), window length (4), window
+ *
+ * with the window deflated unless its length is ZLIB_WINSIZE.
+ */
+#define SEEK_INDEX_SUFFIX       ".seekidx"
+#define SEEK_INDEX_MAGIC        "WTSEEKIX"
+#define SEEK_INDEX_VERSION      2
+#define SEEK_INDEX_HDR_LEN      40
+#define SEEK_INDEX_CHECK_LEN    65536
+#define SEEK_INDEX_POINT_LEN    20
+#define SEEK_INDEX_ZLIB_LEN     16
+
+/* Point types in the index */
+#define SEEK_INDEX_UNCOMPRESSED         0
+#define SEEK_INDEX_ZLIB                 1
+#define SEEK_INDEX_GZIP_AFTER_HEADER    2
+#define SEEK_INDEX_ZSTD_FRAME           3
+#define SEEK_INDEX_LZ4_FRAME            4
+
+static gboolean
+seek_index_read(FILE *fp, void *buf, size_t len, guint32 *crc)
+{
+    if (fread(buf, 1, len, fp) != len)
+        return FALSE;
+    *crc = (guint32)crc32(*crc, (const Bytef *)buf, (uInt)len);
+    return TRUE;
+}
+
+static void
+seek_index_write(FILE *fp, const void *buf, size_t len, guint32 *crc)
+{
+    fwrite(buf, 1, len, fp);
+    *crc = (guint32)crc32(*crc, (const Bytef *)buf, (uInt)len);
+}
+
+static guint32
+seek_index_mtime_nsec(const ws_statb64 *st _U_)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    return (guint32)st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return (guint32)st->st_mtimespec.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Compute the CRC-32 of the start of the file the index is for.  We
+ * open it again rather than using the stream's descriptor, so as not to
+ * move the stream's file position.
+ */
+static gboolean
+seek_index_file_crc(FILE_T state, guint32 *crc)
+{
+    char *path;
+    FILE *fp;
+    guint8 *buf;
+    size_t len;
+    gboolean ok;
+
+    path = g_strndup(state->index_path,
+                     strlen(state->index_path) - strlen(SEEK_INDEX_SUFFIX));
+    fp = ws_fopen(path, "rb");
+    g_free(path);
+    if (fp == NULL)
+        return FALSE;
+    buf = (guint8 *)g_malloc(SEEK_INDEX_CHECK_LEN);
+    len = fread(buf, 1, SEEK_INDEX_CHECK_LEN, fp);
+    ok = !ferror(fp);
+    *crc = (guint32)crc32(0L, (const Bytef *)buf, (uInt)len);
+    g_free(buf);
+    fclose(fp);
+    return ok;
+}
+
+static void
+seek_index_load(FILE_T state)
+{
+    ws_statb64 st;
+    FILE *fp;
+    guint8 hdr[SEEK_INDEX_HDR_LEN];
+    guint8 rec[SEEK_INDEX_POINT_LEN + SEEK_INDEX_ZLIB_LEN];
+    guint8 *wbuf;
+    guint8 trailer[4];
+    guint32 count, i, crc = 0, file_crc;
+    gint64 last_out = -1;
+    gboolean ok = FALSE;
+
+    if (ws_fstat64(state->fd, &st) == -1)
+        return;
+    if ((fp = ws_fopen(state->index_path, "rb")) == NULL)
+        return;
+    if (!seek_index_read(fp, hdr, sizeof hdr, &crc) ||
+        memcmp(hdr, SEEK_INDEX_MAGIC, 8) != 0 ||
+        pletoh32(hdr + 8) != SEEK_INDEX_VERSION ||
+        pletoh64(hdr + 12) != (guint64)st.st_size ||
+        (gint64)pletoh64(hdr + 20) != (gint64)st.st_mtime ||
+        pletoh32(hdr + 28) != seek_index_mtime_nsec(&st) ||
+        !seek_index_file_crc(state, &file_crc) ||
+        pletoh32(hdr + 32) != file_crc) {
+        /* Not an index, or out of date */
+        fclose(fp);
+        return;
+    }
+    count = pletoh32(hdr + 36);
+
+    wbuf = (guint8 *)g_malloc(ZLIB_WINSIZE);
+    for (i = 0; i < count; i++) {
+        struct fast_seek_point *point;
+        guint32 bits, wlen;
+        uLongf len;
+
+        if (!seek_index_read(fp, rec, SEEK_INDEX_POINT_LEN, &crc))
+            break;
+        point = g_new(struct fast_seek_point, 1);
+        point->out = (gint64)pletoh64(rec);
+        point->in = (gint64)pletoh64(rec + 8);
+        g_ptr_array_add(state->fast_seek, point);
+        if (point->out <= last_out || point->in < 0 || point->in > st.st_size)
+            break;
+        last_out = point->out;
+
+        switch (pletoh32(rec + 16)) {
+
+        case SEEK_INDEX_UNCOMPRESSED:
+            point->compression = UNCOMPRESSED;
+            continue;
+
+        case SEEK_INDEX_GZIP_AFTER_HEADER:
+            point->compression = GZIP_AFTER_HEADER;
+            continue;
+
+#ifdef HAVE_ZSTD
+        case SEEK_INDEX_ZSTD_FRAME:
+            point->compression = ZSTD;
+            continue;
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+        case SEEK_INDEX_LZ4_FRAME:
+            point->compression = LZ4;
+            continue;
+#endif
+
+        case SEEK_INDEX_ZLIB:
+            break;
+
+        default:
+            goto bad;
+        }
+
+        point->compression = ZLIB;
+        if (!seek_index_read(fp, rec + SEEK_INDEX_POINT_LEN, SEEK_INDEX_ZLIB_LEN, &crc))
+            break;
+        bits = pletoh32(rec + SEEK_INDEX_POINT_LEN);
+        point->data.zlib.adler = pletoh32(rec + SEEK_INDEX_POINT_LEN + 4);
+        point->data.zlib.total_out = pletoh32(rec + SEEK_INDEX_POINT_LEN + 8);
+        wlen = pletoh32(rec + SEEK_INDEX_POINT_LEN + 12);
+        if (bits > 7 || wlen > ZLIB_WINSIZE)
+            break;
+        if (wlen == ZLIB_WINSIZE) {
+            if (!seek_index_read(fp, point->data.zlib.window, ZLIB_WINSIZE, &crc))
+                break;
+        } else {
+            len = ZLIB_WINSIZE;
+            if (!seek_index_read(fp, wbuf, wlen, &crc) ||
+                uncompress(point->data.zlib.window, &len, wbuf, wlen) != Z_OK ||
+                len != ZLIB_WINSIZE)
+                break;
+        }
+#ifdef HAVE_INFLATEPRIME
+        point->data.zlib.bits = bits;
+#else
+        /* We can't resume in the middle of a byte; see zlib_fast_seek_add() */
+        if (bits != 0) {
+            g_ptr_array_remove_index(state->fast_seek, state->fast_seek->len - 1);
+            g_free(point);
+        }
+#endif
+    }
+    ok = (i == count && fread(trailer, 1, sizeof trailer, fp) == sizeof trailer &&
+          pletoh32(trailer) == crc);
+bad:
+    g_free(wbuf);
+    fclose(fp);
+
+    if (!ok) {
+        /* Damaged; forget whatever we read */
+        for (i = 0; i < state->fast_seek->len; i++)
+            g_free(g_ptr_array_index(state->fast_seek, i));
+        g_ptr_array_set_size(state->fast_seek, 0);
+    }
+    state->index_loaded = state->fast_seek->len;
+}
+
+static void
+seek_index_save(FILE_T state)
+{
+    ws_statb64 st;
+    GPtrArray *points = state->fast_seek;
+    char *tmp_path;
+    FILE *fp;
+    guint8 hdr[SEEK_INDEX_HDR_LEN];
+    guint8 rec[SEEK_INDEX_POINT_LEN + SEEK_INDEX_ZLIB_LEN];
+    guint8 *wbuf;
+    uLong wbuf_len;
+    guint32 crc = 0, file_crc;
+    gboolean useful = FALSE;
+    guint i;
+
+    /*
+     * Don't bother unless we've found points the index doesn't have,
+     * and some of them save decompressing.
+     */
+    if (points->len <= state->index_loaded)
+        return;
+    for (i = 0; i < points->len && !useful; i++)
+        useful = ((struct fast_seek_point *)g_ptr_array_index(points, i))->compression != UNCOMPRESSED;
+    if (!useful)
+        return;
+    if (ws_fstat64(state->fd, &st) == -1 || !seek_index_file_crc(state, &file_crc))
+        return;
+
+    /* Write it under another name, so nobody reads half an index */
+    tmp_path = g_strconcat(state->index_path, ".tmp", NULL);
+    if ((fp = ws_fopen(tmp_path, "wb")) == NULL) {
+        g_free(tmp_path);
+        return;
+    }
+    memcpy(hdr, SEEK_INDEX_MAGIC, 8);
+    phtole32(hdr + 8, SEEK_INDEX_VERSION);
+    phtole64(hdr + 12, (guint64)st.st_size);
+    phtole64(hdr + 20, (guint64)(gint64)st.st_mtime);
+    phtole32(hdr + 28, seek_index_mtime_nsec(&st));
+    phtole32(hdr + 32, file_crc);
+    phtole32(hdr + 36, points->len);
+    seek_index_write(fp, hdr, sizeof hdr, &crc);
+
+    wbuf_len = compressBound(ZLIB_WINSIZE);
+    wbuf = (guint8 *)g_malloc(wbuf_len);
+    for (i = 0; i < points->len; i++) {
+        struct fast_seek_point *point = (struct fast_seek_point *)g_ptr_array_index(points, i);
+        uLongf len;
+
+        phtole64(rec, (guint64)point->out);
+        phtole64(rec + 8, (guint64)point->in);
+        switch (point->compression) {
+
+        case ZLIB:
+            phtole32(rec + 16, SEEK_INDEX_ZLIB);
+            break;
+
+        case GZIP_AFTER_HEADER:
+            phtole32(rec + 16, SEEK_INDEX_GZIP_AFTER_HEADER);
+            seek_index_write(fp, rec, SEEK_INDEX_POINT_LEN, &crc);
+            continue;
+
+#ifdef HAVE_ZSTD
+        case ZSTD:
+            phtole32(rec + 16, SEEK_INDEX_ZSTD_FRAME);
+            seek_index_write(fp, rec, SEEK_INDEX_POINT_LEN, &crc);
+            continue;
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+        case LZ4:
+            phtole32(rec + 16, SEEK_INDEX_LZ4_FRAME);
+            seek_index_write(fp, rec, SEEK_INDEX_POINT_LEN, &crc);
+            continue;
+#endif
+
+        default:
+            phtole32(rec + 16, SEEK_INDEX_UNCOMPRESSED);
+            seek_index_write(fp, rec, SEEK_INDEX_POINT_LEN, &crc);
+            continue;
+        }
+
+#ifdef HAVE_INFLATEPRIME
+        phtole32(rec + SEEK_INDEX_POINT_LEN, point->data.zlib.bits);
+#else
+        phtole32(rec + SEEK_INDEX_POINT_LEN, 0);
+#endif
+        phtole32(rec + SEEK_INDEX_POINT_LEN + 4, point->data.zlib.adler);
+        phtole32(rec + SEEK_INDEX_POINT_LEN + 8, point->data.zlib.total_out);
+        len = wbuf_len;
+        if (compress2(wbuf, &len, point->data.zlib.window, ZLIB_WINSIZE, Z_BEST_SPEED) != Z_OK ||
+            len >= ZLIB_WINSIZE) {
+            phtole32(rec + SEEK_INDEX_POINT_LEN + 12, ZLIB_WINSIZE);
+            seek_index_write(fp, rec, sizeof rec, &crc);
+            seek_index_write(fp, point->data.zlib.window, ZLIB_WINSIZE, &crc);
+        } else {
+            phtole32(rec + SEEK_INDEX_POINT_LEN + 12, (guint32)len);
+            seek_index_write(fp, rec, sizeof rec, &crc);
+            seek_index_write(fp, wbuf, len, &crc);
+        }
+    }
+    g_free(wbuf);
+    phtole32(hdr, crc);
+    fwrite(hdr, 1, 4, fp);
+
+    if (ferror(fp)) {
+        fclose(fp);
+        ws_unlink(tmp_path);
+    } else if (fclose(fp) != 0 || ws_rename(tmp_path, state->index_path) == -1)
+        ws_unlink(tmp_path);
+    g_free(tmp_path);
+}
+#endif /* HAVE_ZLIB */
+
+FILE_T
+file_fdopen(int fd)
+{
+    /*
+     * XXX - we now check whether we have st_blksize in struct stat;
+     * it's not available on all platforms.
+     *
+     * I'm not sure why we're testing _STATBUF_ST_BLKSIZE; it's not
+     * set on all platforms that have st_blksize in struct stat.
+     * (Not all platforms have st_blksize in struct stat.)
+     *
+     * Is there some reason *not* to make the buffer size the maximum
+     * of GBUFSIZE and st_blksize?  On most UN*Xes, the standard I/O
+     * library does I/O with st_blksize as the buffer size; on others,
+     * and on Windows, it's a 4K buffer size.  If st_blksize is bigger
+     * than GBUFSIZE (which is currently 4KB), that's probably a
+     * hint that reading in st_blksize chunks is considered a good
+     * idea (e.g., an 8K/1K Berkeley fast file system with st_blksize
+     * being 8K, or APFS, where st_blksize is big on at least some
+     * versions of macOS).
+     */
+#ifdef _STATBUF_ST_BLKSIZE
+    ws_statb64 st;
+#endif
+    int want = GZBUFSIZE;
+    FILE_T state;
+
+    if (fd == -1)
+        return NULL;
+
+    /* allocate FILE_T structure to return */
+    state = (FILE_T)g_try_malloc0(sizeof *state);
+    if (state == NULL)
+        return NULL;
+
+    state->fast_seek_cur = NULL;
+    state->fast_seek = NULL;
+
+    /* open the file with the appropriate mode (or just use fd) */
+    state->fd = fd;
+
+    /* we don't yet know whether it's compressed */
+    state->compression_type = WTAP_UNCOMPRESSED;
+
+    /* save the current position for rewinding (only if reading) */
+    state->start = ws_lseek64(state->fd, 0, SEEK_CUR);
+    if (state->start == -1) state->start = 0;
+    state->raw_pos = state->start;
+
+    /* initialize stream */
+    gz_reset(state);
+
+#ifdef _STATBUF_ST_BLKSIZE
+    if (ws_fstat64(fd, &st) >= 0) {
+        /*
+         * Yes, st_blksize can be bigger than an int; apparently,
+         * it's a long on LP64 Linux, for example.
+         *
+         * If the value is too big to fit into an int, just
+         * use the default.
+         */
+        if (st.st_blksize <= G_MAXINT)
+            want = (int)st.st_blksize;
+        /* XXX, verify result? */
+    }
 #endif
 
     /* allocate buffers */
@@ -1060,11 +2336,167 @@ file_open(const char *path)
 }
 
 void
-file_set_random_access(FILE_T stream, gboolean random_flag _U_, GPtrArray *seek)
+file_set_random_access(FILE_T stream, gboolean random_flag, GPtrArray *seek)
 {
+    stream->random_access = random_flag;
     stream->fast_seek = seek;
 }
 
+/*
+ * Use a sidecar index for the fast seek points of the file at "path":
+ * load them from it now, if it's there and up to date, and, if
+ * file_set_seek_index_save() is called, save them to it when the
+ * stream is closed, if we've found more in the meantime.
+ * file_set_random_access() must have been called first, with an empty
+ * array of fast seek points.
+ *
+ * Only compressed files get an index; for other files the points are
+ * trivial.
+ */
+void
+file_set_seek_index(
+#ifdef HAVE_ZLIB
+    FILE_T stream, const char *path)
+#else
+    FILE_T stream _U_, const char *path _U_)
+#endif
+{
+#ifdef HAVE_ZLIB
+    if (stream->fast_seek == NULL || stream->fast_seek->len != 0 ||
+        stream->index_path != NULL)
+        return;
+    stream->index_path = g_strconcat(path, SEEK_INDEX_SUFFIX, NULL);
+    seek_index_load(stream);
+#endif
+}
+
+/*
+ * Save the fast seek points to the index set up by file_set_seek_index()
+ * when the stream is closed, if save is TRUE.  This creates a file next
+ * to the capture file, so it's off unless the application turns it on.
+ */
+void
+file_set_seek_index_save(FILE_T stream, gboolean save)
+{
+    stream->index_save = save;
+}
+
+/*
+ * Hint that the file will be read sequentially, from start to end,
+ * and read it in chunks of at least "size" bytes.  This is for callers
+ * such as mergecap that read many files at once, so that we don't
+ * seek back and forth between them in little reads.
+ *
+ * If the buffers can't be enlarged, we just keep the ones we have.
+ */
+void
+file_set_read_ahead(FILE_T stream, guint size)
+{
+    guint8 *in_buf, *out_buf;
+    guint in_off, out_off;
+
+    /* Round up to a multiple of the page size; keep size << 1 in a guint */
+    size = (MIN(size, G_MAXUINT >> 2) + 4095) & ~4095U;
+
+#ifdef HAVE_POSIX_FADVISE
+    /* Let the OS read ahead further than it would otherwise */
+    (void)posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (size <= stream->size)
+        return;
+
+    /*
+     * The buffers may already hold data (from reading the file header),
+     * so keep the offsets of the data in them.  The inflate stream is
+     * pointed at the input buffer afresh on each read, so it doesn't
+     * keep pointers into it.
+     */
+    in_off = offset_in_buffer(&stream->in);
+    out_off = offset_in_buffer(&stream->out);
+    in_buf = (guint8 *)g_try_realloc(stream->in.buf, size);
+    if (in_buf == NULL)
+        return;
+    stream->in.buf = in_buf;
+    stream->in.next = in_buf + in_off;
+    out_buf = (guint8 *)g_try_realloc(stream->out.buf, ((gsize)size) << 1);
+    if (out_buf == NULL)
+        return;         /* the input buffer is just bigger than it needs to be */
+    stream->out.buf = out_buf;
+    stream->out.next = out_buf + out_off;
+    stream->size = size;
+}
+
+/*
+ * Map an uncompressed regular file into memory and read it from there,
+ * so that file_read_mapped() can hand out pointers into the file rather
+ * than copying it through our buffers.  The mapping covers the file as
+ * it is now; if it grows afterwards, we won't see the new data.
+ *
+ * Returns FALSE, and keeps reading the file as before, if it's
+ * compressed, isn't a regular file, or can't be mapped.
+ */
+gboolean
+file_map(FILE_T stream)
+{
+#ifdef HAVE_MMAP
+    ws_statb64 statb;
+    void *map;
+
+    if (stream->map != NULL)
+        return TRUE;
+    /* If nothing's been read yet, look at the header to see what we have */
+    if (stream->compression == UNKNOWN && !stream->seek_pending &&
+        stream->out.avail == 0)
+        (void)file_peekc(stream);
+    if (stream->fd == -1 || stream->compression != UNCOMPRESSED ||
+        stream->compression_type != WTAP_UNCOMPRESSED || stream->err != 0)
+        return FALSE;
+    if (ws_fstat64(stream->fd, &statb) == -1 || !S_ISREG(statb.st_mode) ||
+        statb.st_size <= 0 || (guint64)statb.st_size > G_MAXSIZE)
+        return FALSE;
+    map = mmap(NULL, (size_t)statb.st_size, PROT_READ, MAP_PRIVATE,
+               stream->fd, 0);
+    if (map == MAP_FAILED)
+        return FALSE;
+#ifdef MADV_SEQUENTIAL
+    if (!stream->random_access)
+        (void)madvise(map, (size_t)statb.st_size, MADV_SEQUENTIAL);
+#endif
+
+    /* Whatever is buffered or pending is now just a position in the map */
+    stream->pos = file_tell(stream);
+    stream->seek_pending = FALSE;
+    buf_reset(&stream->in);
+    buf_reset(&stream->out);
+    stream->map = (const guint8 *)map;
+    stream->map_len = statb.st_size;
+    stream->map_checked = MIN(stream->map_len, stream->pos + MAP_CHECK_SPAN);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/*
+ * If the stream is mapped and has "len" more bytes, return a pointer
+ * to them in the mapping and move past them; otherwise return NULL and
+ * leave the position alone, so the caller can fall back on file_read()
+ * to read them, or to get the short read.  The pointer is valid until
+ * the stream is closed.
+ */
+const guint8 *
+file_read_mapped(FILE_T file, unsigned int len)
+{
+    const guint8 *data;
+
+    if (file->map == NULL || file->err != 0 || map_avail(file, len) < len)
+        return NULL;
+    data = file->map + file->pos;
+    file->pos += len;
+    return data;
+}
+
 gint64
 file_seek(FILE_T file, gint64 offset, int whence, int *err)
 {
@@ -1079,6 +2511,20 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
 */
     }
 
+    if (file->map != NULL) {
+        /* Mapped; seeking is just arithmetic */
+        if (whence == SEEK_END)
+            offset += file->map_len;
+        else if (whence == SEEK_CUR)
+            offset += file->pos;
+        if (offset < 0) {
+            *err = EINVAL;
+            return -1;
+        }
+        file->pos = offset;
+        return offset;
+    }
+
     /* Normalize offset to a SEEK_CUR specification */
     if (whence == SEEK_END) {
         /* Seek relative to the end of the file; given that we might be
@@ -1169,6 +2615,20 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
         }
     }
 
+#ifdef HAVE_ZLIB
+    if (file->readahead != NULL && offset < 0) {
+        /*
+         * We're seeking backwards out of the chunk we got from the
+         * decompression thread.  Stop it, which leaves us where it
+         * had got to, and seek from there.
+         */
+        gint64 target = file->pos + offset;
+
+        readahead_finish(file);
+        offset = target - file->pos;
+    }
+#endif
+
     /*
      * We're not seeking within the buffer.  Do we have "fast seek" data
      * for the location to which we will be seeking, and is the offset
@@ -1177,7 +2637,8 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
      *
      * XXX, profile
      */
-    if ((here = fast_seek_find(file, file->pos + offset)) &&
+    if (file->readahead == NULL &&
+        (here = fast_seek_find(file, file->pos + offset)) &&
         (offset < 0 || offset > SPAN || here->compression == UNCOMPRESSED)) {
         gint64 off, off2;
 
@@ -1187,6 +2648,10 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
          * has been called on this file, which should never be the case
          * for a pipe.
          */
+        if (is_frame_start(here->compression)) {
+            off = here->in;
+            off2 = here->out;
+        } else
 #ifdef HAVE_ZLIB
         if (here->compression == ZLIB) {
 #ifdef HAVE_INFLATEPRIME
@@ -1212,6 +2677,7 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
         fast_seek_reset(file);
 
         file->raw_pos = off;
+        file->seq_fills = 0;
         buf_reset(&file->out);
         file->eof = FALSE;
         file->seek_pending = FALSE;
@@ -1252,6 +2718,9 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             file->compression = ZLIB;
         } else
 #endif
+        if (is_frame_start(here->compression))
+            file->compression = UNKNOWN;    /* gz_head() sets up the decoder */
+        else
             file->compression = here->compression;
 
         offset = (file->pos + offset) - off2;
@@ -1290,6 +2759,7 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             return -1;
         }
         file->raw_pos += (offset - file->out.avail);
+        file->seq_fills = 0;
         buf_reset(&file->out);
         file->eof = FALSE;
         file->seek_pending = FALSE;
@@ -1325,6 +2795,7 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
         }
         fast_seek_reset(file);
         file->raw_pos = file->start;
+        file->seq_fills = 0;
         gz_reset(file);
     }
 
@@ -1361,6 +2832,12 @@ file_tell(FILE_T stream)
 gint64
 file_tell_raw(FILE_T stream)
 {
+#ifdef HAVE_ZLIB
+    if (stream->readahead != NULL)
+        return stream->readahead->raw_pos;
+#endif
+    if (stream->map != NULL)
+        return stream->pos;
     return stream->raw_pos;
 }
 
@@ -1378,7 +2855,13 @@ file_fstat(FILE_T stream, ws_statb64 *statb, int *err)
 gboolean
 file_iscompressed(FILE_T stream)
 {
-    return stream->is_compressed;
+    return stream->compression_type != WTAP_UNCOMPRESSED;
+}
+
+wtap_compression_type
+file_get_compression_type(FILE_T stream)
+{
+    return stream->compression_type;
 }
 
 int
@@ -1390,6 +2873,19 @@ file_read(void *buf, unsigned int len, FILE_T file)
     if (len == 0)
         return 0;
 
+    if (file->map != NULL) {
+        gint64 avail;
+
+        if (file->err != 0)
+            return -1;
+        avail = map_avail(file, len);
+        got = avail < len ? (guint)avail : len;
+        if (buf != NULL)
+            memcpy(buf, file->map + file->pos, got);
+        file->pos += got;
+        return (int)got;
+    }
+
     /* process a skip request */
     if (file->seek_pending) {
         file->seek_pending = FALSE;
@@ -1442,6 +2938,47 @@ file_read(void *buf, unsigned int len, FILE_T file)
     return (int)got;
 }
 
+/*
+ * Skip len bytes, as file_read(NULL, len, file) would.  If the file is
+ * uncompressed and more than a buffer's worth of the skip lies beyond
+ * what we've already read, seek past that part rather than reading it.
+ *
+ * Returns the number of bytes skipped, which is less than len only at
+ * the end of the file, or -1 on an error.
+ */
+int
+file_skip(unsigned int len, FILE_T file)
+{
+    ws_statb64 statb;
+    gint64 beyond, left;
+
+    if (file->map != NULL || file->seek_pending || file->err != 0 ||
+        file->compression != UNCOMPRESSED || file->fd == -1 ||
+        len <= file->out.avail || len - file->out.avail < file->size)
+        return file_read(NULL, len, file);
+
+    /*
+     * Don't seek past the end of the file, so that a record cut short
+     * is still reported as a short read.
+     */
+    if (ws_fstat64(file->fd, &statb) == -1 || !S_ISREG(statb.st_mode))
+        return file_read(NULL, len, file);
+    beyond = len - file->out.avail;
+    left = statb.st_size - file->raw_pos;
+    if (beyond > left)
+        beyond = left > 0 ? left : 0;
+    if (ws_lseek64(file->fd, beyond, SEEK_CUR) == -1) {
+        file->err = errno;
+        file->err_info = NULL;
+        return -1;
+    }
+    file->raw_pos += beyond;
+    file->pos += file->out.avail + beyond;
+    len = file->out.avail + (unsigned int)beyond;
+    buf_reset(&file->out);
+    return (int)len;
+}
+
 /*
  * XXX - this *peeks* at next byte, not a character.
  */
@@ -1454,6 +2991,9 @@ file_peekc(FILE_T file)
     if (file->err != 0)
         return -1;
 
+    if (file->map != NULL)
+        return map_avail(file, 1) != 0 ? file->map[file->pos] : -1;
+
     /* try output buffer (no need to check for skip request) */
     if (file->out.avail != 0) {
         return *(file->out.next);
@@ -1502,6 +3042,9 @@ file_getc(FILE_T file)
     if (file->err != 0)
         return -1;
 
+    if (file->map != NULL)
+        return map_avail(file, 1) != 0 ? file->map[file->pos++] : -1;
+
     /* try output buffer (no need to check for skip request) */
     if (file->out.avail != 0) {
         file->out.avail--;
@@ -1529,6 +3072,22 @@ file_getsp(char *buf, int len, FILE_T file)
     if (file->err != 0)
         return NULL;
 
+    if (file->map != NULL) {
+        /* copy straight from the mapping, the same way as below */
+        gint64 avail = map_avail(file, len - 1);
+
+        if (avail == 0)
+            return NULL;
+        n = avail < len - 1 ? (guint)avail : (guint)len - 1;
+        eol = (unsigned char *)memchr(file->map + file->pos, '\n', n);
+        if (eol != NULL)
+            n = (unsigned)(eol - (file->map + file->pos)) + 1;
+        memcpy(buf, file->map + file->pos, n);
+        file->pos += n;
+        buf[n] = 0;
+        return buf + n;
+    }
+
     /* process a skip request */
     if (file->seek_pending) {
         file->seek_pending = FALSE;
@@ -1594,6 +3153,8 @@ int
 file_eof(FILE_T file)
 {
     /* return end-of-file state */
+    if (file->map != NULL)
+        return map_avail(file, 1) == 0;
     return (file->eof && file->in.avail == 0 && file->out.avail == 0);
 }
 
@@ -1624,6 +3185,11 @@ file_clearerr(FILE_T stream)
 void
 file_fdclose(FILE_T file)
 {
+#ifdef HAVE_ZLIB
+    /* The chunks already decompressed can still be read */
+    if (file->readahead != NULL)
+        readahead_stop(file->readahead);
+#endif
     ws_close(file->fd);
     file->fd = -1;
 }
@@ -1644,6 +3210,16 @@ file_close(FILE_T file)
 {
     int fd = file->fd;
 
+#ifdef HAVE_ZLIB
+    if (file->readahead != NULL)
+        readahead_finish(file);
+    if (file->index_path != NULL) {
+        if (fd != -1 && file->index_save &&
+            file->compression_type != WTAP_UNCOMPRESSED)
+            seek_index_save(file);
+        g_free(file->index_path);
+    }
+#endif
     /* free memory and close file */
     if (file->size) {
 #ifdef HAVE_ZLIB
@@ -1653,6 +3229,18 @@ file_close(FILE_T file)
         g_free(file->in.buf);
     }
     g_free(file->fast_seek_cur);
+#ifdef HAVE_ZSTD
+    if (file->zstd_dstream != NULL)
+        ZSTD_freeDStream(file->zstd_dstream);
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    if (file->lz4_dctx != NULL)
+        LZ4F_freeDecompressionContext(file->lz4_dctx);
+#endif
+#ifdef HAVE_MMAP
+    if (file->map != NULL)
+        munmap((void *)file->map, (size_t)file->map_len);
+#endif
     file->err = 0;
     file->err_info = NULL;
     g_free(file);
@@ -1950,6 +3538,375 @@ gzwfile_geterr(GZWFILE_T state)
 }
 #endif
 
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4FRAME_H)
+/*
+ * Zstandard and LZ4 files are written as a series of frames, each
+ * holding at most FRAME_WRITE_SIZE bytes of uncompressed data.  When
+ * reading, we can start decompressing at the beginning of any frame,
+ * so this bounds how much we have to decompress to seek.
+ */
+#define FRAME_WRITE_SIZE    (8 * 1024 * 1024)
+
+/* Write out len bytes of compressed data.  Return -1, and set *err,
+   on failure; return 0 on success. */
+static int
+frame_write(int fd, const void *buf, size_t len, int *err)
+{
+    ssize_t got;
+
+    if (len == 0)
+        return 0;
+    got = ws_write(fd, buf, (unsigned int)len);
+    if (got < 0) {
+        *err = errno;
+        return -1;
+    }
+    if ((size_t)got != len) {
+        *err = WTAP_ERR_SHORT_WRITE;
+        return -1;
+    }
+    return 0;
+}
+#endif /* HAVE_ZSTD || HAVE_LZ4FRAME_H */
+
+#ifdef HAVE_ZSTD
+#ifndef ZSTD_CLEVEL_DEFAULT
+#define ZSTD_CLEVEL_DEFAULT 3
+#endif
+
+/* Size of the jobs handed to libzstd's worker threads */
+#define ZSTD_WRITE_JOB_SIZE (1024 * 1024)
+
+/* internal Zstandard file state data structure for writing */
+struct zstd_writer {
+    int fd;                 /* file descriptor */
+    ZSTD_CStream *cstream;  /* compression stream */
+    guint8 *out;            /* output buffer */
+    size_t out_size;        /* size of output buffer */
+    gboolean in_frame;      /* TRUE if we've started a frame */
+    size_t frame_len;       /* uncompressed data in the current frame */
+    int err;                /* error code */
+};
+
+ZSTDWFILE_T
+zstdwfile_open(const char *path)
+{
+    int fd;
+    ZSTDWFILE_T state;
+    int save_errno;
+
+    fd = ws_open(path, O_BINARY|O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd == -1)
+        return NULL;
+    state = zstdwfile_fdopen(fd);
+    if (state == NULL) {
+        save_errno = errno;
+        ws_close(fd);
+        errno = save_errno;
+    }
+    return state;
+}
+
+ZSTDWFILE_T
+zstdwfile_fdopen(int fd)
+{
+    ZSTDWFILE_T state;
+
+    state = g_new0(struct zstd_writer, 1);
+    state->fd = fd;
+    state->cstream = ZSTD_createCStream();
+    if (state->cstream == NULL) {
+        g_free(state);
+        errno = ENOMEM;
+        return NULL;
+    }
+#if ZSTD_VERSION_NUMBER >= 10400
+    {
+#if GLIB_CHECK_VERSION(2,36,0)
+        int nworkers = (int)g_get_num_processors();
+#else
+        int nworkers = 4;
+#endif
+        /*
+         * Compress in worker threads, in jobs small enough that each
+         * frame is spread over several of them.  Setting the number
+         * of workers fails if libzstd was built without threads, in
+         * which case we compress in this thread.
+         */
+        if (!ZSTD_isError(ZSTD_CCtx_setParameter(state->cstream, ZSTD_c_nbWorkers, nworkers)))
+            (void)ZSTD_CCtx_setParameter(state->cstream, ZSTD_c_jobSize, ZSTD_WRITE_JOB_SIZE);
+    }
+#endif
+    state->out_size = ZSTD_CStreamOutSize();
+    state->out = (guint8 *)g_malloc(state->out_size);
+    return state;
+}
+
+/* Run the compressor with "op" (0 to compress input, 1 to flush, 2 to end
+   the frame) until it's done.  Return -1, and set state->err, on failure;
+   return 0 on success. */
+static int
+zstd_comp(ZSTDWFILE_T state, ZSTD_inBuffer *input, int op)
+{
+    ZSTD_outBuffer output;
+    size_t ret;
+
+    do {
+        output.dst = state->out;
+        output.size = state->out_size;
+        output.pos = 0;
+        if (op == 0)
+            ret = ZSTD_compressStream(state->cstream, &output, input);
+        else if (op == 1)
+            ret = ZSTD_flushStream(state->cstream, &output);
+        else
+            ret = ZSTD_endStream(state->cstream, &output);
+        if (ZSTD_isError(ret)) {
+            /* This "shouldn't happen". */
+            state->err = WTAP_ERR_INTERNAL;
+            return -1;
+        }
+        if (frame_write(state->fd, state->out, output.pos, &state->err) == -1)
+            return -1;
+    } while (op == 0 ? input->pos < input->size : ret != 0);
+    return 0;
+}
+
+/* Write out len bytes from buf.  Return 0, and set state->err, on
+   failure or on an attempt to write 0 bytes (in which case state->err
+   is 0); return the number of bytes written on success. */
+guint
+zstdwfile_write(ZSTDWFILE_T state, const void *buf, guint len)
+{
+    ZSTD_inBuffer input;
+    guint put = len;
+    size_t n;
+
+    if (state->err != 0 || len == 0)
+        return 0;
+
+    while (len != 0) {
+        if (!state->in_frame) {
+            if (ZSTD_isError(ZSTD_initCStream(state->cstream, ZSTD_CLEVEL_DEFAULT))) {
+                state->err = WTAP_ERR_INTERNAL;
+                return 0;
+            }
+            state->in_frame = TRUE;
+            state->frame_len = 0;
+        }
+        n = MIN(len, FRAME_WRITE_SIZE - state->frame_len);
+        input.src = buf;
+        input.size = n;
+        input.pos = 0;
+        if (zstd_comp(state, &input, 0) == -1)
+            return 0;
+        buf = (const guint8 *)buf + n;
+        len -= (guint)n;
+        state->frame_len += n;
+        if (state->frame_len == FRAME_WRITE_SIZE) {
+            if (zstd_comp(state, NULL, 2) == -1)
+                return 0;
+            state->in_frame = FALSE;
+        }
+    }
+    return put;
+}
+
+/* Flush out what we've written so far.  Returns -1, and sets state->err,
+   on failure; returns 0 on success. */
+int
+zstdwfile_flush(ZSTDWFILE_T state)
+{
+    if (state->err != 0)
+        return -1;
+    if (state->in_frame && zstd_comp(state, NULL, 1) == -1)
+        return -1;
+    return 0;
+}
+
+/* Flush out all data written, and close the file.  Returns a Wiretap
+   error on failure; returns 0 on success. */
+int
+zstdwfile_close(ZSTDWFILE_T state)
+{
+    int ret = 0;
+
+    if (state->err != 0)
+        ret = state->err;
+    else if (state->in_frame && zstd_comp(state, NULL, 2) == -1)
+        ret = state->err;
+    ZSTD_freeCStream(state->cstream);
+    g_free(state->out);
+    if (ws_close(state->fd) == -1 && ret == 0)
+        ret = errno;
+    g_free(state);
+    return ret;
+}
+
+int
+zstdwfile_geterr(ZSTDWFILE_T state)
+{
+    return state->err;
+}
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4FRAME_H
+/* Most uncompressed data we hand LZ4F_compressUpdate() at once */
+#define LZ4_WRITE_CHUNK     (64 * 1024)
+
+/* internal LZ4 file state data structure for writing */
+struct lz4_writer {
+    int fd;                 /* file descriptor */
+    LZ4F_cctx *cctx;        /* compression context */
+    LZ4F_preferences_t prefs; /* frame parameters */
+    guint8 *out;            /* output buffer */
+    size_t out_size;        /* size of output buffer */
+    gboolean in_frame;      /* TRUE if we've started a frame */
+    size_t frame_len;       /* uncompressed data in the current frame */
+    int err;                /* error code */
+};
+
+LZ4WFILE_T
+lz4wfile_open(const char *path)
+{
+    int fd;
+    LZ4WFILE_T state;
+    int save_errno;
+
+    fd = ws_open(path, O_BINARY|O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd == -1)
+        return NULL;
+    state = lz4wfile_fdopen(fd);
+    if (state == NULL) {
+        save_errno = errno;
+        ws_close(fd);
+        errno = save_errno;
+    }
+    return state;
+}
+
+LZ4WFILE_T
+lz4wfile_fdopen(int fd)
+{
+    LZ4WFILE_T state;
+
+    state = g_new0(struct lz4_writer, 1);
+    state->fd = fd;
+    if (LZ4F_isError(LZ4F_createCompressionContext(&state->cctx, LZ4F_VERSION))) {
+        g_free(state);
+        errno = ENOMEM;
+        return NULL;
+    }
+    state->prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    /* Room for the frame header, or for compressing a chunk and ending the frame */
+    state->out_size = LZ4F_compressBound(LZ4_WRITE_CHUNK, &state->prefs);
+    state->out = (guint8 *)g_malloc(state->out_size);
+    return state;
+}
+
+/* Finish off the current frame.  Return -1, and set state->err, on
+   failure; return 0 on success. */
+static int
+lz4_end_frame(LZ4WFILE_T state)
+{
+    size_t ret;
+
+    ret = LZ4F_compressEnd(state->cctx, state->out, state->out_size, NULL);
+    if (LZ4F_isError(ret)) {
+        /* This "shouldn't happen". */
+        state->err = WTAP_ERR_INTERNAL;
+        return -1;
+    }
+    state->in_frame = FALSE;
+    return frame_write(state->fd, state->out, ret, &state->err);
+}
+
+/* Write out len bytes from buf.  Return 0, and set state->err, on
+   failure or on an attempt to write 0 bytes (in which case state->err
+   is 0); return the number of bytes written on success. */
+guint
+lz4wfile_write(LZ4WFILE_T state, const void *buf, guint len)
+{
+    guint put = len;
+    size_t n, ret;
+
+    if (state->err != 0 || len == 0)
+        return 0;
+
+    while (len != 0) {
+        if (!state->in_frame) {
+            ret = LZ4F_compressBegin(state->cctx, state->out, state->out_size, &state->prefs);
+            if (LZ4F_isError(ret)) {
+                state->err = WTAP_ERR_INTERNAL;
+                return 0;
+            }
+            if (frame_write(state->fd, state->out, ret, &state->err) == -1)
+                return 0;
+            state->in_frame = TRUE;
+            state->frame_len = 0;
+        }
+        n = MIN(MIN(len, LZ4_WRITE_CHUNK), FRAME_WRITE_SIZE - state->frame_len);
+        ret = LZ4F_compressUpdate(state->cctx, state->out, state->out_size, buf, n, NULL);
+        if (LZ4F_isError(ret)) {
+            state->err = WTAP_ERR_INTERNAL;
+            return 0;
+        }
+        if (frame_write(state->fd, state->out, ret, &state->err) == -1)
+            return 0;
+        buf = (const guint8 *)buf + n;
+        len -= (guint)n;
+        state->frame_len += n;
+        if (state->frame_len == FRAME_WRITE_SIZE && lz4_end_frame(state) == -1)
+            return 0;
+    }
+    return put;
+}
+
+/* Flush out what we've written so far.  Returns -1, and sets state->err,
+   on failure; returns 0 on success. */
+int
+lz4wfile_flush(LZ4WFILE_T state)
+{
+    size_t ret;
+
+    if (state->err != 0)
+        return -1;
+    if (!state->in_frame)
+        return 0;
+    ret = LZ4F_flush(state->cctx, state->out, state->out_size, NULL);
+    if (LZ4F_isError(ret)) {
+        state->err = WTAP_ERR_INTERNAL;
+        return -1;
+    }
+    return frame_write(state->fd, state->out, ret, &state->err);
+}
+
+/* Flush out all data written, and close the file.  Returns a Wiretap
+   error on failure; returns 0 on success. */
+int
+lz4wfile_close(LZ4WFILE_T state)
+{
+    int ret = 0;
+
+    if (state->err != 0)
+        ret = state->err;
+    else if (state->in_frame && lz4_end_frame(state) == -1)
+        ret = state->err;
+    LZ4F_freeCompressionContext(state->cctx);
+    g_free(state->out);
+    if (ws_close(state->fd) == -1 && ret == 0)
+        ret = errno;
+    g_free(state);
+    return ret;
+}
+
+int
+lz4wfile_geterr(LZ4WFILE_T state)
+{
+    return state->err;
+}
+#endif /* HAVE_LZ4FRAME_H */
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
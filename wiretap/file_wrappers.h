@@ -17,12 +17,19 @@
 extern FILE_T file_open(const char *path);
 extern FILE_T file_fdopen(int fildes);
 extern void file_set_random_access(FILE_T stream, gboolean random_flag, GPtrArray *seek);
+extern void file_set_seek_index(FILE_T stream, const char *path);
+extern void file_set_seek_index_save(FILE_T stream, gboolean save);
+extern void file_set_read_ahead(FILE_T stream, guint size);
+extern gboolean file_map(FILE_T stream);
+extern const guint8 *file_read_mapped(FILE_T file, unsigned int len);
 WS_DLL_PUBLIC gint64 file_seek(FILE_T stream, gint64 offset, int whence, int *err);
 WS_DLL_PUBLIC gint64 file_tell(FILE_T stream);
 extern gint64 file_tell_raw(FILE_T stream);
 extern int file_fstat(FILE_T stream, ws_statb64 *statb, int *err);
 WS_DLL_PUBLIC gboolean file_iscompressed(FILE_T stream);
+extern wtap_compression_type file_get_compression_type(FILE_T stream);
 WS_DLL_PUBLIC int file_read(void *buf, unsigned int count, FILE_T file);
+extern int file_skip(unsigned int count, FILE_T file);
 WS_DLL_PUBLIC int file_peekc(FILE_T stream);
 WS_DLL_PUBLIC int file_getc(FILE_T stream);
 WS_DLL_PUBLIC char *file_gets(char *buf, int len, FILE_T stream);
@@ -45,4 +52,26 @@ extern int gzwfile_close(GZWFILE_T state);
 extern int gzwfile_geterr(GZWFILE_T state);
 #endif /* HAVE_ZLIB */
 
+#ifdef HAVE_ZSTD
+typedef struct zstd_writer *ZSTDWFILE_T;
+
+extern ZSTDWFILE_T zstdwfile_open(const char *path);
+extern ZSTDWFILE_T zstdwfile_fdopen(int fd);
+extern guint zstdwfile_write(ZSTDWFILE_T state, const void *buf, guint len);
+extern int zstdwfile_flush(ZSTDWFILE_T state);
+extern int zstdwfile_close(ZSTDWFILE_T state);
+extern int zstdwfile_geterr(ZSTDWFILE_T state);
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4FRAME_H
+typedef struct lz4_writer *LZ4WFILE_T;
+
+extern LZ4WFILE_T lz4wfile_open(const char *path);
+extern LZ4WFILE_T lz4wfile_fdopen(int fd);
+extern guint lz4wfile_write(LZ4WFILE_T state, const void *buf, guint len);
+extern int lz4wfile_flush(LZ4WFILE_T state);
+extern int lz4wfile_close(LZ4WFILE_T state);
+extern int lz4wfile_geterr(LZ4WFILE_T state);
+#endif /* HAVE_LZ4FRAME_H */
+
 #endif /* __FILE_H__ */
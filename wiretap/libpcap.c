@@ -853,13 +853,20 @@ libpcap_read_packet(wtap *wth, FILE_T fh, wtap_rec *rec,
 	rec->rec_header.packet_header.len = orig_size;
 
 	/*
-	 * Read the packet data.
+	 * Read the packet data, or, if our caller doesn't want it when
+	 * reading sequentially, skip over it.
 	 */
-	if (!wtap_read_packet_bytes(fh, buf, packet_size, err, err_info))
-		return FALSE;	/* failed */
+	if (wth->skip_packet_data && fh == wth->fh) {
+		if (!wtap_skip_packet_bytes(fh, packet_size, err, err_info))
+			return FALSE;	/* failed */
+		buf = NULL;
+	} else {
+		if (!wtap_read_packet_bytes(fh, buf, packet_size, err, err_info))
+			return FALSE;	/* failed */
+	}
 
 	pcap_read_post_process(wth->file_type_subtype, wth->file_encap,
-	    rec, ws_buffer_start_ptr(buf), libpcap->byte_swapped, -1);
+	    rec, buf, libpcap->byte_swapped, -1);
 	return TRUE;
 }
 
@@ -26,6 +26,7 @@
 #include "wtap_opttypes.h"
 #include "pcapng.h"
 #include "wtap-int.h"
+#include "file_wrappers.h"
 
 #include <wsutil/filesystem.h>
 #include "wsutil/os_version_info.h"
@@ -37,6 +38,16 @@
 #define merge_debug(...)
 #endif
 
+/*
+ * All the input files are read at once, so give each of them a read
+ * buffer bigger than the default, and ask the OS to read ahead, so
+ * that we don't keep seeking from file to file on a spinning disk.
+ * The buffers of all files together take up to three times
+ * MERGE_READ_AHEAD_BUDGET.
+ */
+#define MERGE_READ_AHEAD_BUDGET (64 * 1024 * 1024)
+#define MERGE_READ_AHEAD_MAX    (1024 * 1024)
+
 
 static const char* idb_merge_mode_strings[] = {
     /* IDB_MERGE_MODE_NONE */
@@ -122,6 +133,7 @@ merge_open_in_files(guint in_file_count, const char *const *in_file_names,
     size_t files_size = in_file_count * sizeof(merge_in_file_t);
     merge_in_file_t *files;
     gint64 size;
+    guint read_ahead = MIN(MERGE_READ_AHEAD_BUDGET / in_file_count, MERGE_READ_AHEAD_MAX);
 
     files = (merge_in_file_t *)g_malloc0(files_size);
     *out_files = NULL;
@@ -148,6 +160,7 @@ merge_open_in_files(guint in_file_count, const char *const *in_file_names,
             *err_fileno = i;
             return FALSE;
         }
+        file_set_read_ahead(files[i].wth->fh, read_ahead);
         wtap_rec_init(&files[i].rec);
         ws_buffer_init(&files[i].frame_buffer, 1514);
         files[i].size = size;
@@ -210,7 +223,7 @@ merge_select_frame_type(int in_file_count, merge_in_file_t in_files[])
  * returns TRUE if first argument is earlier than second
  */
 static gboolean
-is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
+is_earlier(const nstime_t *l, const nstime_t *r) /* XXX, move to nstime.c */
 {
     if (l->secs > r->secs) {  /* left is later */
         return FALSE;
@@ -225,6 +238,103 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
     return TRUE;
 }
 
+/*
+ * The input files that have a record ready, kept as a binary min-heap
+ * ordered by the time stamp of that record, so that finding the next
+ * record to write takes O(log n) rather than O(n) for n input files.
+ */
+typedef struct {
+    guint   *files;     /* indices into in_files[] */
+    guint    count;     /* number of files in the heap */
+    gboolean primed;    /* TRUE once every file has been read from */
+} merge_heap_t;
+
+/*
+ * Returns TRUE if the record from in_files[a] is to be written before
+ * the one from in_files[b].
+ *
+ * Records with no time stamp are treated as earlier than all other
+ * records, and are taken in file order.  Yes, this means you won't get
+ * a chronological merge of those records, but you obviously *can't*
+ * get that.  Of records with the same time stamp, the one from the
+ * file that's later in the list is taken first.
+ */
+static gboolean
+merge_heap_before(const merge_in_file_t in_files[], guint a, guint b)
+{
+    const wtap_rec *ra = &in_files[a].rec;
+    const wtap_rec *rb = &in_files[b].rec;
+
+    if (!(ra->presence_flags & WTAP_HAS_TS)) {
+        if (!(rb->presence_flags & WTAP_HAS_TS))
+            return a < b;
+        return TRUE;
+    }
+    if (!(rb->presence_flags & WTAP_HAS_TS))
+        return FALSE;
+    if (ra->ts.secs == rb->ts.secs && ra->ts.nsecs == rb->ts.nsecs)
+        return a > b;
+    return is_earlier(&ra->ts, &rb->ts);
+}
+
+static void
+merge_heap_sift_down(merge_heap_t *heap, const merge_in_file_t in_files[], guint pos)
+{
+    guint file = heap->files[pos];
+
+    for (;;) {
+        guint child = 2 * pos + 1;
+
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+            merge_heap_before(in_files, heap->files[child + 1], heap->files[child]))
+            child++;
+        if (!merge_heap_before(in_files, heap->files[child], file))
+            break;
+        heap->files[pos] = heap->files[child];
+        pos = child;
+    }
+    heap->files[pos] = file;
+}
+
+static void
+merge_heap_push(merge_heap_t *heap, const merge_in_file_t in_files[], guint file)
+{
+    guint pos = heap->count++;
+
+    while (pos > 0) {
+        guint parent = (pos - 1) / 2;
+
+        if (!merge_heap_before(in_files, file, heap->files[parent]))
+            break;
+        heap->files[pos] = heap->files[parent];
+        pos = parent;
+    }
+    heap->files[pos] = file;
+}
+
+/*
+ * Read the next record from a file and update its state.
+ * Returns FALSE, with *err set, on a read error.
+ */
+static gboolean
+merge_read_record(merge_in_file_t *in_file, int *err, gchar **err_info)
+{
+    gint64 data_offset;
+
+    if (!wtap_read(in_file->wth, &in_file->rec, &in_file->frame_buffer,
+                   err, err_info, &data_offset)) {
+        if (*err != 0) {
+            in_file->state = GOT_ERROR;
+            return FALSE;
+        }
+        in_file->state = AT_EOF;
+    } else
+        in_file->state = RECORD_PRESENT;
+    return TRUE;
+}
+
 /** Read the next packet, in chronological order, from the set of files to
  * be merged.
  *
@@ -239,6 +349,7 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  *
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
+ * @param heap heap of the files with a record available, initially empty
  * @param err wiretap error, if failed
  * @param err_info wiretap error string, if failed
  * @return pointer to merge_in_file_t for file from which that packet
@@ -247,67 +358,45 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  */
 static merge_in_file_t *
 merge_read_packet(int in_file_count, merge_in_file_t in_files[],
-                  int *err, gchar **err_info)
+                  merge_heap_t *heap, int *err, gchar **err_info)
 {
-    int i;
-    int ei = -1;
-    nstime_t tv = NSTIME_INIT_MAX;
-    wtap_rec *rec;
+    guint ei;
 
-    /*
-     * Make sure we have a record available from each file that's not at
-     * EOF, and search for the record with the earliest time stamp or
-     * with no time stamp (those records are treated as earlier than
-     * all other records).  Yes, this means you won't get a chronological
-     * merge of those records, but you obviously *can't* get that.
-     */
-    for (i = 0; i < in_file_count; i++) {
-        gint64 data_offset;
-
-        if (in_files[i].state == RECORD_NOT_PRESENT) {
-            /*
-             * No packet available, and we haven't seen an error or EOF yet,
-             * so try to read the next packet.
-             */
-            if (!wtap_read(in_files[i].wth, &in_files[i].rec,
-                           &in_files[i].frame_buffer, err, err_info,
-                           &data_offset)) {
-                if (*err != 0) {
-                    in_files[i].state = GOT_ERROR;
-                    return &in_files[i];
-                }
-                in_files[i].state = AT_EOF;
-            } else
-                in_files[i].state = RECORD_PRESENT;
-        }
-
-        if (in_files[i].state == RECORD_PRESENT) {
-            rec = &in_files[i].rec;
-            if (!(rec->presence_flags & WTAP_HAS_TS)) {
-                /*
-                 * No time stamp.  Pick this record, and stop looking.
-                 */
-                ei = i;
-                break;
-            }
-            if (is_earlier(&rec->ts, &tv)) {
-                /*
-                 * This record's time stamp is earlier than any of the
-                 * records we've seen so far.  Pick it, for now, but
-                 * keep looking.
-                 */
-                tv = rec->ts;
-                ei = i;
-            }
+    if (!heap->primed) {
+        /*
+         * Get the first record from each file.  A read error ends
+         * the merge, so we needn't be able to resume after one.
+         */
+        heap->primed = TRUE;
+        for (ei = 0; ei < (guint)in_file_count; ei++) {
+            if (!merge_read_record(&in_files[ei], err, err_info))
+                return &in_files[ei];
+            if (in_files[ei].state == RECORD_PRESENT)
+                merge_heap_push(heap, in_files, ei);
         }
+    } else if (heap->count > 0 &&
+               in_files[heap->files[0]].state == RECORD_NOT_PRESENT) {
+        /*
+         * We handed out the record of the file at the top of the heap
+         * last time; replace it with that file's next record.
+         */
+        ei = heap->files[0];
+        if (!merge_read_record(&in_files[ei], err, err_info))
+            return &in_files[ei];
+        if (in_files[ei].state != RECORD_PRESENT)
+            heap->files[0] = heap->files[--heap->count];
+        if (heap->count > 0)
+            merge_heap_sift_down(heap, in_files, 0);
     }
 
-    if (ei == -1) {
+    if (heap->count == 0) {
         /* All the streams are at EOF.  Return an EOF indication. */
         *err = 0;
         return NULL;
     }
 
+    ei = heap->files[0];
+
     /* We'll need to read another packet from this file. */
     in_files[ei].state = RECORD_NOT_PRESENT;
 
@@ -851,6 +940,11 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
     int                 count = 0;
     gboolean            stop_flag = FALSE;
     wtap_rec *rec,      snap_rec;
+    merge_heap_t        heap;
+
+    heap.files = do_append ? NULL : g_new(guint, in_file_count);
+    heap.count = 0;
+    heap.primed = FALSE;
 
     for (;;) {
         *err = 0;
@@ -860,8 +954,8 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
                                                err_info);
         }
         else {
-            in_file = merge_read_packet(in_file_count, in_files, err,
-                                        err_info);
+            in_file = merge_read_packet(in_file_count, in_files, &heap,
+                                        err, err_info);
         }
 
         if (in_file == NULL) {
@@ -942,6 +1036,8 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
         }
     }
 
+    g_free(heap.files);
+
     if (cb)
         cb->callback_func(MERGE_EVENT_DONE, count, in_files, in_file_count, cb->data);
 
@@ -979,7 +1075,9 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
 static merge_result
 merge_files_common(const gchar* out_filename, /* normal output mode */
                    gchar **out_filenamep, const char *pfx, /* tempfile mode  */
-                   const int file_type, const char *const *in_filenames,
+                   const int file_type,
+                   const wtap_compression_type compression_type,
+                   const char *const *in_filenames,
                    const guint in_file_count, const gboolean do_append,
                    const idb_merge_mode mode, guint snaplen,
                    const gchar *app_name, merge_progress_callback_t* cb,
@@ -1050,12 +1148,12 @@ merge_files_common(const gchar* out_filename, /* normal output mode */
         params.dsbs_growing = dsb_combined;
     }
     if (out_filename) {
-        pdh = wtap_dump_open(out_filename, file_type, WTAP_UNCOMPRESSED, &params, err);
+        pdh = wtap_dump_open(out_filename, file_type, compression_type, &params, err);
     } else if (out_filenamep) {
         pdh = wtap_dump_open_tempfile(out_filenamep, pfx, file_type,
-                                      WTAP_UNCOMPRESSED, &params, err);
+                                      compression_type, &params, err);
     } else {
-        pdh = wtap_dump_open_stdout(file_type, WTAP_UNCOMPRESSED, &params, err);
+        pdh = wtap_dump_open_stdout(file_type, compression_type, &params, err);
     }
     if (pdh == NULL) {
         merge_close_in_files(in_file_count, in_files);
@@ -1093,6 +1191,7 @@ merge_files_common(const gchar* out_filename, /* normal output mode */
  */
 merge_result
 merge_files(const gchar* out_filename, const int file_type,
+            const wtap_compression_type compression_type,
             const char *const *in_filenames, const guint in_file_count,
             const gboolean do_append, const idb_merge_mode mode,
             guint snaplen, const gchar *app_name, merge_progress_callback_t* cb,
@@ -1102,7 +1201,7 @@ merge_files(const gchar* out_filename, const int file_type,
     g_assert(out_filename != NULL);
 
     return merge_files_common(out_filename, NULL, NULL,
-                              file_type, in_filenames, in_file_count,
+                              file_type, compression_type, in_filenames, in_file_count,
                               do_append, mode, snaplen, app_name, cb, err,
                               err_info, err_fileno, err_framenum);
 }
@@ -1127,7 +1226,7 @@ merge_files_to_tempfile(gchar **out_filenamep, const char *pfx,
     *out_filenamep = NULL;
 
     return merge_files_common(NULL, out_filenamep, pfx,
-                              file_type, in_filenames, in_file_count,
+                              file_type, WTAP_UNCOMPRESSED, in_filenames, in_file_count,
                               do_append, mode, snaplen, app_name, cb, err,
                               err_info, err_fileno, err_framenum);
 }
@@ -1138,7 +1237,9 @@ merge_files_to_tempfile(gchar **out_filenamep, const char *pfx,
  * on failure.
  */
 merge_result
-merge_files_to_stdout(const int file_type, const char *const *in_filenames,
+merge_files_to_stdout(const int file_type,
+                      const wtap_compression_type compression_type,
+                      const char *const *in_filenames,
                       const guint in_file_count, const gboolean do_append,
                       const idb_merge_mode mode, guint snaplen,
                       const gchar *app_name, merge_progress_callback_t* cb,
@@ -1146,7 +1247,7 @@ merge_files_to_stdout(const int file_type, const char *const *in_filenames,
                       guint32 *err_framenum)
 {
     return merge_files_common(NULL, NULL, NULL,
-                              file_type, in_filenames, in_file_count,
+                              file_type, compression_type, in_filenames, in_file_count,
                               do_append, mode, snaplen, app_name, cb, err,
                               err_info, err_fileno, err_framenum);
 }
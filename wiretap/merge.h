@@ -117,6 +117,7 @@ typedef struct {
  *
  * @param out_filename The output filename
  * @param file_type The WTAP_FILE_TYPE_SUBTYPE_XXX output file type
+ * @param compression_type The compression type for the output file
  * @param in_filenames An array of input filenames to merge from
  * @param in_file_count The number of entries in in_filenames
  * @param do_append Whether to append by file order instead of chronological order
@@ -136,6 +137,7 @@ typedef struct {
  */
 WS_DLL_PUBLIC merge_result
 merge_files(const gchar* out_filename, const int file_type,
+            const wtap_compression_type compression_type,
             const char *const *in_filenames, const guint in_file_count,
             const gboolean do_append, const idb_merge_mode mode,
             guint snaplen, const gchar *app_name, merge_progress_callback_t* cb,
@@ -177,6 +179,7 @@ merge_files_to_tempfile(gchar **out_filenamep, const char *pfx,
 /** Merge the given input files to the standard output
  *
  * @param file_type The WTAP_FILE_TYPE_SUBTYPE_XXX output file type
+ * @param compression_type The compression type for the output file
  * @param in_filenames An array of input filenames to merge from
  * @param in_file_count The number of entries in in_filenames
  * @param do_append Whether to append by file order instead of chronological order
@@ -195,7 +198,9 @@ merge_files_to_tempfile(gchar **out_filenamep, const char *pfx,
  * @return the frame type
  */
 WS_DLL_PUBLIC merge_result
-merge_files_to_stdout(const int file_type, const char *const *in_filenames,
+merge_files_to_stdout(const int file_type,
+                      const wtap_compression_type compression_type,
+                      const char *const *in_filenames,
                       const guint in_file_count, const gboolean do_append,
                       const idb_merge_mode mode, guint snaplen,
                       const gchar *app_name, merge_progress_callback_t* cb,
@@ -2264,11 +2264,34 @@ pcap_process_pseudo_header(FILE_T fh, int file_type, int wtap_encap,
 
 void
 pcap_read_post_process(int file_type, int wtap_encap,
-    wtap_rec *rec, guint8 *pd, gboolean bytes_swapped, int fcs_len)
+    wtap_rec *rec, Buffer *buf, gboolean bytes_swapped, int fcs_len)
 {
+	guint8 *pd;
+
+	/*
+	 * If the packet data was skipped, buf is NULL, and we only do
+	 * what doesn't look at the data.
+	 *
+	 * Byte-swapping is done in place, so if the packet data is
+	 * borrowed from a mapped file, take a copy first.
+	 */
+	if (buf == NULL) {
+		pd = NULL;
+	} else {
+		if (bytes_swapped &&
+		    (wtap_encap == WTAP_ENCAP_SLL ||
+		     wtap_encap == WTAP_ENCAP_USB_LINUX ||
+		     wtap_encap == WTAP_ENCAP_USB_LINUX_MMAPPED ||
+		     wtap_encap == WTAP_ENCAP_NFLOG))
+			ws_buffer_unborrow(buf);
+		pd = ws_buffer_start_ptr(buf);
+	}
+
 	switch (wtap_encap) {
 
 	case WTAP_ENCAP_ATM_PDUS:
+		if (pd == NULL)
+			break;
 		if (file_type == WTAP_FILE_TYPE_SUBTYPE_PCAP_NOKIA) {
 			/*
 			 * Nokia IPSO ATM.
@@ -2295,17 +2318,17 @@ pcap_read_post_process(int file_type, int wtap_encap,
 		break;
 
 	case WTAP_ENCAP_SLL:
-		if (bytes_swapped)
+		if (bytes_swapped && pd != NULL)
 			pcap_byteswap_linux_sll_pseudoheader(rec, pd);
 		break;
 
 	case WTAP_ENCAP_USB_LINUX:
-		if (bytes_swapped)
+		if (bytes_swapped && pd != NULL)
 			pcap_byteswap_linux_usb_pseudoheader(rec, pd, FALSE);
 		break;
 
 	case WTAP_ENCAP_USB_LINUX_MMAPPED:
-		if (bytes_swapped)
+		if (bytes_swapped && pd != NULL)
 			pcap_byteswap_linux_usb_pseudoheader(rec, pd, TRUE);
 		break;
 
@@ -2319,7 +2342,7 @@ pcap_read_post_process(int file_type, int wtap_encap,
 		break;
 
 	case WTAP_ENCAP_NFLOG:
-		if (bytes_swapped)
+		if (bytes_swapped && pd != NULL)
 			pcap_byteswap_nflog_pseudoheader(rec, pd);
 		break;
 
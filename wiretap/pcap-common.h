@@ -23,7 +23,7 @@ extern int pcap_process_pseudo_header(FILE_T fh, int file_type, int wtap_encap,
     guint packet_size, wtap_rec *rec, int *err, gchar **err_info);
 
 extern void pcap_read_post_process(int file_type, int wtap_encap,
-    wtap_rec *rec, guint8 *pd, gboolean bytes_swapped, int fcs_len);
+    wtap_rec *rec, Buffer *buf, gboolean bytes_swapped, int fcs_len);
 
 extern int pcap_get_phdr_size(int encap,
     const union wtap_pseudo_header *pseudo_header);
@@ -1138,7 +1138,8 @@ static gboolean
 pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh,
                          const section_info_t *section_info,
                          wtapng_block_t *wblock,
-                         int *err, gchar **err_info, gboolean enhanced)
+                         int *err, gchar **err_info, gboolean enhanced,
+                         gboolean skip_data)
 {
     int bytes_read;
     guint block_read;
@@ -1333,19 +1334,6 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh,
     wblock->rec->ts.secs = (time_t)(ts / iface_info.time_units_per_second);
     wblock->rec->ts.nsecs = (int)(((ts % iface_info.time_units_per_second) * 1000000000) / iface_info.time_units_per_second);
 
-    /* "(Enhanced) Packet Block" read capture data */
-    if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
-                                packet.cap_len - pseudo_header_len, err, err_info))
-        return FALSE;
-    block_read += packet.cap_len - pseudo_header_len;
-
-    /* jump over potential padding bytes at end of the packet data */
-    if (padding != 0) {
-        if (!wtap_read_bytes(fh, NULL, padding, err, err_info))
-            return FALSE;
-        block_read += padding;
-    }
-
     /* Option defaults */
     g_free(wblock->rec->opt_comment);   /* Free memory from an earlier read. */
     wblock->rec->opt_comment = NULL;
@@ -1361,6 +1349,37 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh,
     /* FCS length default */
     fcslen = iface_info.fcslen;
 
+    if (skip_data) {
+        /*
+         * Our caller only wants the record header; skip the
+         * packet data, padding and options all at once.
+         */
+        to_read = block_total_length -
+            (int)sizeof(pcapng_block_header_t) -
+            block_read -    /* fixed part and any pseudo-header */
+            (int)sizeof(bh->block_total_length);
+        if (!wtap_skip_packet_bytes(fh, to_read, err, err_info))
+            return FALSE;
+        pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
+                               wblock->rec, NULL,
+                               section_info->byte_swapped, fcslen);
+        wblock->internal = FALSE;
+        return TRUE;
+    }
+
+    /* "(Enhanced) Packet Block" read capture data */
+    if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
+                                packet.cap_len - pseudo_header_len, err, err_info))
+        return FALSE;
+    block_read += packet.cap_len - pseudo_header_len;
+
+    /* jump over potential padding bytes at end of the packet data */
+    if (padding != 0) {
+        if (!wtap_read_bytes(fh, NULL, padding, err, err_info))
+            return FALSE;
+        block_read += padding;
+    }
+
     /* Options
      * opt_comment    1
      * epb_flags      2
@@ -1573,7 +1592,7 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh,
     }
 
     pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
-                           wblock->rec, ws_buffer_start_ptr(wblock->frame_buffer),
+                           wblock->rec, wblock->frame_buffer,
                            section_info->byte_swapped, fcslen);
 
     /*
@@ -1589,7 +1608,8 @@ static gboolean
 pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh,
                                 const section_info_t *section_info,
                                 wtapng_block_t *wblock,
-                                int *err, gchar **err_info)
+                                int *err, gchar **err_info,
+                                gboolean skip_data)
 {
     interface_info_t iface_info;
     pcapng_simple_packet_block_t spb;
@@ -1722,6 +1742,17 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh,
 
     memset((void *)&wblock->rec->rec_header.packet_header.pseudo_header, 0, sizeof(union wtap_pseudo_header));
 
+    if (skip_data) {
+        /* Our caller only wants the record header */
+        if (!wtap_skip_packet_bytes(fh, simple_packet.cap_len + padding, err, err_info))
+            return FALSE;
+        pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
+                               wblock->rec, NULL,
+                               section_info->byte_swapped, iface_info.fcslen);
+        wblock->internal = FALSE;
+        return TRUE;
+    }
+
     /* "Simple Packet Block" read capture data */
     if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
                                 simple_packet.cap_len, err, err_info))
@@ -1734,7 +1765,7 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh,
     }
 
     pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
-                           wblock->rec, ws_buffer_start_ptr(wblock->frame_buffer),
+                           wblock->rec, wblock->frame_buffer,
                            section_info->byte_swapped, iface_info.fcslen);
 
     /*
@@ -2619,6 +2650,7 @@ pcapng_read_block(wtap *wth, FILE_T fh, pcapng_t *pn,
     block_return_val ret;
     pcapng_block_header_t bh;
     guint32 block_total_length;
+    gboolean skip_data = wth->skip_packet_data && fh == wth->fh;
 
     wblock->block = NULL;
 
@@ -2724,15 +2756,15 @@ pcapng_read_block(wtap *wth, FILE_T fh, pcapng_t *pn,
                     return PCAPNG_BLOCK_ERROR;
                 break;
             case(BLOCK_TYPE_PB):
-                if (!pcapng_read_packet_block(fh, &bh, section_info, wblock, err, err_info, FALSE))
+                if (!pcapng_read_packet_block(fh, &bh, section_info, wblock, err, err_info, FALSE, skip_data))
                     return PCAPNG_BLOCK_ERROR;
                 break;
             case(BLOCK_TYPE_SPB):
-                if (!pcapng_read_simple_packet_block(fh, &bh, section_info, wblock, err, err_info))
+                if (!pcapng_read_simple_packet_block(fh, &bh, section_info, wblock, err, err_info, skip_data))
                     return PCAPNG_BLOCK_ERROR;
                 break;
             case(BLOCK_TYPE_EPB):
-                if (!pcapng_read_packet_block(fh, &bh, section_info, wblock, err, err_info, TRUE))
+                if (!pcapng_read_packet_block(fh, &bh, section_info, wblock, err, err_info, TRUE, skip_data))
                     return PCAPNG_BLOCK_ERROR;
                 break;
             case(BLOCK_TYPE_NRB):
@@ -70,6 +70,7 @@ struct wtap {
     wtap_new_ipv6_callback_t    add_new_ipv6;
     wtap_new_secrets_callback_t add_new_secrets;
     GPtrArray                   *fast_seek;
+    gboolean                    skip_packet_data;       /**< TRUE if wtap_read() callers don't want packet data */
 };
 
 struct wtap_dumper;
@@ -312,6 +313,17 @@ gboolean
 wtap_read_packet_bytes(FILE_T fh, Buffer *buf, guint length, int *err,
     gchar **err_info);
 
+/*
+ * Skip over packet data rather than reading it, for readers whose
+ * caller has asked for headers only with wtap_set_skip_packet_data().
+ *
+ * This returns an error on a short read, just as
+ * wtap_read_packet_bytes() does.
+ */
+WS_DLL_PUBLIC
+gboolean
+wtap_skip_packet_bytes(FILE_T fh, guint length, int *err, gchar **err_info);
+
 /*
  * Implementation of wth->subtype_read that reads the full file contents
  * as a single packet.
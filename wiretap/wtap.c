@@ -1377,6 +1377,54 @@ wtap_cleareof(wtap *wth) {
 	file_clearerr(wth->fh);
 }
 
+gboolean
+wtap_use_mmap(wtap *wth)
+{
+	switch (wth->file_type_subtype) {
+
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAPNG:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_NSEC:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_AIX:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS991029:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_NOKIA:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS990417:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS990915:
+		/*
+		 * These readers don't modify packet data in place, other
+		 * than through pcap_read_post_process(), which copies it
+		 * first if need be.
+		 */
+		break;
+
+	default:
+		return FALSE;
+	}
+	if (!file_map(wth->fh))
+		return FALSE;
+	if (wth->random_fh != NULL)
+		(void)file_map(wth->random_fh);
+	return TRUE;
+}
+
+void
+wtap_set_skip_packet_data(wtap *wth, gboolean skip)
+{
+	wth->skip_packet_data = skip;
+}
+
+void
+wtap_set_save_seek_index(wtap *wth, gboolean save)
+{
+	file_set_seek_index_save(wth->fh, save);
+}
+
+gboolean
+wtap_can_read_in_thread(wtap *wth)
+{
+	return wth->wslua_data == NULL;
+}
+
 void wtap_set_cb_new_ipv4(wtap *wth, wtap_new_ipv4_callback_t add_new_ipv4) {
 	if (wth)
 		wth->add_new_ipv4 = add_new_ipv4;
@@ -1553,11 +1601,34 @@ gboolean
 wtap_read_packet_bytes(FILE_T fh, Buffer *buf, guint length, int *err,
     gchar **err_info)
 {
+	const guint8 *data;
+
+	/* If the file is mapped, point the buffer at the data in place */
+	data = file_read_mapped(fh, length);
+	if (data != NULL) {
+		ws_buffer_borrow(buf, data, length);
+		return TRUE;
+	}
 	ws_buffer_assure_space(buf, length);
 	return wtap_read_bytes(fh, ws_buffer_start_ptr(buf), length, err,
 	    err_info);
 }
 
+gboolean
+wtap_skip_packet_bytes(FILE_T fh, guint length, int *err, gchar **err_info)
+{
+	int	bytes_skipped;
+
+	bytes_skipped = file_skip(length, fh);
+	if (bytes_skipped < 0 || (guint)bytes_skipped != length) {
+		*err = file_error(fh, err_info);
+		if (*err == 0)
+			*err = WTAP_ERR_SHORT_READ;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /*
  * Return an approximation of the amount of data we've read sequentially
  * from the file so far.  (gint64, in case that's 64 bits.)
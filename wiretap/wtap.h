@@ -1789,6 +1789,74 @@ struct wtap* wtap_open_offline(const char *filename, unsigned int type, int *err
 WS_DLL_PUBLIC
 void wtap_cleareof(wtap *wth);
 
+/**
+ * Read the file through a memory mapping, if it's an uncompressed
+ * pcap or pcapng file on local storage, so that packet data is handed
+ * back in place rather than copied: wtap_read() and wtap_seek_read()
+ * point the Buffer at the mapped bytes, and seeking is just arithmetic.
+ *
+ * The data stays valid until wtap_close(); after that, a Buffer filled
+ * from the file mustn't be used again, other than to free it, unless
+ * ws_buffer_unborrow() was called on it first.  The mapping covers the
+ * file as it was when this was called; don't use this when reading a
+ * file that's still being written.
+ *
+ * The file's size is checked again before reading each megabyte or so,
+ * and reading stops where a truncated file now ends, but a file
+ * truncated between the checks, or while packet data already handed
+ * back is in use (it still points into the mapping), can still get the
+ * process a SIGBUS.  Don't use this if the file may be truncated under
+ * you.
+ *
+ * @param wth The wiretap session.
+ * @return TRUE if the file is now read through a mapping.
+ */
+WS_DLL_PUBLIC
+gboolean wtap_use_mmap(wtap *wth);
+
+/**
+ * Tell the pcap and pcapng readers that the caller of wtap_read() only
+ * looks at record headers, so they can skip packet data, and pcapng
+ * packet options, rather than reading them.  The record's captured
+ * length is still filled in, but the Buffer is left as it was, and
+ * per-packet comments, flags and the like are not set.
+ *
+ * wtap_seek_read() always reads the packet data.  Other file types
+ * ignore this and read everything.
+ *
+ * @param wth The wiretap session.
+ * @param skip TRUE to skip packet data.
+ */
+WS_DLL_PUBLIC
+void wtap_set_skip_packet_data(wtap *wth, gboolean skip);
+
+/**
+ * Save the fast seek points found while reading a compressed file to
+ * a "<file>.seekidx" index next to it when the file is closed, so that
+ * the next open of the file needn't decompress all of it to find them.
+ * An index that's already there is used whether or not this is set.
+ * Only files opened with do_random TRUE have an index.
+ *
+ * @param wth The wiretap session.
+ * @param save TRUE to save the index.
+ */
+WS_DLL_PUBLIC
+void wtap_set_save_seek_index(wtap *wth, gboolean save);
+
+/**
+ * Check whether wtap_read() may be called in a thread other than the
+ * one running the dissectors.  That's not the case for files read by
+ * a Lua file handler, as it runs in the dissectors' Lua state.
+ *
+ * The callbacks set with wtap_set_cb_new_ipv4() and the like are
+ * called in the reading thread.
+ *
+ * @param wth The wiretap session.
+ * @return TRUE if the file can be read in another thread.
+ */
+WS_DLL_PUBLIC
+gboolean wtap_can_read_in_thread(wtap *wth);
+
 /**
  * Set callback functions to add new hostnames. Currently pcapng-only.
  * MUST match add_ipv4_name and add_ipv6_name in addr_resolv.c.
@@ -1861,7 +1929,9 @@ void wtap_rec_cleanup(wtap_rec *rec);
  */
 typedef enum {
     WTAP_UNCOMPRESSED,
-    WTAP_GZIP_COMPRESSED
+    WTAP_GZIP_COMPRESSED,
+    WTAP_ZSTD_COMPRESSED,
+    WTAP_LZ4_COMPRESSED
 } wtap_compression_type;
 
 WS_DLL_PUBLIC
@@ -1871,6 +1941,8 @@ const char *wtap_compression_type_description(wtap_compression_type compression_
 WS_DLL_PUBLIC
 const char *wtap_compression_type_extension(wtap_compression_type compression_type);
 WS_DLL_PUBLIC
+int wtap_name_to_compression_type(const char *name);
+WS_DLL_PUBLIC
 GSList *wtap_get_all_compression_type_extensions_list(void);
 
 /*** get various information snippets about the current file ***/
@@ -0,0 +1,510 @@
+/* aio_output.c
+ * Our own routines for writing capture files asynchronously, bypassing
+ * the page cache where possible.
+ *
+ * At high capture rates writing through stdio means every page of packet
+ * data is copied through the page cache, and the capture thread sits in
+ * write() while the kernel's capture buffer fills up.  Instead, we collect
+ * the data in page-aligned buffers and hand full buffers to the kernel
+ * without waiting for them, using O_DIRECT where the file system allows
+ * it.  The buffers are written with io_uring if we have liburing and the
+ * kernel supports it, otherwise by a small pool of writer threads.
+ *
+ * The result is wrapped in a FILE * with fopencookie(), so the pcapio
+ * routines and everything that calls them don't need to know about it.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <config.h>
+
+#ifdef __linux__
+#define _GNU_SOURCE /* Otherwise fopencookie() and O_DIRECT won't be defined */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <glib.h>
+
+#include "ws_attributes.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "aio_output.h"
+
+static aio_output_stats_t aio_stats;
+
+#ifdef __linux__
+
+/* O_DIRECT wants buffers, offsets and lengths aligned to the logical
+   block size; a page covers every block size we're likely to meet. */
+#define AIO_ALIGNMENT 4096
+
+/*
+ * Where to carry on after a short write: with O_DIRECT, the rest has to
+ * start on a block boundary too, so the block that was partly written
+ * is written again, whole.
+ */
+#define AIO_RESUME_AT(done, direct) \
+    ((direct) ? (done) & ~(size_t)(AIO_ALIGNMENT - 1) : (done))
+
+/* Number of writer threads when we can't use io_uring */
+#define AIO_MAX_WRITER_THREADS 4
+
+typedef struct _aio_buf {
+    guint8  *data;
+    size_t   len;       /* bytes of data filled in */
+    size_t   done;      /* bytes of data already written (io_uring short writes) */
+    guint64  offset;    /* file offset of data[0] */
+    int      err;       /* errno of a failed write, 0 if it succeeded */
+} aio_buf_t;
+
+typedef struct _aio_stream {
+    int           fd;
+    gboolean      direct;       /* TRUE if O_DIRECT is set on fd */
+    guint64       offset;       /* file offset at which the next buffer starts */
+    guint         depth;
+    aio_buf_t    *bufs;
+    aio_buf_t   **free_bufs;    /* stack of buffers not in flight */
+    guint         num_free;
+    aio_buf_t    *cur;          /* buffer being filled, NULL if none */
+    guint         in_flight;    /* buffers being written */
+    int           err;          /* first write error seen */
+#ifdef HAVE_LIBURING
+    gboolean      use_uring;
+    struct io_uring ring;
+#endif
+    GThread      *writers[AIO_MAX_WRITER_THREADS];
+    guint         num_writers;
+    GAsyncQueue  *pending;      /* buffers waiting for a writer thread */
+    GAsyncQueue  *done;         /* buffers the writer threads are finished with */
+} aio_stream_t;
+
+/* Pushed to the pending queue to tell a writer thread to exit. */
+static aio_buf_t aio_stop_marker;
+
+/*
+ * pwrite() the whole of a buffer, returning 0 or an errno value.  "direct"
+ * is TRUE if fd has O_DIRECT set, so that the buffer is block-aligned.
+ */
+static int
+aio_pwrite_all(int fd, const guint8 *data, size_t len, guint64 offset,
+               gboolean direct)
+{
+    ssize_t nwritten;
+    size_t  done = 0;
+
+    while (done < len) {
+        nwritten = pwrite(fd, data + done, len - done, (off_t)(offset + done));
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (nwritten == 0)
+            return ENOSPC;
+        done = AIO_RESUME_AT(done + (size_t)nwritten, direct);
+    }
+    return 0;
+}
+
+static gpointer
+aio_writer_thread(gpointer arg)
+{
+    aio_stream_t *stream = (aio_stream_t *)arg;
+    aio_buf_t    *buf;
+
+    while ((buf = (aio_buf_t *)g_async_queue_pop(stream->pending)) != &aio_stop_marker) {
+        buf->err = aio_pwrite_all(stream->fd, buf->data, buf->len, buf->offset,
+                                  stream->direct);
+        g_async_queue_push(stream->done, buf);
+    }
+    return NULL;
+}
+
+/* A write has finished; account for it and make its buffer available. */
+static void
+aio_complete(aio_stream_t *stream, aio_buf_t *buf)
+{
+    if (buf->err != 0) {
+        if (stream->err == 0)
+            stream->err = buf->err;
+    } else {
+        aio_stats.writes++;
+        aio_stats.bytes += buf->len;
+    }
+    buf->len = 0;
+    buf->done = 0;
+    buf->err = 0;
+    stream->free_bufs[stream->num_free++] = buf;
+    stream->in_flight--;
+    aio_stats.in_flight--;
+}
+
+#ifdef HAVE_LIBURING
+static gboolean
+aio_uring_submit(aio_stream_t *stream, aio_buf_t *buf)
+{
+    struct io_uring_sqe *sqe;
+    int ret;
+
+    sqe = io_uring_get_sqe(&stream->ring);
+    if (sqe == NULL) {
+        /* Can't happen; the ring has one entry per buffer. */
+        buf->err = EAGAIN;
+        return FALSE;
+    }
+    io_uring_prep_write(sqe, stream->fd, buf->data + buf->done,
+                        (unsigned)(buf->len - buf->done), buf->offset + buf->done);
+    io_uring_sqe_set_data(sqe, buf);
+    ret = io_uring_submit(&stream->ring);
+    if (ret < 0) {
+        buf->err = -ret;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Collect completed writes; if "wait" is TRUE, block until at least
+ * one write has completed.
+ */
+static void
+aio_uring_reap(aio_stream_t *stream, gboolean wait)
+{
+    struct io_uring_cqe *cqe;
+    aio_buf_t *buf;
+    int ret;
+
+    for (;;) {
+        if (wait) {
+            ret = io_uring_wait_cqe(&stream->ring, &cqe);
+            if (ret == -EINTR)
+                continue;
+            wait = FALSE;
+        } else {
+            ret = io_uring_peek_cqe(&stream->ring, &cqe);
+        }
+        if (ret != 0)
+            return;
+
+        buf = (aio_buf_t *)io_uring_cqe_get_data(cqe);
+        if (cqe->res < 0) {
+            buf->err = -cqe->res;
+        } else if (cqe->res == 0) {
+            buf->err = ENOSPC;
+        } else {
+            buf->done = AIO_RESUME_AT(buf->done + (size_t)cqe->res, stream->direct);
+        }
+        io_uring_cqe_seen(&stream->ring, cqe);
+
+        if (buf->err == 0 && buf->done < buf->len) {
+            /* Short write; queue the rest, from a block boundary with O_DIRECT. */
+            if (aio_uring_submit(stream, buf))
+                continue;
+        }
+        aio_complete(stream, buf);
+    }
+}
+#endif
+
+/* Collect completed writes, blocking until there's one if "wait" is TRUE. */
+static void
+aio_reap(aio_stream_t *stream, gboolean wait)
+{
+    aio_buf_t *buf;
+
+#ifdef HAVE_LIBURING
+    if (stream->use_uring) {
+        aio_uring_reap(stream, wait);
+        return;
+    }
+#endif
+    if (wait) {
+        buf = (aio_buf_t *)g_async_queue_pop(stream->done);
+        aio_complete(stream, buf);
+    }
+    while ((buf = (aio_buf_t *)g_async_queue_try_pop(stream->done)) != NULL) {
+        aio_complete(stream, buf);
+    }
+}
+
+/* Start writing the current buffer. */
+static void
+aio_submit(aio_stream_t *stream)
+{
+    aio_buf_t *buf = stream->cur;
+
+    stream->cur = NULL;
+    buf->offset = stream->offset;
+    stream->offset += buf->len;
+
+    stream->in_flight++;
+    aio_stats.in_flight++;
+    if (aio_stats.in_flight > aio_stats.max_in_flight)
+        aio_stats.max_in_flight = aio_stats.in_flight;
+
+#ifdef HAVE_LIBURING
+    if (stream->use_uring) {
+        if (!aio_uring_submit(stream, buf))
+            aio_complete(stream, buf);
+        return;
+    }
+#endif
+    g_async_queue_push(stream->pending, buf);
+}
+
+/* Get a buffer to fill, waiting for a write to complete if they're all busy. */
+static void
+aio_get_buffer(aio_stream_t *stream)
+{
+    gint64 stall_start;
+
+    aio_reap(stream, FALSE);
+    if (stream->num_free == 0) {
+        stall_start = g_get_monotonic_time();
+        while (stream->num_free == 0)
+            aio_reap(stream, TRUE);
+        aio_stats.stalls++;
+        aio_stats.stall_time += g_get_monotonic_time() - stall_start;
+    }
+    stream->cur = stream->free_bufs[--stream->num_free];
+}
+
+static ssize_t
+aio_cookie_write(void *cookie, const char *data, size_t size)
+{
+    aio_stream_t *stream = (aio_stream_t *)cookie;
+    size_t        left = size;
+    size_t        chunk;
+
+    while (left != 0) {
+        if (stream->cur == NULL)
+            aio_get_buffer(stream);
+        if (stream->err != 0) {
+            errno = stream->err;
+            return -1;
+        }
+        chunk = MIN(left, AIO_OUTPUT_BUFFER_SIZE - stream->cur->len);
+        memcpy(stream->cur->data + stream->cur->len, data, chunk);
+        stream->cur->len += chunk;
+        data += chunk;
+        left -= chunk;
+        if (stream->cur->len == AIO_OUTPUT_BUFFER_SIZE)
+            aio_submit(stream);
+    }
+    return size;
+}
+
+static void
+aio_stream_free(aio_stream_t *stream)
+{
+    guint i;
+
+    for (i = 0; i < stream->num_writers; i++)
+        g_async_queue_push(stream->pending, &aio_stop_marker);
+    for (i = 0; i < stream->num_writers; i++)
+        g_thread_join(stream->writers[i]);
+    if (stream->pending)
+        g_async_queue_unref(stream->pending);
+    if (stream->done)
+        g_async_queue_unref(stream->done);
+#ifdef HAVE_LIBURING
+    if (stream->use_uring)
+        io_uring_queue_exit(&stream->ring);
+#endif
+    for (i = 0; i < stream->depth; i++)
+        free(stream->bufs[i].data);     /* from posix_memalign() */
+    g_free(stream->bufs);
+    g_free(stream->free_bufs);
+    g_free(stream);
+}
+
+static int
+aio_cookie_close(void *cookie)
+{
+    aio_stream_t *stream = (aio_stream_t *)cookie;
+    int           err;
+    int           flags;
+
+    while (stream->in_flight != 0)
+        aio_reap(stream, TRUE);
+
+    /*
+     * The last buffer is almost certainly not a multiple of the block
+     * size, so it can't be written with O_DIRECT.
+     */
+    if (stream->cur != NULL && stream->cur->len != 0 && stream->err == 0) {
+        if (stream->direct) {
+            flags = fcntl(stream->fd, F_GETFL);
+            if (flags != -1)
+                fcntl(stream->fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        stream->err = aio_pwrite_all(stream->fd, stream->cur->data,
+                                     stream->cur->len, stream->offset, FALSE);
+        if (stream->err == 0) {
+            aio_stats.writes++;
+            aio_stats.bytes += stream->cur->len;
+        }
+    }
+
+    err = stream->err;
+    if (close(stream->fd) == -1 && err == 0)
+        err = errno;
+    aio_stream_free(stream);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+gboolean
+aio_output_supported(void)
+{
+    return TRUE;
+}
+
+FILE *
+aio_output_fdopen(int fd, guint queue_depth, int *err)
+{
+    static const cookie_io_functions_t funcs = {
+        NULL,               /* read */
+        aio_cookie_write,
+        NULL,               /* seek */
+        aio_cookie_close
+    };
+    aio_stream_t *stream;
+    off_t         start;
+    int           flags;
+    guint         i;
+    FILE         *fh;
+
+    if (queue_depth == 0)
+        queue_depth = AIO_OUTPUT_DEFAULT_QUEUE_DEPTH;
+    else if (queue_depth > AIO_OUTPUT_MAX_QUEUE_DEPTH)
+        queue_depth = AIO_OUTPUT_MAX_QUEUE_DEPTH;
+
+    /* We write with pwrite() and friends, so we need a real file. */
+    start = lseek(fd, 0, SEEK_CUR);
+    if (start == (off_t)-1) {
+        *err = errno;
+        return NULL;
+    }
+
+    stream = g_new0(aio_stream_t, 1);
+    stream->fd = fd;
+    stream->offset = (guint64)start;
+    stream->depth = queue_depth;
+    stream->bufs = g_new0(aio_buf_t, queue_depth);
+    stream->free_bufs = g_new(aio_buf_t *, queue_depth);
+    for (i = 0; i < queue_depth; i++) {
+        if (posix_memalign((void **)&stream->bufs[i].data, AIO_ALIGNMENT,
+                           AIO_OUTPUT_BUFFER_SIZE) != 0) {
+            stream->bufs[i].data = NULL;
+            aio_stream_free(stream);
+            *err = ENOMEM;
+            return NULL;
+        }
+        stream->free_bufs[stream->num_free++] = &stream->bufs[i];
+    }
+
+    /*
+     * Bypass the page cache if the file system lets us.  tmpfs and
+     * some network file systems don't, in which case we still write
+     * asynchronously but through the page cache.
+     */
+    if (start % AIO_ALIGNMENT == 0) {
+        flags = fcntl(fd, F_GETFL);
+        if (flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+            stream->direct = TRUE;
+    }
+
+#ifdef HAVE_LIBURING
+    if (io_uring_queue_init(queue_depth, &stream->ring, 0) == 0) {
+        stream->use_uring = TRUE;
+    }
+    if (!stream->use_uring)
+#endif
+    {
+        stream->pending = g_async_queue_new();
+        stream->done = g_async_queue_new();
+        stream->num_writers = MIN(queue_depth, AIO_MAX_WRITER_THREADS);
+        for (i = 0; i < stream->num_writers; i++)
+            stream->writers[i] = g_thread_new("Capture file writer", aio_writer_thread, stream);
+    }
+
+    fh = fopencookie(stream, "w", funcs);
+    if (fh == NULL) {
+        *err = errno;
+        if (stream->direct) {
+            flags = fcntl(fd, F_GETFL);
+            if (flags != -1)
+                fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        aio_stream_free(stream);
+        return NULL;
+    }
+    /* We do our own buffering. */
+    setvbuf(fh, NULL, _IONBF, 0);
+
+#ifdef HAVE_LIBURING
+    if (stream->use_uring)
+        aio_stats.backend = stream->direct ? "io_uring, O_DIRECT" : "io_uring";
+    else
+#endif
+        aio_stats.backend = stream->direct ? "writer threads, O_DIRECT" : "writer threads";
+    aio_stats.queue_depth = queue_depth;
+
+    return fh;
+}
+
+#else /* __linux__ */
+
+gboolean
+aio_output_supported(void)
+{
+    return FALSE;
+}
+
+FILE *
+aio_output_fdopen(int fd _U_, guint queue_depth _U_, int *err)
+{
+    *err = ENOSYS;
+    return NULL;
+}
+
+#endif /* __linux__ */
+
+void
+aio_output_get_stats(aio_output_stats_t *stats)
+{
+    *stats = aio_stats;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,73 @@
+/* aio_output.h
+ * Declarations of our routines for writing capture files asynchronously,
+ * bypassing the page cache where possible.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __WRITECAP_AIO_OUTPUT_H__
+#define __WRITECAP_AIO_OUTPUT_H__
+
+/* Size of each of the aligned buffers handed to the kernel */
+#define AIO_OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+/* Default and maximum number of writes kept in flight per stream */
+#define AIO_OUTPUT_DEFAULT_QUEUE_DEPTH 8
+#define AIO_OUTPUT_MAX_QUEUE_DEPTH     256
+
+/** Counters for all asynchronous output streams opened by this process. */
+typedef struct {
+    const char *backend;        /**< Backend used by the most recently opened stream */
+    guint       queue_depth;    /**< Maximum number of writes in flight */
+    guint       max_in_flight;  /**< Largest number of writes seen in flight at once */
+    guint       in_flight;      /**< Writes currently in flight */
+    guint64     writes;         /**< Writes completed */
+    guint64     bytes;          /**< Bytes written */
+    guint64     stalls;         /**< Times the writer had to wait for a free buffer */
+    guint64     stall_time;     /**< Total time spent waiting, in microseconds */
+} aio_output_stats_t;
+
+/** Returns TRUE if asynchronous output is available on this platform. */
+extern gboolean
+aio_output_supported(void);
+
+/** Open a stdio stream for an already-open, seekable file descriptor.
+ *
+ * Data written to the stream is collected in page-aligned buffers,
+ * which are written with O_DIRECT (if the file system supports it)
+ * through io_uring or, failing that, a small pool of writer threads.
+ * Up to "queue_depth" buffers are in flight at any time; the writer
+ * only blocks if all of them are.
+ *
+ * Data is only guaranteed to be in the file once it has been closed;
+ * fflush() on the stream does not wait for outstanding writes.
+ * fclose() waits for them, closes "fd" and returns EOF, with errno
+ * set, if any of them failed.
+ *
+ * Returns NULL and sets "*err" on failure.
+ */
+extern FILE *
+aio_output_fdopen(int fd, guint queue_depth, int *err);
+
+/** Get the counters for all asynchronous output so far. */
+extern void
+aio_output_get_stats(aio_output_stats_t *stats);
+
+#endif /* __WRITECAP_AIO_OUTPUT_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,516 @@
+/* compress_output.c
+ * Our own routines for compressing capture files as they're written.
+ *
+ * The compressor is wrapped in a FILE * with fopencookie() and writes
+ * its output to another FILE *, which may be an ordinary stdio stream or
+ * one from aio_output_fdopen(), so the pcapio routines and everything
+ * that calls them don't need to know about it.
+ *
+ * zstd and lz4 output is cut into frames of COMPRESS_OUTPUT_FRAME_SIZE
+ * uncompressed bytes, which Wiretap records as seek points when it reads
+ * the file; gzip output is a single member.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <config.h>
+
+#ifdef __linux__
+#define _GNU_SOURCE /* Otherwise fopencookie() won't be defined */
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ws_attributes.h"
+
+#ifdef HAVE_ZLIB
+#define ZLIB_CONST
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#ifndef ZSTD_CLEVEL_DEFAULT
+#define ZSTD_CLEVEL_DEFAULT 3
+#endif
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include "compress_output.h"
+
+static const struct {
+    const char             *name;
+    compress_output_type_t  type;
+} compress_output_types[] = {
+    { "none", COMPRESS_OUTPUT_NONE },
+#if defined(__linux__) && defined(HAVE_ZLIB)
+    { "gz",   COMPRESS_OUTPUT_GZIP },
+#endif
+#if defined(__linux__) && defined(HAVE_ZSTD)
+    { "zst",  COMPRESS_OUTPUT_ZSTD },
+#endif
+#if defined(__linux__) && defined(HAVE_LZ4FRAME_H)
+    { "lz4",  COMPRESS_OUTPUT_LZ4 },
+#endif
+};
+
+int
+compress_output_type_from_name(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(compress_output_types); i++) {
+        if (g_ascii_strcasecmp(name, compress_output_types[i].name) == 0)
+            return compress_output_types[i].type;
+    }
+    return -1;
+}
+
+const char *
+compress_output_type_name(compress_output_type_t type)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(compress_output_types); i++) {
+        if (compress_output_types[i].type == type)
+            return compress_output_types[i].name;
+    }
+    return "none";
+}
+
+const char *
+compress_output_type_names(void)
+{
+    static char *names;
+    GString *str;
+    size_t i;
+
+    if (names == NULL) {
+        str = g_string_new(NULL);
+        for (i = 0; i < G_N_ELEMENTS(compress_output_types); i++) {
+            if (i != 0)
+                g_string_append_c(str, ' ');
+            g_string_append(str, compress_output_types[i].name);
+        }
+        names = g_string_free(str, FALSE);
+    }
+    return names;
+}
+
+#ifdef __linux__
+
+/* Uncompressed bytes handed to LZ4F_compressUpdate() at a time */
+#define LZ4_CHUNK_SIZE (64 * 1024)
+
+/* Output buffer size for gzip */
+#define GZIP_OUT_SIZE (256 * 1024)
+
+/* zstd work handed to each worker thread at a time */
+#define ZSTD_JOB_SIZE (1024 * 1024)
+
+typedef struct _compress_stream {
+    FILE                   *out;
+    compress_output_type_t  type;
+    guint8                 *obuf;
+    size_t                  obuf_size;
+    gboolean                in_frame;   /* TRUE if we've started a zstd or lz4 frame */
+    size_t                  frame_len;  /* uncompressed bytes in the current frame */
+    int                     err;        /* first error seen */
+#ifdef HAVE_ZLIB
+    z_stream                zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CStream           *zcs;
+#endif
+#ifdef HAVE_LZ4FRAME_H
+    LZ4F_cctx              *lz4;
+    LZ4F_preferences_t      lz4_prefs;
+#endif
+} compress_stream_t;
+
+/* Pass "len" bytes of the output buffer on; returns FALSE on failure. */
+static gboolean
+compress_put(compress_stream_t *stream, size_t len)
+{
+    if (len != 0 && fwrite(stream->obuf, 1, len, stream->out) != len) {
+        stream->err = errno != 0 ? errno : EIO;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#ifdef HAVE_ZLIB
+/* Deflate with "flush" until the input is used up, or, for Z_FINISH,
+   until the stream is finished. */
+static gboolean
+compress_gzip(compress_stream_t *stream, int flush)
+{
+    int ret;
+
+    do {
+        stream->zs.next_out = stream->obuf;
+        stream->zs.avail_out = (uInt)stream->obuf_size;
+        ret = deflate(&stream->zs, flush);
+        if (ret == Z_STREAM_ERROR) {
+            stream->err = EINVAL;
+            return FALSE;
+        }
+        if (!compress_put(stream, stream->obuf_size - stream->zs.avail_out))
+            return FALSE;
+    } while (flush == Z_FINISH ? ret != Z_STREAM_END :
+             stream->zs.avail_in != 0 || stream->zs.avail_out == 0);
+    return TRUE;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Compress "input" if it's non-null, otherwise end the frame. */
+static gboolean
+compress_zstd(compress_stream_t *stream, ZSTD_inBuffer *input)
+{
+    ZSTD_outBuffer output;
+    size_t ret;
+
+    do {
+        output.dst = stream->obuf;
+        output.size = stream->obuf_size;
+        output.pos = 0;
+        if (input != NULL)
+            ret = ZSTD_compressStream(stream->zcs, &output, input);
+        else
+            ret = ZSTD_endStream(stream->zcs, &output);
+        if (ZSTD_isError(ret)) {
+            stream->err = EINVAL;
+            return FALSE;
+        }
+        if (!compress_put(stream, output.pos))
+            return FALSE;
+    } while (input != NULL ? input->pos < input->size : ret != 0);
+    if (input == NULL)
+        stream->in_frame = FALSE;
+    return TRUE;
+}
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+static gboolean
+compress_lz4_end(compress_stream_t *stream)
+{
+    size_t ret;
+
+    ret = LZ4F_compressEnd(stream->lz4, stream->obuf, stream->obuf_size, NULL);
+    if (LZ4F_isError(ret)) {
+        stream->err = EINVAL;
+        return FALSE;
+    }
+    stream->in_frame = FALSE;
+    return compress_put(stream, ret);
+}
+#endif
+
+/* Compress up to the end of the current frame; returns the number of
+   bytes used, or 0 on failure. */
+static size_t
+compress_frame(compress_stream_t *stream, const guint8 *data, size_t size)
+{
+    size_t n;
+#ifdef HAVE_LZ4FRAME_H
+    size_t ret;
+#endif
+
+    if (!stream->in_frame)
+        stream->frame_len = 0;
+    n = MIN(size, COMPRESS_OUTPUT_FRAME_SIZE - stream->frame_len);
+
+    switch (stream->type) {
+
+#ifdef HAVE_ZSTD
+    case COMPRESS_OUTPUT_ZSTD:
+    {
+        ZSTD_inBuffer input;
+
+        if (!stream->in_frame) {
+            if (ZSTD_isError(ZSTD_initCStream(stream->zcs, ZSTD_CLEVEL_DEFAULT))) {
+                stream->err = EINVAL;
+                return 0;
+            }
+            stream->in_frame = TRUE;
+        }
+        input.src = data;
+        input.size = n;
+        input.pos = 0;
+        if (!compress_zstd(stream, &input))
+            return 0;
+        stream->frame_len += n;
+        if (stream->frame_len == COMPRESS_OUTPUT_FRAME_SIZE && !compress_zstd(stream, NULL))
+            return 0;
+        break;
+    }
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+    case COMPRESS_OUTPUT_LZ4:
+        if (!stream->in_frame) {
+            ret = LZ4F_compressBegin(stream->lz4, stream->obuf, stream->obuf_size,
+                                     &stream->lz4_prefs);
+            if (LZ4F_isError(ret)) {
+                stream->err = EINVAL;
+                return 0;
+            }
+            if (!compress_put(stream, ret))
+                return 0;
+            stream->in_frame = TRUE;
+        }
+        n = MIN(n, LZ4_CHUNK_SIZE);
+        ret = LZ4F_compressUpdate(stream->lz4, stream->obuf, stream->obuf_size,
+                                  data, n, NULL);
+        if (LZ4F_isError(ret)) {
+            stream->err = EINVAL;
+            return 0;
+        }
+        if (!compress_put(stream, ret))
+            return 0;
+        stream->frame_len += n;
+        if (stream->frame_len == COMPRESS_OUTPUT_FRAME_SIZE && !compress_lz4_end(stream))
+            return 0;
+        break;
+#endif
+
+    default:
+        stream->err = EINVAL;
+        return 0;
+    }
+    return n;
+}
+
+static ssize_t
+compress_cookie_write(void *cookie, const char *data, size_t size)
+{
+    compress_stream_t *stream = (compress_stream_t *)cookie;
+    size_t             left = size;
+    size_t             n;
+
+    if (stream->err != 0) {
+        errno = stream->err;
+        return -1;
+    }
+#ifdef HAVE_ZLIB
+    if (stream->type == COMPRESS_OUTPUT_GZIP) {
+        stream->zs.next_in = (const Bytef *)data;
+        stream->zs.avail_in = (uInt)size;
+        if (!compress_gzip(stream, Z_NO_FLUSH)) {
+            errno = stream->err;
+            return -1;
+        }
+        return size;
+    }
+#endif
+    while (left != 0) {
+        n = compress_frame(stream, (const guint8 *)data, left);
+        if (n == 0) {
+            errno = stream->err;
+            return -1;
+        }
+        data += n;
+        left -= n;
+    }
+    return size;
+}
+
+static void
+compress_stream_free(compress_stream_t *stream)
+{
+    switch (stream->type) {
+
+#ifdef HAVE_ZLIB
+    case COMPRESS_OUTPUT_GZIP:
+        deflateEnd(&stream->zs);
+        break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case COMPRESS_OUTPUT_ZSTD:
+        ZSTD_freeCStream(stream->zcs);
+        break;
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+    case COMPRESS_OUTPUT_LZ4:
+        LZ4F_freeCompressionContext(stream->lz4);
+        break;
+#endif
+
+    default:
+        break;
+    }
+    g_free(stream->obuf);
+    g_free(stream);
+}
+
+static int
+compress_cookie_close(void *cookie)
+{
+    compress_stream_t *stream = (compress_stream_t *)cookie;
+    int                err;
+
+    if (stream->err == 0) {
+        switch (stream->type) {
+
+#ifdef HAVE_ZLIB
+        case COMPRESS_OUTPUT_GZIP:
+            stream->zs.next_in = NULL;
+            stream->zs.avail_in = 0;
+            compress_gzip(stream, Z_FINISH);
+            break;
+#endif
+
+#ifdef HAVE_ZSTD
+        case COMPRESS_OUTPUT_ZSTD:
+            if (stream->in_frame)
+                compress_zstd(stream, NULL);
+            break;
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+        case COMPRESS_OUTPUT_LZ4:
+            if (stream->in_frame)
+                compress_lz4_end(stream);
+            break;
+#endif
+
+        default:
+            break;
+        }
+    }
+
+    err = stream->err;
+    if (fclose(stream->out) == EOF && err == 0)
+        err = errno;
+    compress_stream_free(stream);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+FILE *
+compress_output_open(FILE *out, compress_output_type_t type, int *err)
+{
+    static const cookie_io_functions_t funcs = {
+        NULL,               /* read */
+        compress_cookie_write,
+        NULL,               /* seek */
+        compress_cookie_close
+    };
+    compress_stream_t *stream;
+    FILE              *fh;
+
+    stream = g_new0(compress_stream_t, 1);
+    stream->out = out;
+    stream->type = type;
+
+    switch (type) {
+
+#ifdef HAVE_ZLIB
+    case COMPRESS_OUTPUT_GZIP:
+        /* windowBits + 16 means "write a gzip header and trailer" */
+        if (deflateInit2(&stream->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            g_free(stream);
+            *err = ENOMEM;
+            return NULL;
+        }
+        stream->obuf_size = GZIP_OUT_SIZE;
+        break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case COMPRESS_OUTPUT_ZSTD:
+        stream->zcs = ZSTD_createCStream();
+        if (stream->zcs == NULL) {
+            g_free(stream);
+            *err = ENOMEM;
+            return NULL;
+        }
+#if ZSTD_VERSION_NUMBER >= 10400
+        {
+#if GLIB_CHECK_VERSION(2,36,0)
+            int nworkers = (int)g_get_num_processors();
+#else
+            int nworkers = 4;
+#endif
+            /*
+             * Keep the compression off the capture thread where we
+             * can; this fails if libzstd was built without threads.
+             */
+            if (!ZSTD_isError(ZSTD_CCtx_setParameter(stream->zcs, ZSTD_c_nbWorkers, nworkers)))
+                (void)ZSTD_CCtx_setParameter(stream->zcs, ZSTD_c_jobSize, ZSTD_JOB_SIZE);
+        }
+#endif
+        stream->obuf_size = ZSTD_CStreamOutSize();
+        break;
+#endif
+
+#ifdef HAVE_LZ4FRAME_H
+    case COMPRESS_OUTPUT_LZ4:
+        if (LZ4F_isError(LZ4F_createCompressionContext(&stream->lz4, LZ4F_VERSION))) {
+            g_free(stream);
+            *err = ENOMEM;
+            return NULL;
+        }
+        stream->lz4_prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+        /* Room for the frame header, or for compressing a chunk and ending the frame */
+        stream->obuf_size = LZ4F_compressBound(LZ4_CHUNK_SIZE, &stream->lz4_prefs);
+        break;
+#endif
+
+    default:
+        g_free(stream);
+        *err = EINVAL;
+        return NULL;
+    }
+    stream->obuf = (guint8 *)g_malloc(stream->obuf_size);
+
+    fh = fopencookie(stream, "w", funcs);
+    if (fh == NULL) {
+        *err = errno;
+        compress_stream_free(stream);
+        return NULL;
+    }
+    return fh;
+}
+
+#else /* __linux__ */
+
+FILE *
+compress_output_open(FILE *out _U_, compress_output_type_t type _U_, int *err)
+{
+    *err = ENOSYS;
+    return NULL;
+}
+
+#endif /* __linux__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
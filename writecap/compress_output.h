@@ -0,0 +1,72 @@
+/* compress_output.h
+ * Declarations of our routines for compressing capture files as they're
+ * written.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __WRITECAP_COMPRESS_OUTPUT_H__
+#define __WRITECAP_COMPRESS_OUTPUT_H__
+
+/* Uncompressed bytes per zstd or lz4 frame; readers can seek to frame starts */
+#define COMPRESS_OUTPUT_FRAME_SIZE (8 * 1024 * 1024)
+
+typedef enum {
+    COMPRESS_OUTPUT_NONE,
+    COMPRESS_OUTPUT_GZIP,
+    COMPRESS_OUTPUT_ZSTD,
+    COMPRESS_OUTPUT_LZ4
+} compress_output_type_t;
+
+/** Look up a compression type by its file name extension ("gz", "zst"
+ * or "lz4"), or "none".
+ *
+ * Returns -1 if there's no such type, or if it isn't supported in this
+ * build.
+ */
+extern int
+compress_output_type_from_name(const char *name);
+
+/** The file name extension for a compression type, or "none".
+ */
+extern const char *
+compress_output_type_name(compress_output_type_t type);
+
+/** Space-separated list of the names compress_output_type_from_name()
+ * accepts in this build.
+ */
+extern const char *
+compress_output_type_names(void);
+
+/** Open a stdio stream that compresses what's written to it and writes
+ * the result to "out".
+ *
+ * zstd is compressed by worker threads if libzstd supports them.
+ * Compressed data reaches "out" in blocks, so fflush() on the stream
+ * does not push out what has been written so far.  fclose() finishes
+ * the compressed data, closes "out" and returns EOF, with errno set,
+ * if that or any earlier write failed.
+ *
+ * Returns NULL and sets "*err" on failure; "out" is left open.
+ */
+extern FILE *
+compress_output_open(FILE *out, compress_output_type_t type, int *err);
+
+#endif /* __WRITECAP_COMPRESS_OUTPUT_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
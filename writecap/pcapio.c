@@ -35,6 +35,9 @@
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #ifdef _WIN32
 #include <Windows.h>
 #endif
@@ -781,6 +784,314 @@ pcapng_write_interface_statistics_block(FILE* pfile,
         return write_to_file(pfile, (const guint8*)&block_total_length, sizeof(guint32), bytes_written, err);
 }
 
+/* Batched writing */
+
+/*
+ * Hand a whole batch to the file with a single system call.
+ *
+ * Anything the stdio stream still has buffered (file header, SHB, IDBs,
+ * ISBs written with the routines above) has to reach the file first,
+ * so flush the stream before writing to its descriptor.
+ */
+static gboolean
+write_batch_to_file(FILE* pfile, const guint8* data, size_t data_length,
+                    int *err)
+{
+#ifdef _WIN32
+        guint64 ignored = 0;
+
+        /*
+         * A single fwrite() of a large contiguous buffer is passed
+         * straight through by the MSVC runtime.
+         */
+        return write_to_file(pfile, data, data_length, &ignored, err);
+#else
+        int fd;
+        ssize_t nwritten;
+
+        if (fflush(pfile) == EOF) {
+                *err = errno;
+                return FALSE;
+        }
+        fd = fileno(pfile);
+        if (fd == -1) {
+                guint64 ignored = 0;
+
+                /*
+                 * No file descriptor behind it, e.g. a stream from
+                 * aio_output_fdopen() or compress_output_open(), which
+                 * do their own buffering.
+                 */
+                return write_to_file(pfile, data, data_length, &ignored, err);
+        }
+        while (data_length != 0) {
+                nwritten = write(fd, data, data_length);
+                if (nwritten < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        *err = errno;
+                        return FALSE;
+                }
+                if (nwritten == 0) {
+                        /* short write */
+                        *err = 0;
+                        return FALSE;
+                }
+                data += nwritten;
+                data_length -= nwritten;
+        }
+        return TRUE;
+#endif
+}
+
+void
+pcapio_batch_init(pcapio_batch_t *batch, guint8 *buf, size_t buf_size,
+                  gint64 max_delay)
+{
+        batch->buf = buf;
+        batch->buf_size = buf_size;
+        batch->buf_used = 0;
+        batch->records = 0;
+        batch->first_queued = 0;
+        batch->max_delay = max_delay;
+}
+
+gboolean
+pcapio_batch_flush(FILE* pfile, pcapio_batch_t *batch, int *err)
+{
+        gboolean successful = TRUE;
+
+        if (batch->buf_used != 0) {
+                successful = write_batch_to_file(pfile, batch->buf, batch->buf_used, err);
+        }
+        batch->buf_used = 0;
+        batch->records = 0;
+        batch->first_queued = 0;
+        return successful;
+}
+
+gboolean
+pcapio_batch_flush_if_due(FILE* pfile, pcapio_batch_t *batch, int *err)
+{
+        if (batch->records == 0 || batch->max_delay == 0)
+                return TRUE;
+        if (g_get_monotonic_time() - batch->first_queued < batch->max_delay)
+                return TRUE;
+        return pcapio_batch_flush(pfile, batch, err);
+}
+
+/*
+ * Make sure there are "length" contiguous bytes free at the end of the
+ * batch, flushing what's already there if need be.  The caller must have
+ * checked that the record fits into an empty batch.
+ */
+static guint8 *
+pcapio_batch_reserve(FILE* pfile, pcapio_batch_t *batch, size_t length,
+                     int *err)
+{
+        if (batch->buf_size - batch->buf_used < length) {
+                if (!pcapio_batch_flush(pfile, batch, err))
+                        return NULL;
+        }
+        return batch->buf + batch->buf_used;
+}
+
+/* Account for a record just copied into the batch. */
+static gboolean
+pcapio_batch_commit(FILE* pfile, pcapio_batch_t *batch, size_t length,
+                    guint64 *bytes_written, int *err)
+{
+        if (batch->records == 0 && batch->max_delay != 0)
+                batch->first_queued = g_get_monotonic_time();
+        batch->buf_used += length;
+        batch->records++;
+        (*bytes_written) += length;
+
+        if (batch->buf_used == batch->buf_size)
+                return pcapio_batch_flush(pfile, batch, err);
+        return pcapio_batch_flush_if_due(pfile, batch, err);
+}
+
+static guint8 *
+pcapng_put_string_option(guint8 *p, guint16 option_type,
+                         const char *option_value)
+{
+        size_t option_value_length;
+        struct option option;
+
+        if (option_value == NULL)
+                return p; /* nothing to write */
+        option_value_length = strlen(option_value);
+        if ((option_value_length > 0) && (option_value_length < G_MAXUINT16)) {
+                option.type = option_type;
+                option.value_length = (guint16)option_value_length;
+                memcpy(p, &option, sizeof(struct option));
+                p += sizeof(struct option);
+                memcpy(p, option_value, option_value_length);
+                p += option_value_length;
+                if (option_value_length % 4) {
+                        memset(p, 0, 4 - option_value_length % 4);
+                        p += 4 - option_value_length % 4;
+                }
+        }
+        return p;
+}
+
+gboolean
+libpcap_batch_packet(FILE* pfile,
+                     pcapio_batch_t *batch,
+                     time_t sec, guint32 usec,
+                     guint32 caplen, guint32 len,
+                     const guint8 *pd,
+                     guint64 *bytes_written, int *err)
+{
+        struct pcaprec_hdr rec_hdr;
+        size_t record_length = sizeof(struct pcaprec_hdr) + caplen;
+        guint8 *p;
+
+        if (record_length > batch->buf_size) {
+                /* Doesn't fit even into an empty batch; write it as is. */
+                if (!pcapio_batch_flush(pfile, batch, err))
+                        return FALSE;
+                return libpcap_write_packet(pfile, sec, usec, caplen, len, pd,
+                                            bytes_written, err);
+        }
+
+        p = pcapio_batch_reserve(pfile, batch, record_length, err);
+        if (p == NULL)
+                return FALSE;
+
+        rec_hdr.ts_sec = (guint32)sec; /* Y2.038K issue in pcap format.... */
+        rec_hdr.ts_usec = usec;
+        rec_hdr.incl_len = caplen;
+        rec_hdr.orig_len = len;
+        memcpy(p, &rec_hdr, sizeof(struct pcaprec_hdr));
+        memcpy(p + sizeof(struct pcaprec_hdr), pd, caplen);
+
+        return pcapio_batch_commit(pfile, batch, record_length, bytes_written, err);
+}
+
+gboolean
+pcapng_batch_block(FILE* pfile,
+                   pcapio_batch_t *batch,
+                   const guint8 *data,
+                   guint32 length,
+                   guint64 *bytes_written,
+                   int *err)
+{
+        guint8 *p;
+
+        if (length > batch->buf_size) {
+                if (!pcapio_batch_flush(pfile, batch, err))
+                        return FALSE;
+                return pcapng_write_block(pfile, data, length, bytes_written, err);
+        }
+        /* Same sanity checks as pcapng_write_block() */
+        if (((length & 3) != 0) || (((gintptr)data & 3) != 0)) {
+                *err = EINVAL;
+                return FALSE;
+        }
+        if (*(const guint32 *) (data+sizeof(guint32)) != *(const guint32 *) (data+length-sizeof(guint32))) {
+                *err = EBADMSG;
+                return FALSE;
+        }
+
+        p = pcapio_batch_reserve(pfile, batch, length, err);
+        if (p == NULL)
+                return FALSE;
+        memcpy(p, data, length);
+
+        return pcapio_batch_commit(pfile, batch, length, bytes_written, err);
+}
+
+gboolean
+pcapng_batch_enhanced_packet_block(FILE* pfile,
+                                   pcapio_batch_t *batch,
+                                   const char *comment,
+                                   time_t sec, guint32 usec,
+                                   guint32 caplen, guint32 len,
+                                   guint32 interface_id,
+                                   guint ts_mul,
+                                   const guint8 *pd,
+                                   guint32 flags,
+                                   guint64 *bytes_written,
+                                   int *err)
+{
+        struct epb epb;
+        struct option option;
+        guint32 block_total_length;
+        guint64 timestamp;
+        guint32 options_length;
+        guint8 *p;
+
+        block_total_length = (guint32)(sizeof(struct epb) +
+                                       ADD_PADDING(caplen) +
+                                       sizeof(guint32));
+        options_length = 0;
+        options_length += pcapng_count_string_option(comment);
+        if (flags != 0) {
+                options_length += (guint32)(sizeof(struct option) +
+                                            sizeof(guint32));
+        }
+        /* If we have options add size of end-of-options */
+        if (options_length != 0) {
+                options_length += (guint32)sizeof(struct option);
+        }
+        block_total_length += options_length;
+
+        if (block_total_length > batch->buf_size) {
+                /* Doesn't fit even into an empty batch; write it as is. */
+                if (!pcapio_batch_flush(pfile, batch, err))
+                        return FALSE;
+                return pcapng_write_enhanced_packet_block(pfile, comment,
+                                                          sec, usec,
+                                                          caplen, len,
+                                                          interface_id,
+                                                          ts_mul, pd, flags,
+                                                          bytes_written, err);
+        }
+
+        p = pcapio_batch_reserve(pfile, batch, block_total_length, err);
+        if (p == NULL)
+                return FALSE;
+
+        timestamp = (guint64)sec * ts_mul + (guint64)usec;
+        epb.block_type = ENHANCED_PACKET_BLOCK_TYPE;
+        epb.block_total_length = block_total_length;
+        epb.interface_id = interface_id;
+        epb.timestamp_high = (guint32)((timestamp>>32) & 0xffffffff);
+        epb.timestamp_low = (guint32)(timestamp & 0xffffffff);
+        epb.captured_len = caplen;
+        epb.packet_len = len;
+        memcpy(p, &epb, sizeof(struct epb));
+        p += sizeof(struct epb);
+        memcpy(p, pd, caplen);
+        p += caplen;
+        if (caplen % 4) {
+                memset(p, 0, 4 - caplen % 4);
+                p += 4 - caplen % 4;
+        }
+        p = pcapng_put_string_option(p, OPT_COMMENT, comment);
+        if (flags != 0) {
+                option.type = EPB_FLAGS;
+                option.value_length = sizeof(guint32);
+                memcpy(p, &option, sizeof(struct option));
+                p += sizeof(struct option);
+                memcpy(p, &flags, sizeof(guint32));
+                p += sizeof(guint32);
+        }
+        if (options_length != 0) {
+                /* end of options */
+                option.type = OPT_ENDOFOPT;
+                option.value_length = 0;
+                memcpy(p, &option, sizeof(struct option));
+                p += sizeof(struct option);
+        }
+        memcpy(p, &block_total_length, sizeof(guint32));
+
+        return pcapio_batch_commit(pfile, batch, block_total_length, bytes_written, err);
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
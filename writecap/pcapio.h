@@ -99,6 +99,80 @@ pcapng_write_enhanced_packet_block(FILE* pfile,
                                    guint64 *bytes_written,
                                    int *err);
 
+/* Batched writing
+ *
+ * Records are assembled back to back in a buffer supplied by the caller
+ * and handed to the file with one write() per batch instead of several
+ * fwrite() calls per record.  "bytes_written" is updated as records are
+ * added to the batch, so file size limits keep working; write errors
+ * may therefore be reported for records added by earlier calls.
+ *
+ * The batch must be flushed with pcapio_batch_flush() before anything
+ * else is written to, or the caller closes, the file.
+ */
+typedef struct pcapio_batch {
+    guint8  *buf;           /**< Caller-owned buffer the records are built in */
+    size_t   buf_size;      /**< Size of buf */
+    size_t   buf_used;      /**< Bytes of buf holding queued records */
+    guint    records;       /**< Number of queued records */
+    gint64   first_queued;  /**< Monotonic time (usecs) the oldest queued record was added */
+    gint64   max_delay;     /**< Flush once the oldest record is this old (usecs), 0 for no limit */
+} pcapio_batch_t;
+
+/** Set up a batch using "buf" as its storage. Records are flushed when
+    the buffer is full or, if "max_delay" is non-zero, when the oldest
+    of them has been queued for "max_delay" microseconds. */
+extern void
+pcapio_batch_init(pcapio_batch_t *batch, guint8 *buf, size_t buf_size,
+                  gint64 max_delay);
+
+/** Write out all queued records.
+   Returns TRUE on success, FALSE on failure.
+   Sets "*err" to an error code, or 0 for a short write, on failure */
+extern gboolean
+pcapio_batch_flush(FILE* pfile, pcapio_batch_t *batch, int *err);
+
+/** Write out all queued records if the oldest of them is past the
+    batch's flush deadline. Returns TRUE on success, FALSE on failure. */
+extern gboolean
+pcapio_batch_flush_if_due(FILE* pfile, pcapio_batch_t *batch, int *err);
+
+/** Add a record for a packet to a batch, see libpcap_write_packet().
+   Returns TRUE on success, FALSE on failure. */
+extern gboolean
+libpcap_batch_packet(FILE* pfile,
+                     pcapio_batch_t *batch,
+                     time_t sec, guint32 usec,
+                     guint32 caplen, guint32 len,
+                     const guint8 *pd,
+                     guint64 *bytes_written, int *err);
+
+/** Add a pre-formatted pcapng block to a batch, see pcapng_write_block().
+   Returns TRUE on success, FALSE on failure. */
+extern gboolean
+pcapng_batch_block(FILE* pfile,
+                   pcapio_batch_t *batch,
+                   const guint8 *data,
+                   guint32 block_total_length,
+                   guint64 *bytes_written,
+                   int *err);
+
+/** Add an enhanced packet block (EPB) to a batch, see
+   pcapng_write_enhanced_packet_block().
+   Returns TRUE on success, FALSE on failure. */
+extern gboolean
+pcapng_batch_enhanced_packet_block(FILE* pfile,
+                                   pcapio_batch_t *batch,
+                                   const char *comment,
+                                   time_t sec, guint32 usec,
+                                   guint32 caplen, guint32 len,
+                                   guint32 interface_id,
+                                   guint ts_mul,
+                                   const guint8 *pd,
+                                   guint32 flags,
+                                   guint64 *bytes_written,
+                                   int *err);
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -37,6 +37,8 @@ ws_buffer_init(Buffer* buffer, gsize space)
 	}
 	buffer->start = 0;
 	buffer->first_free = 0;
+	buffer->owned_data = NULL;
+	buffer->owned_allocated = 0;
 }
 
 /* Frees the memory used by a buffer */
@@ -44,6 +46,11 @@ void
 ws_buffer_free(Buffer* buffer)
 {
 	g_assert(buffer);
+	if (buffer->owned_data) {
+		buffer->data = buffer->owned_data;
+		buffer->allocated = buffer->owned_allocated;
+		buffer->owned_data = NULL;
+	}
 	if (buffer->allocated == SMALL_BUFFER_SIZE) {
 		g_assert(buffer->data);
 		g_ptr_array_add(small_buffers, buffer->data);
@@ -66,6 +73,12 @@ ws_buffer_assure_space(Buffer* buffer, gsize space)
 	gsize space_used;
 	gboolean space_at_beginning;
 
+	/* Borrowed space can't be grown; copy it into our own first */
+	if (buffer->owned_data) {
+		ws_buffer_unborrow(buffer);
+		available_at_end = buffer->allocated - buffer->first_free;
+	}
+
 	/* If we've got the space already, good! */
 	if (space <= available_at_end) {
 		return;
@@ -124,6 +137,40 @@ ws_buffer_remove_start(Buffer* buffer, gsize bytes)
 	}
 }
 
+/* Points the buffer at space it doesn't own; see buffer.h */
+void
+ws_buffer_borrow(Buffer* buffer, const guint8 *data, gsize len)
+{
+	g_assert(buffer);
+	if (!buffer->owned_data) {
+		g_assert(buffer->data);
+		buffer->owned_data = buffer->data;
+		buffer->owned_allocated = buffer->allocated;
+	}
+	/* Never written through while borrowed; see ws_buffer_unborrow() */
+	buffer->data = (guint8*)data;
+	buffer->allocated = len;
+	buffer->start = 0;
+	buffer->first_free = 0;
+}
+
+/* Copies borrowed space into the buffer's own */
+void
+ws_buffer_unborrow(Buffer* buffer)
+{
+	g_assert(buffer);
+	if (!buffer->owned_data)
+		return;
+	if (buffer->owned_allocated < buffer->allocated) {
+		buffer->owned_allocated = buffer->allocated + 1024;
+		buffer->owned_data = (guint8*)g_realloc(buffer->owned_data, buffer->owned_allocated);
+	}
+	memcpy(buffer->owned_data, buffer->data, buffer->allocated);
+	buffer->data = buffer->owned_data;
+	buffer->allocated = buffer->owned_allocated;
+	buffer->owned_data = NULL;
+	buffer->owned_allocated = 0;
+}
 
 #ifndef SOME_FUNCTIONS_ARE_DEFINES
 void
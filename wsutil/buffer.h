@@ -23,6 +23,12 @@ typedef struct Buffer {
 	gsize	allocated;
 	gsize	start;
 	gsize	first_free;
+	/*
+	 * Added in 3.3.2; this changed the size of the structure, so code
+	 * that embeds a Buffer must be rebuilt against this header.
+	 */
+	guint8	*owned_data;		/* our own allocation, while data is borrowed */
+	gsize	owned_allocated;
 } Buffer;
 
 WS_DLL_PUBLIC
@@ -38,6 +44,22 @@ void ws_buffer_remove_start(Buffer* buffer, gsize bytes);
 WS_DLL_PUBLIC
 void ws_buffer_cleanup(void);
 
+/*
+ * Use the "len" bytes at "data" as the buffer's space, without copying
+ * them, as if they had been read there after ws_buffer_assure_space();
+ * the buffer's length is left at zero.  The caller must keep the bytes
+ * valid, and unchanged, until the buffer is refilled or freed.
+ *
+ * They mustn't be modified through the buffer; ws_buffer_unborrow()
+ * copies them into the buffer's own space first, and anything that
+ * needs more space, such as ws_buffer_assure_space(), does that itself.
+ */
+WS_DLL_PUBLIC
+void ws_buffer_borrow(Buffer* buffer, const guint8 *data, gsize len);
+WS_DLL_PUBLIC
+void ws_buffer_unborrow(Buffer* buffer);
+#define ws_buffer_is_borrowed(buffer) ((buffer)->owned_data != NULL)
+
 #ifdef SOME_FUNCTIONS_ARE_DEFINES
 # define ws_buffer_clean(buffer) ws_buffer_remove_start((buffer), ws_buffer_length(buffer))
 # define ws_buffer_increase_length(buffer,bytes) (buffer)->first_free += (bytes)
@@ -14,6 +14,8 @@
 #include "json_dumper.h"
 
 #include <math.h>
+#include <string.h>
+#include <stdlib.h>
 
 /*
  * json_dumper.state[current_depth] describes a nested element:
@@ -76,6 +78,279 @@ json_puts_string(FILE *fp, const char *str, gboolean dot_to_underscore)
     fputc('"', fp);
 }
 
+/*
+ * CBOR major types, and the initial bytes used for the indefinite-length
+ * items and simple values.
+ */
+#define CBOR_UNSIGNED           0
+#define CBOR_NEGATIVE           1
+#define CBOR_BYTES              2
+#define CBOR_TEXT               3
+#define CBOR_ARRAY              4
+#define CBOR_MAP                5
+#define CBOR_INDEFINITE         31
+#define CBOR_FALSE              0xf4
+#define CBOR_TRUE               0xf5
+#define CBOR_NULL               0xf6
+#define CBOR_DOUBLE             0xfb
+#define CBOR_BREAK              0xff
+
+/*
+ * Encodes the initial byte of a data item and its argument in buf.
+ * Returns the number of bytes used.
+ */
+static size_t
+cbor_encode_head(guint8 buf[9], guint major, guint64 value)
+{
+    size_t len;
+
+    if (value < 24) {
+        buf[0] = (guint8)(major << 5 | value);
+        len = 1;
+    } else if (value <= G_MAXUINT8) {
+        buf[0] = (guint8)(major << 5 | 24);
+        len = 2;
+    } else if (value <= G_MAXUINT16) {
+        buf[0] = (guint8)(major << 5 | 25);
+        len = 3;
+    } else if (value <= G_MAXUINT32) {
+        buf[0] = (guint8)(major << 5 | 26);
+        len = 5;
+    } else {
+        buf[0] = (guint8)(major << 5 | 27);
+        len = 9;
+    }
+    /* big-endian argument after the initial byte */
+    for (size_t i = len - 1; i > 0; i--) {
+        buf[i] = (guint8)value;
+        value >>= 8;
+    }
+    return len;
+}
+
+static void
+cbor_put_head(FILE *fp, guint major, guint64 value)
+{
+    guint8 buf[9];
+
+    fwrite(buf, 1, cbor_encode_head(buf, major, value), fp);
+}
+
+static void
+cbor_append_head(GByteArray *out, guint major, guint64 value)
+{
+    guint8 buf[9];
+
+    g_byte_array_append(out, buf, (guint)cbor_encode_head(buf, major, value));
+}
+
+static void
+cbor_put_string(FILE *fp, const char *str, gboolean dot_to_underscore)
+{
+    if (!str) {
+        fputc(CBOR_NULL, fp);
+        return;
+    }
+
+    size_t len = strlen(str);
+    cbor_put_head(fp, CBOR_TEXT, len);
+    if (!dot_to_underscore) {
+        fwrite(str, 1, len, fp);
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        fputc(str[i] == '.' ? '_' : str[i], fp);
+    }
+}
+
+/*
+ * Encodes a double in buf, or null if it's not finite, like the JSON
+ * output.  Returns the number of bytes used.
+ */
+static size_t
+cbor_encode_double(guint8 buf[9], double value)
+{
+    guint64 bits;
+
+    if (!isfinite(value)) {
+        buf[0] = CBOR_NULL;
+        return 1;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    buf[0] = CBOR_DOUBLE;
+    for (int i = 8; i > 0; i--) {
+        buf[i] = (guint8)bits;
+        bits >>= 8;
+    }
+    return 9;
+}
+
+static void
+cbor_put_double(FILE *fp, double value)
+{
+    guint8 buf[9];
+
+    fwrite(buf, 1, cbor_encode_double(buf, value), fp);
+}
+
+static const char *
+cbor_skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Converts a JSON quoted string to CBOR.  Returns the end of the string,
+ * or NULL if it's not valid.
+ */
+static const char *
+cbor_put_json_string(GByteArray *out, const char *p)
+{
+    GString *str = g_string_new(NULL);
+
+    for (p++; *p != '"'; p++) {
+        if (*p == '\0') {
+            g_string_free(str, TRUE);
+            return NULL;
+        }
+        if (*p != '\\') {
+            g_string_append_c(str, *p);
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'b': g_string_append_c(str, '\b'); break;
+            case 'f': g_string_append_c(str, '\f'); break;
+            case 'n': g_string_append_c(str, '\n'); break;
+            case 'r': g_string_append_c(str, '\r'); break;
+            case 't': g_string_append_c(str, '\t'); break;
+            case 'u': {
+                gchar hex[5];
+                gunichar c;
+
+                if (strlen(p + 1) < 4) {
+                    g_string_free(str, TRUE);
+                    return NULL;
+                }
+                memcpy(hex, p + 1, 4);
+                hex[4] = '\0';
+                c = (gunichar)strtoul(hex, NULL, 16);
+                /* surrogate pairs are not produced by our callers */
+                g_string_append_unichar(str, c);
+                p += 4;
+                break;
+            }
+            case '\0':
+                g_string_free(str, TRUE);
+                return NULL;
+            default:
+                g_string_append_c(str, *p);
+                break;
+        }
+    }
+    cbor_append_head(out, CBOR_TEXT, str->len);
+    g_byte_array_append(out, (const guint8 *)str->str, (guint)str->len);
+    g_string_free(str, TRUE);
+    return p + 1;
+}
+
+/*
+ * Converts the JSON value at p to CBOR.  Returns the end of the value, or
+ * NULL if it's not valid, in which case out has part of it.
+ */
+static const char *
+cbor_put_json_value(GByteArray *out, const char *p, int depth)
+{
+    guint8 byte;
+    guint8 buf[9];
+
+    p = cbor_skip_space(p);
+
+    if (depth >= JSON_DUMPER_MAX_DEPTH) {
+        return NULL;
+    }
+
+    if (*p == '[' || *p == '{') {
+        gboolean is_object = (*p == '{');
+        char close_char = is_object ? '}' : ']';
+
+        byte = (is_object ? CBOR_MAP : CBOR_ARRAY) << 5 | CBOR_INDEFINITE;
+        g_byte_array_append(out, &byte, 1);
+        p = cbor_skip_space(p + 1);
+        while (*p != close_char) {
+            if (is_object) {
+                if (*p != '"' || !(p = cbor_put_json_string(out, p))) {
+                    return NULL;
+                }
+                p = cbor_skip_space(p);
+                if (*p++ != ':') {
+                    return NULL;
+                }
+            }
+            if (!(p = cbor_put_json_value(out, p, depth + 1))) {
+                return NULL;
+            }
+            p = cbor_skip_space(p);
+            if (*p == ',') {
+                p = cbor_skip_space(p + 1);
+            } else if (*p != close_char) {
+                return NULL;
+            }
+        }
+        byte = CBOR_BREAK;
+        g_byte_array_append(out, &byte, 1);
+        return p + 1;
+    }
+
+    if (*p == '"') {
+        return cbor_put_json_string(out, p);
+    }
+    if (!strncmp(p, "true", 4)) {
+        byte = CBOR_TRUE;
+        g_byte_array_append(out, &byte, 1);
+        return p + 4;
+    }
+    if (!strncmp(p, "false", 5)) {
+        byte = CBOR_FALSE;
+        g_byte_array_append(out, &byte, 1);
+        return p + 5;
+    }
+    if (!strncmp(p, "null", 4)) {
+        byte = CBOR_NULL;
+        g_byte_array_append(out, &byte, 1);
+        return p + 4;
+    }
+
+    /* a number: integers stay integers, everything else is a double */
+    size_t len = strspn(p, "+-0123456789.eE");
+    if (len == 0) {
+        return NULL;
+    }
+    if (strcspn(p, ".eE") >= len) {
+        char *end;
+
+        if (*p == '-') {
+            gint64 value = g_ascii_strtoll(p, &end, 10);
+            cbor_append_head(out, CBOR_NEGATIVE, (guint64)(-(value + 1)));
+        } else {
+            guint64 value = g_ascii_strtoull(p, &end, 10);
+            cbor_append_head(out, CBOR_UNSIGNED, value);
+        }
+        /* e.g. "-nan" */
+        return end != p ? end : NULL;
+    }
+    char *end;
+    double value = g_ascii_strtod(p, &end);
+    if (end == p) {
+        return NULL;
+    }
+    g_byte_array_append(out, buf, (guint)cbor_encode_double(buf, value));
+    return end;
+}
+
 /**
  * Called when a programming error is encountered where the JSON manipulation
  * state got corrupted. This could happen when pairing the wrong begin/end
@@ -184,6 +459,13 @@ print_newline_indent(const json_dumper *dumper, int depth)
 static void
 prepare_token(json_dumper *dumper)
 {
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        // CBOR has no separators, just reset the key state.
+        if (dumper->current_depth > 0) {
+            dumper->state[dumper->current_depth - 1] &= ~JSON_DUMPER_HAS_NAME;
+        }
+        return;
+    }
     if (dumper->current_depth == 0) {
         // not part of an array or object.
         return;
@@ -220,6 +502,11 @@ prepare_token(json_dumper *dumper)
 static void
 finish_token(const json_dumper *dumper, char close_char)
 {
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc(CBOR_BREAK, dumper->output_file);
+        return;
+    }
+
     // if the object/array was non-empty, add a newline and indentation.
     if (dumper->state[dumper->current_depth]) {
         print_newline_indent(dumper, dumper->current_depth - 1);
@@ -235,7 +522,11 @@ json_dumper_begin_object(json_dumper *dumper)
     }
 
     prepare_token(dumper);
-    fputc('{', dumper->output_file);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc(CBOR_MAP << 5 | CBOR_INDEFINITE, dumper->output_file);
+    } else {
+        fputc('{', dumper->output_file);
+    }
 
     dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_OBJECT;
     ++dumper->current_depth;
@@ -250,10 +541,14 @@ json_dumper_set_member_name(json_dumper *dumper, const char *name)
     }
 
     prepare_token(dumper);
-    json_puts_string(dumper->output_file, name, dumper->flags & JSON_DUMPER_DOT_TO_UNDERSCORE);
-    fputc(':', dumper->output_file);
-    if ((dumper->flags & JSON_DUMPER_FLAGS_PRETTY_PRINT)) {
-        fputc(' ', dumper->output_file);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        cbor_put_string(dumper->output_file, name, dumper->flags & JSON_DUMPER_DOT_TO_UNDERSCORE);
+    } else {
+        json_puts_string(dumper->output_file, name, dumper->flags & JSON_DUMPER_DOT_TO_UNDERSCORE);
+        fputc(':', dumper->output_file);
+        if ((dumper->flags & JSON_DUMPER_FLAGS_PRETTY_PRINT)) {
+            fputc(' ', dumper->output_file);
+        }
     }
 
     dumper->state[dumper->current_depth - 1] |= JSON_DUMPER_HAS_NAME;
@@ -279,7 +574,11 @@ json_dumper_begin_array(json_dumper *dumper)
     }
 
     prepare_token(dumper);
-    fputc('[', dumper->output_file);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc(CBOR_ARRAY << 5 | CBOR_INDEFINITE, dumper->output_file);
+    } else {
+        fputc('[', dumper->output_file);
+    }
 
     dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_ARRAY;
     ++dumper->current_depth;
@@ -306,7 +605,11 @@ json_dumper_value_string(json_dumper *dumper, const char *value)
     }
 
     prepare_token(dumper);
-    json_puts_string(dumper->output_file, value, FALSE);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        cbor_put_string(dumper->output_file, value, FALSE);
+    } else {
+        json_puts_string(dumper->output_file, value, FALSE);
+    }
 
     dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_VALUE;
 }
@@ -319,6 +622,11 @@ json_dumper_value_double(json_dumper *dumper, double value)
     }
 
     prepare_token(dumper);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        cbor_put_double(dumper->output_file, value);
+        dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_VALUE;
+        return;
+    }
     gchar buffer[G_ASCII_DTOSTR_BUF_SIZE] = { 0 };
     if (isfinite(value) && g_ascii_dtostr(buffer, G_ASCII_DTOSTR_BUF_SIZE, value) && buffer[0]) {
         fputs(buffer, dumper->output_file);
@@ -337,7 +645,26 @@ json_dumper_value_va_list(json_dumper *dumper, const char *format, va_list ap)
     }
 
     prepare_token(dumper);
-    vfprintf(dumper->output_file, format, ap);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        gchar *text = g_strdup_vprintf(format, ap);
+        GByteArray *cbor = g_byte_array_new();
+        const char *end = cbor_put_json_value(cbor, text, dumper->current_depth);
+
+        /*
+         * Converted aside, so that a value that can't be converted, such
+         * as "%f" of an infinite or NaN value, is written as null, like
+         * json_dumper_value_double() does, instead of in part.
+         */
+        if (end && *cbor_skip_space(end) == '\0') {
+            fwrite(cbor->data, 1, cbor->len, dumper->output_file);
+        } else {
+            fputc(CBOR_NULL, dumper->output_file);
+        }
+        g_byte_array_free(cbor, TRUE);
+        g_free(text);
+    } else {
+        vfprintf(dumper->output_file, format, ap);
+    }
 
     dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_VALUE;
 }
@@ -359,7 +686,9 @@ json_dumper_finish(json_dumper *dumper)
         return FALSE;
     }
 
-    fputc('\n', dumper->output_file);
+    if (!(dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc('\n', dumper->output_file);
+    }
     dumper->state[0] = 0;
     return TRUE;
 }
@@ -376,7 +705,11 @@ json_dumper_begin_base64(json_dumper *dumper)
 
     prepare_token(dumper);
 
-    fputc('"', dumper->output_file);
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc(CBOR_BYTES << 5 | CBOR_INDEFINITE, dumper->output_file);
+    } else {
+        fputc('"', dumper->output_file);
+    }
 
     dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_BASE64;
     ++dumper->current_depth;
@@ -390,6 +723,16 @@ json_dumper_write_base64(json_dumper* dumper, const guchar *data, size_t len)
         return;
     }
 
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        /* one definite-length chunk of the indefinite-length byte string */
+        if (len > 0) {
+            cbor_put_head(dumper->output_file, CBOR_BYTES, len);
+            fwrite(data, 1, len, dumper->output_file);
+        }
+        dumper->state[dumper->current_depth] = JSON_DUMPER_TYPE_BASE64;
+        return;
+    }
+
     #define CHUNK_SIZE 1024
     gchar buf[(CHUNK_SIZE / 3 + 1) * 4 + 4];
 
@@ -411,6 +754,12 @@ json_dumper_end_base64(json_dumper *dumper)
         return;
     }
 
+    if ((dumper->flags & JSON_DUMPER_FLAGS_CBOR)) {
+        fputc(CBOR_BREAK, dumper->output_file);
+        --dumper->current_depth;
+        return;
+    }
+
     gchar buf[4];
     gsize wrote;
 
@@ -48,12 +48,20 @@ extern "C" {
  *  json_dumper_finish(&dumper);
  */
 
+/**
+ * With JSON_DUMPER_FLAGS_CBOR the same calls write CBOR instead of JSON.
+ * Objects and arrays are written with indefinite lengths, so they can be
+ * streamed; base64 data is written as a byte string without the base64
+ * encoding, and json_dumper_finish() doesn't write a newline.
+ */
+
 /** Maximum object/array nesting depth. */
 #define JSON_DUMPER_MAX_DEPTH   1100
 typedef struct json_dumper {
     FILE   *output_file;    /**< Output file, must be set. */
 #define JSON_DUMPER_FLAGS_PRETTY_PRINT  (1 << 0)    /* Enable pretty printing. */
 #define JSON_DUMPER_DOT_TO_UNDERSCORE   (1 << 1)    /* Convert dots to underscores in keys */
+#define JSON_DUMPER_FLAGS_CBOR          (1 << 2)    /* Write CBOR (RFC 7049) instead of JSON text */
     int     flags;
     /* for internal use, initialize with zeroes. */
     int     current_depth;
@@ -85,6 +93,9 @@ json_dumper_value_double(json_dumper *dumper, double value);
 
 /**
  * Dump number, "true", "false" or "null" values.
+ *
+ * In CBOR mode, the formatted text is converted from JSON, so it may also
+ * be an array, an object or a quoted string.
  */
 WS_DLL_PUBLIC void
 json_dumper_value_anyf(json_dumper *dumper, const char *format, ...)
@@ -0,0 +1,139 @@
+/* xxhash64.c
+ * XXH64 hash function
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "xxhash64.h"
+
+/*
+ * An implementation of the XXH64 algorithm as specified in
+ *
+ *	https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ *
+ * It gives the same results as the reference implementation on all
+ * platforms.
+ */
+
+#define XXH_PRIME64_1	G_GUINT64_CONSTANT(0x9E3779B185EBCA87)
+#define XXH_PRIME64_2	G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3	G_GUINT64_CONSTANT(0x165667B19E3779F9)
+#define XXH_PRIME64_4	G_GUINT64_CONSTANT(0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5	G_GUINT64_CONSTANT(0x27D4EB2F165667C5)
+
+#define XXH_ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline guint64
+xxh_read64(const guint8 *p)
+{
+	guint64 v;
+
+	memcpy(&v, p, sizeof v);
+	return GUINT64_FROM_LE(v);
+}
+
+static inline guint32
+xxh_read32(const guint8 *p)
+{
+	guint32 v;
+
+	memcpy(&v, p, sizeof v);
+	return GUINT32_FROM_LE(v);
+}
+
+static inline guint64
+xxh64_round(guint64 acc, guint64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = XXH_ROTL64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline guint64
+xxh64_merge_round(guint64 acc, guint64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+guint64
+xxhash64(const guint8 *buf, size_t len, guint64 seed)
+{
+	const guint8 *p = buf;
+	const guint8 *end = buf + len;
+	guint64 h;
+
+	if (len >= 32) {
+		const guint8 *limit = end - 32;
+		guint64 v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		guint64 v2 = seed + XXH_PRIME64_2;
+		guint64 v3 = seed;
+		guint64 v4 = seed - XXH_PRIME64_1;
+
+		do {
+			v1 = xxh64_round(v1, xxh_read64(p));
+			v2 = xxh64_round(v2, xxh_read64(p + 8));
+			v3 = xxh64_round(v3, xxh_read64(p + 16));
+			v4 = xxh64_round(v4, xxh_read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = XXH_ROTL64(v1, 1) + XXH_ROTL64(v2, 7) +
+		    XXH_ROTL64(v3, 12) + XXH_ROTL64(v4, 18);
+		h = xxh64_merge_round(h, v1);
+		h = xxh64_merge_round(h, v2);
+		h = xxh64_merge_round(h, v3);
+		h = xxh64_merge_round(h, v4);
+	} else {
+		h = seed + XXH_PRIME64_5;
+	}
+
+	h += (guint64)len;
+
+	while (p + 8 <= end) {
+		h ^= xxh64_round(0, xxh_read64(p));
+		h = XXH_ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (guint64)xxh_read32(p) * XXH_PRIME64_1;
+		h = XXH_ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h = XXH_ROTL64(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	/* Avalanche */
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
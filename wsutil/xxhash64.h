@@ -0,0 +1,53 @@
+/* xxhash64.h
+ * Declaration of the XXH64 hash function
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __XXHASH64_H__
+#define __XXHASH64_H__
+
+#include <glib.h>
+
+#include "ws_symbol_export.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Compute Yann Collet's XXH64 hash of a buffer.
+ *
+ * This is a fast, well-distributed, non-cryptographic hash; use it to
+ * index or compare data, never where an attacker could choose the data
+ * to cause collisions.
+ *
+ * @param buf The data to hash.
+ * @param len The length of the data.
+ * @param seed Value that selects one of a family of hash functions.
+ * @return The hash.
+ */
+WS_DLL_PUBLIC guint64 xxhash64(const guint8 *buf, size_t len, guint64 seed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __XXHASH64_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */